@@ -0,0 +1,188 @@
+/*
+ * LotManagement bay map, see bay_map.h
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <system_error>
+#include "bay_map.h"
+
+#define REGION   8                           // cells per region side
+#define REGION_CELLS (REGION * REGION)       //   one bitmap word
+
+enum : uint32_t { FOUND_LEVEL, FOUND_REGION, FOUND_CELL, FOUND_BAY };
+
+//---------
+// This function lays the grid over the bays and numbers them by cell. The
+// grid spans the bays of all levels, so a cell is the same place on every
+// level.
+//----------
+bay_map::bay_map(const std::vector<bay_position> &bays, const bay_map_config &cfg) : cfg_(cfg) {
+//----------
+  float x1, y1;
+  uint32_t levels = 0;
+  std::vector<uint32_t> cell(bays.size());
+
+  if (bays.empty() || bays.size() >= 1u << 30 || !(cfg_.cell_m > 0) || !(cfg_.level_m >= 0)) {
+    throw std::system_error(EINVAL, std::generic_category(), "bay_map");
+  }
+  x0_ = x1 = bays[0].x;
+  y0_ = y1 = bays[0].y;
+  for (const bay_position &b : bays) {
+    x0_ = std::min(x0_, b.x);
+    y0_ = std::min(y0_, b.y);
+    x1 = std::max(x1, b.x);
+    y1 = std::max(y1, b.y);
+    levels = std::max(levels, b.level + 1u);
+  }
+  cells_x_ = (uint32_t)((x1 - x0_) / cfg_.cell_m) + 1;
+  cells_y_ = (uint32_t)((y1 - y0_) / cfg_.cell_m) + 1;
+  regions_x_ = (cells_x_ + REGION - 1) / REGION;
+  regions_y_ = (cells_y_ + REGION - 1) / REGION;
+  levels_ = levels;
+  regions_ = levels * regions_x_ * regions_y_;
+
+  cell_start_.assign((size_t)regions_ * REGION_CELLS + 1, 0);
+  for (size_t i = 0; i < bays.size(); i++) {
+    uint32_t cx = std::min((uint32_t)((bays[i].x - x0_) / cfg_.cell_m), cells_x_ - 1);
+    uint32_t cy = std::min((uint32_t)((bays[i].y - y0_) / cfg_.cell_m), cells_y_ - 1);
+    uint32_t region = (bays[i].level * regions_y_ + cy / REGION) * regions_x_ + cx / REGION;
+
+    cell[i] = region * REGION_CELLS + cy % REGION * REGION + cx % REGION;
+    cell_start_[cell[i] + 1]++;
+  }
+  for (size_t c = 1; c < cell_start_.size(); c++) {
+    cell_start_[c] += cell_start_[c - 1];
+  }
+  std::vector<uint32_t> next(cell_start_.begin(), cell_start_.end() - 1);
+
+  order_.resize(bays.size());
+  index_.resize(bays.size());
+  pos_.resize(bays.size());
+  cell_.resize(bays.size());
+  for (size_t i = 0; i < bays.size(); i++) {
+    uint32_t n = next[cell[i]]++;
+
+    order_[n] = (uint32_t)i;
+    index_[i] = n;
+    pos_[n] = bays[i];
+    cell_[n] = cell[i];
+  }
+  free_.assign((bays.size() + 63) / 64, 0);
+  cell_free_.assign((size_t)regions_ * REGION_CELLS, 0);
+  region_cells_.assign(regions_, 0);
+  region_free_.assign(regions_, 0);
+  level_free_.assign(levels_, 0);
+}
+
+void bay_map::set_free(uint32_t bay, bool free) {
+  uint32_t n = index_[bay];
+  uint64_t bit = 1ull << n % 64;
+  uint32_t c, region;
+
+  if (!(free_[n / 64] & bit) == !free) {
+    return;
+  }
+  c = cell_[n];
+  region = c / REGION_CELLS;
+  if (free) {
+    free_[n / 64] |= bit;
+    free_count_++;
+    level_free_[pos_[n].level]++;
+    region_free_[region]++;
+    if (!cell_free_[c]++) {
+      region_cells_[region] |= 1ull << c % REGION_CELLS;
+    }
+  } else {
+    free_[n / 64] &= ~bit;
+    free_count_--;
+    level_free_[pos_[n].level]--;
+    region_free_[region]--;
+    if (!--cell_free_[c]) {
+      region_cells_[region] &= ~(1ull << c % REGION_CELLS);
+    }
+  }
+}
+
+float bay_map::distance(const bay_position &a, const bay_position &b) const {
+  return std::hypot(a.x - b.x, a.y - b.y) + cfg_.level_m * std::abs((int)a.level - (int)b.level);
+}
+
+//---------
+// This function returns how far from is at least from the rectangle
+// x0, y0 .. x1, y1 on level.
+//----------
+float bay_map::bound(const bay_position &from, uint32_t level, float x0, float y0, float x1, float y1) const {
+//----------
+  float dx = std::max({x0 - from.x, 0.0f, from.x - x1});
+  float dy = std::max({y0 - from.y, 0.0f, from.y - y1});
+
+  return std::sqrt(dx * dx + dy * dy) + cfg_.level_m * std::abs((int)level - (int)from.level);
+}
+
+//---------
+// This function searches best first: the heap holds the levels and regions
+// with free bays and the cells with free bays by the distance of their
+// rectangle, and free bays by their own. A bay on top is nearer than
+// anything not yet opened.
+//----------
+uint32_t bay_map::nearest_free(const bay_position &from, uint32_t k, uint32_t *bays, float *distance_m) {
+//----------
+  float region_m = cfg_.cell_m * REGION;
+  uint32_t per_level = regions_x_ * regions_y_;
+  uint32_t found = 0;
+
+  heap_.clear();
+  for (uint32_t l = 0; l < levels_ && k; l++) {
+    if (level_free_[l]) {
+      heap_.push_back({bound(from, l, x0_, y0_, x0_ + cells_x_ * cfg_.cell_m, y0_ + cells_y_ * cfg_.cell_m),
+                       FOUND_LEVEL << 30 | l});
+    }
+  }
+  std::make_heap(heap_.begin(), heap_.end());
+  while (found < k && !heap_.empty()) {
+    entry e = heap_.front();
+    uint32_t n = e.what & ((1u << 30) - 1);
+
+    std::pop_heap(heap_.begin(), heap_.end());
+    heap_.pop_back();
+    switch (e.what >> 30) {
+    case FOUND_LEVEL:
+      for (uint32_t r = n * per_level; r < (n + 1) * per_level; r++) {
+        if (region_free_[r]) {
+          float x = x0_ + r % regions_x_ * region_m, y = y0_ + r / regions_x_ % regions_y_ * region_m;
+
+          heap_.push_back({bound(from, n, x, y, x + region_m, y + region_m), FOUND_REGION << 30 | r});
+          std::push_heap(heap_.begin(), heap_.end());
+        }
+      }
+      break;
+    case FOUND_REGION:
+      for (uint64_t cells = region_cells_[n]; cells; cells &= cells - 1) {
+        uint32_t c = __builtin_ctzll(cells);
+        float x = x0_ + (n % regions_x_ * REGION + c % REGION) * cfg_.cell_m;
+        float y = y0_ + (n / regions_x_ % regions_y_ * REGION + c / REGION) * cfg_.cell_m;
+
+        heap_.push_back({bound(from, n / per_level, x, y, x + cfg_.cell_m, y + cfg_.cell_m),
+                         FOUND_CELL << 30 | (n * REGION_CELLS + c)});
+        std::push_heap(heap_.begin(), heap_.end());
+      }
+      break;
+    case FOUND_CELL:
+      for (uint32_t b = cell_start_[n]; b < cell_start_[n + 1]; b++) {
+        if (free_[b / 64] >> b % 64 & 1) {
+          heap_.push_back({distance(from, pos_[b]), FOUND_BAY << 30 | b});
+          std::push_heap(heap_.begin(), heap_.end());
+        }
+      }
+      break;
+    default:
+      if (distance_m) {
+        distance_m[found] = e.d;
+      }
+      bays[found++] = order_[n];
+    }
+  }
+  return found;
+}
@@ -0,0 +1,82 @@
+/*
+ * LotManagement bay map
+ *
+ * Where the bays of a site are and which of them are free, for the question
+ * drivers ask most: which free bays are nearest to where I am. Bays have a
+ * position in metres on a level; the distance between two points is the
+ * straight one on a level plus level_m per level between them, the ramps.
+ *
+ * Every level is cut into a grid of square cells of cell_m, the cells into
+ * regions of 8 x 8. The bays are numbered internally by level, region and
+ * cell, so the bays of a cell are a range of one free bitmap; a cell counts
+ * its free bays and a region keeps a bitmap of its 64 cells with any free
+ * bay. A search is best first over levels, regions, cells and bays by the
+ * distance they are at least away: a level, region or cell without a free
+ * bay is never looked at, nor one farther than the bays found. Setting
+ * a bay free or taken updates a bit and two counts.
+ *
+ * One thread at a time, the search keeps its heap between calls.
+ */
+
+#ifndef BAY_MAP_H_
+#define BAY_MAP_H_
+
+#include <cstdint>
+#include <vector>
+
+struct bay_position {
+  float    x, y;                             // metres
+  uint16_t level;
+};
+
+struct bay_map_config {
+  float cell_m  = 8;                         // grid cell size
+  float level_m = 40;                        // distance of one level up or down
+};
+
+class bay_map {
+public:
+  // Maps bays, numbered as given. All bays start out taken.
+  explicit bay_map(const std::vector<bay_position> &bays, const bay_map_config &cfg = {});
+
+  uint32_t size() const { return (uint32_t)order_.size(); }
+  uint32_t free() const { return free_count_; }
+  bool is_free(uint32_t bay) const { return free_[index_[bay] / 64] >> index_[bay] % 64 & 1; }
+  void set_free(uint32_t bay, bool free);
+
+  // Finds up to k free bays nearest to from, nearest first, with their
+  // distance if distance_m. Returns their number.
+  uint32_t nearest_free(const bay_position &from, uint32_t k, uint32_t *bays, float *distance_m = nullptr);
+
+  float distance(const bay_position &a, const bay_position &b) const;
+
+private:
+  struct entry {
+    float    d;                              // at least this far
+    uint32_t what;                           // see nearest_free()
+    bool operator<(const entry &o) const { return d > o.d; } // nearest on top
+  };
+
+  float bound(const bay_position &from, uint32_t level, float x0, float y0, float x1, float y1) const;
+
+  bay_map_config cfg_;
+  float x0_, y0_;                            // corner of the grid
+  uint32_t cells_x_, cells_y_;               //   cells per level
+  uint32_t regions_x_, regions_y_;           //   regions per level
+  uint32_t levels_;
+  uint32_t regions_;                         // of all levels
+  std::vector<bay_position> pos_;            // by internal number
+  std::vector<uint32_t> cell_;               //   cell
+  std::vector<uint32_t> order_;              //   bay
+  std::vector<uint32_t> index_;              // by bay, internal number
+  std::vector<uint32_t> cell_start_;         // by cell, first internal number
+  std::vector<uint64_t> free_;               // by internal number
+  std::vector<uint32_t> cell_free_;          // by cell, free bays
+  std::vector<uint64_t> region_cells_;       // by region, cells with free bays
+  std::vector<uint32_t> region_free_;        //   free bays
+  std::vector<uint32_t> level_free_;         // by level, free bays
+  uint32_t free_count_ = 0;
+  std::vector<entry> heap_;
+};
+
+#endif /* BAY_MAP_H_ */
@@ -0,0 +1,116 @@
+/*
+ * LotManagement manager ring, see manager_ring.h
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <system_error>
+#include "manager_ring.h"
+
+//---------
+// This function mixes the bits of x (splitmix64), so neighbouring groups
+// and point numbers land all over the ring.
+//----------
+static uint64_t mix(uint64_t x) {
+//----------
+  x += 0x9E3779B97F4A7C15ull;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+  return x ^ (x >> 31);
+}
+
+static uint64_t name_hash(const std::string &name) {
+  uint64_t h = 0xCBF29CE484222325ull;          // FNV-1a
+
+  for (unsigned char c : name) {
+    h = (h ^ c) * 0x100000001B3ull;
+  }
+  return h;
+}
+
+manager_ring::manager_ring(const ring_config &cfg) : cfg_(cfg), owner_(cfg.monitors, RING_NONE) {
+  if (!cfg.monitors || cfg.monitors > 65536 || !cfg.vnodes || !cfg.group) {
+    throw std::system_error(EINVAL, std::generic_category(), "manager_ring");
+  }
+}
+
+uint16_t manager_ring::find(const std::string &name) const {
+  for (size_t m = 0; m < names_.size(); m++) {
+    if (!name.empty() && names_[m] == name) {
+      return (uint16_t)m;
+    }
+  }
+  return RING_NONE;
+}
+
+std::vector<ring_move> manager_ring::add(const std::string &name) {
+  uint16_t m = 0;
+  uint64_t h = name_hash(name);
+
+  if (name.empty() || find(name) != RING_NONE) {
+    return {};
+  }
+  while (m < names_.size() && !names_[m].empty()) {
+    m++;
+  }
+  if (m >= RING_NONE) {
+    throw std::system_error(ENOSPC, std::generic_category(), "manager_ring");
+  }
+  if (m == names_.size()) {
+    names_.emplace_back();
+    load_.push_back(0);
+  }
+  names_[m] = name;
+  managers_++;
+  for (uint32_t v = 0; v < cfg_.vnodes; v++) {
+    points_.push_back({mix(h + v), m});
+  }
+  return rebuild();
+}
+
+std::vector<ring_move> manager_ring::remove(const std::string &name) {
+  uint16_t m = find(name);
+
+  if (m == RING_NONE) {
+    return {};
+  }
+  names_[m].clear();
+  managers_--;
+  points_.erase(std::remove_if(points_.begin(), points_.end(), [m](const point &p) { return p.manager == m; }),
+                points_.end());
+  return rebuild();
+}
+
+//---------
+// This function sorts the points and looks up the owner of every group,
+// the first point at or after its hash, the first of the ring beyond the
+// last. Equal hashes go to the lower manager, so the owners don't depend
+// on the order the managers came in.
+//----------
+std::vector<ring_move> manager_ring::rebuild() {
+//----------
+  std::vector<ring_move> moves;
+
+  std::sort(points_.begin(), points_.end(), [](const point &a, const point &b) {
+    return a.hash != b.hash ? a.hash < b.hash : a.manager < b.manager;
+  });
+  std::fill(load_.begin(), load_.end(), 0);
+  for (uint32_t first = 0; first < owner_.size(); first += cfg_.group) {
+    uint64_t h = mix(first / cfg_.group);
+    auto p = std::lower_bound(points_.begin(), points_.end(), h,
+                              [](const point &a, uint64_t x) { return a.hash < x; });
+    uint16_t m = points_.empty() ? RING_NONE : p == points_.end() ? points_[0].manager : p->manager;
+    uint32_t last = std::min<uint32_t>(first + cfg_.group, owner_.size());
+
+    for (uint32_t id = first; id < last; id++) {
+      if (owner_[id] != m) {
+        moves.push_back({(uint16_t)id, owner_[id], m});
+        owner_[id] = m;
+      }
+    }
+    if (m != RING_NONE) {
+      load_[m] += last - first;
+    }
+  }
+  return moves;
+}
@@ -0,0 +1,85 @@
+/*
+ * LotManagement manager ring
+ *
+ * Splits the monitors of a large site across several LotManagers by
+ * consistent hashing. Every manager puts vnodes points on a ring of 64 bit
+ * hashes, a hash of its name and the point number each; a monitor belongs
+ * to the manager of the first point at or after its own hash. With many
+ * points per manager the monitors spread evenly, at 128 the busiest
+ * manager gets about 1.2 times its share, and adding or removing a manager
+ * only moves the monitors between it and the others: about 1/n of them on
+ * the nth manager added, none between the managers staying.
+ *
+ * The bays of a node report in one datagram to one manager, so the ring
+ * hashes groups of group ids, id / group, and a group always moves as a
+ * whole. The owners of all ids are kept in a flat table, so routing a
+ * command costs one array access; add() and remove() rebuild it and
+ * return the monitors that moved.
+ */
+
+#ifndef MANAGER_RING_H_
+#define MANAGER_RING_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define RING_NONE  0xFFFF                    // owner while the ring is empty
+
+struct ring_config {
+  uint32_t monitors = 65536;                 // ids 0..monitors-1
+  uint32_t vnodes   = 128;                   // points per manager
+  uint32_t group    = 1;                     // ids of a node, hashed together
+};
+
+struct ring_move {
+  uint16_t id;
+  uint16_t from;                             // manager, RING_NONE if none
+  uint16_t to;                               //   RING_NONE if removed
+};
+
+class manager_ring {
+public:
+  explicit manager_ring(const ring_config &cfg);
+
+  uint32_t monitors() const { return (uint32_t)owner_.size(); }
+  uint32_t managers() const { return managers_; }
+
+  // Manager m, "" if m is unused
+  const std::string &name(uint16_t m) const { return names_[m]; }
+
+  // Manager named name, RING_NONE if not on the ring
+  uint16_t find(const std::string &name) const;
+
+  // Owner of id, RING_NONE if id is beyond the site or no manager is on
+  // the ring
+  uint16_t owner(uint32_t id) const { return id < owner_.size() ? owner_[id] : RING_NONE; }
+
+  // Monitors owned by manager m
+  uint32_t load(uint16_t m) const { return m < load_.size() ? load_[m] : 0; }
+
+  // Puts name on the ring, it takes the lowest unused number. Returns the
+  // monitors that moved to it, nothing if name is on the ring already.
+  std::vector<ring_move> add(const std::string &name);
+
+  // Takes name off the ring, its number becomes unused. Returns the
+  // monitors that moved away from it.
+  std::vector<ring_move> remove(const std::string &name);
+
+private:
+  struct point {
+    uint64_t hash;
+    uint16_t manager;
+  };
+
+  std::vector<ring_move> rebuild();
+
+  ring_config cfg_;
+  std::vector<point> points_;                // by hash
+  std::vector<std::string> names_;           // by manager
+  std::vector<uint32_t> load_;               //   monitors owned
+  std::vector<uint16_t> owner_;              // by id
+  uint32_t managers_ = 0;
+};
+
+#endif /* MANAGER_RING_H_ */
@@ -0,0 +1,291 @@
+/*
+ * LotManagement manager router, see manager_router.h
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <system_error>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "manager_router.h"
+
+#define UNREACHABLE  "ERROR manager unreachable"
+
+manager_router::manager_router(const ring_config &cfg, uint32_t timeout_ms) : ring_(cfg), timeout_ms_(timeout_ms) {
+}
+
+manager_router::~manager_router() {
+  for (connection &c : connections_) {
+    drop(c);
+  }
+}
+
+manager_router::connection manager_router::parse(const std::string &manager) {
+  connection c;
+  char address[64];
+  unsigned udp, tcp;
+
+  if (sscanf(manager.c_str(), "%63[^:]:%u:%u", address, &udp, &tcp) != 3 || udp > 65535 || tcp > 65535) {
+    throw std::system_error(EINVAL, std::generic_category(), manager);
+  }
+  c.udp.sin_family = c.tcp.sin_family = AF_INET;
+  c.udp.sin_port = htons(udp);
+  c.tcp.sin_port = htons(tcp);
+  if (inet_pton(AF_INET, address, &c.udp.sin_addr) != 1) {
+    throw std::system_error(EINVAL, std::generic_category(), manager);
+  }
+  c.tcp.sin_addr = c.udp.sin_addr;
+  return c;
+}
+
+//---------
+// This function connects c, blocking, with timeout_ms for every send and
+// receive. Returns false if the manager can't be reached.
+//----------
+bool manager_router::connect(connection &c) {
+//----------
+  struct timeval tv = { (time_t)(timeout_ms_ / 1000), (suseconds_t)(timeout_ms_ % 1000 * 1000) };
+  int one = 1;
+
+  c.fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (c.fd < 0) {
+    return false;
+  }
+  setsockopt(c.fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(c.fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  if (::connect(c.fd, (const struct sockaddr *)&c.tcp, sizeof(c.tcp)) < 0) {
+    int e = errno;
+
+    drop(c);
+    errno = e;
+    return false;
+  }
+  return true;
+}
+
+void manager_router::drop(connection &c) {
+  if (c.fd >= 0) {
+    close(c.fd);
+  }
+  c.fd = -1;
+  c.in.clear();
+}
+
+rebalance_result manager_router::add(const std::string &manager) {
+  connection c = parse(manager);
+
+  if (ring_.find(manager) != RING_NONE) {
+    return {};
+  }
+  if (!connect(c)) {
+    throw std::system_error(errno, std::generic_category(), manager);
+  }
+  std::vector<ring_move> moves = ring_.add(manager);
+  uint16_t m = ring_.find(manager);
+
+  if (m >= connections_.size()) {
+    connections_.resize(m + 1);
+  }
+  drop(connections_[m]);
+  connections_[m] = std::move(c);
+  return carry(moves);
+}
+
+rebalance_result manager_router::remove(const std::string &manager) {
+  uint16_t m = ring_.find(manager);
+
+  if (m == RING_NONE) {
+    return {};
+  }
+  rebalance_result r = carry(ring_.remove(manager)); // still connected
+  drop(connections_[m]);
+  return r;
+}
+
+sockaddr_in manager_router::udp(uint16_t id) const {
+  uint16_t m = ring_.owner(id);
+
+  if (m == RING_NONE) {
+    return sockaddr_in{};
+  }
+  return connections_[m].udp;
+}
+
+std::string manager_router::ask(const std::string &line) {
+  return ask(std::vector<std::string>{line})[0];
+}
+
+//---------
+// This function sorts the commands by the manager owning the monitor they
+// name and runs the batches of all managers side by side.
+//----------
+std::vector<std::string> manager_router::ask(const std::vector<std::string> &lines) {
+//----------
+  std::vector<std::string> answers(lines.size());
+  std::vector<batch> batches(connections_.size());
+
+  for (size_t i = 0; i < lines.size(); i++) {
+    unsigned id;
+    uint16_t m;
+
+    if (sscanf(lines[i].c_str(), "%*s %u", &id) != 1 || (m = ring_.owner(id)) == RING_NONE) {
+      answers[i] = "ERROR unknown monitor";
+      continue;
+    }
+    batches[m].lines.push_back(&lines[i]);
+    batches[m].answers.push_back(&answers[i]);
+  }
+  exchange(batches);
+  return answers;
+}
+
+std::vector<std::string> manager_router::each(const std::string &line) {
+  std::vector<std::string> answers(connections_.size());
+  std::vector<batch> batches(connections_.size());
+
+  for (uint16_t m = 0; m < connections_.size(); m++) {
+    if (!ring_.name(m).empty()) {
+      batches[m].lines.push_back(&line);
+      batches[m].answers.push_back(&answers[m]);
+    }
+  }
+  exchange(batches);
+  return answers;
+}
+
+//---------
+// This function sends the next window of every batch to its manager, then
+// collects the answers of all of them, until all batches are answered. A
+// manager failing to take or answer a window is dropped, the rest of its
+// batch is answered with an error, it is connected again next time.
+//----------
+void manager_router::exchange(std::vector<batch> &batches) {
+//----------
+  for (size_t done = 0;; done += ROUTER_WINDOW) {
+    bool more = false;
+
+    for (uint16_t m = 0; m < batches.size(); m++) {
+      batch &b = batches[m];
+      connection &c = connections_[m];
+      std::string out;
+
+      if (b.lines.size() <= done) {
+        continue;
+      }
+      more = true;
+      if (c.fd < 0 && !connect(c)) {
+        continue;
+      }
+      for (size_t i = done; i < std::min(b.lines.size(), done + ROUTER_WINDOW); i++) {
+        out += *b.lines[i];
+        out += '\n';
+      }
+      for (size_t sent = 0; sent < out.size();) {
+        ssize_t n = send(c.fd, out.data() + sent, out.size() - sent, MSG_NOSIGNAL);
+
+        if (n <= 0) {
+          drop(c);
+          break;
+        }
+        sent += n;
+      }
+    }
+    if (!more) {
+      return;
+    }
+    for (uint16_t m = 0; m < batches.size(); m++) {
+      batch &b = batches[m];
+      connection &c = connections_[m];
+
+      for (size_t i = done; i < std::min(b.lines.size(), done + ROUTER_WINDOW); i++) {
+        size_t eol;
+
+        while (c.fd >= 0 && (eol = c.in.find('\n')) == std::string::npos) {
+          char buf[4096];
+          ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+
+          if (n <= 0) {
+            drop(c);                         // closed or timed out
+          } else {
+            c.in.append(buf, n);
+          }
+        }
+        if (c.fd < 0) {
+          *b.answers[i] = UNREACHABLE;
+          continue;
+        }
+        b.answers[i]->assign(c.in, 0, eol && c.in[eol - 1] == '\r' ? eol - 1 : eol);
+        c.in.erase(0, eol + 1);
+      }
+    }
+  }
+}
+
+//---------
+// This function carries the reservations of the monitors that moved over:
+// the managers they leave are asked for their status, the reserved ones
+// are cleared there first and then every flag, set or not, is written to
+// the managers they come to, so a stale one from an earlier visit can't
+// come back. Monitors coming from no manager or going to none have nothing
+// to carry.
+//----------
+rebalance_result manager_router::carry(const std::vector<ring_move> &moves) {
+//----------
+  rebalance_result r = { (uint32_t)moves.size(), 0, 0 };
+  std::vector<batch> batches(connections_.size());
+  std::vector<std::string> gets, status(moves.size()), clears, sets, answers(2 * moves.size());
+  std::vector<uint16_t> from;
+  std::vector<bool> on;
+  unsigned id, reserved;
+
+  gets.reserve(moves.size());                // the batches point into them
+  clears.reserve(moves.size());
+  sets.reserve(moves.size());
+  for (const ring_move &x : moves) {
+    if (x.from != RING_NONE && x.to != RING_NONE) {
+      gets.push_back("GET " + std::to_string(x.id));
+      from.push_back(x.from);
+      batches[x.from].lines.push_back(&gets.back());
+      batches[x.from].answers.push_back(&status[gets.size() - 1]);
+    }
+  }
+  exchange(batches);
+
+  batches.assign(connections_.size(), batch());
+  for (size_t i = 0; i < gets.size(); i++) {
+    if (sscanf(status[i].c_str(), "STATUS %u %*u %*u %u", &id, &reserved) != 2) {
+      r.lost++;
+      continue;
+    }
+    if (reserved) {
+      clears.push_back("RESERVE " + std::to_string(id) + " 0");
+      batches[from[i]].lines.push_back(&clears.back());
+      batches[from[i]].answers.push_back(&answers[moves.size() + clears.size() - 1]);
+    }
+    sets.push_back("RESERVE " + std::to_string(id) + (reserved ? " 1" : " 0"));
+    on.push_back(reserved != 0);
+  }
+  exchange(batches);                         // left behind, while still there
+
+  batches.assign(connections_.size(), batch());
+  for (size_t i = 0; i < sets.size(); i++) {
+    sscanf(sets[i].c_str(), "%*s %u", &id);
+    batches[ring_.owner(id)].lines.push_back(&sets[i]);
+    batches[ring_.owner(id)].answers.push_back(&answers[i]);
+  }
+  exchange(batches);
+  for (size_t i = 0; i < sets.size(); i++) {
+    if (answers[i] != "OK") {
+      r.lost++;
+    } else if (on[i]) {
+      r.reserved++;
+    }
+  }
+  return r;
+}
@@ -0,0 +1,93 @@
+/*
+ * LotManagement manager router
+ *
+ * The LotManagers of a site split by a manager_ring, seen as one: a command
+ * about a monitor (GET, RESERVE, QUERY, SLOT of LotManager/src/manager.h)
+ * goes to the manager owning it, over one TCP connection per manager.
+ * Batches are pipelined, up to ROUTER_WINDOW commands per manager in
+ * flight, and answered in the order of the commands.
+ *
+ * A manager is named by its address:udp_port:tcp_port; the monitors report
+ * to the udp_port of their owner, udp() tells which. When a manager is
+ * added or removed, the monitors moving to another one keep their
+ * reservation: it is read from the manager they leave while that is still
+ * there, cleared on it and written to the one they come to, set or not. A
+ * manager that went away unannounced takes the reservations of its
+ * monitors with it, LotManagement sets them again from its reservation
+ * index.
+ */
+
+#ifndef MANAGER_ROUTER_H_
+#define MANAGER_ROUTER_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <netinet/in.h>
+#include "manager_ring.h"
+
+#define ROUTER_WINDOW   256                  // commands in flight per manager
+#define ROUTER_TIMEOUT  2000                 // ms for an answer, by default
+
+struct rebalance_result {
+  uint32_t moved;                            // monitors to another manager
+  uint32_t reserved;                         //   reserved ones carried over
+  uint32_t lost;                             //   whose reservation didn't make it
+};
+
+class manager_router {
+public:
+  // Waits timeout_ms for a manager to take or answer a window
+  explicit manager_router(const ring_config &cfg, uint32_t timeout_ms = ROUTER_TIMEOUT);
+  ~manager_router();
+  manager_router(const manager_router &) = delete;
+  manager_router &operator=(const manager_router &) = delete;
+
+  const manager_ring &ring() const { return ring_; }
+
+  // Puts the manager at address:udp_port:tcp_port on the ring and connects
+  // to it, throws if it can't. The monitors moving to it keep their
+  // reservations.
+  rebalance_result add(const std::string &manager);
+
+  // Takes manager off the ring, the monitors moving away keep their
+  // reservations.
+  rebalance_result remove(const std::string &manager);
+
+  // Where id reports its status, port 0 if no manager owns it
+  sockaddr_in udp(uint16_t id) const;
+
+  // Answers a command about one monitor, without the '\n', "ERROR ..." if
+  // its manager can't be reached
+  std::string ask(const std::string &line);
+
+  // Answers a batch of commands about monitors, in order
+  std::vector<std::string> ask(const std::vector<std::string> &lines);
+
+  // Answers of every manager on the ring to line, e.g. STATS, by manager
+  std::vector<std::string> each(const std::string &line);
+
+private:
+  struct connection {
+    sockaddr_in udp, tcp;
+    int fd = -1;                             // reconnected on demand
+    std::string in;                          // answers not yet taken
+  };
+
+  struct batch {                             // commands for one manager
+    std::vector<const std::string *> lines;
+    std::vector<std::string *> answers;
+  };
+
+  static connection parse(const std::string &manager);
+  bool connect(connection &c);
+  void drop(connection &c);
+  void exchange(std::vector<batch> &batches);
+  rebalance_result carry(const std::vector<ring_move> &moves);
+
+  manager_ring ring_;
+  uint32_t timeout_ms_;
+  std::vector<connection> connections_;      // by manager
+};
+
+#endif /* MANAGER_ROUTER_H_ */
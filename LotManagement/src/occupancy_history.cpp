@@ -0,0 +1,405 @@
+/*
+ * LotManagement occupancy history, see occupancy_history.h
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <system_error>
+#include "occupancy_history.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#define CHUNK      4096                      // intervals decoded at once
+#define BLOCK_MAX  (1u << 22)                // block_s, the kernels sum in 32 bit lanes
+#define LANE_STEPS 256                       //   for this many steps
+
+static void put(std::vector<uint8_t> &b, uint32_t v) {
+  while (v >= 0x80) {
+    b.push_back((uint8_t)(v | 0x80));
+    v >>= 7;
+  }
+  b.push_back((uint8_t)v);
+}
+
+static inline uint32_t get(const uint8_t *&p) {
+  uint32_t v = *p++;
+
+  if (v < 0x80) {
+    return v;
+  }
+  v = (v & 0x7F) | (uint32_t)(*p & 0x7F) << 7;
+  if (*p++ < 0x80) {                         // most gaps and lengths
+    return v;
+  }
+  for (unsigned shift = 14;; shift += 7) {
+    uint32_t c = *p++;
+
+    v |= (c & 0x7F) << shift;
+    if (c < 0x80) {
+      return v;
+    }
+  }
+}
+
+//---------
+// The totals kernel: per interval [s, e) the seconds within [f, t), and
+// whether it arrived within [f, t). arrive is -1 for an arrival, 0 for an
+// interval continued from the block before.
+//----------
+static void totals_scalar(const int32_t *s, const int32_t *e, const int32_t *arrive, uint32_t n,
+                          int32_t f, int32_t t, uint64_t &occupied, uint64_t &arrivals) {
+//----------
+  for (uint32_t i = 0; i < n; i++) {
+    int32_t a = std::max(s[i], f), b = std::min(e[i], t);
+
+    occupied += b > a ? b - a : 0;
+    arrivals += (s[i] >= f) & (s[i] < t) & (arrive[i] != 0);
+  }
+}
+
+#if defined(__x86_64__)
+static inline uint64_t lanes(__m128i v) {
+  uint32_t l[4];
+
+  _mm_storeu_si128((__m128i *)l, v);
+  return (uint64_t)l[0] + l[1] + l[2] + l[3];
+}
+
+//---------
+// The totals kernel, 4 intervals per step. SSE2 has no 32 bit min and max,
+// the compares select; the times fit in 31 bits.
+//----------
+static void totals_sse2(const int32_t *s, const int32_t *e, const int32_t *arrive, uint32_t n,
+                        int32_t f, int32_t t, uint64_t &occupied, uint64_t &arrivals) {
+//----------
+  const __m128i vf = _mm_set1_epi32(f), vt = _mm_set1_epi32(t), zero = _mm_setzero_si128();
+  uint32_t i = 0;
+
+  while (i + 4 <= n) {
+    __m128i occ = zero, arr = zero;
+
+    for (unsigned k = 0; k < LANE_STEPS && i + 4 <= n; k++, i += 4) {
+      __m128i vs = _mm_loadu_si128((const __m128i *)(s + i));
+      __m128i ve = _mm_loadu_si128((const __m128i *)(e + i));
+      __m128i later = _mm_cmpgt_epi32(vs, vf), earlier = _mm_cmpgt_epi32(vt, ve);
+      __m128i a = _mm_or_si128(_mm_and_si128(later, vs), _mm_andnot_si128(later, vf));
+      __m128i b = _mm_or_si128(_mm_and_si128(earlier, ve), _mm_andnot_si128(earlier, vt));
+      __m128i d = _mm_sub_epi32(b, a);
+
+      occ = _mm_add_epi32(occ, _mm_and_si128(d, _mm_cmpgt_epi32(d, zero)));
+      arr = _mm_sub_epi32(arr, _mm_and_si128(_mm_andnot_si128(_mm_cmpgt_epi32(vf, vs), _mm_cmpgt_epi32(vt, vs)),
+                                             _mm_loadu_si128((const __m128i *)(arrive + i))));
+    }
+    occupied += lanes(occ);
+    arrivals += lanes(arr);
+  }
+  totals_scalar(s + i, e + i, arrive + i, n - i, f, t, occupied, arrivals);
+}
+
+//---------
+// The totals kernel, 8 intervals per step
+//----------
+__attribute__((target("avx2")))
+static void totals_avx2(const int32_t *s, const int32_t *e, const int32_t *arrive, uint32_t n,
+                        int32_t f, int32_t t, uint64_t &occupied, uint64_t &arrivals) {
+//----------
+  const __m256i vf = _mm256_set1_epi32(f), vt = _mm256_set1_epi32(t), zero = _mm256_setzero_si256();
+  uint32_t i = 0;
+
+  while (i + 8 <= n) {
+    __m256i occ = zero, arr = zero;
+
+    for (unsigned k = 0; k < LANE_STEPS && i + 8 <= n; k++, i += 8) {
+      __m256i vs = _mm256_loadu_si256((const __m256i *)(s + i));
+      __m256i ve = _mm256_loadu_si256((const __m256i *)(e + i));
+      __m256i d = _mm256_sub_epi32(_mm256_min_epi32(ve, vt), _mm256_max_epi32(vs, vf));
+      __m256i in = _mm256_andnot_si256(_mm256_cmpgt_epi32(vf, vs), _mm256_cmpgt_epi32(vt, vs));
+
+      occ = _mm256_add_epi32(occ, _mm256_max_epi32(d, zero));
+      arr = _mm256_sub_epi32(arr, _mm256_and_si256(in, _mm256_loadu_si256((const __m256i *)(arrive + i))));
+    }
+    occupied += lanes(_mm_add_epi32(_mm256_castsi256_si128(occ), _mm256_extracti128_si256(occ, 1)));
+    arrivals += lanes(_mm_add_epi32(_mm256_castsi256_si128(arr), _mm256_extracti128_si256(arr, 1)));
+  }
+  totals_scalar(s + i, e + i, arrive + i, n - i, f, t, occupied, arrivals);
+}
+
+static const bool has_avx2 = [] {            // may run before main()
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") != 0;
+}();
+
+static void totals(const int32_t *s, const int32_t *e, const int32_t *arrive, uint32_t n,
+                   int32_t f, int32_t t, uint64_t &occupied, uint64_t &arrivals) {
+  if (has_avx2) {
+    totals_avx2(s, e, arrive, n, f, t, occupied, arrivals);
+  } else {
+    totals_sse2(s, e, arrive, n, f, t, occupied, arrivals);
+  }
+}
+
+const char *occupancy_history::path() {
+  return has_avx2 ? "avx2" : "sse2";
+}
+#else
+static void totals(const int32_t *s, const int32_t *e, const int32_t *arrive, uint32_t n,
+                   int32_t f, int32_t t, uint64_t &occupied, uint64_t &arrivals) {
+  totals_scalar(s, e, arrive, n, f, t, occupied, arrivals);
+}
+
+const char *occupancy_history::path() {
+  return "scalar";
+}
+#endif
+
+occupancy_history::occupancy_history(const history_config &cfg)
+  : cfg_(cfg), open_(cfg.bays, -1), open_continued_(cfg.bays) {
+  if (!cfg_.bays || !cfg_.block_s || cfg_.block_s > BLOCK_MAX) {
+    throw std::system_error(EINVAL, std::generic_category(), "occupancy_history");
+  }
+}
+
+uint64_t occupancy_history::bytes() const {
+  uint64_t n = 0;
+
+  for (auto &b : blocks_) {
+    n += b.runs.size() * sizeof(run) + b.gap.size() + b.length.size();
+  }
+  return n;
+}
+
+int occupancy_history::record(uint32_t bay, int64_t t, bool occupied) {
+  if (bay >= cfg_.bays || t < sealed()) {
+    return 0;
+  }
+  if (occupied && open_[bay] < 0) {
+    open_[bay] = t;
+    open_continued_[bay] = 0;
+  } else if (!occupied && open_[bay] >= 0) {
+    if (t > open_[bay]) {
+      tail_.push_back({bay, open_continued_[bay], open_[bay], t});
+    }
+    open_[bay] = -1;
+  }
+  return 1;
+}
+
+int occupancy_history::add(uint32_t bay, int64_t start, int64_t end) {
+  if (bay >= cfg_.bays || start < sealed()) {
+    return 0;
+  }
+  if (end > start) {
+    tail_.push_back({bay, 0, start, end});
+  }
+  return 1;
+}
+
+void occupancy_history::seal(int64_t until) {
+  while (sealed() + cfg_.block_s <= until) {
+    seal_block();
+  }
+}
+
+//---------
+// This function seals the block after the last one: takes the intervals
+// starting in it, cuts those running on, sorts them by bay and start and
+// encodes the columns. Overlapping intervals of a bay are merged.
+//----------
+void occupancy_history::seal_block() {
+//----------
+  int64_t begin = sealed(), end = begin + cfg_.block_s;
+  std::vector<row> rows, rest;
+  block b;
+
+  for (uint32_t bay = 0; bay < cfg_.bays; bay++) {
+    if (open_[bay] >= 0 && open_[bay] < end) {
+      tail_.push_back({bay, open_continued_[bay], open_[bay], end});
+      open_[bay] = end;
+      open_continued_[bay] = 1;
+    }
+  }
+  for (auto &r : tail_) {
+    if (r.start >= end) {
+      rest.push_back(r);
+    } else {
+      if (r.end > end) {
+        rest.push_back({r.bay, 1, end, r.end});
+      }
+      rows.push_back({r.bay, r.continued, r.start, std::min(r.end, end)});
+    }
+  }
+  tail_.swap(rest);
+  std::sort(rows.begin(), rows.end(), [](const row &x, const row &y) {
+    return x.bay != y.bay ? x.bay < y.bay : x.start < y.start;
+  });
+
+  int64_t last = begin;                      // end of the bay's interval before
+
+  for (auto &r : rows) {
+    if (b.runs.empty() || b.runs.back().bay != r.bay) {
+      b.runs.push_back({r.bay, 0, (uint32_t)b.gap.size(), (uint32_t)b.length.size()});
+      last = begin;
+    }
+    int64_t start = std::max(r.start, last);
+
+    if (r.end <= start) {
+      continue;
+    }
+    put(b.gap, (uint32_t)(start - last) << 1 | r.continued);
+    put(b.length, (uint32_t)(r.end - start));
+    last = r.end;
+    b.runs.back().rows++;
+    intervals_++;
+  }
+  b.runs.shrink_to_fit();
+  b.gap.shrink_to_fit();
+  b.length.shrink_to_fit();
+  blocks_.push_back(std::move(b));
+}
+
+//---------
+// This function decodes the intervals of the bays of zone in the blocks
+// overlapping [from, to) into chunks and hands them to kernel(chunk, begin
+// of their block). A chunk holds the intervals of one block.
+//----------
+template <typename F>
+void occupancy_history::scan(int64_t from, int64_t to, const uint64_t *zone, F kernel) const {
+//----------
+  chunk c;
+  uint32_t words = (cfg_.bays + 63) / 64;
+  int64_t first = std::max<int64_t>(from - cfg_.begin, 0) / cfg_.block_s;
+  int64_t last = std::min<int64_t>((to - cfg_.begin + cfg_.block_s - 1) / cfg_.block_s, blocks_.size());
+
+  c.start.resize(CHUNK);
+  c.end.resize(CHUNK);
+  c.arrive.resize(CHUNK);
+  for (int64_t i = first; i < last; i++) {
+    const block &b = blocks_[i];
+    int64_t begin = cfg_.begin + i * cfg_.block_s;
+
+    for (size_t k = 0; k < b.runs.size(); k++) {
+      const run &r = b.runs[k];
+
+      if (zone && !zone[r.bay / 64]) {       // on to the next word of the zone
+        uint32_t w = r.bay / 64 + 1;
+
+        while (w < words && !zone[w]) {
+          w++;
+        }
+        if (w == words) {
+          break;
+        }
+        k = std::lower_bound(b.runs.begin() + k, b.runs.end(), w * 64,
+                             [](const run &x, uint32_t bay) { return x.bay < bay; }) - b.runs.begin() - 1;
+        continue;
+      }
+      if (zone && !(zone[r.bay / 64] >> r.bay % 64 & 1)) {
+        continue;
+      }
+      if (c.n + r.rows > c.start.size()) {
+        if (c.n) {
+          kernel(c, begin);
+          c.n = 0;
+        }
+        if (r.rows > c.start.size()) {
+          c.start.resize(r.rows);
+          c.end.resize(r.rows);
+          c.arrive.resize(r.rows);
+        }
+      }
+      const uint8_t *g = b.gap.data() + r.gap, *l = b.length.data() + r.length;
+      int32_t end = 0;
+
+      for (uint32_t k = 0; k < r.rows; k++, c.n++) {
+        uint32_t x = get(g);
+
+        c.start[c.n] = end + (int32_t)(x >> 1);
+        c.end[c.n] = end = c.start[c.n] + (int32_t)get(l);
+        c.arrive[c.n] = x & 1 ? 0 : -1;
+      }
+    }
+    if (c.n) {
+      kernel(c, begin);
+      c.n = 0;
+    }
+  }
+}
+
+history_totals occupancy_history::totals(int64_t from, int64_t to, const uint64_t *zone) const {
+  history_totals sum = {};
+
+  if (to <= from) {
+    return sum;
+  }
+  scan(from, to, zone, [&](const chunk &c, int64_t begin) {
+    int32_t f = (int32_t)std::clamp<int64_t>(from - begin, 0, cfg_.block_s);
+    int32_t t = (int32_t)std::clamp<int64_t>(to - begin, 0, cfg_.block_s);
+
+    ::totals(c.start.data(), c.end.data(), c.arrive.data(), c.n, f, t, sum.occupied_s, sum.arrivals);
+    sum.intervals += c.n;
+  });
+  return sum;
+}
+
+//---------
+// This function spreads every interval over the buckets it covers: the
+// seconds in its first and last bucket directly, the buckets in between
+// as +1 and -1 in a difference array summed up at the end.
+//----------
+void occupancy_history::profile(int64_t from, int64_t to, uint32_t bucket_s, const uint64_t *zone,
+                                std::vector<uint64_t> &out) const {
+//----------
+  uint32_t buckets = to > from && bucket_s ? (uint32_t)((to - from + bucket_s - 1) / bucket_s) : 0;
+  std::vector<int64_t> diff(buckets + 1);
+  int64_t running = 0;
+
+  out.assign(buckets, 0);
+  if (!buckets) {
+    return;
+  }
+  scan(from, to, zone, [&](const chunk &c, int64_t begin) {
+    int64_t f = from - begin, t = to - begin;
+
+    for (uint32_t i = 0; i < c.n; i++) {
+      int64_t a = std::max<int64_t>(c.start[i], f) - f, b = std::min<int64_t>(c.end[i], t) - f;
+
+      if (b <= a) {
+        continue;
+      }
+      uint32_t ba = (uint32_t)(a / bucket_s), bb = (uint32_t)(b / bucket_s);
+
+      if (ba == bb) {
+        out[ba] += b - a;
+      } else {
+        out[ba] += (int64_t)(ba + 1) * bucket_s - a;
+        diff[ba + 1]++;
+        diff[bb]--;
+        if (bb < buckets) {
+          out[bb] += b - (int64_t)bb * bucket_s;
+        }
+      }
+    }
+  });
+  for (uint32_t i = 0; i < buckets; i++) {
+    running += diff[i];
+    out[i] += running * bucket_s;
+  }
+}
+
+history_peak occupancy_history::peak(int64_t from, int64_t to, uint32_t bucket_s, const uint64_t *zone) const {
+  std::vector<uint64_t> occupied;
+  history_peak best = {from, 0};
+
+  profile(from, to, bucket_s, zone, occupied);
+  for (uint32_t i = 0; i < occupied.size(); i++) {
+    int64_t t = from + (int64_t)i * bucket_s;
+    double bays = (double)occupied[i] / std::min<int64_t>(bucket_s, to - t);
+
+    if (bays > best.bays) {
+      best = {t, bays};
+    }
+  }
+  return best;
+}
@@ -0,0 +1,129 @@
+/*
+ * LotManagement occupancy history
+ *
+ * When every bay of a site was occupied, kept for a year and more, for the
+ * utilisation reports of operations: occupied hours and turnover of a bay
+ * or a zone, how occupancy runs over the day, when the peaks are.
+ *
+ * The history is a list of the intervals a bay was occupied, fed from the
+ * state changes of the monitors with record() or as whole intervals with
+ * add(). It is stored in columns, one block per block_s (a day) sealed once
+ * the day is over; an interval crossing the end of a block is cut there and
+ * continued in the next. A block sorts its intervals by bay and start and
+ * keeps three columns:
+ *
+ *   bay       run-length: bay, intervals, offsets into the other columns
+ *   gap       per interval, seconds since the end of the previous one of
+ *             the bay (or the block begin) * 2 + continued, LEB128
+ *   length    per interval, seconds occupied, LEB128
+ *
+ * so an interval takes about 4 bytes, 7 to 8 with its share of the runs
+ * at a few cars a bay a day, instead of 16 or more as a row. A query
+ * skips the blocks outside its window and the runs of bays outside its
+ * zone, up to the next word of the zone with a bay by binary search. It
+ * decodes the rest in chunks of times relative to the block and runs the
+ * aggregation kernels over them: the occupied seconds and arrivals in a
+ * window with SSE2 or AVX2, the occupancy per time bucket with a difference
+ * array, O(1) per interval.
+ *
+ * Times are seconds of the Unix epoch. A zone is a bitmap over the bays,
+ * nullptr is the whole site. Queries see the sealed blocks only.
+ */
+
+#ifndef OCCUPANCY_HISTORY_H_
+#define OCCUPANCY_HISTORY_H_
+
+#include <cstdint>
+#include <vector>
+
+struct history_config {
+  uint32_t bays    = 4096;
+  uint32_t block_s = 86400;                  // block length
+  int64_t  begin   = 0;                      // of the first block
+};
+
+struct history_totals {
+  uint64_t occupied_s;                       // bay seconds occupied in the window
+  uint64_t arrivals;                         // intervals starting in it, the turnover
+  uint64_t intervals;                        // decoded to answer
+};
+
+struct history_peak {
+  int64_t t;                                 // bucket begin
+  double  bays;                              // occupied on average in it
+};
+
+class occupancy_history {
+public:
+  explicit occupancy_history(const history_config &cfg);
+
+  uint32_t bays() const { return cfg_.bays; }
+  int64_t sealed() const { return cfg_.begin + (int64_t)blocks_.size() * cfg_.block_s; }
+  uint64_t intervals() const { return intervals_; }
+  uint64_t bytes() const;                    // of the sealed blocks
+
+  // Takes a state change of bay at t, in time order per bay and not before
+  // sealed(). Returns 0 if bay is beyond the site or t is too old.
+  int record(uint32_t bay, int64_t t, bool occupied);
+
+  // Takes the interval [start, end) of bay, not before sealed().
+  int add(uint32_t bay, int64_t start, int64_t end);
+
+  // Seals the blocks ending at until or before, the bays occupied at their
+  // end are cut there.
+  void seal(int64_t until);
+
+  // Occupied seconds and arrivals of the bays of zone in [from, to)
+  history_totals totals(int64_t from, int64_t to, const uint64_t *zone = nullptr) const;
+
+  // Occupied bay seconds of zone per bucket_s from from on, into out, one
+  // entry per bucket up to to. Divided by bucket_s, the bays occupied on
+  // average.
+  void profile(int64_t from, int64_t to, uint32_t bucket_s, const uint64_t *zone,
+               std::vector<uint64_t> &out) const;
+
+  // The bucket of profile() with the most bays occupied, the earliest of
+  // equal ones.
+  history_peak peak(int64_t from, int64_t to, uint32_t bucket_s, const uint64_t *zone = nullptr) const;
+
+  // The path the kernels take, "avx2", "sse2" or "scalar"
+  static const char *path();
+
+private:
+  struct row {
+    uint32_t bay;
+    uint32_t continued;                      // cut at a block begin
+    int64_t  start, end;
+  };
+
+  struct run {
+    uint32_t bay;
+    uint32_t rows;
+    uint32_t gap;                            // offsets of its first interval
+    uint32_t length;                         //   in the columns
+  };
+
+  struct block {
+    std::vector<run> runs;                   // by bay
+    std::vector<uint8_t> gap;
+    std::vector<uint8_t> length;
+  };
+
+  // Decoded intervals, relative to their block
+  struct chunk {
+    std::vector<int32_t> start, end, arrive; // arrive -1 unless continued
+    uint32_t n = 0;
+  };
+
+  void seal_block();
+  template <typename F> void scan(int64_t from, int64_t to, const uint64_t *zone, F kernel) const;
+
+  history_config cfg_;
+  std::vector<block> blocks_;
+  std::vector<row> tail_;                    // not yet sealed
+  std::vector<int64_t> open_;                // occupied since, -1 if free
+  std::vector<uint8_t> open_continued_;      //   since a block begin
+  uint64_t intervals_ = 0;                   // sealed
+};
+
+#endif /* OCCUPANCY_HISTORY_H_ */
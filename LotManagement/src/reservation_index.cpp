@@ -0,0 +1,190 @@
+/*
+ * LotManagement reservation index, see reservation_index.h
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <system_error>
+#include "reservation_index.h"
+
+reservation_index::reservation_index(const reservation_config &cfg, int64_t now)
+  : cfg_(cfg), bays_(cfg.bays), words_((cfg.bays + 63) / 64), groups_((words_ + 63) / 64),
+    base_(now / std::max(cfg.slot_s, 1u)) {
+  if (!cfg_.bays || !cfg_.slot_s || !cfg_.horizon) {
+    throw std::system_error(EINVAL, std::generic_category(), "reservation_index");
+  }
+  busy_.resize((size_t)cfg_.horizon * words_);
+  full_.resize((size_t)cfg_.horizon * groups_);
+  for (uint64_t s = base_; s < base_ + cfg_.horizon; s++) {
+    clear(s);
+  }
+}
+
+//---------
+// This function empties the bitmaps of a slot. The bits beyond the last
+// bay and the summary bits beyond the last word count as taken, so no
+// search ever stops there.
+//----------
+void reservation_index::clear(uint64_t slot) {
+//----------
+  uint64_t *b = busy(slot), *f = full(slot);
+
+  std::fill(b, b + words_, 0);
+  std::fill(f, f + groups_, 0);
+  if (bays_ % 64) {
+    b[words_ - 1] = ~0ull << bays_ % 64;
+  }
+  if (words_ % 64) {
+    f[groups_ - 1] = ~0ull << words_ % 64;
+  }
+}
+
+//---------
+// This function turns [from, to) into the slots first..last of the
+// horizon, false if none.
+//----------
+bool reservation_index::window(int64_t from, int64_t to, uint64_t &first, uint64_t &last) const {
+//----------
+  if (to <= from || to <= begin() || to > end()) {
+    return false;
+  }
+  first = from < begin() ? base_ : (uint64_t)from / cfg_.slot_s;
+  last = (uint64_t)(to - 1) / cfg_.slot_s;
+  return true;
+}
+
+void reservation_index::take(uint32_t bay, uint64_t first, uint64_t last, bool taken) {
+  uint32_t w = bay / 64;
+  uint64_t bit = 1ull << bay % 64;
+
+  for (uint64_t s = first; s <= last; s++) {
+    uint64_t &word = busy(s)[w];
+    uint64_t &summary = full(s)[w / 64];
+
+    word = taken ? word | bit : word & ~bit;
+    summary = ~word ? summary & ~(1ull << w % 64) : summary | 1ull << w % 64;
+  }
+}
+
+uint64_t reservation_index::reserve(uint32_t bay, int64_t from, int64_t to) {
+  uint64_t first, last, id;
+  uint32_t index;
+
+  if (bay >= bays_ || !window(from, to, first, last)) {
+    return 0;
+  }
+  for (uint64_t s = first; s <= last; s++) {
+    if (busy(s)[bay / 64] >> bay % 64 & 1) {
+      return 0;
+    }
+  }
+  if (!unused_.empty()) {
+    index = unused_.back();
+    unused_.pop_back();
+  } else {
+    index = (uint32_t)records_.size();
+    records_.push_back({UINT32_MAX, 0, 0, 0});
+  }
+  record &r = records_[index];
+
+  r.bay = bay;
+  r.first = first;
+  r.last = last;
+  id = (uint64_t)r.gen << 32 | (index + 1);
+  take(bay, first, last, true);
+  ends_.push({last, id});
+  count_++;
+  return id;
+}
+
+int reservation_index::cancel(uint64_t id) {
+  uint32_t index = (uint32_t)id - 1;
+
+  if (index >= records_.size() || records_[index].bay == UINT32_MAX || records_[index].gen != id >> 32) {
+    return 0;
+  }
+  const record &r = records_[index];
+
+  take(r.bay, std::max(r.first, base_), r.last, false);
+  release(index);
+  return 1;
+}
+
+void reservation_index::release(uint32_t index) {
+  records_[index].bay = UINT32_MAX;
+  records_[index].gen++;                     // the old id is gone
+  unused_.push_back(index);
+  count_--;
+}
+
+bool reservation_index::reserved(uint32_t bay, int64_t t) const {
+  uint64_t s = (uint64_t)t / cfg_.slot_s;
+
+  if (bay >= bays_ || t < begin() || t >= end()) {
+    return false;
+  }
+  return busy(s)[bay / 64] >> bay % 64 & 1;
+}
+
+//---------
+// This function searches the groups of 4096 bays from the one of first on.
+// The summaries of the slots show the words full in any of them, each
+// other word is ORed over the slots until a bay is free in all or the word
+// fills up. The bays below first are masked as taken.
+//----------
+int64_t reservation_index::find_free(int64_t from, int64_t to, uint32_t first) const {
+//----------
+  uint64_t s1, s2, ring = cfg_.horizon;
+
+  if (first >= bays_ || !window(from, to, s1, s2)) {
+    return -1;
+  }
+  uint64_t r1 = s1 % ring, slots = s2 - s1 + 1;
+
+  for (uint32_t g = first / 4096; g < groups_; g++) {
+    uint64_t taken = 0;
+
+    for (uint64_t i = 0, r = r1; i < slots && ~taken; i++, r = r + 1 == ring ? 0 : r + 1) {
+      taken |= full_[r * groups_ + g];
+    }
+    if (g == first / 4096) {
+      taken |= (1ull << first / 64 % 64) - 1;
+    }
+    for (uint64_t candidates = ~taken; candidates; candidates &= candidates - 1) {
+      uint32_t w = g * 64 + __builtin_ctzll(candidates);
+      uint64_t t = w == first / 64 ? (1ull << first % 64) - 1 : 0;
+
+      for (uint64_t i = 0, r = r1; i < slots && ~t; i++, r = r + 1 == ring ? 0 : r + 1) {
+        t |= busy_[r * words_ + w];
+      }
+      if (~t) {
+        return (int64_t)w * 64 + __builtin_ctzll(~t);
+      }
+    }
+  }
+  return -1;
+}
+
+uint32_t reservation_index::advance(int64_t now) {
+  uint64_t slot = (uint64_t)now / cfg_.slot_s;
+  uint32_t over = 0;
+
+  if (slot <= base_) {
+    return 0;
+  }
+  for (uint64_t s = base_; s < slot && s < base_ + cfg_.horizon; s++) {
+    clear(s);                                // becomes slot s + horizon
+  }
+  base_ = slot;
+  while (!ends_.empty() && ends_.top().first < base_) {
+    uint64_t id = ends_.top().second;
+    uint32_t index = (uint32_t)id - 1;
+
+    ends_.pop();
+    if (records_[index].bay != UINT32_MAX && records_[index].gen == id >> 32) {
+      release(index);                        // else cancelled before
+      over++;
+    }
+  }
+  return over;
+}
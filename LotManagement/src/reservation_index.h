@@ -0,0 +1,98 @@
+/*
+ * LotManagement reservation index
+ *
+ * The reservations of all bays of a site over a bookable horizon, in slots
+ * of slot_s seconds (15 minutes by default, a week ahead). A reservation
+ * takes whole slots of one bay, a bay holds at most one reservation per
+ * slot.
+ *
+ * For every slot of the horizon the index keeps a bitmap over the bays, bit
+ * b set while bay b is taken, and a summary bitmap over its words, bit w
+ * set while all 64 bays of word w are taken. The slots form a ring: moving
+ * the horizon on clears the slots of the past, which become the new last
+ * ones. So
+ *
+ *   reserved(bay, t)       one bit, O(1)
+ *   reserve(), cancel()    a bit per slot of the reservation
+ *   find_free(from, to)    ORs the summaries of the slots, then the words
+ *                          of the groups of 64 bays not full in any slot,
+ *                          until one has a bay free in all of them:
+ *                          O(slots * bays / 4096) to skip a full site
+ *
+ * 100000 bays over a week of 15 minute slots take 8.4MB of bitmaps. Times
+ * are seconds of the Unix epoch.
+ */
+
+#ifndef RESERVATION_INDEX_H_
+#define RESERVATION_INDEX_H_
+
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <vector>
+
+struct reservation_config {
+  uint32_t bays    = 4096;
+  uint32_t slot_s  = 900;                    // slot length
+  uint32_t horizon = 7 * 24 * 4;             // slots bookable ahead
+};
+
+class reservation_index {
+public:
+  reservation_index(const reservation_config &cfg, int64_t now);
+
+  uint32_t bays() const { return bays_; }
+  uint32_t count() const { return count_; }  // reservations held
+  int64_t begin() const { return (int64_t)base_ * cfg_.slot_s; } // bookable from
+  int64_t end() const { return (int64_t)(base_ + cfg_.horizon) * cfg_.slot_s; } //   until
+
+  // Reserves bay for [from, to), widened to whole slots, from before
+  // begin() counts from begin(). Returns the id of the reservation, 0 if
+  // bay is unknown, the window ends beyond end() or the bay is taken in it.
+  uint64_t reserve(uint32_t bay, int64_t from, int64_t to);
+
+  // Frees the slots of a reservation, returns 0 if it is unknown or over.
+  int cancel(uint64_t id);
+
+  // Is bay taken at t? Times outside the horizon are free.
+  bool reserved(uint32_t bay, int64_t t) const;
+
+  // Returns the lowest bay from first on free all of [from, to), -1 if none
+  // or the window is outside the horizon.
+  int64_t find_free(int64_t from, int64_t to, uint32_t first = 0) const;
+
+  // Moves the horizon on to now, forgets the slots before and the
+  // reservations over by then. Returns their number.
+  uint32_t advance(int64_t now);
+
+private:
+  struct record {
+    uint32_t bay;                            // UINT32_MAX = unused
+    uint32_t gen;                            // of the id
+    uint64_t first, last;                    // slots taken
+  };
+
+  uint64_t *busy(uint64_t slot) { return &busy_[slot % cfg_.horizon * words_]; }
+  const uint64_t *busy(uint64_t slot) const { return &busy_[slot % cfg_.horizon * words_]; }
+  uint64_t *full(uint64_t slot) { return &full_[slot % cfg_.horizon * groups_]; }
+  const uint64_t *full(uint64_t slot) const { return &full_[slot % cfg_.horizon * groups_]; }
+  bool window(int64_t from, int64_t to, uint64_t &first, uint64_t &last) const;
+  void clear(uint64_t slot);
+  void take(uint32_t bay, uint64_t first, uint64_t last, bool taken);
+  void release(uint32_t index);
+
+  reservation_config cfg_;
+  uint32_t bays_;
+  uint32_t words_;                           // bitmap words per slot
+  uint32_t groups_;                          //   summary words per slot
+  uint64_t base_;                            // first slot of the horizon
+  uint32_t count_ = 0;
+  std::vector<uint64_t> busy_;               // horizon x words_
+  std::vector<uint64_t> full_;               // horizon x groups_
+  std::vector<record> records_;              // by id & 0xFFFFFFFF - 1
+  std::vector<uint32_t> unused_;             //   free for reuse
+  std::priority_queue<std::pair<uint64_t, uint64_t>, std::vector<std::pair<uint64_t, uint64_t>>,
+                      std::greater<std::pair<uint64_t, uint64_t>>> ends_; // last slot, id
+};
+
+#endif /* RESERVATION_INDEX_H_ */
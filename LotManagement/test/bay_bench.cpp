@@ -0,0 +1,101 @@
+/*
+ * LotManagement nearest free bay benchmark
+ *
+ * A multi-level garage of 10 levels of 10000 bays, 50 rows of 200 bays of
+ * 2.5 x 5 m on each level with 6 m aisles, 500 x 400 m. Reports the
+ * occupancy updates per second and, at several occupancies, the searches
+ * for the nearest and the 10 nearest free bays: from one of four
+ * entrances on the ground level, and from anywhere while the bays keep
+ * changing, 10 updates between two searches.
+ *
+ * usage: bay_bench [seconds per measurement]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <vector>
+#include "bay_map.h"
+
+#define LEVELS   10
+#define ROWS     50
+#define PER_ROW  200
+
+static volatile uint32_t sink;               // keeps the results alive
+static uint32_t seed = 1;
+
+static uint32_t rnd(uint32_t n) {
+  seed = seed * 1103515245 + 12345;
+  return (uint32_t)(((uint64_t)(seed >> 1) * n) >> 31);
+}
+
+static double clock_s(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//---------
+// This function runs step until seconds passed, returns the microseconds
+// of one step.
+//----------
+template <typename F> static double measure(double seconds, F step) {
+//----------
+  double start = clock_s(), elapsed;
+  uint64_t n = 0;
+
+  do {
+    for (int i = 0; i < 64; i++) {
+      step();
+    }
+    n += 64;
+    elapsed = clock_s() - start;
+  } while (elapsed < seconds);
+  return elapsed * 1e6 / n;
+}
+
+int main(int argc, char **argv) {
+  double seconds = argc > 1 ? strtod(argv[1], NULL) : 0.5;
+  const bay_position entrances[] = {{0, 0, 0}, {500, 0, 0}, {0, 400, 0}, {500, 400, 0}};
+  std::vector<bay_position> bays;
+  uint32_t found[10];
+  double start, us;
+
+  for (int level = 0; level < LEVELS; level++) {
+    for (int row = 0; row < ROWS; row++) {   // facing rows share an aisle
+      for (int i = 0; i < PER_ROW; i++) {
+        bays.push_back({2.5f * i + 1.25f, row / 2 * 16.0f + (row & 1 ? 13.5f : 2.5f), (uint16_t)level});
+      }
+    }
+  }
+  start = clock_s();
+  bay_map m(bays);
+  printf("bay_bench: %zu bays on %d levels, mapped in %.1f ms\n", bays.size(), LEVELS, (clock_s() - start) * 1e3);
+
+  us = measure(seconds, [&] { m.set_free(rnd(bays.size()), rnd(2)); });
+  printf("  updates                  %8.2f M/s\n", 1 / us);
+
+  for (uint32_t taken : {500u, 900u, 990u, 999u}) { // per mille
+    auto update = [&] { m.set_free(rnd(bays.size()), rnd(1000) >= taken); };
+
+    for (uint32_t b = 0; b < bays.size(); b++) {
+      m.set_free(b, rnd(1000) >= taken);
+    }
+    printf("  %4.1f%% taken, %6u free\n", taken / 10.0, m.free());
+    for (uint32_t k : {1u, 10u}) {
+      us = measure(seconds, [&] { sink = m.nearest_free(entrances[rnd(4)], k, found); });
+      printf("    %2u nearest, entrance  %8.2f us\n", k, us);
+      us = measure(seconds, [&] {
+        bay_position from = {(float)rnd(500), (float)rnd(400), (uint16_t)rnd(LEVELS)};
+
+        for (int i = 0; i < 10; i++) {
+          update();
+        }
+        sink = m.nearest_free(from, k, found);
+      });
+      printf("    %2u nearest, anywhere  %8.2f us with 10 updates\n", k, us);
+    }
+  }
+  return 0;
+}
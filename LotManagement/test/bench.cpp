@@ -0,0 +1,116 @@
+/*
+ * LotManagement reservation index benchmark
+ *
+ * Books a site of random reservations of 15 minutes to 4 hours over the
+ * week ahead and reports reservations, lookups and searches per second:
+ * the inserts, "is bay X reserved at t", "find a free bay for [t1, t2)" on
+ * the booked site and on one where only the last bays are left, the
+ * cancellations and moving the horizon through a day.
+ *
+ * usage: reservation_bench [bays [reservations]]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <vector>
+#include "reservation_index.h"
+
+#define T0       1700000100                  // a slot boundary
+#define LOOKUPS  (1 << 22)
+#define SEARCHES (1 << 16)
+
+static volatile int64_t sink;                // keeps the results alive
+static uint32_t seed = 1;
+
+static uint32_t rnd(uint32_t n) {
+  seed = seed * 1103515245 + 12345;
+  return (uint32_t)(((uint64_t)(seed >> 1) * n) >> 31);
+}
+
+static double clock_s(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void print(const char *what, uint64_t n, double s) {
+  printf("  %-28s %10.2f M/s, %6.0f ns each\n", what, n / s / 1e6, s * 1e9 / n);
+}
+
+int main(int argc, char **argv) {
+  reservation_config cfg;
+  cfg.bays = argc > 1 ? strtoul(argv[1], NULL, 0) : 200000;
+  uint32_t wanted = argc > 2 ? strtoul(argv[2], NULL, 0) : 500000;
+  int64_t week = (int64_t)cfg.horizon * cfg.slot_s;
+  reservation_index r(cfg, T0);
+  std::vector<uint64_t> ids;
+  uint64_t attempts = 0, found = 0;
+  double start;
+
+  if (!cfg.bays || cfg.bays > 1 << 24) {
+    fprintf(stderr, "usage: reservation_bench [bays [reservations]]\n");
+    return 1;
+  }
+  printf("reservation_bench: %u bays, %u slots of %u s\n", cfg.bays, cfg.horizon, cfg.slot_s);
+
+  start = clock_s();
+  while (ids.size() < wanted && attempts < 4ull * wanted) {
+    int64_t from = T0 + rnd(week - 4 * 3600);
+    uint64_t id = r.reserve(rnd(cfg.bays), from, from + 900 + rnd(4 * 3600 - 900));
+
+    attempts++;
+    if (id) {
+      ids.push_back(id);
+    }
+  }
+  print("reserve", attempts, clock_s() - start);
+  printf("  %-28s %10zu held, %llu taken before\n", "", ids.size(), (unsigned long long)(attempts - ids.size()));
+
+  start = clock_s();
+  for (uint32_t i = 0; i < LOOKUPS; i++) {
+    found += r.reserved(rnd(cfg.bays), T0 + rnd(week));
+  }
+  print("reserved(bay, t)", LOOKUPS, clock_s() - start);
+  printf("  %-28s %10.1f %% taken\n", "", 100.0 * found / LOOKUPS);
+
+  found = 0;
+  start = clock_s();
+  for (uint32_t i = 0; i < SEARCHES; i++) {
+    int64_t from = T0 + rnd(week - 8 * 3600);
+
+    int64_t bay = r.find_free(from, from + 3600 + rnd(7 * 3600), rnd(cfg.bays));
+
+    found += bay >= 0;
+    sink = bay;
+  }
+  print("find_free, booked site", SEARCHES, clock_s() - start);
+  printf("  %-28s %10.1f %% found\n", "", 100.0 * found / SEARCHES);
+
+  {
+    reservation_index full(cfg, T0);         // two hours, 16 bays left
+
+    for (uint32_t bay = 0; bay + 16 < cfg.bays; bay++) {
+      full.reserve(bay, T0 + 3600 * (bay & 1), T0 + 3600 * (bay & 1) + 3600 * 2);
+    }
+    start = clock_s();
+    for (uint32_t i = 0; i < SEARCHES / 16; i++) {
+      sink = full.find_free(T0 + 3600, T0 + 7200);
+    }
+    print("find_free, 16 bays left", SEARCHES / 16, clock_s() - start);
+  }
+
+  start = clock_s();
+  for (size_t i = 0; i < ids.size(); i += 2) {
+    r.cancel(ids[i]);
+  }
+  print("cancel", (ids.size() + 1) / 2, clock_s() - start);
+
+  start = clock_s();
+  for (int64_t t = T0; t < T0 + 24 * 3600; t += cfg.slot_s) {
+    r.advance(t);
+  }
+  printf("  %-28s %10.2f ms, %u held\n", "advance, a day", (clock_s() - start) * 1e3, r.count());
+  return 0;
+}
@@ -0,0 +1,141 @@
+/*
+ * LotManagement occupancy history benchmark
+ *
+ * Records a year of a site: every bay parks cars of a few minutes to a
+ * working day at random, busier by day than by night, as the occupancy
+ * filter of the monitors derives them from 10 measurements a second, and
+ * seals day by day. Reports the intervals recorded per second, the bytes
+ * per interval, and the intervals per second the queries go through: the
+ * totals of the site, of a zone and of a bay over the year, and the
+ * occupancy of the site in 15 minute buckets with its peak.
+ *
+ * usage: history_bench [bays [days]]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <vector>
+#include "occupancy_history.h"
+
+#define T0      1704067200                   // a midnight
+#define ROUNDS  8
+
+static volatile uint64_t sink;               // keeps the results alive
+static uint32_t seed = 1;
+
+static uint32_t rnd(uint32_t n) {
+  seed = seed * 1103515245 + 12345;
+  return (uint32_t)(((uint64_t)(seed >> 1) * n) >> 31);
+}
+
+static double clock_s(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Prints the rate of ROUNDS queries of intervals each, taking s in all
+static void print(const char *what, uint64_t intervals, double s, const char *more = "") {
+  printf("  %-28s %10.1f M intervals/s, %8.3f ms a query%s\n", what, intervals * ROUNDS / s / 1e6,
+         s * 1e3 / ROUNDS, more);
+}
+
+int main(int argc, char **argv) {
+  history_config cfg;
+  cfg.bays = argc > 1 ? strtoul(argv[1], NULL, 0) : 2000;
+  uint32_t days = argc > 2 ? strtoul(argv[2], NULL, 0) : 365;
+  cfg.begin = T0;
+  occupancy_history h(cfg);
+  std::vector<int64_t> next(cfg.bays);
+  std::vector<bool> occupied(cfg.bays);
+  std::vector<uint64_t> zone((cfg.bays + 63) / 64), profile;
+  const int64_t end = T0 + (int64_t)days * 86400;
+  uint64_t changes = 0;
+  double start;
+  char more[64];
+
+  if (!cfg.bays || !days) {
+    fprintf(stderr, "usage: history_bench [bays [days]]\n");
+    return 1;
+  }
+  printf("history_bench: %u bays, %u days of 10 Hz, path %s\n", cfg.bays, days, occupancy_history::path());
+  for (uint32_t bay = 0; bay < cfg.bays; bay++) {
+    next[bay] = T0 + rnd(3600);
+  }
+  start = clock_s();
+  for (int64_t day = T0; day < end; day += 86400) {
+    for (uint32_t bay = 0; bay < cfg.bays; bay++) {
+      while (next[bay] < day + 86400) {
+        int64_t t = next[bay];
+        uint32_t hour = (uint32_t)(t - day) / 3600;
+
+        occupied[bay] = !occupied[bay];
+        h.record(bay, t, occupied[bay]);
+        changes++;
+        if (occupied[bay]) {                 // minutes, hours or a working day
+          uint32_t kind = rnd(10);
+
+          next[bay] = t + (kind < 2   ? 60 + rnd(900)
+                           : kind < 8 ? 1800 + rnd(3 * 3600)
+                                      : 8 * 3600 + rnd(2 * 3600));
+        } else {                             // free for longer at night
+          next[bay] = t + 1 + rnd(hour >= 7 && hour < 20 ? 2 * 3600 : 8 * 3600);
+        }
+      }
+    }
+    h.seal(day + 86400);
+  }
+  double s = clock_s() - start;
+  printf("  %-28s %10.1f M changes/s, %8.2f ms, %llu intervals, %.1f bytes each\n", "record + seal",
+         changes / s / 1e6, s * 1e3, (unsigned long long)h.intervals(), (double)h.bytes() / h.intervals());
+  printf("  %-28s %10.1f G measurements, %.1f MB as 16 byte rows, %.1f MB stored\n", "",
+         10.0 * cfg.bays * days * 86400 / 1e9, h.intervals() * 16 / 1e6, h.bytes() / 1e6);
+
+  history_totals t = h.totals(T0, end);      // warm
+
+  start = clock_s();
+  for (int i = 0; i < ROUNDS; i++) {
+    t = h.totals(T0, end);
+    sink = t.occupied_s;
+  }
+  snprintf(more, sizeof(more), ", %.1f %% used, %.1f cars a bay a day", 100.0 * t.occupied_s / cfg.bays / (end - T0),
+           (double)t.arrivals / cfg.bays / days);
+  print("totals, site, year", t.intervals, clock_s() - start, more);
+
+  for (uint32_t bay = 0; bay < cfg.bays; bay += 8) {
+    zone[bay / 64] |= 1ull << bay % 64;
+  }
+  t = h.totals(T0, end, zone.data());
+  start = clock_s();
+  for (int i = 0; i < ROUNDS; i++) {
+    t = h.totals(T0, end, zone.data());
+    sink = t.occupied_s;
+  }
+  print("totals, zone of 1/8, year", t.intervals, clock_s() - start);
+
+  std::fill(zone.begin(), zone.end(), 0);
+  zone[0] = 1 << 5;
+  t = h.totals(T0, end, zone.data());
+  start = clock_s();
+  for (int i = 0; i < ROUNDS; i++) {
+    t = h.totals(T0, end, zone.data());
+    sink = t.occupied_s;
+  }
+  print("totals, one bay, year", t.intervals, clock_s() - start);
+
+  t = h.totals(T0, end);
+  h.profile(T0, end, 900, nullptr, profile);
+  start = clock_s();
+  for (int i = 0; i < ROUNDS; i++) {
+    h.profile(T0, end, 900, nullptr, profile);
+    sink = profile[0];
+  }
+  s = clock_s() - start;
+  history_peak p = h.peak(T0, end, 900);
+  snprintf(more, sizeof(more), ", peak %.0f bays at day %lld %02lld:%02lld", p.bays, (long long)(p.t - T0) / 86400,
+           (long long)(p.t - T0) % 86400 / 3600, (long long)(p.t - T0) % 3600 / 60);
+  print("profile, site, 15 min", t.intervals, s, more);
+  return 0;
+}
@@ -0,0 +1,202 @@
+/*
+ * LotManagement manager ring benchmark
+ *
+ * Drives running LotManagers split by a manager_ring on loopback, see
+ * test/scale.sh. First the rebalance: the ring starts without the last
+ * manager, every 7th monitor is reserved through the router, the last
+ * manager is added and the reserved monitors that moved are looked up on
+ * their new owner. Then the load: every thread plays single-bay nodes of a
+ * slice of the ids and sends their status to the owner as fast as it can,
+ * a datagram per status, for seconds. Reports the status the managers took
+ * over per second, from the updates in their STATS.
+ *
+ * usage: ring_bench -m address:udp:tcp [-m ...] [-n monitors] [-g group]
+ *                   [-v vnodes] [-t seconds] [-T threads]
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "lot_proto.h"
+#include "occupancy.h"
+#include "manager_router.h"
+
+#define BATCH  64                            // datagrams per sendmmsg
+
+static double clock_s(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Sum of the updates of all managers on the ring
+static uint64_t updates(manager_router &router) {
+  uint64_t sum = 0;
+
+  for (const std::string &s : router.each("STATS")) {
+    size_t at = s.find(" updates ");
+
+    if (at != std::string::npos) {
+      sum += strtoull(s.c_str() + at + 9, NULL, 10);
+    }
+  }
+  return sum;
+}
+
+//---------
+// Sends the status of the monitors first..last-1 round robin to their
+// owners until stop, counts the datagrams sent
+//----------
+static void blast(const manager_router &router, uint32_t first, uint32_t last, std::atomic<bool> *stop,
+                  std::atomic<uint64_t> *sent) {
+//----------
+  std::vector<sockaddr_in> to(last - first);
+  std::vector<uint8_t> seq(last - first);
+  uint8_t b[BATCH][LOT_HEADER_LEN + LOT_FRAME_LEN];
+  struct mmsghdr msgs[BATCH] = {};
+  struct iovec iovs[BATCH];
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  uint64_t n = 0;
+  uint32_t i = 0;
+
+  for (uint32_t id = first; id < last; id++) {
+    to[id - first] = router.udp(id);
+  }
+  while (!stop->load(std::memory_order_relaxed)) {
+    for (int k = 0; k < BATCH; k++, i = i + 1 < to.size() ? i + 1 : 0) {
+      lot_frame_set(lot_header_set(b[k], LOT_STATUS, 1), first + i, ++seq[i], OCCUPANCY_FREE, 0, 0);
+      iovs[k] = { b[k], sizeof(b[k]) };
+      msgs[k].msg_hdr.msg_name = &to[i];
+      msgs[k].msg_hdr.msg_namelen = sizeof(to[i]);
+      msgs[k].msg_hdr.msg_iov = &iovs[k];
+      msgs[k].msg_hdr.msg_iovlen = 1;
+    }
+    int r = sendmmsg(fd, msgs, BATCH, 0);
+
+    if (r > 0) {
+      n += r;
+    }
+  }
+  close(fd);
+  *sent += n;
+}
+
+static void usage(void) {
+  fprintf(stderr, "usage: ring_bench -m address:udp:tcp [-m ...] [-n monitors] [-g group]\n"
+                  "                  [-v vnodes] [-t seconds] [-T threads]\n");
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  std::vector<std::string> managers;
+  ring_config cfg;
+  double seconds = 5;
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  int opt;
+
+  while ((opt = getopt(argc, argv, "m:n:g:v:t:T:")) != -1) {
+    switch (opt) {
+    case 'm': managers.push_back(optarg); break;
+    case 'n': cfg.monitors = strtoul(optarg, NULL, 0); break;
+    case 'g': cfg.group = strtoul(optarg, NULL, 0); break;
+    case 'v': cfg.vnodes = strtoul(optarg, NULL, 0); break;
+    case 't': seconds = strtod(optarg, NULL); break;
+    case 'T': threads = strtoul(optarg, NULL, 0); break;
+    default: usage();
+    }
+  }
+  if (optind != argc || managers.empty() || !threads) {
+    usage();
+  }
+  try {
+    manager_router router(cfg);
+    std::vector<std::string> lines;
+    std::vector<uint16_t> reserved;
+    uint32_t most = 0;
+
+    printf("ring_bench: %zu managers, %u monitors, group %u, %u points each\n", managers.size(), cfg.monitors,
+           cfg.group, cfg.vnodes);
+    for (size_t m = 0; m + 1 < managers.size(); m++) {
+      router.add(managers[m]);
+    }
+    if (managers.size() > 1) {
+      for (uint32_t id = 0; id < cfg.monitors; id += 7) {
+        lines.push_back("RESERVE " + std::to_string(id) + " 1");
+      }
+      router.ask(lines);
+    }
+    std::vector<uint16_t> owner(cfg.monitors);
+
+    for (uint32_t id = 0; id < cfg.monitors; id++) {
+      owner[id] = router.ring().owner(id);
+    }
+    double start = clock_s();
+    rebalance_result r = router.add(managers.back());
+    double s = clock_s() - start;
+
+    if (managers.size() > 1) {
+      uint32_t found = 0;
+
+      lines.clear();
+      for (uint32_t id = 0; id < cfg.monitors; id += 7) {
+        if (router.ring().owner(id) != owner[id]) {
+          reserved.push_back(id);
+          lines.push_back("GET " + std::to_string(id));
+        }
+      }
+      for (const std::string &a : router.ask(lines)) {
+        unsigned yes;
+
+        found += sscanf(a.c_str(), "STATUS %*u %*u %*u %u", &yes) == 1 && yes;
+      }
+      printf("  %-12s moved %u monitors, %.1f %% (1/%zu is %.1f %%), %u reservations carried, %u lost, "
+             "%u of %zu found, %.1f ms\n", "rebalance", r.moved, 100.0 * r.moved / cfg.monitors, managers.size(),
+             100.0 / managers.size(), r.reserved, r.lost, found, reserved.size(), s * 1e3);
+      lines.clear();
+      for (uint32_t id = 0; id < cfg.monitors; id += 7) {
+        lines.push_back("RESERVE " + std::to_string(id) + " 0");
+      }
+      router.ask(lines);
+    }
+    for (uint16_t m = 0; m < managers.size(); m++) {
+      most = std::max(most, router.ring().load(m));
+    }
+    printf("  %-12s busiest manager %u monitors, %.2f of its share\n", "balance", most,
+           (double)most * managers.size() / cfg.monitors);
+
+    std::atomic<bool> stop(false);
+    std::atomic<uint64_t> sent(0);
+    std::vector<std::thread> blasters;
+    uint64_t taken = updates(router);
+
+    start = clock_s();
+    for (unsigned t = 0; t < threads; t++) {
+      blasters.emplace_back(blast, std::cref(router), cfg.monitors * t / threads, cfg.monitors * (t + 1) / threads,
+                            &stop, &sent);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds((long)(seconds * 1000)));
+    stop = true;
+    for (std::thread &t : blasters) {
+      t.join();
+    }
+    s = clock_s() - start;
+    std::this_thread::sleep_for(std::chrono::milliseconds(200)); // the managers drain
+    taken = updates(router) - taken;
+    printf("  %-12s sent %.0f /s, taken %.0f /s (%.1f %%)\n", "status", sent / s, taken / s,
+           sent ? 100.0 * taken / sent : 0);
+  } catch (const std::system_error &e) {
+    fprintf(stderr, "ring_bench: %s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
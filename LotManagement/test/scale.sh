@@ -0,0 +1,56 @@
+#!/bin/sh
+#
+# LotManagement manager ring scaling benchmark
+#
+# Runs 1, 2, 4 .. LotManagers on loopback, up to the cores of the host and
+# at least 4, splits 65536 single-bay monitors across them with the ring and
+# has test/ring_bench reserve, rebalance and send their status to the
+# owners for seconds. Prints the status per second all managers took over,
+# the share of the status sent and the status taken per second of manager
+# CPU: with a core per manager the total grows with the managers until the
+# senders run out, on fewer cores the status per CPU second shows what a
+# core each would take.
+#
+# usage: test/scale.sh [seconds]
+
+SECONDS_RUN=${1:-5}
+CORES=$(nproc)
+MAX=$((CORES > 4 ? CORES : 4))
+HZ=$(getconf CLK_TCK)
+LOTMANAGER=../LotManager/lotmanager
+PORT=7500
+
+# CPU ticks of process $1, user and system
+ticks() {
+  awk '{ print $14 + $15 }' /proc/$1/stat
+}
+
+printf '%8s %14s %14s %8s %14s\n' managers sent/s taken/s taken taken/cpu-s
+managers=1
+while [ $managers -le $MAX ]; do
+  m=0
+  pids=
+  args=
+  while [ $m -lt $managers ]; do
+    $LOTMANAGER -a 127.0.0.1 -u $PORT -t $((PORT + 1)) -n 65536 -s 60000 2>/dev/null &
+    pids="$pids $!"
+    args="$args -m 127.0.0.1:$PORT:$((PORT + 1))"
+    PORT=$((PORT + 2))
+    m=$((m + 1))
+  done
+  sleep 0.3
+  ./ring_bench $args -t "$SECONDS_RUN" > /tmp/lotmanagement_scale
+  cpu=0
+  for pid in $pids; do
+    cpu=$((cpu + $(ticks $pid)))
+    kill $pid
+  done
+  wait $pids 2>/dev/null
+  awk -v managers=$managers -v cpu=$cpu -v hz=$HZ -v s="$SECONDS_RUN" '
+    /^  status/ { sent = $3; taken = $6 }
+    END { printf "%8d %14.0f %14.0f %7.1f%% %14.0f\n", managers, sent, taken, sent ? 100 * taken / sent : 0,
+                 cpu ? taken * s / (cpu / hz) : 0 }' /tmp/lotmanagement_scale
+  grep -v '^  status\|^ring_bench' /tmp/lotmanagement_scale
+  rm -f /tmp/lotmanagement_scale
+  managers=$((managers * 2))
+done
@@ -0,0 +1,510 @@
+/*
+ * LotManagement tests
+ *
+ * The router is tested against LotManagers (../LotManager) running in the
+ * test on loopback, each on a thread of its own.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <vector>
+#include "bay_map.h"
+#include "cluster.h"
+#include "manager_ring.h"
+#include "manager_router.h"
+#include "occupancy_history.h"
+#include "reservation_index.h"
+
+static int failures;
+
+#define CHECK(cond) do { if (!(cond)) { \
+  printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+  failures++; } } while (0)
+
+#define T0 1700000100                        // a slot boundary of 15 minutes
+
+static void test_reserve(void) {
+  reservation_config cfg;
+  cfg.bays = 100;
+  reservation_index r(cfg, T0 + 60);
+  uint64_t a, b;
+
+  CHECK(r.begin() == T0 && r.end() == T0 + 7 * 24 * 3600);
+  CHECK((a = r.reserve(5, T0 + 3600, T0 + 7200)) != 0);
+  CHECK(r.reserved(5, T0 + 3600) && r.reserved(5, T0 + 7199) && !r.reserved(5, T0 + 7200));
+  CHECK(!r.reserved(5, T0 + 3599) && !r.reserved(6, T0 + 3600));
+  CHECK(!r.reserve(5, T0 + 7000, T0 + 8000)); // overlaps
+  CHECK((b = r.reserve(5, T0 + 7200, T0 + 7300)) != 0); // widened to the slot
+  CHECK(r.reserved(5, T0 + 8099) && !r.reserved(5, T0 + 8100));
+  CHECK(!r.reserve(100, T0, T0 + 900));      // no such bay
+  CHECK(!r.reserve(1, T0, r.end() + 1));     // beyond the horizon
+  CHECK(!r.reserve(1, T0 + 900, T0 + 900));
+  CHECK(r.reserve(1, T0 - 5000, T0 + 10) && r.reserved(1, T0)); // from now on
+  CHECK(r.count() == 3);
+  CHECK(r.cancel(a) && !r.cancel(a) && !r.reserved(5, T0 + 3600) && r.reserved(5, T0 + 7200));
+  CHECK(r.reserve(5, T0 + 3600, T0 + 7200) && r.count() == 3);
+
+  CHECK(r.advance(T0 + 7300) == 2);          // bay 1 and the first of bay 5 over
+  CHECK(r.begin() == T0 + 7200 && r.count() == 1 && r.reserved(5, T0 + 7200));
+  CHECK(!r.reserved(1, T0) && r.reserve(1, T0 + 7 * 24 * 3600, T0 + 7 * 24 * 3600 + 900));
+  CHECK(r.cancel(b) && r.count() == 1);
+}
+
+static void test_find_free(void) {
+  reservation_config cfg;
+  cfg.bays = 10000;
+  reservation_index r(cfg, T0);
+
+  CHECK(r.find_free(T0, T0 + 900) == 0);
+  for (uint32_t bay = 0; bay < 9000; bay++) {  // groups full at different times
+    CHECK(r.reserve(bay, T0 + (bay % 2) * 3600, T0 + (bay % 2) * 3600 + 3600));
+  }
+  CHECK(r.find_free(T0, T0 + 900) == 1);
+  CHECK(r.find_free(T0, T0 + 7200) == 9000);
+  CHECK(r.find_free(T0 + 7200, T0 + 9000) == 0);
+  CHECK(r.find_free(T0, T0 + 900, 4000) == 4001);
+  CHECK(r.find_free(T0, T0 + 900, 9999) == 9999);
+  for (uint32_t bay = 9000; bay < 10000; bay++) {
+    r.reserve(bay, T0, T0 + 3600);
+  }
+  CHECK(r.find_free(T0 + 1800, T0 + 5400) == -1);
+  CHECK(r.find_free(T0 + 3600, T0 + 5400) == 0);
+  CHECK(r.find_free(T0, r.end() + 1) == -1);
+}
+
+//---------
+// Random reservations, cancellations and moves of the horizon against a
+// plain table of slots, on a site with a partly used last word.
+//----------
+static void test_random(void) {
+//----------
+  reservation_config cfg;
+  cfg.bays = 200;
+  cfg.slot_s = 60;
+  cfg.horizon = 50;
+  int64_t now = 6000;
+  reservation_index r(cfg, now);
+  std::vector<std::vector<uint64_t>> model(cfg.bays); // by bay, id per absolute slot
+  std::vector<uint64_t> ids;
+  uint32_t seed = 7;
+  auto rnd = [&](uint32_t n) { seed = seed * 1103515245 + 12345; return (seed >> 8) % n; };
+
+  for (auto &m : model) {
+    m.assign(1000, 0);
+  }
+  for (int step = 0; step < 20000; step++) {
+    int64_t from = now + rnd(60 * 60) - 300, to = from + 1 + rnd(60 * 10);
+    uint32_t bay = rnd(cfg.bays);
+    int op = rnd(10);
+
+    if (op < 5) {
+      bool fits = to <= r.end() && to > r.begin();
+      int64_t s1 = std::max(from, r.begin()) / 60, s2 = (to - 1) / 60;
+
+      for (int64_t s = s1; fits && s <= s2; s++) {
+        fits = !model[bay][s];
+      }
+      uint64_t id = r.reserve(bay, from, to);
+
+      CHECK(!!id == fits);
+      for (int64_t s = s1; id && s <= s2; s++) {
+        model[bay][s] = id;
+      }
+      if (id) {
+        ids.push_back(id);
+      }
+    } else if (op < 7 && !ids.empty()) {
+      size_t i = rnd(ids.size());
+      bool held = false;
+
+      for (auto &m : model) {
+        for (int64_t s = r.begin() / 60; s < r.end() / 60; s++) {
+          if (m[s] == ids[i]) {
+            m[s] = 0;
+            held = true;
+          }
+        }
+      }
+      CHECK(r.cancel(ids[i]) == held);
+      ids.erase(ids.begin() + i);
+    } else if (op < 9) {
+      int64_t expect = -1;
+      uint32_t first = rnd(cfg.bays);
+
+      for (uint32_t b = first; b < cfg.bays && expect < 0 && to <= r.end() && to > r.begin(); b++) {
+        bool free = true;
+
+        for (int64_t s = std::max(from, r.begin()) / 60; free && s <= (to - 1) / 60; s++) {
+          free = !model[b][s];
+        }
+        expect = free ? (int64_t)b : -1;
+      }
+      CHECK(r.find_free(from, to, first) == expect);
+      CHECK(r.reserved(bay, from) == (from >= r.begin() && from < r.end() && model[bay][from / 60]));
+    } else if (now < 50000) {
+      now += rnd(120);
+      r.advance(now);
+    }
+  }
+}
+
+static void test_nearest(void) {
+  std::vector<bay_position> row;
+  uint32_t found[4];
+  float d[4];
+
+  for (int level = 0; level < 2; level++) {  // 0..99 below, 100..199 above
+    for (int i = 0; i < 100; i++) {
+      row.push_back({2.5f * i, 0, (uint16_t)level});
+    }
+  }
+  bay_map m(row);
+
+  CHECK(m.size() == 200 && m.free() == 0 && m.nearest_free({0, 0, 0}, 4, found) == 0);
+  m.set_free(90, true);
+  m.set_free(150, true);
+  m.set_free(5, true);
+  m.set_free(5, true);
+  CHECK(m.free() == 3 && m.is_free(5) && !m.is_free(6));
+  CHECK(m.nearest_free({0, 0, 0}, 4, found, d) == 3);
+  CHECK(found[0] == 5 && found[1] == 150 && found[2] == 90);  // 12.5, 40 + 125, 225 m
+  CHECK(std::abs(d[0] - 12.5f) < 1e-3 && std::abs(d[1] - 165) < 1e-3);
+  CHECK(m.nearest_free({130, 0, 1}, 1, found) == 1 && found[0] == 150);
+  m.set_free(150, false);
+  CHECK(m.nearest_free({130, 0, 1}, 1, found) == 1 && found[0] == 90);
+}
+
+//---------
+// Random garages, bays freed and taken at random, against the distances of
+// all free bays sorted.
+//----------
+static void test_nearest_random(void) {
+//----------
+  uint32_t seed = 3;
+  auto rnd = [&](uint32_t n) { seed = seed * 1103515245 + 12345; return (seed >> 8) % n; };
+  std::vector<bay_position> bays;
+  bay_map_config cfg;
+  cfg.cell_m = 5;
+  cfg.level_m = 30;
+
+  for (int i = 0; i < 3000; i++) {
+    bays.push_back({(float)rnd(30000) / 100, (float)rnd(12000) / 100, (uint16_t)rnd(4)});
+  }
+  bay_map m(bays, cfg);
+  std::vector<bool> free(bays.size());
+
+  for (int round = 0; round < 300; round++) {
+    for (int i = 0; i < 100; i++) {
+      uint32_t b = rnd(bays.size());
+
+      free[b] = rnd(100) < (round < 150 ? 30 : 3);
+      m.set_free(b, free[b]);
+    }
+    bay_position from = {(float)rnd(32000) / 100 - 10, (float)rnd(12000) / 100, (uint16_t)rnd(4)};
+    std::vector<float> all;
+    uint32_t found[8];
+    float d[8];
+    uint32_t n = m.nearest_free(from, 8, found, d);
+
+    for (uint32_t b = 0; b < bays.size(); b++) {
+      if (free[b]) {
+        all.push_back(m.distance(from, bays[b]));
+      }
+    }
+    std::sort(all.begin(), all.end());
+    CHECK(n == std::min<size_t>(8, all.size()));
+    for (uint32_t i = 0; i < n; i++) {
+      CHECK(free[found[i]] && std::abs(d[i] - all[i]) < 1e-3);
+    }
+  }
+}
+
+//---------
+// A few intervals by hand: cut at the end of a day, continued in the next
+//----------
+static void test_history(void) {
+//----------
+  history_config cfg;
+  cfg.bays = 10;
+  cfg.begin = T0;
+  occupancy_history h(cfg);
+  uint64_t zone = 1 << 3;
+  std::vector<uint64_t> p;
+
+  CHECK(h.record(3, T0 + 3600, true) && h.record(3, T0 + 7200, false));
+  CHECK(h.record(3, T0 + 80000, true) && h.add(4, T0 + 100, T0 + 200) && !h.add(10, T0, T0 + 1));
+  h.seal(T0 + 86400 + 10);
+  CHECK(h.sealed() == T0 + 86400 && h.intervals() == 3 && !h.record(3, T0 + 86399, false));
+  CHECK(h.record(3, T0 + 90000, false));
+  h.seal(T0 + 2 * 86400);
+  history_totals t = h.totals(T0, T0 + 2 * 86400, &zone);
+  CHECK(t.occupied_s == 3600 + 10000 && t.arrivals == 2 && t.intervals == 3);
+  t = h.totals(T0 + 86400, T0 + 2 * 86400);
+  CHECK(t.occupied_s == 3600 && t.arrivals == 0);
+  t = h.totals(T0 + 5400, T0 + 86400 + 100);
+  CHECK(t.occupied_s == 1800 + 6400 + 100 && t.arrivals == 1);
+  h.profile(T0, T0 + 4 * 3600, 3600, &zone, p);
+  CHECK(p.size() == 4 && p[0] == 0 && p[1] == 3600 && p[2] == 0);
+  history_peak k = h.peak(T0 + 79200, T0 + 93600, 3600, &zone);
+  CHECK(k.t == T0 + 82800 && k.bays == 1.0);
+}
+
+//---------
+// Random stays of minutes to days through record(), sealed day by day,
+// against the plain intervals
+//----------
+static void test_history_random(void) {
+//----------
+  uint32_t seed = 5;
+  auto rnd = [&](uint32_t n) { seed = seed * 1103515245 + 12345; return (seed >> 8) % n; };
+  history_config cfg;
+  cfg.bays = 200;
+  cfg.begin = T0;
+  cfg.block_s = 6 * 3600;
+  occupancy_history h(cfg);
+  struct stay { uint32_t bay; int64_t start, end; };
+  std::vector<stay> stays;
+  std::vector<std::pair<int64_t, int>> events; // t, bay * 2 + occupied
+  const int64_t end = T0 + 20 * cfg.block_s;
+
+  for (uint32_t bay = 0; bay < cfg.bays; bay++) {
+    for (int64_t t = T0 + rnd(7200); t < end;) {
+      int64_t d = rnd(8) ? 60 + rnd(4 * 3600) : rnd(3 * 86400);
+      stays.push_back({bay, t, std::min(t + d + 1, end)});
+      events.push_back({t, (int)bay * 2 + 1});
+      if (t + d + 1 < end) {
+        events.push_back({t + d + 1, (int)bay * 2});
+      }
+      t += d + 1 + 1 + rnd(3 * 3600);
+    }
+  }
+  std::sort(events.begin(), events.end());
+  for (auto &e : events) {
+    h.seal(e.first);
+    CHECK(h.record(e.second / 2, e.first, e.second & 1));
+  }
+  h.seal(end);
+  CHECK(h.sealed() == end);
+
+  std::vector<uint64_t> zone((cfg.bays + 63) / 64), p;
+
+  for (int round = 0; round < 200; round++) {
+    int64_t from = T0 - 100 + rnd(21 * cfg.block_s), to = from + rnd(4 * cfg.block_s);
+    uint32_t bucket = 60 + rnd(7200);
+    uint64_t occupied = 0, arrivals = 0;
+    std::vector<uint64_t> expect((to - from + bucket - 1) / bucket);
+    bool all = rnd(4) == 0;
+
+    for (uint32_t b = 0; b < cfg.bays; b++) {
+      zone[b / 64] = (zone[b / 64] & ~(1ull << b % 64)) | (uint64_t)(rnd(3) == 0) << b % 64;
+    }
+    for (auto &s : stays) {
+      if (!all && !(zone[s.bay / 64] >> s.bay % 64 & 1)) {
+        continue;
+      }
+      occupied += std::max<int64_t>(0, std::min(s.end, to) - std::max(s.start, from));
+      arrivals += s.start >= from && s.start < to;
+      for (size_t i = 0; i < expect.size(); i++) {
+        int64_t b0 = from + (int64_t)i * bucket, b1 = std::min<int64_t>(b0 + bucket, to);
+        expect[i] += std::max<int64_t>(0, std::min(s.end, b1) - std::max(s.start, b0));
+      }
+    }
+    history_totals t = h.totals(from, to, all ? nullptr : zone.data());
+    h.profile(from, to, bucket, all ? nullptr : zone.data(), p);
+    CHECK(t.occupied_s == occupied && t.arrivals == arrivals);
+    CHECK(p == expect);
+  }
+}
+
+static void test_ring(void) {
+  ring_config cfg;
+  manager_ring r(cfg), back(cfg);
+  const char *names[] = { "10.0.0.1:7300:7301", "10.0.0.2:7300:7301", "10.0.0.3:7300:7301",
+                          "10.0.0.4:7300:7301", "10.0.0.5:7300:7301", "10.0.0.6:7300:7301",
+                          "10.0.0.7:7300:7301", "10.0.0.8:7300:7301" };
+  std::vector<ring_move> moves;
+  std::vector<std::string> before(cfg.monitors);
+  bool only_new = true, unchanged = true, same = true;
+  uint32_t most = 0, load = 0;
+
+  CHECK(r.owner(0) == RING_NONE && r.managers() == 0);
+  moves = r.add(names[0]);
+  CHECK(moves.size() == cfg.monitors && r.load(0) == cfg.monitors && r.owner(65535) == 0);
+  CHECK(moves[0].from == RING_NONE && moves[0].to == 0);
+  CHECK(r.add(names[0]).empty() && r.managers() == 1);
+  for (uint16_t m = 1; m < 8; m++) {         // about 1/n moves, all to the new one
+    moves = r.add(names[m]);
+    CHECK(r.find(names[m]) == m);
+    CHECK(moves.size() > cfg.monitors / (m + 1) * 3 / 4 && moves.size() < cfg.monitors / (m + 1) * 5 / 4);
+    for (const ring_move &x : moves) {
+      only_new &= x.to == m && x.from < m;
+    }
+  }
+  CHECK(only_new);
+  for (uint16_t m = 0; m < 8; m++) {
+    most = std::max(most, r.load(m));
+    load += r.load(m);
+  }
+  CHECK(load == cfg.monitors && most < cfg.monitors / 8 * 5 / 4);
+
+  for (int m = 7; m >= 0; m--) {             // the order doesn't matter
+    back.add(names[m]);
+  }
+  for (uint32_t id = 0; id < cfg.monitors; id++) {
+    before[id] = r.name(r.owner(id));
+    same &= back.name(back.owner(id)) == before[id];
+  }
+  CHECK(same);
+
+  load = r.load(2);                          // only the ones of the removed move
+  moves = r.remove(names[2]);
+  CHECK(moves.size() == load && r.find(names[2]) == RING_NONE && r.managers() == 7 && r.load(2) == 0);
+  for (uint32_t id = 0; id < cfg.monitors; id++) {
+    unchanged &= before[id] == names[2] ? r.owner(id) != 2 : r.name(r.owner(id)) == before[id];
+  }
+  for (const ring_move &x : moves) {
+    unchanged &= x.from == 2 && x.to != 2 && x.to != RING_NONE;
+  }
+  CHECK(unchanged);
+  moves = r.add("10.0.0.9:7300:7301");       // takes the unused number
+  CHECK(r.find("10.0.0.9:7300:7301") == 2);
+
+  cfg.group = 4;                             // the bays of a node stay together
+  manager_ring g(cfg);
+  bool together = true;
+
+  for (uint16_t m = 0; m < 5; m++) {
+    g.add(names[m]);
+  }
+  for (uint32_t id = 0; id < cfg.monitors; id++) {
+    together &= g.owner(id) == g.owner(id & ~3u);
+  }
+  CHECK(together && g.owner(cfg.monitors) == RING_NONE);
+
+  cfg.vnodes = 0;
+  bool thrown = false;
+  try {
+    manager_ring bad(cfg);
+  } catch (const std::system_error &) {
+    thrown = true;
+  }
+  CHECK(thrown);
+}
+
+//---------
+// Three LotManagers behind a router: a batch spanning them is answered in
+// order, the reservations move with the monitors when a manager comes and
+// goes, and the commands for a manager not answering or gone are answered
+// with an error, the others as ever.
+//----------
+static void test_router(void) {
+//----------
+  manager_config mc;
+  ring_config rc;
+  std::unique_ptr<cluster> managers[3];
+  std::string names[3];
+  std::vector<std::string> all, some, answers;
+  rebalance_result r;
+  uint32_t load, reserved;
+  bool ok = true;
+
+  mc.address = "127.0.0.1";
+  mc.udp_port = mc.tcp_port = 0;
+  mc.monitors = rc.monitors = 4096;
+  for (int m = 0; m < 3; m++) {
+    managers[m].reset(new cluster(mc));     // of one shard, on its thread
+    managers[m]->start();
+    names[m] = "127.0.0.1:" + std::to_string(managers[m]->udp_port()) + ":" +
+               std::to_string(managers[m]->tcp_port());
+  }
+  manager_router router(rc, 200);
+  auto status = [&](uint32_t id) {           // never reported, every 3rd reserved
+    return "STATUS " + std::to_string(id) + " 0 0 " + (id % 3 ? "0" : "1") + " 0 ";
+  };
+  auto in_order = [&](const std::vector<std::string> &a) {
+    bool same = a.size() == all.size();
+
+    for (uint32_t id = 0; same && id < a.size(); id++) {
+      same = a[id].rfind(status(id), 0) == 0;
+    }
+    return same;
+  };
+
+  router.add(names[0]);
+  router.add(names[1]);
+  for (uint32_t id = 0; id < rc.monitors; id++) {
+    all.push_back("GET " + std::to_string(id));
+    if (id % 3 == 0) {
+      some.push_back("RESERVE " + std::to_string(id) + " 1");
+    }
+  }
+  for (const std::string &a : router.ask(some)) {
+    ok &= a == "OK";
+  }
+  CHECK(ok);
+  CHECK(in_order(router.ask(all)));          // windows of both, interleaved
+
+  r = router.add(names[2]);
+  load = router.ring().load(2);
+  reserved = 0;
+  for (uint32_t id = 0; id < rc.monitors; id += 3) {
+    reserved += router.ring().owner(id) == 2;
+  }
+  CHECK(r.moved == load && r.reserved == reserved && reserved > 0 && r.lost == 0);
+  CHECK(in_order(router.ask(all)));
+
+  load = router.ring().load(0);
+  reserved = 0;
+  for (uint32_t id = 0; id < rc.monitors; id += 3) {
+    reserved += router.ring().owner(id) == 0;
+  }
+  uint32_t back = 0;                         // reserved, leaves and comes back
+  while (router.ring().owner(back) != 0) {
+    back += 3;
+  }
+  r = router.remove(names[0]);
+  CHECK(r.moved == load && r.reserved == reserved && reserved > 0 && r.lost == 0);
+  CHECK(router.ring().load(0) == 0 && in_order(router.ask(all)));
+
+  CHECK(router.ask("RESERVE " + std::to_string(back) + " 0") == "OK");
+  r = router.add(names[0]);                  // the same points again
+  CHECK(router.ring().owner(back) == 0 && r.lost == 0);
+  CHECK(router.ask("GET " + std::to_string(back)).rfind("STATUS " + std::to_string(back) + " 0 0 0 0 ", 0) == 0);
+  CHECK(router.ask("RESERVE " + std::to_string(back) + " 1") == "OK");
+  CHECK(in_order(router.ask(all)));
+
+  all.resize(600);                           // a window or two for each
+  auto unreachable = [&] {
+    answers = router.ask(all);
+    bool right = true;
+
+    for (uint32_t id = 0; id < all.size(); id++) {
+      right &= router.ring().owner(id) == 1 ? answers[id] == "ERROR manager unreachable"
+                                            : answers[id].rfind(status(id), 0) == 0;
+    }
+    return right;
+  };
+  managers[1]->stop();                       // connected, but silent
+  CHECK(unreachable());
+  managers[1].reset();                       // gone
+  CHECK(unreachable());
+}
+
+int main(void) {
+  test_reserve();
+  test_find_free();
+  test_random();
+  test_nearest();
+  test_nearest_random();
+  test_history();
+  test_history_random();
+  test_ring();
+  test_router();
+  printf("%s\n", failures ? "FAILED" : "OK");
+  return failures != 0;
+}
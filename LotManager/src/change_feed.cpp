@@ -0,0 +1,59 @@
+/*
+ * LotManager change feed, see change_feed.h
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include "change_feed.h"
+
+change_feed::change_feed(uint32_t monitors, uint32_t window_ms, uint32_t credits)
+  : slot_(monitors), window_ms_(window_ms), credits_(credits) {
+}
+
+int change_feed::add(const monitor_change &c) {
+  if (c.id >= slot_.size()) {
+    return 0;
+  }
+  if (slot_[c.id]) {
+    queue_[slot_[c.id] - 1] = c;             // keeps its place in line
+    return 1;
+  }
+  queue_.push_back(c);
+  slot_[c.id] = (uint32_t)queue_.size();
+  return 0;
+}
+
+//---------
+// This function formats a batch. The queue is compacted once half of it
+// went out, the indexes of the rest move with it.
+//----------
+uint32_t change_feed::batch(std::string &out) {
+//----------
+  uint32_t n = std::min<uint32_t>(depth(), FEED_BATCH);
+  char b[32];
+
+  if (!n || !credits_) {
+    return 0;
+  }
+  credits_--;
+  out.append(b, snprintf(b, sizeof(b), "DELTA %llu %u", (unsigned long long)seq_++, n));
+  for (uint32_t i = head_; i < head_ + n; i++) {
+    const monitor_change &c = queue_[i];
+
+    out.append(b, snprintf(b, sizeof(b), " %u %u %u %u", c.id, c.state, c.distance_cm, c.online));
+    slot_[c.id] = 0;
+  }
+  out += '\n';
+  head_ += n;
+  if (head_ == queue_.size()) {
+    queue_.clear();
+    head_ = 0;
+  } else if (head_ > queue_.size() / 2) {
+    queue_.erase(queue_.begin(), queue_.begin() + head_);
+    head_ = 0;
+    for (uint32_t i = 0; i < queue_.size(); i++) {
+      slot_[queue_[i].id] = i + 1;
+    }
+  }
+  return n;
+}
@@ -0,0 +1,62 @@
+/*
+ * LotManager change feed
+ *
+ * The changes of the monitors for one LotManagement connection, coalesced
+ * and paced by the client (FEED in manager.h). A change waits in the feed
+ * for window_ms; a later change of the same monitor meanwhile replaces it
+ * in place, so a bay flapping or a lot emptying at the end of a shift costs
+ * one delta per bay, not one per state. The queued changes go out in
+ * batches of up to FEED_BATCH deltas, one line each:
+ *
+ *   DELTA seq n id state distance_cm online ...
+ *
+ * Every batch takes a credit the client granted. A client out of credits,
+ * or with its socket full, gets nothing more while the feed keeps taking
+ * changes: the queue holds at most one delta per monitor, so a slow client
+ * neither stalls the manager nor grows its memory, it just gets coarser
+ * news.
+ */
+
+#ifndef CHANGE_FEED_H_
+#define CHANGE_FEED_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define FEED_BATCH  256                      // deltas per DELTA line
+
+struct monitor_change {
+  uint16_t id;
+  uint8_t  state;
+  uint8_t  online;
+  uint16_t distance_cm;
+};
+
+class change_feed {
+public:
+  change_feed(uint32_t monitors, uint32_t window_ms, uint32_t credits);
+
+  uint32_t window_ms() const { return window_ms_; }
+  void window_ms(uint32_t ms) { window_ms_ = ms; }
+  uint32_t credits() const { return credits_; }
+  void grant(uint32_t n) { credits_ = n > UINT32_MAX - credits_ ? UINT32_MAX : credits_ + n; }
+  uint32_t depth() const { return (uint32_t)(queue_.size() - head_); }
+
+  // Queues c, returns 1 if it replaced a queued change of the same monitor.
+  int add(const monitor_change &c);
+
+  // Appends the oldest queued changes as one DELTA line to out for a
+  // credit. Returns their number, 0 without changes or credits.
+  uint32_t batch(std::string &out);
+
+private:
+  std::vector<uint32_t> slot_;               // by id, index in queue_ + 1, 0 = not queued
+  std::vector<monitor_change> queue_;        // oldest first from head_
+  uint32_t head_ = 0;
+  uint32_t window_ms_;
+  uint32_t credits_;
+  uint64_t seq_ = 0;                         // batches sent
+};
+
+#endif /* CHANGE_FEED_H_ */
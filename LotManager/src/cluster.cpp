@@ -0,0 +1,67 @@
+/*
+ * LotManager cluster, see cluster.h
+ */
+
+#include <sys/epoll.h>
+#include "cluster.h"
+
+cluster::cluster(const manager_config &cfg)
+  : span_((cfg.monitors + std::max(cfg.shards, 1u) - 1) / std::max(cfg.shards, 1u)),
+    pool_(std::max(cfg.shards, 1u)), watchers_(new std::atomic<uint32_t>[pool_.size()]) {
+  manager_config c = cfg;
+
+  c.shards = pool_.size();
+  for (unsigned i = 0; i < c.shards; i++) {
+    c.shard = i;
+    loops_.emplace_back(new event_loop);
+    shards_.emplace_back(new manager(*loops_[i], c));
+    c.udp_port = shards_[0]->udp_port();     // the others join its ports
+    c.tcp_port = shards_[0]->tcp_port();
+    watchers_[i] = 0;
+    loops_[i]->add(pool_.wake_fd(i), EPOLLIN, [](uint32_t) {}); // read by run()
+  }
+  for (auto &m : shards_) {
+    m->attach(*this);
+  }
+}
+
+cluster::~cluster() {
+  stop();
+  for (unsigned i = size(); i-- > 0; ) {
+    loops_[i]->remove(pool_.wake_fd(i));
+    shards_[i].reset();
+  }
+}
+
+void cluster::start() {
+  stop_ = false;
+  for (unsigned i = 0; i < size(); i++) {
+    threads_.emplace_back([this, i] { run(i); });
+  }
+}
+
+void cluster::stop() {
+  stop_ = true;
+  for (unsigned i = 0; i < threads_.size(); i++) {
+    pool_.post(i, [] {});                    // wakes it up
+  }
+  for (std::thread &t : threads_) {
+    t.join();
+  }
+  threads_.clear();
+}
+
+//---------
+// The loop of shard i: its sockets and timers, then the jobs of the pool
+//----------
+void cluster::run(unsigned i) {
+//----------
+  event_loop &loop = *loops_[i];
+
+  while (!stop_) {
+    pool_.idle(i, true);
+    loop.poll(100);
+    pool_.idle(i, false);
+    pool_.run(i);
+  }
+}
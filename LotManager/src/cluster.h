@@ -0,0 +1,66 @@
+/*
+ * LotManager cluster
+ *
+ * One manager per core, each a shard with its own event loop, thread,
+ * sockets and monitor table of its own ids only. All shards bind the same
+ * UDP and TCP ports with SO_REUSEPORT. Shard i owns the monitor ids
+ * i * span .. (i + 1) * span - 1, and a classic BPF program on the UDP group
+ * steers a datagram to the shard owning the id of its first frame, so a
+ * node's status lands where its bays are kept; only a node straddling two
+ * ranges costs a hop through the work pool. TCP connections are spread
+ * over the shards by the kernel, a command about a foreign monitor is
+ * answered by its owner.
+ *
+ * The shard threads run the jobs of the work pool (work_pool.h) between the
+ * rounds of their loops.
+ */
+
+#ifndef CLUSTER_H_
+#define CLUSTER_H_
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "event_loop.h"
+#include "manager.h"
+#include "work_pool.h"
+
+class cluster {
+public:
+  // Binds cfg.shards managers to the ports of cfg, 0 = any for all.
+  explicit cluster(const manager_config &cfg);
+  ~cluster();
+  cluster(const cluster &) = delete;
+  cluster &operator=(const cluster &) = delete;
+
+  void start();                              // a thread per shard
+  void stop();                               //   joined
+
+  unsigned size() const { return (unsigned)shards_.size(); }
+  uint16_t udp_port() const { return shards_[0]->udp_port(); }
+  uint16_t tcp_port() const { return shards_[0]->tcp_port(); }
+  uint32_t span() const { return span_; }
+  unsigned owner(uint32_t id) const { return std::min(id / span_, size() - 1); }
+
+  // A shard may only be touched from its own thread, or while stopped.
+  manager &shard(unsigned i) { return *shards_[i]; }
+  work_pool &pool() { return pool_; }
+
+  // WATCH clients of shard i, the changes skip shards without any
+  std::atomic<uint32_t> &watchers(unsigned i) { return watchers_[i]; }
+
+private:
+  void run(unsigned i);
+
+  uint32_t span_;
+  work_pool pool_;
+  std::vector<std::unique_ptr<event_loop>> loops_;
+  std::vector<std::unique_ptr<manager>> shards_;
+  std::unique_ptr<std::atomic<uint32_t>[]> watchers_;
+  std::vector<std::thread> threads_;
+  std::atomic<bool> stop_{false};
+};
+
+#endif /* CLUSTER_H_ */
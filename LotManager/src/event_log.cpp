@@ -0,0 +1,345 @@
+/*
+ * LotManager event log, see event_log.h
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <system_error>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "event_log.h"
+#include "event_loop.h"
+
+static uint8_t sum(const log_record &r) {
+  const uint8_t *b = (const uint8_t *)&r;
+  uint8_t s = 0;
+
+  for (size_t i = 0; i < sizeof(r); i++) {
+    s += b[i];
+  }
+  return s;
+}
+
+static std::vector<monitor_state> states(const monitor_table &table) {
+  std::vector<monitor_state> s(table.size());
+
+  for (uint32_t i = 0; i < table.size(); i++) {
+    s[i] = table[table.first() + i];
+  }
+  return s;
+}
+
+//---------
+// This function maps the whole file path read-only, returns nullptr if it
+// is missing or empty.
+//----------
+static const void *map_file(const std::string &path, size_t &len) {
+//----------
+  struct stat st;
+  void *p;
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+  if (fd < 0) {
+    return nullptr;
+  }
+  if (fstat(fd, &st) < 0 || !st.st_size) {
+    close(fd);
+    return nullptr;
+  }
+  len = st.st_size;
+  p = mmap(nullptr, len, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+  close(fd);
+  return p == MAP_FAILED ? nullptr : p;
+}
+
+event_log::event_log(const char *dir, unsigned shard, monitor_table &table, uint32_t commit_ms)
+  : dir_(dir), prefix_("log." + std::to_string(shard) + "."), snapshot_("snapshot." + std::to_string(shard)),
+    first_(table.first()), commit_ms_(std::max(commit_ms, 1u)) {
+  uint64_t start = event_loop::clock_us();
+
+  if (mkdir(dir, 0755) < 0 && errno != EEXIST) {
+    throw std::system_error(errno, std::generic_category(), dir);
+  }
+  bool found = recover(table);
+
+  recover_us_ = (uint32_t)(event_loop::clock_us() - start);
+  start_segment(next_lsn_);
+  if (recovered_ || !found) {                // the next start replays nothing
+    write_snapshot(states(table), next_lsn_ - 1); // and knows the ids logged
+  }
+  writer_ = std::thread([this] { run(); });
+}
+
+event_log::~event_log() {
+  {
+    std::lock_guard<std::mutex> g(lock_);
+
+    stop_ = true;
+  }
+  wake_.notify_one();
+  writer_.join();
+  close(fd_);
+}
+
+std::vector<std::pair<uint64_t, std::string>> event_log::segments() const {
+  std::vector<std::pair<uint64_t, std::string>> found;
+  DIR *d = opendir(dir_.c_str());
+  struct dirent *e;
+
+  while (d && (e = readdir(d))) {
+    char *end;
+
+    if (!strncmp(e->d_name, prefix_.c_str(), prefix_.size())) {
+      uint64_t first = strtoull(e->d_name + prefix_.size(), &end, 16);
+
+      if (end != e->d_name + prefix_.size() && !*end) {
+        found.emplace_back(first, dir_ + "/" + e->d_name);
+      }
+    }
+  }
+  if (d) {
+    closedir(d);
+  }
+  std::sort(found.begin(), found.end());
+  return found;
+}
+
+//---------
+// This function takes over the snapshot, then the records after it in lsn
+// order. A record failing its check ends its file, a record missing ends
+// the replay: what follows a gap can't be applied. A snapshot of other ids
+// than those of table, as after a restart with another number of shards
+// or monitors, throws: the records of some of them would end up on a shard
+// not owning them and be lost. Returns false without a snapshot.
+//----------
+bool event_log::recover(monitor_table &table) {
+//----------
+  uint64_t last = 0;
+  bool found = false;
+  size_t len;
+  const void *p = map_file(dir_ + "/" + snapshot_, len);
+
+  if (p) {
+    const log_snapshot_header *h = (const log_snapshot_header *)p;
+    const monitor_state *s = (const monitor_state *)(h + 1);
+
+    if (len >= sizeof(*h) && h->magic == LOG_SNAPSHOT_MAGIC && h->version == LOG_VERSION &&
+        h->state_len == sizeof(monitor_state) && len >= sizeof(*h) + (size_t)h->monitors * sizeof(monitor_state)) {
+      if (h->monitors != table.size() || h->first != table.first()) {
+        char what[128];
+
+        snprintf(what, sizeof(what), "%s/%s holds monitors %u..%u, not %u..%u: other -n or -j", dir_.c_str(),
+                 snapshot_.c_str(), h->first, h->first + h->monitors - 1, table.first(), table.end() - 1);
+        munmap((void *)p, len);
+        throw std::system_error(EINVAL, std::generic_category(), what);
+      }
+      for (uint32_t i = 0; i < h->monitors; i++) {
+        table.restore(table.first() + i, s[i]);
+      }
+      last = h->lsn;
+      found = true;
+    }
+    munmap((void *)p, len);
+  }
+  for (auto &segment : segments()) {
+    const log_record *r;
+    bool gap = false;
+
+    if (!(p = map_file(segment.second, len))) {
+      continue;
+    }
+    r = (const log_record *)p;
+    for (size_t i = 0; i < len / sizeof(*r) && !sum(r[i]) && r[i].lsn; i++) {
+      if (r[i].lsn <= last) {
+        continue;                            // in the snapshot
+      }
+      if ((gap = r[i].lsn != last + 1)) {
+        break;
+      }
+      last = r[i].lsn;
+      if (!table.owns(r[i].id)) {
+        continue;
+      }
+      monitor_state m = table[r[i].id];
+
+      m.state = r[i].state;
+      m.distance_cm = r[i].distance_cm;
+      m.flags = r[i].flags;
+      m.changes += r[i].type == LOG_CHANGE;
+      table.restore(r[i].id, m);
+      recovered_++;
+    }
+    munmap((void *)p, len);
+    if (gap) {
+      break;
+    }
+  }
+  next_lsn_ = last + 1;
+  return found;
+}
+
+void event_log::start_segment(uint64_t first) {
+  char name[32];
+  int fd;
+
+  snprintf(name, sizeof(name), "%016llx", (unsigned long long)first);
+  fd = open((dir_ + "/" + prefix_ + name).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(), dir_);
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+  fd_ = fd;
+  segment_lsn_ = first;
+}
+
+void event_log::append(uint8_t type, uint16_t id, const monitor_state &m) {
+  log_record r = {next_lsn_++, id, type, m.state, m.distance_cm, (uint8_t)(m.flags & MONITOR_RESERVED), 0};
+
+  r.check = (uint8_t)-sum(r);
+  {
+    std::lock_guard<std::mutex> g(lock_);
+
+    buffer_.push_back(r);
+  }
+  records_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void event_log::snapshot(const monitor_table &table) {
+  std::vector<monitor_state> s = states(table);
+
+  {
+    std::lock_guard<std::mutex> g(lock_);
+
+    snap_.swap(s);
+    snap_lsn_ = next_lsn_ - 1;
+    snap_due_ = true;
+  }
+  wake_.notify_one();
+}
+
+//---------
+// The writer: every commit_ms all records appended meanwhile go out with
+// one write and one fdatasync, then a snapshot if one is due.
+//----------
+void event_log::run() {
+//----------
+  std::unique_lock<std::mutex> g(lock_);
+  std::vector<log_record> records;
+  std::vector<monitor_state> states;
+
+  for (;;) {
+    bool snap, stop;
+    uint64_t lsn = snap_lsn_;
+
+    wake_.wait_for(g, std::chrono::milliseconds(commit_ms_), [this] { return stop_ || snap_due_; });
+    records.swap(buffer_);
+    if ((snap = snap_due_)) {
+      states.swap(snap_);
+      lsn = snap_lsn_;
+      snap_due_ = false;
+    }
+    stop = stop_;
+    g.unlock();
+    if (!records.empty()) {
+      write_out(records);
+      records.clear();
+    }
+    if (snap) {
+      write_snapshot(states, lsn);
+    }
+    g.lock();
+    if (stop && buffer_.empty() && !snap_due_) {
+      return;
+    }
+  }
+}
+
+void event_log::write_out(std::vector<log_record> &records) {
+  const char *b = (const char *)records.data();
+  size_t len = records.size() * sizeof(log_record);
+
+  while (len) {
+    ssize_t n = write(fd_, b, len);
+
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      fprintf(stderr, "lotmanager: log: %s\n", strerror(errno));
+      return;
+    }
+    b += n;
+    len -= n;
+    bytes_.fetch_add(n, std::memory_order_relaxed);
+  }
+  fdatasync(fd_);
+  commits_.fetch_add(1, std::memory_order_relaxed);
+  segment_end_ = records.back().lsn + 1;
+}
+
+//---------
+// This function writes a snapshot next to the old one and renames it over,
+// then starts a new log file and removes the ones whose records are all in
+// the snapshot: those followed by a file starting at lsn + 1 or before.
+//----------
+void event_log::write_snapshot(const std::vector<monitor_state> &states, uint64_t lsn) {
+//----------
+  log_snapshot_header h = {};
+  std::string tmp = dir_ + "/" + snapshot_ + ".tmp";
+  int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  size_t len = states.size() * sizeof(monitor_state);
+
+  h.magic = LOG_SNAPSHOT_MAGIC;
+  h.version = LOG_VERSION;
+  h.state_len = sizeof(monitor_state);
+  h.monitors = (uint32_t)states.size();
+  h.first = first_;
+  h.lsn = lsn;
+  if (fd < 0 || ::write(fd, &h, sizeof(h)) != sizeof(h) || ::write(fd, states.data(), len) != (ssize_t)len ||
+      fdatasync(fd) < 0) {
+    fprintf(stderr, "lotmanager: snapshot: %s\n", strerror(errno));
+    if (fd >= 0) {
+      close(fd);
+    }
+    return;
+  }
+  close(fd);
+  if (rename(tmp.c_str(), (dir_ + "/" + snapshot_).c_str()) < 0) {
+    fprintf(stderr, "lotmanager: snapshot: %s\n", strerror(errno));
+    return;
+  }
+  if ((fd = open(dir_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)) >= 0) {
+    fsync(fd);                               // the rename
+    close(fd);
+  }
+  snapshots_.fetch_add(1, std::memory_order_relaxed);
+  if (segment_end_ > segment_lsn_) {         // else the file is still empty
+    try {
+      start_segment(segment_end_);
+    } catch (const std::system_error &e) {
+      fprintf(stderr, "lotmanager: log: %s\n", e.what());
+    }
+  }
+  auto files = segments();
+
+  for (size_t i = 0; i + 1 < files.size(); i++) {
+    if (files[i + 1].first <= lsn + 1) {
+      unlink(files[i].second.c_str());
+    }
+  }
+}
+
+log_stats event_log::stats() const {
+  return {records_.load(std::memory_order_relaxed), commits_.load(std::memory_order_relaxed),
+          bytes_.load(std::memory_order_relaxed), snapshots_.load(std::memory_order_relaxed),
+          recovered_, recover_us_};
+}
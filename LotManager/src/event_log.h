@@ -0,0 +1,132 @@
+/*
+ * LotManager event log
+ *
+ * What the manager knows outlives it: every state change and reservation
+ * of a monitor is appended to a log, and every snapshot_s the whole monitor
+ * table is written as a snapshot. A manager starting over maps the last
+ * snapshot and replays the records after it, instead of waiting for every
+ * monitor to report again. The monitors come back offline, with their last
+ * state, distance and reservation, until they report.
+ *
+ * Files in the log directory, per shard:
+ *
+ *   snapshot.<shard>         64 byte header, the monitor_state of every id
+ *                            of the shard
+ *   log.<shard>.<first lsn>  16 byte records, lsn order
+ *
+ * A record carries its log sequence number and a check making its byte sum
+ * 0 mod 256, a torn tail after a crash ends the replay. Which ids a shard
+ * owns depends on the number of shards, so the snapshot header tells which
+ * ids the files hold; a new log starts with a snapshot right away, and a
+ * manager finding the files of other ids refuses to start instead of
+ * losing their state. A snapshot is
+ * written to a new file and renamed, so there always is a complete one; the
+ * manager starts a new log file after it and removes the files holding only
+ * records before it.
+ *
+ * The event loop appends to a buffer, a thread of the log writes it out and
+ * syncs it every commit_ms: one fdatasync() commits all records of the
+ * period, the loop never waits for the disk.
+ */
+
+#ifndef EVENT_LOG_H_
+#define EVENT_LOG_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "monitor_table.h"
+
+#define LOG_SNAPSHOT_MAGIC  0x50534E4Cu      // "LNSP" little endian
+#define LOG_VERSION         1
+
+#define LOG_CHANGE   1                       // state changed
+#define LOG_RESERVE  2                       // reservation set or cleared
+
+struct log_record {
+  uint64_t lsn;
+  uint16_t id;
+  uint8_t  type;                             // LOG_*
+  uint8_t  state;
+  uint16_t distance_cm;
+  uint8_t  flags;                            // MONITOR_RESERVED
+  uint8_t  check;
+};
+
+static_assert(sizeof(log_record) == 16, "four records per cache line");
+
+struct log_snapshot_header {
+  uint32_t magic;                            // LOG_SNAPSHOT_MAGIC
+  uint16_t version;
+  uint16_t state_len;                        // sizeof(monitor_state)
+  uint32_t monitors;                         // states in it
+  uint32_t first;                            //   id of the first
+  uint64_t lsn;                              // last record in it
+  uint8_t  reserved[40];
+};
+
+static_assert(sizeof(log_snapshot_header) == 64, "one cache line");
+
+struct log_stats {
+  uint64_t records;                          // appended
+  uint64_t commits;                          // fdatasync() of records
+  uint64_t bytes;                            //   written
+  uint64_t snapshots;
+  uint64_t recovered;                        // records replayed at start
+  uint32_t recover_us;                       //   snapshot and records
+};
+
+class event_log {
+public:
+  // Recovers table from the files of shard in dir, then starts the writer.
+  // Throws if the files hold other ids than table.
+  event_log(const char *dir, unsigned shard, monitor_table &table, uint32_t commit_ms);
+  ~event_log();                              // commits what is left
+  event_log(const event_log &) = delete;
+  event_log &operator=(const event_log &) = delete;
+
+  // Appends the state of id after an event of type, from the loop.
+  void append(uint8_t type, uint16_t id, const monitor_state &m);
+
+  // Writes a snapshot of table as of the last record appended.
+  void snapshot(const monitor_table &table);
+
+  log_stats stats() const;
+
+private:
+  bool recover(monitor_table &table);
+  void run();
+  void write_out(std::vector<log_record> &records);
+  void write_snapshot(const std::vector<monitor_state> &states, uint64_t lsn);
+  void start_segment(uint64_t first);
+  std::vector<std::pair<uint64_t, std::string>> segments() const;
+
+  std::string dir_;
+  std::string prefix_;                       // log.<shard>.
+  std::string snapshot_;                     // snapshot.<shard>
+  uint32_t first_;                           // of the table
+  uint32_t commit_ms_;
+  int fd_ = -1;                              // log file written
+  uint64_t next_lsn_ = 1;                    // of the loop
+  uint64_t segment_lsn_ = 1;                 // first lsn of fd_
+  uint64_t segment_end_ = 1;                 //   next lsn to write
+
+  std::mutex lock_;
+  std::condition_variable wake_;
+  std::vector<log_record> buffer_;           // appended, not yet written
+  std::vector<monitor_state> snap_;          // to write, with snap_lsn_
+  uint64_t snap_lsn_ = 0;
+  bool snap_due_ = false;
+  bool stop_ = false;
+  std::thread writer_;
+
+  std::atomic<uint64_t> records_{0}, commits_{0}, bytes_{0}, snapshots_{0};
+  uint64_t recovered_ = 0;
+  uint32_t recover_us_ = 0;
+};
+
+#endif /* EVENT_LOG_H_ */
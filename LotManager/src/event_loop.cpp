@@ -0,0 +1,146 @@
+/*
+ * LotManager event loop, see event_loop.h
+ */
+
+#include <cerrno>
+#include <system_error>
+#include <sys/epoll.h>
+#include <time.h>
+#include <unistd.h>
+#include "event_loop.h"
+
+#define EVENTS_MAX 256                       // ready sockets per epoll_wait
+
+event_loop::event_loop() {
+  epfd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epfd_ < 0) {
+    throw std::system_error(errno, std::generic_category(), "epoll_create1");
+  }
+  now_us_ = clock_us();
+}
+
+event_loop::~event_loop() {
+  close(epfd_);
+}
+
+//---------
+// Monotonic host time in microseconds
+//----------
+uint64_t event_loop::clock_us() {
+//----------
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000u + ts.tv_nsec / 1000;
+}
+
+void event_loop::add(int fd, uint32_t events, handler h) {
+  struct epoll_event ev = {};
+
+  ev.events = events;
+  ev.data.fd = fd;
+  if (epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+    throw std::system_error(errno, std::generic_category(), "epoll_ctl");
+  }
+  if ((size_t)fd >= handlers_.size()) {
+    handlers_.resize(fd + 1);
+  }
+  handlers_[fd] = std::move(h);
+}
+
+void event_loop::modify(int fd, uint32_t events) {
+  struct epoll_event ev = {};
+
+  ev.events = events;
+  ev.data.fd = fd;
+  if (epoll_ctl(epfd_, EPOLL_CTL_MOD, fd, &ev) < 0) {
+    throw std::system_error(errno, std::generic_category(), "epoll_ctl");
+  }
+}
+
+//---------
+// This function stops watching fd, call it before closing fd. Events of fd
+// already fetched by the running poll() are not delivered any more.
+//----------
+void event_loop::remove(int fd) {
+//----------
+  epoll_ctl(epfd_, EPOLL_CTL_DEL, fd, nullptr);
+  if ((size_t)fd < handlers_.size()) {
+    handlers_[fd] = nullptr;
+  }
+}
+
+uint64_t event_loop::after(uint32_t ms, timer t) {
+  uint64_t id = next_timer_++;
+
+  queue_.push({clock_us() + (uint64_t)ms * 1000, id});
+  timers_.emplace(id, std::move(t));
+  return id;
+}
+
+void event_loop::cancel(uint64_t id) {
+  timers_.erase(id);                         // left in queue_ until due
+}
+
+//---------
+// This function runs the timers due, returns their number
+//----------
+int event_loop::run_timers() {
+//----------
+  int n = 0;
+
+  while (!queue_.empty() && queue_.top().at_us <= now_us_) {
+    auto it = timers_.find(queue_.top().id);
+
+    queue_.pop();
+    if (it != timers_.end()) {
+      timer t = std::move(it->second);
+
+      timers_.erase(it);
+      t();
+      n++;
+    }
+  }
+  return n;
+}
+
+int event_loop::poll(int timeout_ms) {
+  struct epoll_event events[EVENTS_MAX];
+  int n, run = 0;
+
+  now_us_ = clock_us();
+  while (!queue_.empty() && !timers_.count(queue_.top().id)) {
+    queue_.pop();                            // cancelled
+  }
+  if (!queue_.empty()) {
+    uint64_t at_us = queue_.top().at_us;
+    int due_ms = at_us <= now_us_ ? 0 : (int)((at_us - now_us_ + 999) / 1000);
+
+    if (timeout_ms < 0 || due_ms < timeout_ms) {
+      timeout_ms = due_ms;
+    }
+  }
+  n = epoll_wait(epfd_, events, EVENTS_MAX, timeout_ms);
+  if (n < 0 && errno != EINTR) {
+    throw std::system_error(errno, std::generic_category(), "epoll_wait");
+  }
+  now_us_ = clock_us();
+  for (int i = 0; i < n; i++) {
+    int fd = events[i].data.fd;
+
+    if ((size_t)fd < handlers_.size() && handlers_[fd]) {
+      handler h = handlers_[fd];             // may remove itself
+
+      h(events[i].events);
+      run++;
+    }
+  }
+  return run + run_timers();
+}
+
+void event_loop::run() {
+  running_ = true;
+  while (running_) {
+    poll(-1);
+  }
+}
@@ -0,0 +1,67 @@
+/*
+ * LotManager event loop
+ *
+ * A single epoll instance serves all sockets of the manager, a timer queue
+ * the periodic jobs. Everything runs on the thread calling poll(), handlers
+ * run one after the other and must not block. Sockets are level triggered,
+ * so a handler may leave work for the next round to keep the others going.
+ */
+
+#ifndef EVENT_LOOP_H_
+#define EVENT_LOOP_H_
+
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+class event_loop {
+public:
+  using handler = std::function<void(uint32_t events)>;
+  using timer = std::function<void()>;
+
+  event_loop();
+  ~event_loop();
+  event_loop(const event_loop &) = delete;
+  event_loop &operator=(const event_loop &) = delete;
+
+  // Watches fd for the EPOLL* events, calls h with the ready ones. A handler
+  // may see a spurious event, e.g. after its fd number was reused.
+  void add(int fd, uint32_t events, handler h);
+  void modify(int fd, uint32_t events);
+  void remove(int fd);
+
+  // Calls t once ms milliseconds from now, returns an id to cancel it.
+  uint64_t after(uint32_t ms, timer t);
+  void cancel(uint64_t id);
+
+  // Waits at most timeout_ms (-1 = until an event) for sockets and timers
+  // and runs their handlers. Returns the number of handlers run.
+  int poll(int timeout_ms);
+  void run();                                // until stop()
+  void stop() { running_ = false; }
+
+  uint64_t now_ms() const { return now_us_ / 1000; } // of the last poll()
+  uint64_t now_us() const { return now_us_; }
+  static uint64_t clock_us();                // monotonic
+
+private:
+  struct pending {
+    uint64_t at_us;
+    uint64_t id;
+    bool operator>(const pending &o) const { return at_us > o.at_us || (at_us == o.at_us && id > o.id); }
+  };
+
+  int run_timers();
+
+  int epfd_;
+  bool running_ = false;
+  uint64_t now_us_;
+  uint64_t next_timer_ = 1;
+  std::vector<handler> handlers_;            // indexed by fd
+  std::priority_queue<pending, std::vector<pending>, std::greater<pending>> queue_;
+  std::unordered_map<uint64_t, timer> timers_; // not yet run or cancelled
+};
+
+#endif /* EVENT_LOOP_H_ */
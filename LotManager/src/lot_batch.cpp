@@ -0,0 +1,99 @@
+/*
+ * LotManager batch validation, see lot_batch.h
+ */
+
+#include "lot_batch.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+static_assert(sizeof(lot_frame) == LOT_FRAME_LEN, "frames are packed back to back");
+
+uint64_t lot_validate_scalar(const lot_frame *f, unsigned count) {
+  uint64_t valid = 0;
+
+  for (unsigned i = 0; i < count; i++) {
+    valid |= (uint64_t)lot_frame_valid(&f[i]) << i;
+  }
+  return valid;
+}
+
+#if defined(__x86_64__)
+// Per 64 bit lane: the low byte of the byte sum, and state_flags & LOT_F_INVALID
+// (byte 3), both within the low 32 bits. A lane is valid if they are all 0.
+#define LANE_SUM   0xFFull
+#define LANE_FLAGS ((uint64_t)LOT_F_INVALID << 24)
+
+//---------
+// This function validates 2 frames per step, SSE2 is part of every x86-64
+//----------
+static uint64_t validate_sse2(const lot_frame *f, unsigned count) {
+//----------
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i sum_mask = _mm_set1_epi64x(LANE_SUM);
+  const __m128i flag_mask = _mm_set1_epi64x(LANE_FLAGS);
+  uint64_t valid = 0;
+  unsigned i = 0;
+
+  for (; i + 2 <= count; i += 2) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(f + i));
+    __m128i bad = _mm_or_si128(_mm_and_si128(_mm_sad_epu8(v, zero), sum_mask),
+                               _mm_and_si128(v, flag_mask));
+    int m = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(bad, zero)));
+
+    valid |= (uint64_t)((m & 1) | (m >> 1 & 2)) << i;
+  }
+  if (i < count) {
+    valid |= lot_validate_scalar(f + i, count - i) << i;
+  }
+  return valid;
+}
+
+//---------
+// This function validates 4 frames per step
+//----------
+__attribute__((target("avx2")))
+static uint64_t validate_avx2(const lot_frame *f, unsigned count) {
+//----------
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i sum_mask = _mm256_set1_epi64x(LANE_SUM);
+  const __m256i flag_mask = _mm256_set1_epi64x(LANE_FLAGS);
+  uint64_t valid = 0;
+  unsigned i = 0;
+
+  for (; i + 4 <= count; i += 4) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(f + i));
+    __m256i bad = _mm256_or_si256(_mm256_and_si256(_mm256_sad_epu8(v, zero), sum_mask),
+                                  _mm256_and_si256(v, flag_mask));
+    int m = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(bad, zero)));
+
+    valid |= (uint64_t)((m & 1) | (m >> 1 & 2) | (m >> 2 & 4) | (m >> 3 & 8)) << i;
+  }
+  if (i < count) {
+    valid |= validate_sse2(f + i, count - i) << i;
+  }
+  return valid;
+}
+
+static const bool has_avx2 = [] {          // may run before main()
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") != 0;
+}();
+
+uint64_t lot_validate(const lot_frame *f, unsigned count) {
+  return has_avx2 ? validate_avx2(f, count) : validate_sse2(f, count);
+}
+
+const char *lot_validate_path() {
+  return has_avx2 ? "avx2" : "sse2";
+}
+#else
+uint64_t lot_validate(const lot_frame *f, unsigned count) {
+  return lot_validate_scalar(f, count);
+}
+
+const char *lot_validate_path() {
+  return "scalar";
+}
+#endif
@@ -0,0 +1,26 @@
+/*
+ * LotManager batch validation
+ *
+ * Validates the frames of a datagram (../LotMonitor/core/lot_proto.h) in
+ * the receive buffer they arrived in. The check of a frame makes its byte
+ * sum 0 mod 256, so one SAD instruction sums the frames of a vector lane
+ * by lane: 2 frames per SSE2 instruction, 4 with AVX2, picked at run time.
+ * Other hosts take the scalar path with the same result.
+ */
+
+#ifndef LOT_BATCH_H_
+#define LOT_BATCH_H_
+
+#include <cstdint>
+#include "lot_proto.h"
+
+// Returns a mask with bit i set if frame i of the count frames at f is
+// valid, count <= LOT_FRAMES_MAX.
+uint64_t lot_validate(const lot_frame *f, unsigned count);
+
+// The same one frame at a time, and the name of the path lot_validate()
+// takes on this host: "avx2", "sse2" or "scalar".
+uint64_t lot_validate_scalar(const lot_frame *f, unsigned count);
+const char *lot_validate_path();
+
+#endif /* LOT_BATCH_H_ */
@@ -0,0 +1,119 @@
+/*
+ * LotManager shared state table
+ *
+ * The manager publishes the state of every monitor in a file of fixed
+ * layout (/dev/shm/lotmanager by default), so dashboards and tools on the
+ * same host read it straight from their own mapping: no socket, no system
+ * call and no lock per read, and the manager never waits for a reader.
+ *
+ *   header   64 bytes, struct lot_shm_header
+ *   slots    16 bytes per monitor id, four to a cache line
+ *
+ * Every slot is a seqlock. The one writer of a slot (the manager or the
+ * shard owning the id) makes seq odd, stores the words and makes seq even
+ * again. A reader loads seq, the words and seq again, and takes the words
+ * if seq was even and unchanged, see lot_shm_read(). The words are accessed
+ * atomically, so a reader never sees a torn word even while it retries.
+ *
+ * All times are CLOCK_MONOTONIC in milliseconds, modulo 2^32, readers on
+ * the same host compare them with their own clock. A manager that stopped
+ * stops the heartbeat.
+ *
+ * Plain C, for C and C++ readers alike.
+ */
+
+#ifndef LOT_SHM_H_
+#define LOT_SHM_H_
+
+#include <stdint.h>
+
+#define LOT_SHM_PATH     "/dev/shm/lotmanager"
+#define LOT_SHM_MAGIC    0x53544F4Cu         // "LOTS" little endian
+#define LOT_SHM_VERSION  1
+
+#define LOT_SHM_ONLINE   0x01                // flags, as MONITOR_ONLINE
+#define LOT_SHM_RESERVED 0x02                //   and MONITOR_RESERVED
+
+struct lot_shm_header {
+  uint32_t magic;                            // LOT_SHM_MAGIC once complete
+  uint16_t version;                          // LOT_SHM_VERSION
+  uint16_t slot_len;                         // sizeof(struct lot_shm_slot)
+  uint32_t monitors;                         // slots
+  uint32_t pid;                              // of the manager
+  uint32_t stale_ms;                         // offline without a status
+  uint32_t heartbeat_ms;                     // written every stale_ms / 4
+  uint8_t  reserved[40];
+};
+
+struct lot_shm_slot {
+  uint32_t seq;                              // odd while written
+  uint32_t status;                           // state | flags << 8 | distance_cm << 16
+  uint32_t seen_ms;                          // last status
+  uint32_t changes;                          // state changes | reported << 16
+};
+
+// A consistent copy of a slot
+struct lot_shm_state {
+  uint8_t  state;                            // OCCUPANCY_*
+  uint8_t  flags;                            // LOT_SHM_*
+  uint16_t distance_cm;
+  uint32_t seen_ms;                          // 0 = never reported
+  uint16_t changes;                          // wraps
+  uint8_t  reported;                         // LOT_F_* of the last status
+};
+
+static inline struct lot_shm_slot *lot_shm_slots(const struct lot_shm_header *h) {
+  return (struct lot_shm_slot *)((char *)h + sizeof(*h));
+}
+
+static inline uint64_t lot_shm_len(uint32_t monitors) {
+  return sizeof(struct lot_shm_header) + (uint64_t)monitors * sizeof(struct lot_shm_slot);
+}
+
+//---------
+// This function copies slot s consistently to out. It spins only while the
+// writer is inside the slot, a few nanoseconds. Returns the number of
+// retries, for the curious.
+//----------
+static inline unsigned lot_shm_read(const struct lot_shm_slot *s, struct lot_shm_state *out) {
+//----------
+  unsigned retries = 0;
+  uint32_t seq, status, seen_ms, changes;
+
+  for (;;) {
+    seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+    status = __atomic_load_n(&s->status, __ATOMIC_RELAXED);
+    seen_ms = __atomic_load_n(&s->seen_ms, __ATOMIC_RELAXED);
+    changes = __atomic_load_n(&s->changes, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE); // the words before seq again
+    if (!(seq & 1) && __atomic_load_n(&s->seq, __ATOMIC_RELAXED) == seq) {
+      break;
+    }
+    retries++;
+  }
+  out->state = status & 0xFF;
+  out->flags = status >> 8 & 0xFF;
+  out->distance_cm = status >> 16;
+  out->seen_ms = seen_ms;
+  out->changes = changes & 0xFFFF;
+  out->reported = changes >> 16 & 0xFF;
+  return retries;
+}
+
+//---------
+// This function is the writer's side, for the only writer of s.
+//----------
+static inline void lot_shm_write(struct lot_shm_slot *s, const struct lot_shm_state *in) {
+//----------
+  uint32_t seq = __atomic_load_n(&s->seq, __ATOMIC_RELAXED);
+
+  __atomic_store_n(&s->seq, seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);   // odd before the words
+  __atomic_store_n(&s->status, in->state | in->flags << 8 | (uint32_t)in->distance_cm << 16,
+                   __ATOMIC_RELAXED);
+  __atomic_store_n(&s->seen_ms, in->seen_ms, __ATOMIC_RELAXED);
+  __atomic_store_n(&s->changes, in->changes | (uint32_t)in->reported << 16, __ATOMIC_RELAXED);
+  __atomic_store_n(&s->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+#endif /* LOT_SHM_H_ */
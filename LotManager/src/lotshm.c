@@ -0,0 +1,129 @@
+/*
+ * LotManager shared state table reader
+ *
+ * usage: lotshm [-f path] [-w ms] [id ...]
+ *
+ * Maps the table a running lotmanager publishes (lot_shm.h, -m of
+ * lotmanager) and prints the monitors by state, how long one consistent
+ * pass over all slots took and, for every id given, its state like GET:
+ *
+ *   STATUS id state distance_cm reserved online age_ms
+ *
+ * With -w it prints again every ms milliseconds until interrupted. Reads
+ * only, the manager never notices it.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "lot_shm.h"
+
+static uint64_t clock_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static void usage(void) {
+  fprintf(stderr, "usage: lotshm [-f path] [-w ms] [id ...]\n");
+  exit(1);
+}
+
+//---------
+// This function maps the table of path read-only, exits if it is no
+// complete table.
+//----------
+static const struct lot_shm_header *map(const char *path) {
+//----------
+  const struct lot_shm_header *h;
+  struct stat st;
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    fprintf(stderr, "lotshm: %s: %s\n", path, strerror(errno));
+    exit(1);
+  }
+  if ((size_t)st.st_size < sizeof(*h) ||
+      (h = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+    fprintf(stderr, "lotshm: %s: no table\n", path);
+    exit(1);
+  }
+  close(fd);
+  if (__atomic_load_n(&h->magic, __ATOMIC_ACQUIRE) != LOT_SHM_MAGIC || h->version != LOT_SHM_VERSION ||
+      h->slot_len != sizeof(struct lot_shm_slot) || lot_shm_len(h->monitors) > (uint64_t)st.st_size) {
+    fprintf(stderr, "lotshm: %s: no table of version %u\n", path, LOT_SHM_VERSION);
+    exit(1);
+  }
+  return h;
+}
+
+//---------
+// This function takes one pass over all slots and prints what it found
+//----------
+static void print(const struct lot_shm_header *h, char **ids, int n) {
+//----------
+  const struct lot_shm_slot *slots = lot_shm_slots(h);
+  uint32_t states[4] = {0}, online = 0, reserved = 0, retries = 0;
+  uint32_t now_ms = (uint32_t)(clock_ns() / 1000000);
+  uint32_t beat = now_ms - __atomic_load_n(&h->heartbeat_ms, __ATOMIC_ACQUIRE);
+  uint64_t start = clock_ns(), ns;
+  struct lot_shm_state s;
+
+  for (uint32_t id = 0; id < h->monitors; id++) {
+    retries += lot_shm_read(&slots[id], &s);
+    if (s.flags & LOT_SHM_ONLINE) {
+      online++;
+      states[s.state & 3]++;
+    }
+    reserved += !!(s.flags & LOT_SHM_RESERVED);
+  }
+  ns = clock_ns() - start;
+  printf("lotmanager %u %s, heartbeat %u ms ago\n", h->pid,
+         beat > 2 * h->stale_ms ? "stopped" : "running", beat);
+  printf("  monitors %u online %u free %u approaching %u occupied %u too_close %u reserved %u\n",
+         h->monitors, online, states[0], states[1], states[2], states[3], reserved);
+  printf("  read %llu us, %.1f ns per monitor, %u retries\n", (unsigned long long)ns / 1000,
+         h->monitors ? (double)ns / h->monitors : 0.0, retries);
+  for (int i = 0; i < n; i++) {
+    unsigned long id = strtoul(ids[i], NULL, 0);
+
+    if (id >= h->monitors) {
+      printf("ERROR unknown monitor\n");
+      continue;
+    }
+    lot_shm_read(&slots[id], &s);
+    printf("STATUS %lu %u %u %u %u %u\n", id, s.state, s.distance_cm, !!(s.flags & LOT_SHM_RESERVED),
+           !!(s.flags & LOT_SHM_ONLINE), s.seen_ms ? now_ms - s.seen_ms : 0);
+  }
+  fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+  const char *path = LOT_SHM_PATH;
+  unsigned watch_ms = 0;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "f:w:")) != -1) {
+    switch (opt) {
+    case 'f': path = optarg; break;
+    case 'w': watch_ms = strtoul(optarg, NULL, 0); break;
+    default: usage();
+    }
+  }
+  const struct lot_shm_header *h = map(path);
+
+  for (;;) {
+    print(h, argv + optind, argc - optind);
+    if (!watch_ms) {
+      return 0;
+    }
+    usleep(watch_ms * 1000);
+  }
+}
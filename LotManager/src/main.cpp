@@ -0,0 +1,89 @@
+/*
+ * LotManager daemon
+ *
+ * usage: lotmanager [-a address] [-u udp_port] [-t tcp_port] [-n monitors] [-s stale_ms]
+ *                   [-w sweep_ms] [-j shards] [-m snapshot] [-l log_dir] [-T slots]
+ *
+ * Runs until SIGINT or SIGTERM, see manager.h for the protocols. With -j it
+ * runs a cluster of shards, one thread each (cluster.h). With -m it
+ * publishes the state of the monitors in a shared table for lotshm and other
+ * local readers (lot_shm.h), /dev/shm/lotmanager is theirs by default. With
+ * -l it logs the changes to log_dir and starts over from it (event_log.h).
+ * With -T it gives the monitors trigger slots in frames of slots * 20ms and
+ * sends them a beacon every second (slot_schedule.h).
+ */
+
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <system_error>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
+#include "cluster.h"
+#include "manager.h"
+
+static void usage(void) {
+  fprintf(stderr, "usage: lotmanager [-a address] [-u udp_port] [-t tcp_port] [-n monitors] [-s stale_ms]\n"
+                  "                  [-w sweep_ms] [-j shards] [-m snapshot] [-l log_dir] [-T slots]\n");
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  manager_config cfg;
+  sigset_t mask;
+  int opt, sfd;
+
+  while ((opt = getopt(argc, argv, "a:u:t:n:s:w:j:m:l:T:")) != -1) {
+    switch (opt) {
+    case 'a': cfg.address = optarg; break;
+    case 'u': cfg.udp_port = (uint16_t)strtoul(optarg, NULL, 0); break;
+    case 't': cfg.tcp_port = (uint16_t)strtoul(optarg, NULL, 0); break;
+    case 'n': cfg.monitors = strtoul(optarg, NULL, 0); break;
+    case 's': cfg.stale_ms = strtoul(optarg, NULL, 0); break;
+    case 'w': cfg.sweep_ms = strtoul(optarg, NULL, 0); break;
+    case 'j': cfg.shards = strtoul(optarg, NULL, 0); break;
+    case 'm': cfg.snapshot = optarg; break;
+    case 'l': cfg.log_dir = optarg; break;
+    case 'T': cfg.slots = (uint8_t)std::min(strtoul(optarg, NULL, 0), 255ul); break;
+    default: usage();
+    }
+  }
+  if (optind != argc || !cfg.monitors || cfg.monitors > 65536 || !cfg.shards || cfg.shards > 256) {
+    usage();
+  }
+
+  sigemptyset(&mask);                        // stop cleanly on the loop
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTERM);
+  sigprocmask(SIG_BLOCK, &mask, NULL);
+  sfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+
+  try {
+    event_loop loop;
+
+    loop.add(sfd, EPOLLIN, [&loop](uint32_t) { loop.stop(); });
+    if (cfg.shards > 1) {
+      cluster c(cfg);
+
+      fprintf(stderr, "lotmanager: %u monitors on %u shards, status on udp %s:%u, commands on tcp %s:%u\n",
+              cfg.monitors, cfg.shards, cfg.address, c.udp_port(), cfg.address, c.tcp_port());
+      c.start();
+      loop.run();                            // for the signals only
+    } else {
+      manager m(loop, cfg);
+
+      fprintf(stderr, "lotmanager: %u monitors, status on udp %s:%u, commands on tcp %s:%u\n",
+              cfg.monitors, cfg.address, m.udp_port(), cfg.address, m.tcp_port());
+      loop.run();
+    }
+    loop.remove(sfd);
+  } catch (const std::system_error &e) {
+    fprintf(stderr, "lotmanager: %s\n", e.what());
+    return 1;
+  }
+  close(sfd);
+  return 0;
+}
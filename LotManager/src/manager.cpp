@@ -0,0 +1,1057 @@
+/*
+ * LotManager, see manager.h
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <system_error>
+#include <arpa/inet.h>
+#include <linux/filter.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "cluster.h"
+#include "lot_batch.h"
+#include "manager.h"
+
+#define UDP_BATCH      64                    // datagrams per recvmmsg
+#define CMD_MAX        256                   // longest TCP command
+#define UDP_RCVBUF     (4 << 20)             // rides out a burst of status
+
+//---------
+// This function opens a non-blocking socket bound to address:port and
+// returns it with the port bound, which differs if port is 0. Shards share
+// the port.
+//----------
+static int open_socket(int type, const char *address, uint16_t &port, bool shared) {
+//----------
+  struct sockaddr_in a = {};
+  socklen_t len = sizeof(a);
+  int one = 1;
+  int fd = socket(AF_INET, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(), "socket");
+  }
+  a.sin_family = AF_INET;
+  a.sin_port = htons(port);
+  if (inet_pton(AF_INET, address, &a.sin_addr) != 1) {
+    close(fd);
+    throw std::system_error(EINVAL, std::generic_category(), address);
+  }
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  if (shared && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0) {
+    close(fd);
+    throw std::system_error(errno, std::generic_category(), "SO_REUSEPORT");
+  }
+  if (bind(fd, (struct sockaddr *)&a, sizeof(a)) < 0 ||
+      getsockname(fd, (struct sockaddr *)&a, &len) < 0) {
+    int e = errno;
+
+    close(fd);
+    throw std::system_error(e, std::generic_category(), "bind");
+  }
+  port = ntohs(a.sin_port);
+  return fd;
+}
+
+//---------
+// This function steers every datagram to the socket of the shard owning the
+// id of its first frame, the sockets of the group count in the order they
+// joined. A datagram too short for an id goes to shard 0, which drops it.
+// Without the program the kernel spreads the datagrams by address, the
+// shards then pass the frames on, so a failure costs only speed.
+//----------
+static void steer(int fd, uint32_t span) {
+//----------
+  struct sock_filter code[] = {
+    { BPF_LD | BPF_B | BPF_ABS, 0, 0, LOT_HEADER_LEN + 1 }, // id, high byte
+    { BPF_ALU | BPF_LSH | BPF_K, 0, 0, 8 },
+    { BPF_MISC | BPF_TAX, 0, 0, 0 },
+    { BPF_LD | BPF_B | BPF_ABS, 0, 0, LOT_HEADER_LEN },     //   and low byte
+    { BPF_ALU | BPF_ADD | BPF_X, 0, 0, 0 },
+    { BPF_ALU | BPF_DIV | BPF_K, 0, 0, span },
+    { BPF_RET | BPF_A, 0, 0, 0 },
+  };
+  struct sock_fprog prog = { sizeof(code) / sizeof(code[0]), code };
+
+  setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog));
+}
+
+//---------
+// This function returns the table of the ids cfg.shard owns, span of them
+// from shard * span, see cluster::owner(). The last shard may get fewer.
+//----------
+static monitor_table shard_table(const manager_config &cfg) {
+//----------
+  uint32_t shards = std::max(cfg.shards, 1u);
+  uint32_t span = (cfg.monitors + shards - 1) / shards;
+  uint32_t first = std::min(cfg.shard * span, cfg.monitors);
+
+  return monitor_table(std::min(span, cfg.monitors - first), first);
+}
+
+manager::manager(event_loop &loop, const manager_config &cfg)
+  : loop_(loop), cfg_(cfg), table_(shard_table(cfg)), udp_port_(cfg.udp_port), tcp_port_(cfg.tcp_port) {
+  int rcvbuf = UDP_RCVBUF;
+
+  if (cfg_.slots) {                          // first, nothing to close yet
+    slots_.reset(new slot_schedule(table_.first(), table_.size(), cfg_.slots));
+  }
+  if (cfg_.snapshot) {
+    snapshot_.reset(new snapshot(cfg_.snapshot, cfg_.monitors, cfg_.stale_ms, cfg_.shard == 0));
+  }
+  if (cfg_.log_dir) {                        // the table as it was
+    log_.reset(new event_log(cfg_.log_dir, cfg_.shard, table_, cfg_.commit_ms));
+    for (uint32_t id = table_.first(); snapshot_ && id < table_.end(); id++) {
+      if (table_[id].changes || table_[id].flags) {
+        snapshot_->publish(id, table_[id]);
+      }
+    }
+  }
+  udp_fd_ = open_socket(SOCK_DGRAM, cfg_.address, udp_port_, cfg_.shards > 1);
+  setsockopt(udp_fd_, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+  if (cfg_.shards > 1 && cfg_.shard == 0) {
+    steer(udp_fd_, (cfg_.monitors + cfg_.shards - 1) / cfg_.shards);
+  }
+  try {
+    tcp_fd_ = open_socket(SOCK_STREAM, cfg_.address, tcp_port_, cfg_.shards > 1);
+    if (listen(tcp_fd_, SOMAXCONN) < 0) {
+      throw std::system_error(errno, std::generic_category(), "listen");
+    }
+  } catch (...) {
+    close(udp_fd_);
+    if (tcp_fd_ >= 0) {
+      close(tcp_fd_);
+    }
+    throw;
+  }
+  loop_.add(udp_fd_, EPOLLIN, [this](uint32_t ev) { on_udp(ev); });
+  loop_.add(tcp_fd_, EPOLLIN, [this](uint32_t ev) { on_accept(ev); });
+  expire_timer_ = loop_.after(std::max(cfg_.stale_ms / 4, 10u), [this] { expire(); });
+  poller_.reset(new poller(loop_, table_, udp_fd_, cfg_.poll));
+  if (cfg_.sweep_ms) {
+    sweep_timer_ = loop_.after(cfg_.sweep_ms, [this] { sweep_timer(); });
+  }
+  if (log_ && cfg_.snapshot_s) {
+    snapshot_timer_ = loop_.after(cfg_.snapshot_s * 1000, [this] { snapshot_timer(); });
+  }
+  if (slots_) {
+    sync_timer_ = loop_.after(cfg_.sync_ms, [this] { sync_timer(); });
+  }
+}
+
+manager::~manager() {
+  for (auto &c : clients_) {
+    if (c) {
+      close_client(c->fd);
+    }
+  }
+  loop_.cancel(expire_timer_);
+  loop_.cancel(sweep_timer_);
+  loop_.cancel(snapshot_timer_);
+  loop_.cancel(sync_timer_);
+  if (log_) {
+    log_->snapshot(table_);                  // written before log_ is gone
+  }
+  poller_.reset();
+  loop_.remove(udp_fd_);
+  loop_.remove(tcp_fd_);
+  close(udp_fd_);
+  close(tcp_fd_);
+}
+
+//---------
+// This function takes the status datagrams in batches of UDP_BATCH, at most
+// udp_budget per round. The rest stays in the socket buffer for the next
+// round, the socket is level triggered. The frames of a datagram are
+// validated at once and taken over from the receive buffer.
+//----------
+void manager::on_udp(uint32_t) {
+//----------
+  uint8_t buf[UDP_BATCH][LOT_DATAGRAM_MAX];
+  struct mmsghdr msgs[UDP_BATCH];
+  struct iovec iovs[UDP_BATCH];
+  struct sockaddr_in from[UDP_BATCH];
+  uint64_t start = event_loop::clock_us();
+  uint32_t now_ms = (uint32_t)loop_.now_ms();
+  uint32_t taken = 0;
+
+  while (taken < cfg_.udp_budget) {
+    int n;
+
+    for (int i = 0; i < UDP_BATCH; i++) {
+      iovs[i] = { buf[i], LOT_DATAGRAM_MAX };
+      msgs[i].msg_hdr = {};
+      msgs[i].msg_hdr.msg_name = &from[i];
+      msgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+      msgs[i].msg_hdr.msg_iov = &iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    n = recvmmsg(udp_fd_, msgs, UDP_BATCH, MSG_DONTWAIT, nullptr);
+    if (n <= 0) {
+      break;                                 // EAGAIN, drained
+    }
+    taken += n;
+    stats_.datagrams += n;
+    for (int i = 0; i < n; i++) {
+      const lot_frame *f;
+      uint8_t type, count;
+      uint64_t valid;
+
+      if ((msgs[i].msg_hdr.msg_flags & MSG_TRUNC) ||
+          !(f = lot_frames(buf[i], msgs[i].msg_len, &type, &count)) || type != LOT_STATUS) {
+        stats_.malformed++;
+        continue;
+      }
+      stats_.frames += count;
+      valid = lot_validate(f, count);
+      for (uint8_t k = 0; k < count; k++) {
+        uint16_t id = lot_id(&f[k]);
+        unsigned owner;
+
+        if (!(valid >> k & 1)) {
+          stats_.bad_frames++;
+          continue;
+        }
+        if (cluster_ && id < cfg_.monitors && (owner = cluster_->owner(id)) != cfg_.shard) {
+          foreign_[owner].push_back({f[k], from[i]});
+          continue;
+        }
+        status(f[k], now_ms, from[i]);
+      }
+    }
+    if (n < UDP_BATCH) {
+      break;
+    }
+  }
+  if (cluster_) {
+    for (unsigned s = 0; s < foreign_.size(); s++) {
+      if (!foreign_[s].empty()) {
+        manager *m = &cluster_->shard(s);
+
+        cluster_->pool().post(s, [m, frames = std::move(foreign_[s])] { m->take(frames); });
+        foreign_[s].clear();
+      }
+    }
+    publish();
+  }
+  stats_.round_us_max = std::max(stats_.round_us_max, (uint32_t)(event_loop::clock_us() - start));
+}
+
+//---------
+// This function takes over a valid status frame of an own monitor
+//----------
+void manager::status(const lot_frame &f, uint32_t now_ms, const sockaddr_in &from) {
+//----------
+  int result = table_.update(f, now_ms, from);
+
+  if (result & TABLE_UPDATED) {
+    stats_.updates++;
+    if (slots_) {
+      slots_->report(lot_id(&f), lot_aux(&f));
+    }
+    if (snapshot_) {
+      snapshot_->publish(lot_id(&f), table_[lot_id(&f)]);
+    }
+    if (result & TABLE_CHANGED) {
+      stats_.changes++;
+      if (log_) {
+        log_->append(LOG_CHANGE, lot_id(&f), table_[lot_id(&f)]);
+      }
+      report(lot_id(&f));
+    }
+    poller_->on_status(lot_id(&f));
+  } else if (result & TABLE_DUPLICATE) {
+    stats_.duplicates++;
+  } else {
+    stats_.unknown++;
+  }
+}
+
+//---------
+// This function takes over the frames another shard received for ours
+//----------
+void manager::take(const std::vector<foreign> &frames) {
+//----------
+  uint32_t now_ms = (uint32_t)loop_.now_ms();
+
+  for (const foreign &x : frames) {
+    status(x.f, now_ms, x.from);
+  }
+  publish();
+}
+
+void manager::on_accept(uint32_t) {
+  int fd;
+
+  while ((fd = accept4(tcp_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+    int one = 1;
+
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if ((size_t)fd >= clients_.size()) {
+      clients_.resize(fd + 1);
+    }
+    clients_[fd].reset(new client{fd, next_client_++, false, {}, {}, 0, 0, {}, nullptr, 0});
+    loop_.add(fd, EPOLLIN, [this, fd](uint32_t ev) { on_client(fd, ev); });
+    stats_.clients++;
+  }
+}
+
+//---------
+// This function reads the commands of a client and sends what is left of
+// the answers once the socket takes more.
+//----------
+void manager::on_client(int fd, uint32_t events) {
+//----------
+  char buf[4096];
+  ssize_t n;
+
+  if (events & EPOLLOUT) {
+    flush(*clients_[fd]);
+    if (!clients_[fd]) {
+      return;
+    }
+  }
+  if (!(events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+    return;
+  }
+  while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) {
+    client &c = *clients_[fd];
+    size_t start = 0, eol;
+
+    c.in.append(buf, n);
+    while ((eol = c.in.find('\n', start)) != std::string::npos) {
+      c.in[eol] = 0;
+      if (eol > start && c.in[eol - 1] == '\r') {
+        c.in[eol - 1] = 0;
+      }
+      command(c, c.in.c_str() + start);
+      if (!clients_[fd]) {
+        return;                              // closed while answering
+      }
+      start = eol + 1;
+    }
+    c.in.erase(0, start);
+    if (c.in.size() > CMD_MAX) {
+      close_client(fd);
+      return;
+    }
+  }
+  if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+    close_client(fd);
+  }
+}
+
+//---------
+// This function sums the statistics of the shards
+//----------
+static void add(manager_stats &sum, const manager_stats &s) {
+//----------
+  sum.datagrams += s.datagrams;
+  sum.frames += s.frames;
+  sum.updates += s.updates;
+  sum.changes += s.changes;
+  sum.duplicates += s.duplicates;
+  sum.unknown += s.unknown;
+  sum.malformed += s.malformed;
+  sum.bad_frames += s.bad_frames;
+  sum.reports += s.reports;
+  sum.clients += s.clients;
+  sum.slow_clients += s.slow_clients;
+  sum.round_us_max = std::max(sum.round_us_max, s.round_us_max);
+  sum.sweeps += s.sweeps;
+  sum.sweep_lost += s.sweep_lost;
+  sum.sweep_us_max = std::max(sum.sweep_us_max, s.sweep_us_max);
+  sum.feed_changes += s.feed_changes;
+  sum.feed_coalesced += s.feed_coalesced;
+  sum.feed_deltas += s.feed_deltas;
+  sum.feed_batches += s.feed_batches;
+  sum.feed_depth += s.feed_depth;
+  sum.feed_depth_max = std::max(sum.feed_depth_max, s.feed_depth_max);
+  sum.log_records += s.log_records;
+  sum.log_commits += s.log_commits;
+  sum.log_snapshots += s.log_snapshots;
+  sum.log_recovered += s.log_recovered;
+  sum.tdma_beacons += s.tdma_beacons;
+  sum.tdma_synced += s.tdma_synced;
+  sum.tdma_drift_us_max = std::max(sum.tdma_drift_us_max, s.tdma_drift_us_max);
+}
+
+static std::string stats_line(const manager_stats &s, uint32_t monitors, uint32_t online, cluster *c) {
+  char out[4 * CMD_MAX];
+  int len = snprintf(out, sizeof(out),
+                     "STATS monitors %u online %u datagrams %llu frames %llu updates %llu changes %llu "
+                     "duplicates %llu unknown %llu malformed %llu bad_frames %llu reports %llu round_us_max %u "
+                     "sweeps %llu sweep_lost %llu sweep_us_max %u feed_changes %llu feed_coalesced %llu "
+                     "feed_deltas %llu feed_batches %llu feed_depth %u feed_depth_max %u log_records %llu "
+                     "log_commits %llu log_snapshots %llu log_recovered %llu tdma_beacons %llu tdma_synced %u "
+                     "tdma_drift_us_max %u",
+                     monitors, online, (unsigned long long)s.datagrams, (unsigned long long)s.frames,
+                     (unsigned long long)s.updates, (unsigned long long)s.changes,
+                     (unsigned long long)s.duplicates, (unsigned long long)s.unknown,
+                     (unsigned long long)s.malformed, (unsigned long long)s.bad_frames,
+                     (unsigned long long)s.reports, s.round_us_max, (unsigned long long)s.sweeps,
+                     (unsigned long long)s.sweep_lost, s.sweep_us_max, (unsigned long long)s.feed_changes,
+                     (unsigned long long)s.feed_coalesced, (unsigned long long)s.feed_deltas,
+                     (unsigned long long)s.feed_batches, s.feed_depth, s.feed_depth_max,
+                     (unsigned long long)s.log_records, (unsigned long long)s.log_commits,
+                     (unsigned long long)s.log_snapshots, (unsigned long long)s.log_recovered,
+                     (unsigned long long)s.tdma_beacons, s.tdma_synced, s.tdma_drift_us_max);
+  std::string line(out, std::min(len, (int)sizeof(out) - 1));
+
+  if (c) {
+    len = snprintf(out, sizeof(out), " shards %u stolen %llu", c->size(),
+                   (unsigned long long)c->pool().stolen());
+    line.append(out, len);
+  }
+  return line + "\n";
+}
+
+//---------
+// This function answers one command line of c. A command about a monitor
+// of another shard is answered by that shard, STATS and SWEEP by all, the
+// answers go out in the order of the commands anyway.
+//----------
+void manager::command(client &c, const char *line) {
+//----------
+  char cmd[16];
+  unsigned id, last, flag, owner;
+
+  if (sscanf(line, "%15s", cmd) != 1) {
+    return;                                  // empty line
+  }
+  if (!strcmp(cmd, "WATCH")) {
+    if (!c.watch) {
+      c.watch = true;
+      watchers_.push_back(c.fd);
+      if (cluster_) {
+        cluster_->watchers(cfg_.shard)++;
+      }
+    }
+    reply(c, "OK\n");
+  } else if (!strcmp(cmd, "FEED") && sscanf(line, "%*s %u %u", &id, &flag) == 2) {
+    start_feed(c, id, flag);
+    reply(c, "OK\n");
+  } else if (!strcmp(cmd, "CREDIT") && sscanf(line, "%*s %u", &flag) == 1) {
+    if (c.feed) {                            // unanswered
+      c.feed->grant(flag);
+      drain(c);
+    }
+  } else if (!strcmp(cmd, "STATS")) {
+    gather_stats(c);
+  } else if (!strcmp(cmd, "SWEEP")) {
+    gather_sweep(c);
+  } else if (!strcmp(cmd, "RESERVE") && sscanf(line, "%*s %u-%u %u", &id, &last, &flag) == 3 && flag <= 1) {
+    if (id > last || last >= cfg_.monitors) {
+      reply(c, "ERROR unknown monitor\n");
+    } else {
+      reserve_range(c, id, last, flag);
+    }
+  } else if (cluster_ && sscanf(line, "%*s %u", &id) == 1 && id < cfg_.monitors &&
+             (owner = cluster_->owner(id)) != cfg_.shard) {
+    manager *m = &cluster_->shard(owner);
+    pending p = defer(c);
+
+    cluster_->pool().post(owner, [m, p, l = std::string(line)] { p(m->answer(l.c_str())); });
+  } else {
+    reply(c, answer(line));
+  }
+}
+
+//---------
+// This function answers the commands about one monitor, on its shard
+//----------
+std::string manager::answer(const char *line) {
+//----------
+  char out[CMD_MAX];
+  char cmd[16];
+  unsigned id, flag;
+  int len;
+
+  if (sscanf(line, "%15s", cmd) != 1) {
+    return "ERROR bad command\n";
+  }
+  if (!strcmp(cmd, "GET") && sscanf(line, "%*s %u", &id) == 1) {
+    if (!table_.owns(id)) {
+      return "ERROR unknown monitor\n";
+    }
+    const monitor_state &m = table_[id];
+
+    len = snprintf(out, sizeof(out), "STATUS %u %u %u %u %u %u\n", id, m.state, m.distance_cm,
+                   !!(m.flags & MONITOR_RESERVED), !!(m.flags & MONITOR_ONLINE),
+                   m.updates ? (uint32_t)loop_.now_ms() - m.seen_ms : 0);
+    return std::string(out, len);
+  }
+  if (!strcmp(cmd, "RESERVE") && sscanf(line, "%*s %u %u", &id, &flag) == 2 && flag <= 1) {
+    return table_.owns(id) && reserve(id, flag) ? "OK\n" : "ERROR unknown monitor\n";
+  }
+  if (!strcmp(cmd, "QUERY") && sscanf(line, "%*s %u", &id) == 1) {
+    return table_.owns(id) && query(id) ? "OK\n" : "ERROR monitor never reported\n";
+  }
+  if (!strcmp(cmd, "SLOT") && (len = sscanf(line, "%*s %u %u", &id, &flag)) >= 1) {
+    if (!slots_) {
+      return "ERROR no trigger slots\n";
+    }
+    if (!table_.owns(id)) {
+      return "ERROR unknown monitor\n";
+    }
+    if (len == 2) {
+      return flag < slots_->slots() && slots_->assign(id, flag) ? "OK\n" : "ERROR bad slot\n";
+    }
+    uint8_t aux = slots_->aux(id);
+
+    len = snprintf(out, sizeof(out), "SLOT %u %u %u %d\n", id, slots_->slot(id), aux != 0, lot_aux_drift_us(aux));
+    return std::string(out, len);
+  }
+  return "ERROR bad command\n";
+}
+
+//---------
+// This function writes the answer to the next command of c, or holds it
+// back while an earlier one is still pending on another shard.
+//----------
+void manager::reply(client &c, std::string answer) {
+//----------
+  if (c.written == c.issued) {
+    c.issued++;
+    c.written++;
+    write(c, answer.data(), answer.size());
+  } else {
+    c.held.emplace(c.issued++, std::move(answer));
+  }
+}
+
+void manager::pending::operator()(std::string answer) const {
+  if (!home->cluster_) {
+    home->deliver(fd, client, seq, std::move(answer));
+    return;
+  }
+  home->cluster_->pool().post(home->cfg_.shard, [p = *this, a = std::move(answer)]() mutable {
+    p.home->deliver(p.fd, p.client, p.seq, std::move(a));
+  });
+}
+
+//---------
+// This function takes the answer to command seq of a client, and writes
+// it with the ones held back behind it. The client may be gone meanwhile.
+//----------
+void manager::deliver(int fd, uint64_t id, uint64_t seq, std::string answer) {
+//----------
+  if ((size_t)fd >= clients_.size() || !clients_[fd] || clients_[fd]->id != id) {
+    return;
+  }
+  client &c = *clients_[fd];
+
+  c.held.emplace(seq, std::move(answer));
+  while (!c.held.empty() && c.held.begin()->first == c.written) {
+    std::string a = std::move(c.held.begin()->second);
+
+    c.held.erase(c.held.begin());
+    c.written++;
+    write(c, a.data(), a.size());
+    if (!clients_[fd]) {
+      return;                                // too slow, closed
+    }
+  }
+}
+
+//---------
+// This function reserves the monitors first..last, on the shards owning
+// them, and answers once all reservations went out.
+//----------
+void manager::reserve_range(client &c, uint32_t first, uint32_t last, bool reserved) {
+//----------
+  if (!cluster_) {
+    for (uint32_t id = first; id <= last; id++) {
+      reserve(id, reserved);
+    }
+    reply(c, "OK\n");
+    return;
+  }
+  unsigned a = cluster_->owner(first), b = cluster_->owner(last);
+  auto left = std::make_shared<std::atomic<unsigned>>(b - a + 1);
+  pending p = defer(c);
+
+  for (unsigned s = a; s <= b; s++) {
+    manager *m = &cluster_->shard(s);
+    uint32_t from = std::max(first, s * cluster_->span());
+    uint32_t to = s == b ? last : std::min(last, (s + 1) * cluster_->span() - 1);
+
+    cluster_->pool().post(s, [m, from, to, reserved, left, p] {
+      for (uint32_t id = from; id <= to; id++) {
+        m->reserve(id, reserved);
+      }
+      if (!--*left) {
+        p("OK\n");
+      }
+    });
+  }
+}
+
+void manager::gather_stats(client &c) {
+  struct gather {
+    std::mutex lock;
+    manager_stats sum;
+    uint32_t online;
+    unsigned left;
+  };
+
+  if (!cluster_) {
+    reply(c, stats_line(stats(), cfg_.monitors, table_.online(), nullptr));
+    return;
+  }
+  auto g = std::make_shared<gather>();
+  uint32_t monitors = cfg_.monitors;
+  pending p = defer(c);
+
+  g->sum = {};
+  g->online = 0;
+  g->left = cluster_->size();
+  for (unsigned s = 0; s < cluster_->size(); s++) {
+    manager *m = &cluster_->shard(s);
+
+    cluster_->pool().post(s, [m, g, p, monitors] {
+      std::lock_guard<std::mutex> lock(g->lock);
+
+      add(g->sum, m->stats());
+      g->online += m->table_.online();
+      if (!--g->left) {
+        p(stats_line(g->sum, monitors, g->online, m->cluster_));
+      }
+    });
+  }
+}
+
+//---------
+// This function sweeps the monitors of all shards at once, each shard its
+// own, and answers with the sums once the last shard is done.
+//----------
+void manager::gather_sweep(client &c) {
+//----------
+  struct gather {
+    std::mutex lock;
+    sweep_result sum;
+    bool busy;
+    unsigned left;
+  };
+  auto g = std::make_shared<gather>();
+  pending p = defer(c);
+  auto one = [g, p](const sweep_result *r) {
+    std::lock_guard<std::mutex> lock(g->lock);
+    char out[CMD_MAX];
+    int len;
+
+    if (!r) {
+      g->busy = true;
+    } else {
+      g->sum.monitors += r->monitors;
+      g->sum.nodes += r->nodes;
+      g->sum.answered += r->answered;
+      g->sum.lost += r->lost;
+      g->sum.datagrams += r->datagrams;
+      g->sum.retries += r->retries;
+      g->sum.us = std::max(g->sum.us, r->us);
+      g->sum.timeout_ms = std::max(g->sum.timeout_ms, r->timeout_ms);
+    }
+    if (--g->left) {
+      return;
+    }
+    if (g->busy) {
+      p("ERROR sweep running\n");
+      return;
+    }
+    const sweep_result &s = g->sum;
+
+    len = snprintf(out, sizeof(out), "SWEEP monitors %u nodes %u answered %u lost %u datagrams %u "
+                   "retries %u us %u timeout_ms %u\n", s.monitors, s.nodes, s.answered, s.lost,
+                   s.datagrams, s.retries, s.us, s.timeout_ms);
+    p(std::string(out, len));
+  };
+
+  g->sum = {};
+  g->busy = false;
+  g->left = cluster_ ? cluster_->size() : 1;
+  if (!cluster_) {
+    if (!sweep([one](const sweep_result &r) { one(&r); })) {
+      one(nullptr);
+    }
+    return;
+  }
+  for (unsigned s = 0; s < cluster_->size(); s++) {
+    manager *m = &cluster_->shard(s);
+
+    cluster_->pool().post(s, [m, one] {
+      if (!m->sweep([one](const sweep_result &r) { one(&r); })) {
+        one(nullptr);
+      }
+    });
+  }
+}
+
+//---------
+// This function sends s to c, what the socket doesn't take is queued and
+// sent on EPOLLOUT. A client not reading its answers or changes closes
+// once out_max bytes are queued, it must not hold up the manager.
+//----------
+void manager::write(client &c, const char *s, size_t len) {
+//----------
+  if (c.out.empty()) {
+    ssize_t n = send(c.fd, s, len, MSG_NOSIGNAL);
+
+    if (n == (ssize_t)len) {
+      return;
+    }
+    if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+      close_client(c.fd);
+      return;
+    }
+    if (n > 0) {
+      s += n;
+      len -= n;
+    }
+    loop_.modify(c.fd, EPOLLIN | EPOLLOUT);
+  }
+  if (c.out.size() + len > cfg_.out_max) {
+    stats_.slow_clients++;
+    close_client(c.fd);
+    return;
+  }
+  c.out.append(s, len);
+}
+
+void manager::flush(client &c) {
+  ssize_t n = send(c.fd, c.out.data(), c.out.size(), MSG_NOSIGNAL);
+
+  if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+    close_client(c.fd);
+    return;
+  }
+  if (n > 0) {
+    c.out.erase(0, n);
+  }
+  if (c.out.empty()) {
+    loop_.modify(c.fd, EPOLLIN);
+    if (c.feed) {
+      drain(c);                              // held back while full
+    }
+  }
+}
+
+void manager::close_client(int fd) {
+  client &c = *clients_[fd];
+
+  if (c.watch) {
+    watchers_.erase(std::find(watchers_.begin(), watchers_.end(), fd));
+    if (cluster_) {
+      cluster_->watchers(cfg_.shard)--;
+    }
+  }
+  if (c.feed) {
+    feeds_.erase(std::find(feeds_.begin(), feeds_.end(), fd));
+    if (cluster_) {
+      cluster_->watchers(cfg_.shard)--;
+    }
+    stats_.feed_depth -= c.feed->depth();
+    loop_.cancel(c.feed_timer);
+  }
+  loop_.remove(fd);
+  close(fd);
+  clients_[fd].reset();
+}
+
+//---------
+// This function sends the state of id to all WATCH and FEED clients, in a
+// cluster with the other changes of the round, see publish().
+//----------
+void manager::report(uint16_t id) {
+//----------
+  const monitor_state &m = table_[id];
+  char out[64];
+  int len;
+
+  monitor_change x = {id, m.state, !!(m.flags & MONITOR_ONLINE), m.distance_cm};
+
+  if (cluster_) {
+    changes_.push_back(x);
+    return;
+  }
+  feed(x);
+  if (watchers_.empty()) {
+    return;
+  }
+  len = snprintf(out, sizeof(out), "CHANGE %u %u %u %u\n", id, m.state, m.distance_cm,
+                 !!(m.flags & MONITOR_ONLINE));
+  for (size_t i = watchers_.size(); i-- > 0; ) { // a slow one may drop out
+    write(*clients_[watchers_[i]], out, len);
+    stats_.reports++;
+  }
+}
+
+//---------
+// This function hands the changes of a round to the pool: any shard may
+// format the lines, then each shard writes them to its WATCH clients. The
+// batches of a shard are numbered, a shard writes them in order even if
+// two were formatted by different threads.
+//----------
+void manager::publish() {
+//----------
+  cluster *c = cluster_;
+  unsigned from = cfg_.shard;
+  bool watched = false;
+
+  if (changes_.empty()) {
+    return;
+  }
+  for (unsigned s = 0; s < c->size(); s++) {
+    watched |= c->watchers(s) > 0;
+  }
+  if (!watched) {
+    changes_.clear();
+    return;
+  }
+  c->pool().spawn(from, [c, from, batch = batch_++, changes = std::move(changes_)]() mutable {
+    auto r = std::make_shared<round>();
+    char out[64];
+
+    for (const monitor_change &x : changes) {
+      r->lines.append(out, snprintf(out, sizeof(out), "CHANGE %u %u %u %u\n", x.id, x.state,
+                                    x.distance_cm, x.online));
+    }
+    r->changes = std::move(changes);
+    for (unsigned s = 0; s < c->size(); s++) {
+      manager *m = &c->shard(s);
+
+      c->pool().post(s, [m, from, batch, r] { m->broadcast(from, batch, r); });
+    }
+  });
+  changes_.clear();
+}
+
+void manager::broadcast(unsigned from, uint64_t batch, std::shared_ptr<const round> r) {
+  auto write_all = [this](const round &x) {
+    for (size_t i = watchers_.size(); i-- > 0; ) { // a slow one may drop out
+      write(*clients_[watchers_[i]], x.lines.data(), x.lines.size());
+      stats_.reports += x.changes.size();
+    }
+    for (const monitor_change &y : x.changes) {
+      feed(y);
+    }
+  };
+
+  if (batch != next_batch_[from]) {
+    early_.emplace(std::make_pair(from, batch), std::move(r));
+    return;
+  }
+  write_all(*r);
+  for (auto next = early_.find({from, ++next_batch_[from]}); next != early_.end();
+       next = early_.find({from, ++next_batch_[from]})) {
+    write_all(*next->second);
+    early_.erase(next);
+  }
+}
+
+//---------
+// This function makes c a FEED client, or sets the window and adds the
+// credits of one.
+//----------
+void manager::start_feed(client &c, uint32_t window_ms, uint32_t credits) {
+//----------
+  if (c.feed) {
+    c.feed->window_ms(window_ms);
+    c.feed->grant(credits);
+    return;
+  }
+  c.feed.reset(new change_feed(cfg_.monitors, window_ms, credits)); // of all shards
+  feeds_.push_back(c.fd);
+  if (cluster_) {
+    cluster_->watchers(cfg_.shard)++;
+  }
+}
+
+//---------
+// This function queues a change for all FEED clients. The first change
+// queued starts the window of a feed, the batch goes out when it ends.
+//----------
+void manager::feed(const monitor_change &x) {
+//----------
+  for (int fd : feeds_) {
+    client &c = *clients_[fd];
+    change_feed &f = *c.feed;
+
+    stats_.feed_changes++;
+    if (f.add(x)) {
+      stats_.feed_coalesced++;
+      continue;
+    }
+    stats_.feed_depth++;
+    stats_.feed_depth_max = std::max(stats_.feed_depth_max, f.depth());
+    if (!c.feed_timer) {
+      c.feed_timer = loop_.after(f.window_ms(), [this, fd, id = c.id] {
+        if ((size_t)fd < clients_.size() && clients_[fd] && clients_[fd]->id == id) {
+          clients_[fd]->feed_timer = 0;
+          drain(*clients_[fd]);
+        }
+      });
+    }
+  }
+}
+
+//---------
+// This function sends the queued changes of a FEED client as long as it
+// has credits and its socket takes them. What is left waits for a CREDIT
+// or the socket, coalescing meanwhile.
+//----------
+void manager::drain(client &c) {
+//----------
+  int fd = c.fd;
+  std::string line;
+  uint32_t n;
+
+  if (c.feed_timer) {
+    return;                                  // window running
+  }
+  while (c.out.empty() && (n = c.feed->batch(line))) {
+    stats_.feed_deltas += n;
+    stats_.feed_batches++;
+    stats_.feed_depth -= n;
+    write(c, line.data(), line.size());
+    if (!clients_[fd]) {
+      return;
+    }
+    line.clear();
+  }
+}
+
+void manager::attach(cluster &c) {
+  cluster_ = &c;
+  foreign_.resize(c.size());
+  next_batch_.assign(c.size(), 0);
+}
+
+//---------
+// This function takes the monitors silent for stale_ms offline and reports
+// them, every stale_ms / 4. The first shard beats the heartbeat of the
+// snapshot meanwhile.
+//----------
+void manager::expire() {
+//----------
+  uint32_t now_ms = (uint32_t)loop_.now_ms();
+
+  table_.expire(now_ms, cfg_.stale_ms, [this](uint16_t id) {
+    if (snapshot_) {
+      snapshot_->publish(id, table_[id]);
+    }
+    report(id);
+  });
+  if (snapshot_ && cfg_.shard == 0) {
+    snapshot_->heartbeat(now_ms);
+  }
+  if (cluster_) {
+    publish();
+  }
+  expire_timer_ = loop_.after(std::max(cfg_.stale_ms / 4, 10u), [this] { expire(); });
+}
+
+//---------
+// This function runs a sweep every sweep_ms, the next one starts sweep_ms
+// after one ended, so a slow sweep doesn't pile up.
+//----------
+void manager::sweep_timer() {
+//----------
+  sweep_timer_ = 0;
+  if (!sweep([this](const sweep_result &) {
+        sweep_timer_ = loop_.after(cfg_.sweep_ms, [this] { sweep_timer(); });
+      })) {
+    sweep_timer_ = loop_.after(cfg_.sweep_ms, [this] { sweep_timer(); });
+  }
+}
+
+//---------
+// This function snapshots the table every snapshot_s, the log behind it is
+// removed once the snapshot is on disk.
+//----------
+void manager::snapshot_timer() {
+//----------
+  log_->snapshot(table_);
+  snapshot_timer_ = loop_.after(cfg_.snapshot_s * 1000, [this] { snapshot_timer(); });
+}
+
+//---------
+// This function sends the beacons of the trigger slots every sync_ms
+//----------
+void manager::sync_timer() {
+//----------
+  slots_->beacon(table_, udp_fd_);
+  sync_timer_ = loop_.after(cfg_.sync_ms, [this] { sync_timer(); });
+}
+
+manager_stats manager::stats() const {
+  manager_stats s = stats_;
+
+  if (log_) {
+    log_stats l = log_->stats();
+
+    s.log_records = l.records;
+    s.log_commits = l.commits;
+    s.log_snapshots = l.snapshots;
+    s.log_recovered = l.recovered;
+  }
+  if (slots_) {
+    slot_totals t = slots_->totals(table_);
+
+    s.tdma_beacons = slots_->beacons();
+    s.tdma_synced = t.synced;
+    s.tdma_drift_us_max = t.drift_us_max;
+  }
+  return s;
+}
+
+int manager::sweep(poller::done d) {
+  return poller_->sweep([this, d = std::move(d)](const sweep_result &r) {
+    stats_.sweeps++;
+    stats_.sweep_lost += r.lost;
+    stats_.sweep_us_max = std::max(stats_.sweep_us_max, r.us);
+    d(r);
+  });
+}
+
+void manager::send_to(uint16_t id, const uint8_t *b, size_t len) {
+  const sockaddr_in *a = table_.address(id);
+
+  if (a) {
+    sendto(udp_fd_, b, len, MSG_DONTWAIT, (const struct sockaddr *)a, sizeof(*a));
+  }
+}
+
+int manager::reserve(uint16_t id, bool reserved) {
+  uint8_t b[LOT_HEADER_LEN + LOT_FRAME_LEN];
+
+  if (!table_.reserve(id, reserved)) {
+    return 0;
+  }
+  if (snapshot_) {
+    snapshot_->publish(id, table_[id]);
+  }
+  if (log_) {
+    log_->append(LOG_RESERVE, id, table_[id]);
+  }
+  lot_frame_set(lot_header_set(b, LOT_RESERVE, 1), id, 0, reserved ? LOT_F_RESERVED : 0, 0, 0);
+  send_to(id, b, sizeof(b));
+  return 1;
+}
+
+int manager::query(uint16_t id) {
+  uint8_t b[LOT_HEADER_LEN + LOT_FRAME_LEN];
+
+  if (!table_.address(id)) {
+    return 0;
+  }
+  lot_frame_set(lot_header_set(b, LOT_QUERY, 1), id, 0, 0, 0, 0);
+  send_to(id, b, sizeof(b));
+  return 1;
+}
@@ -0,0 +1,233 @@
+/*
+ * LotManager
+ *
+ * Collects the status of its LotMonitors over UDP (lot_proto.h) into the
+ * monitor table and serves LotManagement and tools over TCP, one text
+ * command per line:
+ *
+ *   GET id              -> STATUS id state distance_cm reserved online age_ms
+ *   RESERVE id 0|1      -> OK, the reservation is sent to the monitor
+ *   RESERVE id-last 0|1 -> OK, for all monitors id..last
+ *   QUERY id            -> OK, the monitor is asked for its status
+ *   SLOT id             -> SLOT id slot synced drift_us, with trigger slots
+ *   SLOT id slot        -> OK, the monitor moves to slot with the next beacon
+ *   WATCH               -> OK, then CHANGE id state distance_cm online
+ *                          whenever a monitor changed state or went offline
+ *   FEED window_ms credits -> OK, then the changes coalesced over window_ms
+ *                          in DELTA lines, one per credit (change_feed.h)
+ *   CREDIT n            -> nothing, n more DELTA lines may follow
+ *   STATS               -> STATS name value ...
+ *   SWEEP               -> SWEEP monitors n nodes n answered n lost n datagrams n
+ *                          retries n us n timeout_ms n, once all monitors
+ *                          that reported before were queried (poller.h)
+ *
+ * Errors are answered with ERROR and a reason, every command but CREDIT is
+ * answered, in order. Everything runs on one event loop. A round of the
+ * loop takes at most udp_budget datagrams, so a flood of status can't
+ * delay the TCP clients by more than one round. The frames are validated
+ * and taken over right in the receive buffers. With sweep_ms set, the
+ * manager sweeps the status of all monitors on its own.
+ *
+ * A manager may be one shard of a cluster (cluster.h) sharing its ports:
+ * it owns the monitors of one id range, keeps the state of those only
+ * (table, trigger slots, sweeps) and hands everything about the others to
+ * their shards as jobs of the work pool. A status frame of a foreign
+ * monitor is taken over by its owner, a command about it is answered by
+ * its owner, the changes of a round are formatted once and written to the
+ * WATCH clients of all shards, STATS and SWEEP are gathered from all.
+ *
+ * With a snapshot path set, the manager also publishes the state of every
+ * monitor in a shared table for local readers (snapshot.h, lot_shm.h).
+ * With a log directory set, it logs every state change and reservation,
+ * and starts over from the log with the monitors it knew (event_log.h).
+ * With slots set, it gives every monitor a trigger slot and sends the
+ * beacons the monitors align their frames to (slot_schedule.h).
+ */
+
+#ifndef MANAGER_H_
+#define MANAGER_H_
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "change_feed.h"
+#include "event_log.h"
+#include "event_loop.h"
+#include "monitor_table.h"
+#include "poller.h"
+#include "slot_schedule.h"
+#include "snapshot.h"
+
+struct manager_config {
+  const char *address = "0.0.0.0";           // of both sockets
+  uint16_t udp_port   = 7300;                // 0 = any, see udp_port()
+  uint16_t tcp_port   = 7301;                //   and tcp_port()
+  uint32_t monitors   = 4096;                // ids 0..monitors-1
+  uint32_t stale_ms   = 3000;                // offline without a status
+  uint32_t udp_budget = 1024;                // datagrams per loop round
+  uint32_t out_max    = 1 << 20;             // bytes queued per client
+  uint32_t sweep_ms   = 0;                   // sweep period, 0 = on SWEEP only
+  poller_config poll;                        // of the sweeps
+  uint32_t shards     = 1;                   // managers sharing the ports
+  uint32_t shard      = 0;                   //   this one, see cluster.h
+  const char *snapshot = nullptr;            // shared state table, see lot_shm.h
+  const char *log_dir = nullptr;             // event log, see event_log.h
+  uint32_t commit_ms  = 10;                  //   group commit period
+  uint32_t snapshot_s = 300;                 //   snapshot period
+  uint8_t  slots      = 0;                   // trigger slots, 0 = off, see slot_schedule.h
+  uint32_t sync_ms    = 1000;                //   beacon period
+};
+
+struct manager_stats {
+  uint64_t datagrams;                        // received
+  uint64_t frames;                           //   status frames in them
+  uint64_t updates;                          // status taken over
+  uint64_t changes;                          //   with a state change
+  uint64_t duplicates;                       // dropped, see TABLE_DUPLICATE
+  uint64_t unknown;                          //   id beyond the table
+  uint64_t malformed;                        //   no valid datagram
+  uint64_t bad_frames;                       //   frame check failed
+  uint64_t reports;                          // CHANGE lines sent
+  uint64_t clients;                          // TCP connections accepted
+  uint64_t slow_clients;                     //   closed, out_max exceeded
+  uint32_t round_us_max;                     // longest UDP round
+  uint64_t sweeps;
+  uint64_t sweep_lost;                       // monitors silent in a sweep
+  uint32_t sweep_us_max;                     // longest sweep
+  uint64_t feed_changes;                     // changes queued for FEED clients
+  uint64_t feed_coalesced;                   //   replacing a queued one
+  uint64_t feed_deltas;                      // changes sent in DELTA lines
+  uint64_t feed_batches;                     //   DELTA lines
+  uint32_t feed_depth;                       // changes queued now
+  uint32_t feed_depth_max;                   //   most in one feed
+  uint64_t log_records;                      // appended to the event log
+  uint64_t log_commits;                      //   fdatasync() of them
+  uint64_t log_snapshots;
+  uint64_t log_recovered;                    // records replayed at start
+  uint64_t tdma_beacons;                     // LOT_SYNC datagrams sent
+  uint32_t tdma_synced;                      // online monitors in their slot
+  uint32_t tdma_drift_us_max;                //   largest drift they reported
+};
+
+class cluster;
+
+class manager {
+public:
+  manager(event_loop &loop, const manager_config &cfg);
+  ~manager();
+  manager(const manager &) = delete;
+  manager &operator=(const manager &) = delete;
+
+  uint16_t udp_port() const { return udp_port_; }
+  uint16_t tcp_port() const { return tcp_port_; }
+  const monitor_table &table() const { return table_; }
+  manager_stats stats() const;
+
+  // Sets the reservation of id and sends it to the monitor if it reported
+  // before. Returns 0 if id is beyond the table.
+  int reserve(uint16_t id, bool reserved);
+
+  // Asks id for its status, returns 0 if it never reported.
+  int query(uint16_t id);
+
+  // Queries all monitors that reported before, d gets the result. Returns
+  // 0 if a sweep is still running.
+  int sweep(poller::done d);
+
+private:
+  friend class cluster;
+
+  struct client {
+    int fd;
+    uint64_t id;                             // fds are reused, ids not
+    bool watch;                              // gets CHANGE lines
+    std::string in;                          // incomplete command
+    std::string out;                         // not yet sent
+    uint64_t issued;                         // commands answered or pending
+    uint64_t written;                        //   answers written
+    std::map<uint64_t, std::string> held;    // answers ahead of a pending one
+    std::unique_ptr<change_feed> feed;       // of a FEED client
+    uint64_t feed_timer;                     //   window running
+  };
+
+  // The answer to a command of a client, given on any shard
+  struct pending {
+    manager *home;
+    int fd;
+    uint64_t client;
+    uint64_t seq;
+
+    void operator()(std::string answer) const;
+  };
+
+  struct round {                             // changes of a shard's round
+    std::string lines;                       //   as CHANGE lines
+    std::vector<monitor_change> changes;
+  };
+
+  struct foreign {                           // status frame of another shard
+    lot_frame f;
+    sockaddr_in from;
+  };
+
+  void on_udp(uint32_t events);
+  void on_accept(uint32_t events);
+  void on_client(int fd, uint32_t events);
+  void command(client &c, const char *line);
+  std::string answer(const char *line);
+  void reply(client &c, std::string answer);
+  pending defer(client &c) { return {this, c.fd, c.id, c.issued++}; }
+  void deliver(int fd, uint64_t client, uint64_t seq, std::string answer);
+  void reserve_range(client &c, uint32_t first, uint32_t last, bool reserved);
+  void gather_stats(client &c);
+  void gather_sweep(client &c);
+  void status(const lot_frame &f, uint32_t now_ms, const sockaddr_in &from);
+  void take(const std::vector<foreign> &frames);
+  void publish();
+  void broadcast(unsigned from, uint64_t batch, std::shared_ptr<const round> r);
+  void start_feed(client &c, uint32_t window_ms, uint32_t credits);
+  void feed(const monitor_change &x);
+  void drain(client &c);
+  void attach(cluster &c);
+  void write(client &c, const char *s, size_t len);
+  void flush(client &c);
+  void close_client(int fd);
+  void report(uint16_t id);
+  void expire();
+  void sweep_timer();
+  void snapshot_timer();
+  void sync_timer();
+  void send_to(uint16_t id, const uint8_t *b, size_t len);
+
+  event_loop &loop_;
+  manager_config cfg_;
+  monitor_table table_;
+  manager_stats stats_ = {};
+  int udp_fd_ = -1;
+  int tcp_fd_ = -1;
+  uint16_t udp_port_;
+  uint16_t tcp_port_;
+  uint64_t expire_timer_ = 0;
+  uint64_t sweep_timer_ = 0;
+  uint64_t snapshot_timer_ = 0;
+  uint64_t sync_timer_ = 0;
+  std::unique_ptr<poller> poller_;
+  std::unique_ptr<snapshot> snapshot_;       // if cfg.snapshot
+  std::unique_ptr<event_log> log_;           // if cfg.log_dir
+  std::unique_ptr<slot_schedule> slots_;     // if cfg.slots
+  std::vector<std::unique_ptr<client>> clients_; // indexed by fd
+  std::vector<int> watchers_;                // fds of the WATCH clients
+  std::vector<int> feeds_;                   //   and of the FEED clients
+  uint64_t next_client_ = 1;
+
+  cluster *cluster_ = nullptr;               // of the shards, if any
+  std::vector<std::vector<foreign>> foreign_; // by owner, of this round
+  std::vector<monitor_change> changes_;      //   changes to publish
+  uint64_t batch_ = 0;                       // change batches published
+  std::vector<uint64_t> next_batch_;         // by shard, next to write
+  std::map<std::pair<unsigned, uint64_t>, std::shared_ptr<const round>> early_;
+};
+
+#endif /* MANAGER_H_ */
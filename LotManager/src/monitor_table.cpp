@@ -0,0 +1,83 @@
+/*
+ * LotManager monitor table, see monitor_table.h
+ */
+
+#include "monitor_table.h"
+
+monitor_table::monitor_table(uint32_t size, uint32_t first) : states_(size), addrs_(size), first_(first) {
+}
+
+//---------
+// This function takes over a status frame in place. While a monitor is
+// online a frame with a seq not newer than the last one (mod 256) is a
+// duplicate or came late and is dropped, unless the monitor restarted
+// (LOT_F_BOOT). The first frame of an offline monitor is always taken.
+//----------
+int monitor_table::update(const lot_frame &f, uint32_t now_ms, const sockaddr_in &from) {
+//----------
+  uint16_t id = lot_id(&f);
+  uint8_t seq = lot_seq(&f);
+  uint8_t state = lot_state(&f);
+  int result = TABLE_UPDATED;
+
+  if (!owns(id)) {
+    return TABLE_UNKNOWN;
+  }
+  monitor_state &m = states_[id - first_];
+
+  if (m.flags & MONITOR_ONLINE) {
+    if ((int8_t)(seq - m.seq) <= 0 && !(lot_flags(&f) & LOT_F_BOOT)) {
+      return TABLE_DUPLICATE;
+    }
+    if (state != m.state) {
+      result |= TABLE_CHANGED;
+    }
+  } else {
+    result |= TABLE_ONLINE | TABLE_CHANGED;
+    m.flags |= MONITOR_ONLINE;
+    online_++;
+  }
+  if (result & TABLE_CHANGED) {
+    m.changes++;
+  }
+  m.state = state;
+  m.seq = seq;
+  m.reported = lot_flags(&f);
+  m.distance_cm = lot_distance_cm(&f);
+  m.seen_ms = now_ms;
+  m.updates++;
+  sockaddr_in &a = addrs_[id - first_];
+  if (a.sin_port != from.sin_port || a.sin_addr.s_addr != from.sin_addr.s_addr) {
+    a = from;                                // rare, keeps the line clean
+  }
+  return result;
+}
+
+int monitor_table::reserve(uint16_t id, bool reserved) {
+  if (!owns(id)) {
+    return 0;
+  }
+  if (reserved) {
+    states_[id - first_].flags |= MONITOR_RESERVED;
+  } else {
+    states_[id - first_].flags &= ~MONITOR_RESERVED;
+  }
+  return 1;
+}
+
+void monitor_table::restore(uint16_t id, const monitor_state &m) {
+  if (!owns(id)) {
+    return;
+  }
+  if (states_[id - first_].flags & MONITOR_ONLINE) {
+    online_--;
+  }
+  states_[id - first_] = {m.state, 0, (uint8_t)(m.flags & MONITOR_RESERVED), 0, m.distance_cm, m.changes, 0, 0};
+}
+
+const sockaddr_in *monitor_table::address(uint16_t id) const {
+  if (!owns(id) || !addrs_[id - first_].sin_port) {
+    return nullptr;
+  }
+  return &addrs_[id - first_];
+}
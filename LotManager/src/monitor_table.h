@@ -0,0 +1,97 @@
+/*
+ * LotManager monitor table
+ *
+ * The state of every monitor of the manager in one flat array indexed by
+ * monitor id. The entries the status path touches are 16 bytes, four to a
+ * cache line, the addresses only needed to send to a monitor are kept apart.
+ * A status costs one array access, no hashing and no allocation.
+ *
+ * A shard of a cluster keeps the monitors of its id range only, first()
+ * .. end() - 1, at index id - first().
+ */
+
+#ifndef MONITOR_TABLE_H_
+#define MONITOR_TABLE_H_
+
+#include <cstdint>
+#include <vector>
+#include <netinet/in.h>
+#include "lot_proto.h"
+
+#define MONITOR_ONLINE    0x01               // status seen within stale_ms
+#define MONITOR_RESERVED  0x02               // reservation sent to the monitor
+
+// Results of monitor_table::update(), or'ed
+#define TABLE_UPDATED     0x01               // status taken over
+#define TABLE_CHANGED     0x02               //   and the state changed
+#define TABLE_ONLINE      0x04               //   and the monitor came online
+#define TABLE_DUPLICATE   0x08               // seq not newer, dropped
+#define TABLE_UNKNOWN     0x10               // id not in the table, dropped
+
+struct monitor_state {
+  uint8_t  state;                            // OCCUPANCY_*
+  uint8_t  seq;                              // of the last status
+  uint8_t  flags;                            // MONITOR_*
+  uint8_t  reported;                         // LOT_F_* of the last status
+  uint16_t distance_cm;
+  uint16_t changes;                          // state changes, wraps
+  uint32_t seen_ms;                          // last status, manager clock
+  uint32_t updates;                          // status taken over
+};
+
+static_assert(sizeof(monitor_state) == 16, "four monitors per cache line");
+
+class monitor_table {
+public:
+  explicit monitor_table(uint32_t size, uint32_t first = 0);
+
+  uint32_t first() const { return first_; }
+  uint32_t end() const { return first_ + size(); }
+  uint32_t size() const { return (uint32_t)states_.size(); }
+  uint32_t online() const { return online_; }
+  bool owns(uint32_t id) const { return id - first_ < states_.size(); }
+  const monitor_state &operator[](uint16_t id) const { return states_[id - first_]; }
+
+  // Takes over a valid status frame received from from at now_ms.
+  int update(const lot_frame &f, uint32_t now_ms, const sockaddr_in &from);
+
+  // Sets the reservation flag, returns 0 if id is not in the table.
+  int reserve(uint16_t id, bool reserved);
+
+  // Takes over the state, distance, reservation and change count of m for
+  // id, as recovered from the event log; the monitor is offline until it
+  // reports.
+  void restore(uint16_t id, const monitor_state &m);
+
+  // Address of the last status of id, nullptr if it never reported.
+  const sockaddr_in *address(uint16_t id) const;
+
+  // Takes monitors without a status since stale_ms offline, calls
+  // expired(id) for each. Returns their number.
+  template <typename F> uint32_t expire(uint32_t now_ms, uint32_t stale_ms, F expired);
+
+private:
+  std::vector<monitor_state> states_;
+  std::vector<sockaddr_in> addrs_;           // sin_port 0 = never reported
+  uint32_t first_;                           // id of index 0
+  uint32_t online_ = 0;
+};
+
+template <typename F>
+uint32_t monitor_table::expire(uint32_t now_ms, uint32_t stale_ms, F expired) {
+  uint32_t n = 0;
+
+  for (uint32_t i = 0; i < states_.size(); i++) {
+    monitor_state &m = states_[i];
+
+    if ((m.flags & MONITOR_ONLINE) && now_ms - m.seen_ms > stale_ms) {
+      m.flags &= ~MONITOR_ONLINE;
+      online_--;
+      n++;
+      expired((uint16_t)(first_ + i));
+    }
+  }
+  return n;
+}
+
+#endif /* MONITOR_TABLE_H_ */
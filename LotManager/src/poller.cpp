@@ -0,0 +1,184 @@
+/*
+ * LotManager status poller, see poller.h
+ */
+
+#include <algorithm>
+#include <unordered_map>
+#include <sys/socket.h>
+#include "lot_proto.h"
+#include "poller.h"
+
+poller::poller(event_loop &loop, const monitor_table &table, int udp_fd, const poller_config &cfg)
+  : loop_(loop), table_(table), fd_(udp_fd), cfg_(cfg), window_(std::max(cfg.window, 1u)),
+    waiting_(table.size(), nullptr) {
+  cfg_.window = std::max(cfg_.window, 1u);
+}
+
+//---------
+// The suspended tasks are destroyed, their timers must not fire into them.
+//----------
+poller::~poller() {
+//----------
+  std::vector<request *> active(active_.begin(), active_.end());
+
+  for (request *r : active) {
+    loop_.cancel(r->timer);
+    if (r->waiter) {
+      r->waiter.destroy();
+    }
+  }
+  window_.destroy_waiting();                 // the sweep itself
+}
+
+void poller::answers::await_suspend(std::coroutine_handle<> h) {
+  r.waiter = h;
+  r.timer = p.loop_.after(p.timeout_ms(), [&r = r] {
+    std::coroutine_handle<> w = r.waiter;
+
+    r.waiter = nullptr;
+    r.timer = 0;
+    w.resume();
+  });
+}
+
+void poller::answer(uint16_t id) {
+  request &r = *waiting(id);
+
+  waiting(id) = nullptr;
+  result_.answered++;
+  if (!--r.left && r.waiter) {
+    std::coroutine_handle<> w = r.waiter;
+
+    if (!r.retried) {
+      sample((uint32_t)(event_loop::clock_us() - r.sent_us));
+    }
+    loop_.cancel(r.timer);
+    r.waiter = nullptr;
+    r.timer = 0;
+    w.resume();
+  }
+}
+
+void poller::sample(uint32_t rtt_us) {
+  if (!srtt_us_) {
+    srtt_us_ = std::max(rtt_us, 1u);
+    rttvar_us_ = rtt_us / 2;
+    return;
+  }
+  uint32_t delta = srtt_us_ > rtt_us ? srtt_us_ - rtt_us : rtt_us - srtt_us_;
+
+  rttvar_us_ = (3 * rttvar_us_ + delta) / 4;
+  srtt_us_ = (7 * srtt_us_ + rtt_us) / 8;
+}
+
+uint32_t poller::timeout_ms() const {
+  if (!srtt_us_) {
+    return cfg_.timeout_ms;
+  }
+  return std::clamp((srtt_us_ + 4 * rttvar_us_ + 999) / 1000, cfg_.timeout_min_ms, cfg_.timeout_ms);
+}
+
+int poller::sweep(done d) {
+  if (busy_) {
+    return 0;
+  }
+  busy_ = true;
+  run(std::move(d)).start();
+  return 1;
+}
+
+//---------
+// This function groups the monitors by node and queries the nodes, at most
+// window at once. It ends once it got all slots of the window back.
+//----------
+task poller::run(done d) {
+//----------
+  struct node {
+    struct sockaddr_in to;
+    std::vector<uint16_t> ids;
+  };
+  std::unordered_map<uint64_t, node> nodes;
+  uint64_t start = event_loop::clock_us();
+
+  result_ = {};
+  for (uint32_t id = table_.first(); id < table_.end(); id++) {
+    const struct sockaddr_in *a = table_.address(id);
+
+    if (a) {
+      node &n = nodes[(uint64_t)a->sin_addr.s_addr << 16 | a->sin_port];
+
+      n.to = *a;
+      n.ids.push_back(id);
+      result_.monitors++;
+    }
+  }
+  result_.nodes = nodes.size();
+  for (auto &[key, n] : nodes) {
+    co_await window_.acquire();
+    poll_node(std::move(n.ids), n.to).start();
+  }
+  for (uint32_t i = 0; i < cfg_.window; i++) {
+    co_await window_.acquire();              // the last nodes are done
+  }
+  for (uint32_t i = 0; i < cfg_.window; i++) {
+    window_.release();
+  }
+  result_.us = (uint32_t)(event_loop::clock_us() - start);
+  result_.timeout_ms = timeout_ms();
+  busy_ = false;
+  d(result_);
+}
+
+//---------
+// This function queries the bays ids of one node until all answered or the
+// retries are used up, then hands its slot of the window on.
+//----------
+task poller::poll_node(std::vector<uint16_t> ids, struct sockaddr_in to) {
+//----------
+  request r = {};
+
+  active_.insert(&r);
+  for (uint32_t attempt = 0; !ids.empty() && attempt <= cfg_.retries; attempt++) {
+    if (attempt) {
+      result_.retries++;
+    }
+    for (uint16_t id : ids) {
+      waiting(id) = &r;
+    }
+    r.left = ids.size();
+    r.retried = attempt > 0;
+    r.sent_us = event_loop::clock_us();
+    query(ids, to);
+    co_await answers{*this, r};
+    ids.erase(std::remove_if(ids.begin(), ids.end(), [&](uint16_t id) {
+      if (waiting(id) != &r) {
+        return true;                         // answered
+      }
+      waiting(id) = nullptr;
+      return false;
+    }), ids.end());
+  }
+  result_.lost += ids.size();
+  active_.erase(&r);
+  window_.release();
+}
+
+//---------
+// This function sends the queries for ids in datagrams of up to
+// LOT_FRAMES_MAX frames, back to back.
+//----------
+void poller::query(const std::vector<uint16_t> &ids, const struct sockaddr_in &to) {
+//----------
+  uint8_t b[LOT_DATAGRAM_MAX];
+
+  for (size_t i = 0; i < ids.size(); i += LOT_FRAMES_MAX) {
+    uint8_t count = std::min(ids.size() - i, (size_t)LOT_FRAMES_MAX);
+    lot_frame *f = lot_header_set(b, LOT_QUERY, count);
+
+    for (uint8_t k = 0; k < count; k++) {
+      lot_frame_set(&f[k], ids[i + k], 0, 0, 0, 0);
+    }
+    sendto(fd_, b, lot_len(count), MSG_DONTWAIT, (const struct sockaddr *)&to, sizeof(to));
+    result_.datagrams++;
+  }
+}
@@ -0,0 +1,112 @@
+/*
+ * LotManager status poller
+ *
+ * Sweeps the status of all monitors that reported before with LOT_QUERY
+ * datagrams, as coroutines on the event loop (task.h). The monitors are
+ * grouped by the address they report from, one node: a multi-bay ESP8266
+ * gets the queries for all its bays back to back, up to 64 per datagram,
+ * and answers them with a single status. Up to window nodes are queried at
+ * once, a node not answering for all bays within the timeout is asked again
+ * for the missing ones, at most retries times. The timeout follows the
+ * round trips like TCP's (srtt + 4 rttvar, RFC 6298, no samples from
+ * retried queries), between timeout_min_ms and timeout_ms. It doesn't back
+ * off, so a sweep over a lossy link still ends within (retries + 1)
+ * timeouts after the last node was asked.
+ *
+ * Any status taken over by the monitor table counts as the answer, the
+ * manager passes them in through on_status().
+ */
+
+#ifndef POLLER_H_
+#define POLLER_H_
+
+#include <coroutine>
+#include <cstdint>
+#include <functional>
+#include <unordered_set>
+#include <vector>
+#include <netinet/in.h>
+#include "event_loop.h"
+#include "monitor_table.h"
+#include "task.h"
+
+struct poller_config {
+  uint32_t timeout_ms     = 25;              // per attempt, until measured,
+  uint32_t timeout_min_ms = 5;               //   and the bounds of the measured
+  uint32_t retries        = 2;               //   after the first
+  uint32_t window         = 512;             // nodes queried at once
+};
+
+struct sweep_result {
+  uint32_t monitors;                         // queried
+  uint32_t nodes;                            //   on that many addresses
+  uint32_t answered;
+  uint32_t lost;                             // silent after the retries
+  uint32_t datagrams;                        // LOT_QUERY sent
+  uint32_t retries;                          // nodes asked again
+  uint32_t us;                               // duration
+  uint32_t timeout_ms;                       // at the end
+};
+
+class poller {
+public:
+  using done = std::function<void(const sweep_result &)>;
+
+  poller(event_loop &loop, const monitor_table &table, int udp_fd, const poller_config &cfg);
+  ~poller();
+  poller(const poller &) = delete;
+  poller &operator=(const poller &) = delete;
+
+  // Starts a sweep, d gets its result at the end. Returns 0 if a sweep is
+  // still running.
+  int sweep(done d);
+  bool busy() const { return busy_; }
+
+  // Takes a status of id as the answer to its query
+  void on_status(uint16_t id) {
+    if (table_.owns(id) && waiting(id)) {
+      answer(id);
+    }
+  }
+
+private:
+  struct request {
+    uint32_t left;                           // bays not answered
+    bool retried;                            //   no round trip sample then
+    uint64_t sent_us;
+    std::coroutine_handle<> waiter;
+    uint64_t timer;
+  };
+
+  // co_await answers{r}: until all bays of r answered or timeout_ms passed
+  struct answers {
+    poller &p;
+    request &r;
+
+    bool await_ready() const noexcept { return !r.left; }
+    void await_suspend(std::coroutine_handle<> h);
+    void await_resume() const noexcept {}
+  };
+
+  task run(done d);
+  task poll_node(std::vector<uint16_t> ids, struct sockaddr_in to);
+  void query(const std::vector<uint16_t> &ids, const struct sockaddr_in &to);
+  void answer(uint16_t id);
+  void sample(uint32_t rtt_us);
+  uint32_t timeout_ms() const;
+  request *&waiting(uint16_t id) { return waiting_[id - table_.first()]; }
+
+  event_loop &loop_;
+  const monitor_table &table_;
+  int fd_;
+  poller_config cfg_;
+  slots window_;
+  bool busy_ = false;
+  sweep_result result_ = {};
+  uint32_t srtt_us_ = 0;                     // 0 = no round trip yet
+  uint32_t rttvar_us_ = 0;
+  std::vector<request *> waiting_;           // by id - first, request of its query
+  std::unordered_set<request *> active_;     // suspended node tasks
+};
+
+#endif /* POLLER_H_ */
@@ -0,0 +1,89 @@
+/*
+ * LotManager trigger slots, see slot_schedule.h
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <system_error>
+#include <unordered_map>
+#include <sys/socket.h>
+#include "event_loop.h"
+#include "slot_schedule.h"
+
+slot_schedule::slot_schedule(uint32_t first, uint32_t monitors, uint8_t slots)
+  : first_(first), slot_(monitors), aux_(monitors), slots_(slots) {
+  if (!slots || slots > LOT_SLOTS_MAX) {
+    throw std::system_error(EINVAL, std::generic_category(), "slots");
+  }
+  for (uint32_t i = 0; i < monitors; i++) {
+    slot_[i] = (uint8_t)((first + i) % slots);
+  }
+}
+
+int slot_schedule::assign(uint16_t id, uint8_t slot) {
+  if (!owns(id) || slot >= slots_) {
+    return 0;
+  }
+  slot_[id - first_] = slot;
+  return 1;
+}
+
+//---------
+// This function groups the monitors by the address they report from and
+// sends each node its beacon, LOT_FRAMES_MAX frames per datagram. The phase
+// is taken right before each datagram goes out.
+//----------
+uint32_t slot_schedule::beacon(const monitor_table &table, int fd) {
+//----------
+  struct node {
+    struct sockaddr_in to;
+    std::vector<uint16_t> ids;
+  };
+  std::unordered_map<uint64_t, node> nodes;
+  uint8_t b[LOT_DATAGRAM_MAX];
+  uint32_t sent = 0;
+
+  for (uint32_t id = table.first(); id < table.end(); id++) {
+    const struct sockaddr_in *a = table.address(id);
+
+    if (a) {
+      node &n = nodes[(uint64_t)a->sin_addr.s_addr << 16 | a->sin_port];
+
+      n.to = *a;
+      n.ids.push_back(id);
+    }
+  }
+  for (auto &[key, n] : nodes) {
+    for (size_t i = 0; i < n.ids.size(); i += LOT_FRAMES_MAX) {
+      uint8_t count = (uint8_t)std::min<size_t>(n.ids.size() - i, LOT_FRAMES_MAX);
+      struct lot_frame *f = lot_header_set(b, LOT_SYNC, count);
+      uint32_t phase_us = (uint32_t)(event_loop::clock_us() % frame_us());
+
+      for (uint8_t k = 0; k < count; k++) {
+        uint16_t id = n.ids[i + k];
+
+        lot_sync_set(&f[k], id, seq_, slot(id), slots_, phase_us);
+      }
+      if (sendto(fd, b, LOT_HEADER_LEN + count * LOT_FRAME_LEN, MSG_DONTWAIT, (const struct sockaddr *)&n.to,
+                 sizeof(n.to)) > 0) {
+        sent++;
+      }
+    }
+  }
+  seq_++;
+  beacons_ += sent;
+  return sent;
+}
+
+slot_totals slot_schedule::totals(const monitor_table &table) const {
+  slot_totals t = {};
+
+  for (uint32_t id = table.first(); id < table.end(); id++) {
+    if (aux(id) && (table[id].flags & MONITOR_ONLINE)) {
+      t.synced++;
+      t.drift_us_max = std::max(t.drift_us_max, (uint32_t)std::abs(lot_aux_drift_us(aux(id))));
+    }
+  }
+  return t;
+}
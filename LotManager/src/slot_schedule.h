@@ -0,0 +1,74 @@
+/*
+ * LotManager trigger slots
+ *
+ * Neighbouring HY-SRF05 hear each other's echoes when they are triggered at
+ * once. The manager cuts its clock into frames of slots * LOT_SLOT_MS and
+ * gives every monitor a slot, which it triggers its sensor in only (see
+ * LotMonitor/core/tdma.h). By default monitor id gets slot id % slots, so
+ * the bays of a node and of a row, numbered one after the other, measure
+ * one after the other; SLOT moves a monitor to another slot.
+ *
+ * Every sync_ms the manager sends the beacons, one LOT_SYNC frame per
+ * monitor that reported before with its slot, grouped by node like the
+ * queries of a sweep. Each datagram carries where in its frame the manager
+ * was when it was sent, the monitors align their frames to it. A monitor
+ * tells in the aux byte of its status whether it is synced and the drift
+ * it found at the last beacon, the schedule keeps the last one.
+ */
+
+#ifndef SLOT_SCHEDULE_H_
+#define SLOT_SCHEDULE_H_
+
+#include <cstdint>
+#include <vector>
+#include "monitor_table.h"
+
+struct slot_totals {
+  uint32_t synced;                           // online monitors in their slot
+  uint32_t drift_us_max;                     //   largest drift of them
+};
+
+class slot_schedule {
+public:
+  // Slots of the monitors first..first + monitors - 1
+  slot_schedule(uint32_t first, uint32_t monitors, uint8_t slots);
+
+  uint8_t slots() const { return slots_; }
+  uint32_t frame_us() const { return slots_ * LOT_SLOT_MS * 1000; }
+  uint64_t beacons() const { return beacons_; }
+
+  // Slot of id, 0 if id is not scheduled here
+  uint8_t slot(uint16_t id) const { return owns(id) ? slot_[id - first_] : 0; }
+
+  // Moves id to slot with the next beacon. Returns 0 if id is not
+  // scheduled here or slot beyond the frame.
+  int assign(uint16_t id, uint8_t slot);
+
+  // Takes the aux byte of a status of id
+  void report(uint16_t id, uint8_t aux) {
+    if (owns(id)) {
+      aux_[id - first_] = aux;
+    }
+  }
+
+  // The last aux byte id reported, see lot_proto.h
+  uint8_t aux(uint16_t id) const { return owns(id) ? aux_[id - first_] : 0; }
+
+  // Sends the beacons to the monitors of table on the UDP socket fd.
+  // Returns the datagrams sent.
+  uint32_t beacon(const monitor_table &table, int fd);
+
+  slot_totals totals(const monitor_table &table) const;
+
+private:
+  bool owns(uint32_t id) const { return id - first_ < slot_.size(); }
+
+  uint32_t first_;
+  std::vector<uint8_t> slot_;                // by id - first_
+  std::vector<uint8_t> aux_;                 //   of the last status
+  uint8_t slots_;
+  uint8_t seq_ = 0;                          // of the next beacon
+  uint64_t beacons_ = 0;                     // datagrams sent
+};
+
+#endif /* SLOT_SCHEDULE_H_ */
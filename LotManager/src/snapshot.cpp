@@ -0,0 +1,63 @@
+/*
+ * LotManager snapshot, see snapshot.h
+ */
+
+#include <cerrno>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "event_loop.h"
+#include "snapshot.h"
+
+//---------
+// This function maps the table. A new one is created as a fresh file, a
+// reader still mapping the table of a manager before keeps its old copy and
+// sees the heartbeat stop. The file is sized before it is mapped, so the
+// slots start out zero: never reported.
+//----------
+snapshot::snapshot(const char *path, uint32_t monitors, uint32_t stale_ms, bool create)
+  : len_(lot_shm_len(monitors)) {
+//----------
+  int fd;
+  void *p;
+
+  if (create) {
+    unlink(path);
+    fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  } else {
+    fd = open(path, O_RDWR | O_CLOEXEC);
+  }
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(), path);
+  }
+  if (create && ftruncate(fd, len_) < 0) {
+    int e = errno;
+
+    close(fd);
+    throw std::system_error(e, std::generic_category(), path);
+  }
+  p = mmap(nullptr, len_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);                                 // the mapping stays
+  if (p == MAP_FAILED) {
+    throw std::system_error(errno, std::generic_category(), "mmap");
+  }
+  header_ = (lot_shm_header *)p;
+  slots_ = lot_shm_slots(header_);
+  if (create) {
+    header_->version = LOT_SHM_VERSION;
+    header_->slot_len = sizeof(lot_shm_slot);
+    header_->monitors = monitors;
+    header_->pid = getpid();
+    header_->stale_ms = stale_ms;
+    header_->heartbeat_ms = (uint32_t)(event_loop::clock_us() / 1000);
+    __atomic_store_n(&header_->magic, LOT_SHM_MAGIC, __ATOMIC_RELEASE);
+  } else if (header_->magic != LOT_SHM_MAGIC || header_->monitors != monitors) {
+    munmap(p, len_);
+    throw std::system_error(EINVAL, std::generic_category(), path);
+  }
+}
+
+snapshot::~snapshot() {
+  munmap(header_, len_);
+}
@@ -0,0 +1,49 @@
+/*
+ * LotManager snapshot
+ *
+ * The writer's side of the shared state table (lot_shm.h): a file mapped
+ * into the manager, a slot per monitor written under its seqlock whenever
+ * the monitor table changes. Readers map the same file and never call the
+ * manager; the manager never waits for them.
+ *
+ * The first shard creates the file anew, the other shards of a cluster map
+ * it too and write the slots of their own monitors, so every slot has one
+ * writer. The header is complete, magic last, before any slot is written.
+ */
+
+#ifndef SNAPSHOT_H_
+#define SNAPSHOT_H_
+
+#include <cstdint>
+#include "lot_shm.h"
+#include "monitor_table.h"
+
+static_assert(LOT_SHM_ONLINE == MONITOR_ONLINE && LOT_SHM_RESERVED == MONITOR_RESERVED, "same flags");
+
+class snapshot {
+public:
+  // Maps the table of path for monitors, creates it first if create.
+  snapshot(const char *path, uint32_t monitors, uint32_t stale_ms, bool create);
+  ~snapshot();
+  snapshot(const snapshot &) = delete;
+  snapshot &operator=(const snapshot &) = delete;
+
+  // Writes the state of id, by the owner of id only.
+  void publish(uint16_t id, const monitor_state &m) {
+    lot_shm_state s = {m.state, m.flags, m.distance_cm, m.seen_ms, m.changes, m.reported};
+
+    lot_shm_write(&slots_[id], &s);
+  }
+
+  // Tells the readers the manager is alive, by the first shard only.
+  void heartbeat(uint32_t now_ms) {
+    __atomic_store_n(&header_->heartbeat_ms, now_ms, __ATOMIC_RELEASE);
+  }
+
+private:
+  lot_shm_header *header_;
+  lot_shm_slot *slots_;
+  size_t len_;
+};
+
+#endif /* SNAPSHOT_H_ */
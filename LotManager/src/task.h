@@ -0,0 +1,124 @@
+/*
+ * LotManager coroutine tasks
+ *
+ * C++20 coroutines running on the event loop, so a job waiting for many
+ * monitors reads like a loop without a thread or a callback per monitor.
+ * A task starts suspended: co_await runs it and resumes the awaiting
+ * coroutine at its end, start() runs it detached, its frame is freed at its
+ * end. Nothing here is thread-safe, tasks run on the thread of the loop.
+ */
+
+#ifndef TASK_H_
+#define TASK_H_
+
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+
+class task {
+public:
+  struct promise_type {
+    std::coroutine_handle<> next;            // resumed at the end
+    bool detached = false;
+
+    task get_return_object() { return task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+
+    struct last {
+      bool await_ready() noexcept { return false; }
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+        std::coroutine_handle<> next = h.promise().next;
+
+        if (h.promise().detached) {
+          h.destroy();
+        }
+        return next ? next : std::noop_coroutine();
+      }
+      void await_resume() noexcept {}
+    };
+    last final_suspend() noexcept { return {}; }
+  };
+
+  task(task &&o) noexcept : h_(o.h_) { o.h_ = nullptr; }
+  task(const task &) = delete;
+  task &operator=(const task &) = delete;
+  ~task() {
+    if (h_) {
+      h_.destroy();
+    }
+  }
+
+  bool await_ready() const noexcept { return !h_ || h_.done(); }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+    h_.promise().next = awaiting;
+    return h_;
+  }
+  void await_resume() const noexcept {}
+
+  // Runs the task until it first suspends, it frees itself at its end.
+  void start() && {
+    std::coroutine_handle<promise_type> h = h_;
+
+    h_ = nullptr;
+    h.promise().detached = true;
+    h.resume();
+  }
+
+private:
+  explicit task(std::coroutine_handle<promise_type> h) : h_(h) {}
+
+  std::coroutine_handle<promise_type> h_;
+};
+
+// A counting semaphore for tasks: co_await acquire() waits for a slot,
+// release() hands it on to the longest waiting task.
+class slots {
+public:
+  explicit slots(uint32_t n) : free_(n) {}
+  slots(const slots &) = delete;
+  slots &operator=(const slots &) = delete;
+
+  struct acquirer {
+    slots &s;
+
+    bool await_ready() noexcept {
+      if (s.free_) {
+        s.free_--;
+        return true;
+      }
+      return false;
+    }
+    void await_suspend(std::coroutine_handle<> h) { s.waiting_.push_back(h); }
+    void await_resume() noexcept {}
+  };
+
+  acquirer acquire() { return acquirer{*this}; }
+
+  void release() {
+    if (waiting_.empty()) {
+      free_++;
+      return;
+    }
+    std::coroutine_handle<> h = waiting_.front();
+
+    waiting_.pop_front();
+    h.resume();                              // the slot passes on
+  }
+
+  // Destroys the waiting tasks, for the owner's destructor.
+  void destroy_waiting() {
+    for (std::coroutine_handle<> h : waiting_) {
+      h.destroy();
+    }
+    waiting_.clear();
+  }
+
+private:
+  uint32_t free_;
+  std::deque<std::coroutine_handle<>> waiting_;
+};
+
+#endif /* TASK_H_ */
@@ -0,0 +1,120 @@
+/*
+ * LotManager work pool, see work_pool.h
+ */
+
+#include <cerrno>
+#include <system_error>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include "work_pool.h"
+
+work_pool::work_pool(unsigned workers) {
+  for (unsigned i = 0; i < workers; i++) {
+    std::unique_ptr<worker> w(new worker);
+
+    w->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (w->efd < 0) {
+      throw std::system_error(errno, std::generic_category(), "eventfd");
+    }
+    workers_.push_back(std::move(w));
+  }
+}
+
+work_pool::~work_pool() {
+  for (auto &w : workers_) {
+    close(w->efd);
+  }
+}
+
+//---------
+// One eventfd write per wake-up, however many jobs arrive meanwhile
+//----------
+void work_pool::wake(worker &w) {
+//----------
+  uint64_t one = 1;
+
+  if (!w.woken.exchange(true, std::memory_order_acq_rel)) {
+    (void)!write(w.efd, &one, sizeof(one));
+  }
+}
+
+void work_pool::post(unsigned w, job j) {
+  worker &to = *workers_[w];
+
+  {
+    std::lock_guard<std::mutex> g(to.lock);
+    to.inbox.push_back(std::move(j));
+  }
+  wake(to);
+}
+
+void work_pool::spawn(unsigned self, job j) {
+  {
+    std::lock_guard<std::mutex> g(workers_[self]->lock);
+    workers_[self]->local.push_back(std::move(j));
+  }
+  for (unsigned i = 1; i < workers_.size(); i++) {
+    worker &w = *workers_[(self + i) % workers_.size()];
+
+    if (w.idle.load(std::memory_order_relaxed)) {
+      wake(w);
+      return;
+    }
+  }
+}
+
+size_t work_pool::run(unsigned self) {
+  worker &w = *workers_[self];
+  std::vector<job> inbox;
+  size_t n = 0;
+  uint64_t count;
+
+  // Always read, the write of a wake() may land after woken was seen and
+  // would leave the eventfd readable for good. Read before clearing, a
+  // wake() after the clear writes again and the next round reads it.
+  (void)!read(w.efd, &count, sizeof(count));
+  w.woken.store(false, std::memory_order_seq_cst); // then take the jobs
+  {
+    std::lock_guard<std::mutex> g(w.lock);
+    inbox.swap(w.inbox);
+  }
+  for (job &j : inbox) {
+    j();
+    n++;
+  }
+  for (;;) {                                 // own jobs, newest first
+    job j;
+    {
+      std::lock_guard<std::mutex> g(w.lock);
+
+      if (w.local.empty()) {
+        break;
+      }
+      j = std::move(w.local.back());
+      w.local.pop_back();
+    }
+    j();
+    n++;
+  }
+  for (bool found = true; found; ) {         // the others' oldest
+    found = false;
+    for (unsigned i = 1; i < workers_.size(); i++) {
+      worker &victim = *workers_[(self + i) % workers_.size()];
+      job j;
+      {
+        std::lock_guard<std::mutex> g(victim.lock);
+
+        if (victim.local.empty()) {
+          continue;
+        }
+        j = std::move(victim.local.front());
+        victim.local.pop_front();
+      }
+      j();
+      stolen_.fetch_add(1, std::memory_order_relaxed);
+      found = true;
+      n++;
+    }
+  }
+  return n;
+}
@@ -0,0 +1,71 @@
+/*
+ * LotManager work pool
+ *
+ * Jobs between the shards of a cluster (cluster.h), run by the shard
+ * threads themselves between the rounds of their event loops. A job for
+ * the state of one shard is posted to that shard's inbox and runs there. A
+ * job touching no shard state, like formatting the CHANGE lines of a round,
+ * is spawned onto the deque of the spawning shard: the owner takes its jobs
+ * newest first while they are warm in its cache, an idle shard steals the
+ * oldest from the other end, so a shard flooded with status doesn't sit on
+ * work the others could do.
+ *
+ * Every worker has an eventfd its loop watches, a post or a spawn wakes the
+ * worker it is meant for, or an idle one.
+ */
+
+#ifndef WORK_POOL_H_
+#define WORK_POOL_H_
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class work_pool {
+public:
+  using job = std::function<void()>;
+
+  explicit work_pool(unsigned workers);
+  ~work_pool();
+  work_pool(const work_pool &) = delete;
+  work_pool &operator=(const work_pool &) = delete;
+
+  unsigned size() const { return (unsigned)workers_.size(); }
+  int wake_fd(unsigned w) const { return workers_[w]->efd; }
+
+  // Runs j on worker w, jobs posted from one thread run in order.
+  void post(unsigned w, job j);
+
+  // Runs j on self or on whichever worker steals it first.
+  void spawn(unsigned self, job j);
+
+  // Runs the inbox and the deque of self, then steals from the others until
+  // there is nothing left. Returns the number of jobs run.
+  size_t run(unsigned self);
+
+  // Marks self as waiting for events, a spawn wakes an idle worker.
+  void idle(unsigned self, bool idle) { workers_[self]->idle.store(idle, std::memory_order_relaxed); }
+
+  uint64_t stolen() const { return stolen_.load(std::memory_order_relaxed); }
+
+private:
+  struct alignas(64) worker {
+    std::mutex lock;
+    std::vector<job> inbox;                  // posted, run in order
+    std::deque<job> local;                   // spawned, stealable at the front
+    int efd;
+    std::atomic<bool> idle{false};
+    std::atomic<bool> woken{false};          // eventfd written, not yet read
+  };
+
+  void wake(worker &w);
+
+  std::vector<std::unique_ptr<worker>> workers_;
+  std::atomic<uint64_t> stolen_{0};
+};
+
+#endif /* WORK_POOL_H_ */
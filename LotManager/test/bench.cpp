@@ -0,0 +1,118 @@
+/*
+ * LotManager status decoding benchmark
+ *
+ * Decodes status datagrams (lot_proto.h) the way manager::on_udp() does,
+ * from buffers as recvmmsg() fills them, and reports frames per second:
+ * validation alone, one frame at a time and vectorised, and the whole
+ * path of header check, validation and monitor table update.
+ *
+ * usage: proto_bench [frames_per_datagram [seconds]]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <netinet/in.h>
+#include "event_loop.h"
+#include "lot_batch.h"
+#include "monitor_table.h"
+
+#define DATAGRAMS 4096                       // 2MB of receive buffers
+#define MONITORS  65536
+
+static std::vector<uint8_t> buffers(DATAGRAMS * LOT_DATAGRAM_MAX);
+static volatile uint64_t sink;               // keeps the results alive
+
+//---------
+// This function fills the buffers with datagrams of count frames, one in
+// 64 frames damaged, as the monitors of a large lot would send them. The
+// frames are marked LOT_F_BOOT, so the table takes them over in every
+// round instead of dropping them as duplicates.
+//----------
+static void fill(unsigned count) {
+//----------
+  uint32_t seed = 1;
+
+  for (unsigned d = 0; d < DATAGRAMS; d++) {
+    lot_frame *f = lot_header_set(&buffers[d * LOT_DATAGRAM_MAX], LOT_STATUS, count);
+
+    for (unsigned i = 0; i < count; i++) {
+      seed = seed * 1103515245 + 12345;
+      lot_frame_set(&f[i], (d * count + i) % MONITORS, seed >> 8, (seed >> 16 & 3) | LOT_F_BOOT,
+                    seed >> 20 & 0x1FF, 0);
+      if (!(seed >> 24 & 63)) {
+        f[i].b[4] ^= 1;
+      }
+    }
+  }
+}
+
+//---------
+// This function runs pass over all buffers until seconds passed, returns
+// the frames per second.
+//----------
+template <typename F> static double measure(unsigned count, double seconds, F pass) {
+//----------
+  uint64_t start = event_loop::clock_us(), elapsed, rounds = 0;
+
+  do {
+    for (unsigned d = 0; d < DATAGRAMS; d++) {
+      pass(&buffers[d * LOT_DATAGRAM_MAX], lot_len(count));
+    }
+    rounds++;
+    elapsed = event_loop::clock_us() - start;
+  } while (elapsed < seconds * 1e6);
+  return (double)rounds * DATAGRAMS * count / (elapsed / 1e6);
+}
+
+int main(int argc, char **argv) {
+  unsigned count = argc > 1 ? strtoul(argv[1], NULL, 0) : 32;
+  double seconds = argc > 2 ? strtod(argv[2], NULL) : 1.0;
+  monitor_table table(MONITORS);
+  struct sockaddr_in from = {};
+  uint64_t updates = 0;
+  uint32_t now_ms = 0;
+
+  if (!count || count > LOT_FRAMES_MAX) {
+    fprintf(stderr, "usage: proto_bench [frames_per_datagram [seconds]]\n");
+    return 1;
+  }
+  fill(count);
+  from.sin_port = 1;
+
+  double scalar = measure(count, seconds, [](const uint8_t *b, size_t len) {
+    uint8_t type, n = 0;
+    const lot_frame *f = lot_frames(b, len, &type, &n);
+
+    sink = sink + lot_validate_scalar(f, n);
+  });
+  double vector = measure(count, seconds, [](const uint8_t *b, size_t len) {
+    uint8_t type, n = 0;
+    const lot_frame *f = lot_frames(b, len, &type, &n);
+
+    sink = sink + lot_validate(f, n);
+  });
+  double decode = measure(count, seconds, [&](const uint8_t *b, size_t len) {
+    uint8_t type, n = 0;
+    const lot_frame *f = lot_frames(b, len, &type, &n);
+    uint64_t valid;
+
+    if (!f || type != LOT_STATUS) {
+      return;
+    }
+    valid = lot_validate(f, n);
+    for (uint8_t k = 0; k < n; k++) {
+      if (valid >> k & 1) {
+        updates += table.update(f[k], now_ms, from) & TABLE_UPDATED;
+      }
+    }
+    now_ms++;
+  });
+
+  printf("%u frames per datagram, %u monitors\n", count, MONITORS);
+  printf("  validate, scalar      %8.1f M frames/s\n", scalar / 1e6);
+  printf("  validate, %-6s      %8.1f M frames/s\n", lot_validate_path(), vector / 1e6);
+  printf("  decode + table update %8.1f M frames/s (%llu updates)\n", decode / 1e6,
+         (unsigned long long)updates);
+  return 0;
+}
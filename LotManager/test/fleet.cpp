@@ -0,0 +1,626 @@
+/*
+ * LotMonitor fleet simulator
+ *
+ * Runs thousands of virtual LotMonitors against a LotManager on loopback
+ * and measures the whole pipeline. Every bay measures at 10 Hz through the
+ * occupancy filter of the firmware (../LotMonitor/core/occupancy.c) with the
+ * firmware's limits: echoes beyond MONITOR_DISTANCE_MAX_CM count as nothing
+ * in range, cars may stop within MONITOR_ALARM_CM. Cars arrive after an
+ * exponential vacancy, drive in, park for an exponential dwell time and
+ * drive out, a rush lets a share of them leave at once halfway through the
+ * run. Nodes of several bays report like the ESP8266 sketch: one datagram
+ * for all bays on every change and at least every report period, and on a
+ * reservation or query of the manager, right away.
+ *
+ * A WATCH connection plays LotManagement: the end-to-end latency of a state
+ * change is the time from the datagram reporting it to the CHANGE line.
+ * With -s it asks the manager for a SWEEP of all monitors that often. With
+ * -F it takes the changes from a FEED with that window instead, granting a
+ * credit for every DELTA line, -C ms after it arrived to play a slow
+ * LotManagement.
+ *
+ * usage: fleet [-m manager] [-j shards] [-n monitors] [-o first_id] [-b bays]
+ *              [-t seconds] [-v vacancy_s] [-d dwell_s] [-p report_ms]
+ *              [-r rush_percent] [-s sweep_ms] [-H hz] [-F window_ms] [-C credit_ms]
+ *
+ * Without -m it runs the manager on a thread of its own, or a cluster of
+ * shards with -j, -m address:udp:tcp drives a running one. Several fleets
+ * drive one manager with -o, each with ids of its own. -H raises the
+ * measurement rate beyond the firmware's 10 Hz and -p 0 reports every
+ * measurement, for a load the manager can't take any more.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "lot_proto.h"
+#include "cluster.h"
+#include "manager.h"
+#include "occupancy.h"
+
+#define SOCKETS      64                      // nodes share them round robin
+#define TICK_MS      10                      // a tenth of the bays per tick
+#define DRIVE_MS     4000                    // driving in or out
+#define FAR_CM       400                     // where a car enters the sensor
+#define NOISE        50                      // one in NOISE echoes is lost
+#define CREDITS      4                       // DELTA lines in flight
+
+enum { SCENE_FREE, SCENE_ARRIVING, SCENE_PARKED, SCENE_LEAVING };
+
+struct bay {
+  struct occupancy o;                        // firmware filter, 12 bytes
+  uint8_t  scene;                            // SCENE_*
+  uint8_t  seq;
+  uint8_t  flags;                            // LOT_F_RESERVED, LOT_F_BOOT
+  uint8_t  sent;                             // state last reported
+  uint16_t park_cm;                          // where the car stops
+  uint32_t since_ms;                         // scene started
+  uint32_t until_ms;                         //   and ends
+  uint64_t change_us;                        // sent a state change, 0 = none
+};
+
+struct node {
+  uint32_t reported_ms;                      // last datagram
+  uint8_t  dirty;                            // report at the next tick
+  uint8_t  flags;                            //   with these LOT_F_*
+};
+
+struct fleet_config {
+  std::string address = "127.0.0.1";
+  uint16_t udp_port = 0;                     // 0 = manager of our own
+  uint16_t tcp_port = 0;
+  uint32_t monitors = 10000;
+  uint32_t first = 0;                        // id of the first bay
+  uint32_t bays = 1;                         // per node
+  double   seconds = 10;
+  double   vacancy_s = 60;                   // mean time a bay stays free
+  double   dwell_s = 120;                    //   and occupied
+  uint32_t report_ms = 1000;
+  uint32_t rush_percent = 0;
+  uint32_t sweep_ms = 0;                     // 0 = no sweeps
+  uint32_t hz = 1000 / MONITOR_PERIOD_MS;    // measurements per bay and second
+  int32_t  feed_ms = -1;                     // FEED window, -1 = WATCH
+  uint32_t credit_ms = 0;                    //   credit returned after
+};
+
+class fleet {
+public:
+  fleet(event_loop &loop, const fleet_config &cfg);
+  ~fleet();
+  void run();
+  void print() const;
+
+private:
+  double random();                           // (0, 1]
+  uint32_t exponential_ms(double mean_s) { return (uint32_t)(-log(random()) * mean_s * 1000); }
+  uint16_t distance_cm(bay &b, uint32_t now_ms);
+  void tick();
+  void report(uint32_t n, uint32_t now_ms);
+  void on_udp(int fd);
+  void on_watch();
+  void delta(const char *line);
+  void rush(uint32_t now_ms);
+  void sweep();
+
+  event_loop &loop_;
+  fleet_config cfg_;
+  std::vector<bay> bays_;
+  std::vector<node> nodes_;
+  int fds_[SOCKETS];
+  int watch_fd_;
+  struct sockaddr_in to_;
+  uint32_t seed_ = 1;
+  uint32_t tick_ = 0;
+  uint64_t start_us_;
+  bool sending_ = true;
+  std::string in_;
+  std::string stats_;                        // of the manager
+
+  uint64_t datagrams_ = 0, frames_ = 0, send_errors_ = 0;
+  uint64_t changes_ = 0, reported_ = 0, queries_ = 0, samples_ = 0;
+  uint64_t deltas_ = 0, batches_ = 0;
+  std::vector<uint32_t> latency_us_;
+  std::vector<uint32_t> sweep_us_;
+  uint64_t sweep_lost_ = 0;
+};
+
+static struct sockaddr_in inet(const std::string &address, uint16_t port) {
+  struct sockaddr_in a = {};
+
+  a.sin_family = AF_INET;
+  a.sin_port = htons(port);
+  inet_pton(AF_INET, address.c_str(), &a.sin_addr);
+  return a;
+}
+
+fleet::fleet(event_loop &loop, const fleet_config &cfg)
+  : loop_(loop), cfg_(cfg), bays_(cfg.monitors), nodes_((cfg.monitors + cfg.bays - 1) / cfg.bays) {
+  struct sockaddr_in a = inet(cfg_.address, cfg_.tcp_port);
+  uint32_t now_ms = 0;
+  char ok[3];
+
+  to_ = inet(cfg_.address, cfg_.udp_port);
+  for (int i = 0; i < SOCKETS; i++) {
+    struct sockaddr_in any = inet(cfg_.address, 0);
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+
+    bind(fd, (struct sockaddr *)&any, sizeof(any));
+    fds_[i] = fd;
+    loop_.add(fd, EPOLLIN, [this, fd](uint32_t) { on_udp(fd); });
+  }
+  watch_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+  if (connect(watch_fd_, (struct sockaddr *)&a, sizeof(a)) < 0) {
+    perror("fleet: manager");
+    exit(1);
+  }
+  if (cfg_.feed_ms < 0) {
+    send(watch_fd_, "WATCH\n", 6, 0);
+  } else {
+    char cmd[32];
+
+    send(watch_fd_, cmd, snprintf(cmd, sizeof(cmd), "FEED %d %d\n", cfg_.feed_ms, CREDITS), 0);
+  }
+  if (recv(watch_fd_, ok, sizeof(ok), MSG_WAITALL) != 3 || memcmp(ok, "OK\n", 3)) {
+    fprintf(stderr, "fleet: manager refused %s\n", cfg_.feed_ms < 0 ? "WATCH" : "FEED");
+    exit(1);
+  }
+  loop_.add(watch_fd_, EPOLLIN, [this](uint32_t) { on_watch(); });
+
+  for (bay &b : bays_) {                     // steady state to start from
+    occupancy_init(&b.o);
+    b.flags = LOT_F_BOOT;
+    if (random() < cfg_.dwell_s / (cfg_.dwell_s + cfg_.vacancy_s)) {
+      b.scene = SCENE_PARKED;
+      b.park_cm = random() < 0.05 ? 15 + random() * 10 : 40 + random() * 120;
+      b.until_ms = exponential_ms(cfg_.dwell_s);
+      for (int i = 0; i < MONITOR_SETTLE_SAMPLES + MONITOR_DEBOUNCE; i++) {
+        occupancy_update(&b.o, b.park_cm * MONITOR_US_PER_CM);
+      }
+    } else {
+      b.scene = SCENE_FREE;
+      b.until_ms = exponential_ms(cfg_.vacancy_s);
+    }
+    b.since_ms = now_ms;
+    b.sent = b.o.state;                      // the first report isn't timed
+  }
+  latency_us_.reserve(1 << 20);
+}
+
+fleet::~fleet() {
+  for (int fd : fds_) {
+    loop_.remove(fd);
+    close(fd);
+  }
+  loop_.remove(watch_fd_);
+  close(watch_fd_);
+}
+
+double fleet::random() {
+  seed_ = seed_ * 1103515245 + 12345;
+  return ((seed_ >> 8) + 1) / 16777216.0;
+}
+
+//---------
+// This function moves the scene of b on to now and returns the distance to
+// the car in cm, 0 if there is none in range.
+//----------
+uint16_t fleet::distance_cm(bay &b, uint32_t now_ms) {
+//----------
+  if (now_ms >= b.until_ms) {
+    b.since_ms = now_ms;
+    switch (b.scene) {
+    case SCENE_FREE:
+      b.scene = SCENE_ARRIVING;
+      b.park_cm = random() < 0.05 ? 15 + random() * 10 : 40 + random() * 120;
+      b.until_ms = now_ms + DRIVE_MS;
+      break;
+    case SCENE_ARRIVING:
+      b.scene = SCENE_PARKED;
+      b.until_ms = now_ms + exponential_ms(cfg_.dwell_s);
+      break;
+    case SCENE_PARKED:
+      b.scene = SCENE_LEAVING;
+      b.until_ms = now_ms + DRIVE_MS;
+      break;
+    default:
+      b.scene = SCENE_FREE;
+      b.until_ms = now_ms + exponential_ms(cfg_.vacancy_s);
+    }
+  }
+  uint32_t driven = (now_ms - b.since_ms) * (FAR_CM - b.park_cm) / DRIVE_MS;
+  uint32_t cm;
+
+  switch (b.scene) {
+  case SCENE_ARRIVING: cm = FAR_CM - driven; break;
+  case SCENE_PARKED:   cm = b.park_cm; break;
+  case SCENE_LEAVING:  cm = b.park_cm + driven; break;
+  default:             return 0;
+  }
+  return cm > MONITOR_DISTANCE_MAX_CM ? 0 : cm;
+}
+
+//---------
+// This function measures a share of the bays, every bay hz times a second,
+// and reports the nodes with a change or due.
+//----------
+void fleet::tick() {
+//----------
+  uint32_t now_ms = (uint32_t)((event_loop::clock_us() - start_us_) / 1000);
+  uint32_t ticks = std::max(1000 / (cfg_.hz * TICK_MS), 1u);
+  uint32_t phase = tick_++ % ticks;
+
+  if (now_ms >= cfg_.seconds * 1000) {
+    sending_ = false;
+    return;
+  }
+  if (cfg_.rush_percent && tick_ == (uint32_t)(cfg_.seconds * 500 / TICK_MS)) {
+    rush(now_ms);
+  }
+  for (uint32_t n = phase; n < nodes_.size(); n += ticks) {
+    node &nd = nodes_[n];
+
+    for (uint32_t id = n * cfg_.bays; id < std::min((n + 1) * cfg_.bays, cfg_.monitors); id++) {
+      bay &b = bays_[id];
+      uint16_t cm = distance_cm(b, now_ms);
+      uint16_t echo_us = cm * MONITOR_US_PER_CM;
+
+      if (random() * NOISE < 1) {
+        echo_us = 0;                         // lost echo, the filter copes
+      }
+      samples_++;
+      if (occupancy_update(&b.o, echo_us)) {
+        nd.dirty = 1;
+      }
+    }
+    if (nd.dirty || now_ms - nd.reported_ms >= cfg_.report_ms) {
+      report(n, now_ms);
+    }
+  }
+  loop_.after(TICK_MS - (event_loop::clock_us() - start_us_) / 1000 % TICK_MS, [this] { tick(); });
+}
+
+//---------
+// This function sends the status of all bays of node n in one datagram
+//----------
+void fleet::report(uint32_t n, uint32_t now_ms) {
+//----------
+  uint8_t buf[LOT_DATAGRAM_MAX];
+  uint32_t first = n * cfg_.bays, count = std::min(cfg_.bays, cfg_.monitors - first);
+  lot_frame *f = lot_header_set(buf, LOT_STATUS, count);
+  node &nd = nodes_[n];
+  uint64_t now_us = event_loop::clock_us();
+
+  for (uint32_t i = 0; i < count; i++) {
+    bay &b = bays_[first + i];
+    uint16_t cm = b.o.distance_us / MONITOR_US_PER_CM;
+
+    lot_frame_set(&f[i], cfg_.first + first + i, b.seq, b.o.state | b.flags | nd.flags,
+                  cm > MONITOR_DISTANCE_MAX_CM ? 0 : cm, 0);
+    if (!++b.seq) {
+      b.flags &= ~LOT_F_BOOT;
+    }
+    if (b.o.state != b.sent) {               // times the CHANGE line
+      b.sent = b.o.state;
+      b.change_us = now_us;
+      changes_++;
+    }
+  }
+  if (sendto(fds_[n % SOCKETS], buf, lot_len(count), 0, (struct sockaddr *)&to_, sizeof(to_)) < 0) {
+    send_errors_++;
+  }
+  datagrams_++;
+  frames_ += count;
+  nd.reported_ms = now_ms;
+  nd.dirty = 0;
+  nd.flags = 0;
+}
+
+//---------
+// This function answers the reservations and queries of the manager like
+// the ESP8266 sketch, with one status of each node asked.
+//----------
+void fleet::on_udp(int fd) {
+//----------
+  uint8_t buf[LOT_DATAGRAM_MAX];
+  ssize_t len;
+
+  while ((len = recv(fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+    uint8_t type, count;
+    const lot_frame *f = lot_frames(buf, len, &type, &count);
+    uint32_t now_ms = (uint32_t)((event_loop::clock_us() - start_us_) / 1000);
+    uint32_t last = UINT32_MAX;
+
+    for (uint8_t k = 0; f && k < count; k++) {
+      uint32_t id = lot_id(&f[k]) - cfg_.first;
+
+      if (!lot_frame_valid(&f[k]) || id >= cfg_.monitors) { // wraps below first
+        continue;
+      }
+      if (type == LOT_RESERVE) {
+        bays_[id].flags = (bays_[id].flags & ~LOT_F_RESERVED) | (lot_flags(&f[k]) & LOT_F_RESERVED);
+      } else if (type != LOT_QUERY) {
+        continue;
+      }
+      queries_++;
+      if (id / cfg_.bays != last) {          // the ids of a node come together
+        last = id / cfg_.bays;
+        nodes_[last].flags = LOT_F_REPLY;
+        report(last, now_ms);
+      }
+    }
+  }
+}
+
+//---------
+// This function takes the CHANGE and DELTA lines, the latency of a change
+// is known once the manager reported the state the fleet sent last.
+//----------
+void fleet::on_watch() {
+//----------
+  char buf[65536];
+  ssize_t n = recv(watch_fd_, buf, sizeof(buf), MSG_DONTWAIT);
+  uint64_t now_us = event_loop::clock_us();
+  size_t start = 0, eol;
+
+  if (n <= 0) {
+    if (n == 0) {
+      fprintf(stderr, "fleet: manager closed the connection\n");
+      exit(1);
+    }
+    return;
+  }
+  in_.append(buf, n);
+  while ((eol = in_.find('\n', start)) != std::string::npos) {
+    unsigned id, state;
+
+    unsigned us, lost;
+
+    if (!in_.compare(start, 6, "STATS ")) {
+      stats_ = in_.substr(start, eol - start);
+    } else if (sscanf(in_.c_str() + start, "SWEEP monitors %*u nodes %*u answered %*u lost %u "
+                      "datagrams %*u retries %*u us %u", &lost, &us) == 2) {
+      sweep_us_.push_back(us);
+      sweep_lost_ += lost;
+    } else if (!in_.compare(start, 6, "DELTA ")) {
+      in_[eol] = 0;
+      delta(in_.c_str() + start);
+    } else if (sscanf(in_.c_str() + start, "CHANGE %u %u", &id, &state) == 2 &&
+               id - cfg_.first < cfg_.monitors) {  // another fleet's otherwise
+      bay &b = bays_[id - cfg_.first];
+
+      if (b.change_us && state == b.sent) {
+        latency_us_.push_back((uint32_t)(now_us - b.change_us));
+        b.change_us = 0;
+        reported_++;
+      }
+    }
+    start = eol + 1;
+  }
+  in_.erase(0, start);
+}
+
+//---------
+// This function takes the changes of one DELTA line, then gives the credit
+// it took back.
+//----------
+void fleet::delta(const char *line) {
+//----------
+  uint64_t now_us = event_loop::clock_us();
+  unsigned n, id, state;
+  int len;
+
+  if (sscanf(line, "DELTA %*u %u%n", &n, &len) != 1) {
+    return;
+  }
+  batches_++;
+  for (unsigned i = 0; i < n; i++) {
+    line += len;
+    if (sscanf(line, " %u %u %*u %*u%n", &id, &state, &len) != 2) {
+      break;
+    }
+    deltas_++;
+    if (id - cfg_.first < cfg_.monitors) {
+      bay &b = bays_[id - cfg_.first];
+
+      if (b.change_us && state == b.sent) {
+        latency_us_.push_back((uint32_t)(now_us - b.change_us));
+        b.change_us = 0;
+        reported_++;
+      }
+    }
+  }
+  if (cfg_.credit_ms) {
+    loop_.after(cfg_.credit_ms, [this] { send(watch_fd_, "CREDIT 1\n", 9, 0); });
+  } else {
+    send(watch_fd_, "CREDIT 1\n", 9, 0);
+  }
+}
+
+//---------
+// This function ends a shift: the given share of the parked cars leaves
+// within the next 10 seconds.
+//----------
+void fleet::rush(uint32_t now_ms) {
+//----------
+  for (bay &b : bays_) {
+    if (b.scene == SCENE_PARKED && random() * 100 < cfg_.rush_percent) {
+      b.until_ms = now_ms + random() * 10000;
+    }
+  }
+}
+
+void fleet::sweep() {
+  if (sending_) {
+    send(watch_fd_, "SWEEP\n", 6, 0);
+    loop_.after(cfg_.sweep_ms, [this] { sweep(); });
+  }
+}
+
+//---------
+// This function runs the fleet for the configured time, then waits for the
+// last changes and asks the manager for its statistics.
+//----------
+void fleet::run() {
+//----------
+  uint64_t end_us;
+
+  start_us_ = event_loop::clock_us();
+  tick();
+  if (cfg_.sweep_ms) {
+    loop_.after(cfg_.sweep_ms, [this] { sweep(); });
+  }
+  while (sending_) {
+    loop_.poll(-1);
+  }
+  end_us = event_loop::clock_us() + 500000;  // changes still in flight
+  while (event_loop::clock_us() < end_us) {
+    loop_.poll(10);
+  }
+  send(watch_fd_, "STATS\n", 6, 0);
+  end_us = event_loop::clock_us() + 1000000;
+  while (stats_.empty() && event_loop::clock_us() < end_us) {
+    loop_.poll(10);
+  }
+}
+
+void fleet::print() const {
+  std::vector<uint32_t> l = latency_us_;
+  double s = cfg_.seconds;
+  auto pct = [&](double p) { return l.empty() ? 0u : l[std::min(l.size() - 1, (size_t)(p / 100 * l.size()))]; };
+
+  std::sort(l.begin(), l.end());
+  printf("fleet: %u monitors on %zu nodes, %.0f s\n", cfg_.monitors, nodes_.size(), s);
+  printf("  measurements %12llu %10.0f /s\n", (unsigned long long)samples_, samples_ / s);
+  printf("  datagrams    %12llu %10.0f /s (%llu send errors)\n", (unsigned long long)datagrams_,
+         datagrams_ / s, (unsigned long long)send_errors_);
+  printf("  frames       %12llu %10.0f /s\n", (unsigned long long)frames_, frames_ / s);
+  printf("  changes      %12llu %10.0f /s, %llu reported\n", (unsigned long long)changes_, changes_ / s,
+         (unsigned long long)reported_);
+  printf("  queries      %12llu\n", (unsigned long long)queries_);
+  if (batches_) {
+    printf("  deltas       %12llu in %llu DELTA lines, %.1f each\n", (unsigned long long)deltas_,
+           (unsigned long long)batches_, (double)deltas_ / batches_);
+  }
+  printf("  latency us   p50 %u  p90 %u  p99 %u  p99.9 %u  max %u\n",
+         pct(50), pct(90), pct(99), pct(99.9), l.empty() ? 0 : l.back());
+  if (!sweep_us_.empty()) {
+    std::vector<uint32_t> w = sweep_us_;
+
+    std::sort(w.begin(), w.end());
+    printf("  sweeps       %12zu, us p50 %u  max %u, %llu monitors lost\n", w.size(), w[w.size() / 2],
+           w.back(), (unsigned long long)sweep_lost_);
+  }
+  printf("  manager      %s\n", stats_.empty() ? "no STATS" : stats_.c_str() + 6);
+}
+
+//---------
+// This function runs a manager on its own thread and loop until stop is set
+//----------
+static void serve(manager_config cfg, std::atomic<uint16_t> *udp, std::atomic<uint16_t> *tcp,
+                  std::atomic<bool> *stop) {
+//----------
+  event_loop loop;
+  manager m(loop, cfg);
+
+  *tcp = m.tcp_port();
+  *udp = m.udp_port();
+  while (!*stop) {
+    loop.poll(10);
+  }
+}
+
+static void usage(void) {
+  fprintf(stderr, "usage: fleet [-m address:udp:tcp] [-j shards] [-n monitors] [-o first_id] [-b bays]\n"
+                  "             [-t seconds] [-v vacancy_s] [-d dwell_s] [-p report_ms]\n"
+                  "             [-r rush_percent] [-s sweep_ms] [-H hz] [-F window_ms] [-C credit_ms]\n");
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  fleet_config cfg;
+  std::atomic<uint16_t> udp(0), tcp(0);
+  std::atomic<bool> stop(false);
+  std::thread server;
+  std::unique_ptr<cluster> shards;
+  unsigned jobs = 1;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "m:j:n:o:b:t:v:d:p:r:s:H:F:C:")) != -1) {
+    char address[64];
+    unsigned u, t;
+
+    switch (opt) {
+    case 'm':
+      if (sscanf(optarg, "%63[^:]:%u:%u", address, &u, &t) != 3) {
+        usage();
+      }
+      cfg.address = address;
+      cfg.udp_port = u;
+      cfg.tcp_port = t;
+      break;
+    case 'j': jobs = strtoul(optarg, NULL, 0); break;
+    case 'n': cfg.monitors = strtoul(optarg, NULL, 0); break;
+    case 'o': cfg.first = strtoul(optarg, NULL, 0); break;
+    case 'b': cfg.bays = strtoul(optarg, NULL, 0); break;
+    case 't': cfg.seconds = strtod(optarg, NULL); break;
+    case 'v': cfg.vacancy_s = strtod(optarg, NULL); break;
+    case 'd': cfg.dwell_s = strtod(optarg, NULL); break;
+    case 'p': cfg.report_ms = strtoul(optarg, NULL, 0); break;
+    case 'r': cfg.rush_percent = strtoul(optarg, NULL, 0); break;
+    case 's': cfg.sweep_ms = strtoul(optarg, NULL, 0); break;
+    case 'H': cfg.hz = strtoul(optarg, NULL, 0); break;
+    case 'F': cfg.feed_ms = strtol(optarg, NULL, 0); break;
+    case 'C': cfg.credit_ms = strtoul(optarg, NULL, 0); break;
+    default: usage();
+    }
+  }
+  if (optind != argc || !cfg.monitors || cfg.first + cfg.monitors > 65536 || !cfg.bays ||
+      cfg.bays > LOT_FRAMES_MAX || !cfg.hz || !jobs) {
+    usage();
+  }
+  if (!cfg.udp_port) {
+    manager_config mc;
+
+    mc.address = "127.0.0.1";
+    mc.udp_port = 0;
+    mc.tcp_port = 0;
+    mc.monitors = cfg.first + cfg.monitors;
+    if (jobs > 1) {
+      mc.shards = jobs;
+      shards.reset(new cluster(mc));
+      shards->start();
+      cfg.udp_port = shards->udp_port();
+      cfg.tcp_port = shards->tcp_port();
+    } else {
+      server = std::thread(serve, mc, &udp, &tcp, &stop);
+      while (!udp) {
+        std::this_thread::yield();
+      }
+      cfg.udp_port = udp;
+      cfg.tcp_port = tcp;
+    }
+  }
+  {
+    event_loop loop;
+    fleet f(loop, cfg);
+
+    f.run();
+    f.print();
+  }
+  if (server.joinable()) {
+    stop = true;
+    server.join();
+  }
+  return 0;
+}
@@ -0,0 +1,86 @@
+/*
+ * LotManager event log benchmark
+ *
+ * Appends status changes to the event logs of two managers of 65536
+ * monitors each, in dir.0 and dir.1, as fast as the loop can, with a
+ * snapshot of all monitors first, then starts both over from their logs at
+ * once, as a lot of 100k bays on two managers would after a crash: map the
+ * snapshot, replay the records. The shards of one manager split its 65536
+ * ids among them, 100k bays take two managers.
+ *
+ * usage: log_bench [records [dir]]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include "event_log.h"
+#include "event_loop.h"
+
+#define MONITORS  65536
+#define MANAGERS  2
+
+int main(int argc, char **argv) {
+  uint64_t records = argc > 1 ? strtoull(argv[1], NULL, 0) : 1000000;
+  const char *dir = argc > 2 ? argv[2] : "/tmp/lotmanager_bench.log";
+  uint64_t start, us, sync_us;
+  uint32_t seed = 1;
+
+  auto dir_of = [dir](unsigned m) { return std::string(dir) + "." + std::to_string(m); };
+
+  system(("rm -rf " + std::string(dir) + ".*").c_str());
+  for (unsigned m = 0; m < MANAGERS; m++) {
+    monitor_table t(MONITORS);
+    monitor_state s = {};
+
+    {
+      event_log log(dir_of(m).c_str(), 0, t, 10);
+
+      for (uint32_t id = 0; id < MONITORS; id++) {
+        log.append(LOG_CHANGE, (uint16_t)id, s);
+      }
+      log.snapshot(t);
+      start = event_loop::clock_us();
+      for (uint64_t i = 0; i < records / MANAGERS; i++) {
+        seed = seed * 1103515245 + 12345;
+        s.state = seed >> 30;
+        s.distance_cm = seed >> 20 & 0x1FF;
+        log.append(LOG_CHANGE, (uint16_t)(seed >> 8), s);
+      }
+      us = event_loop::clock_us() - start;
+      start = event_loop::clock_us();
+    }                                        // commits the rest
+    sync_us = event_loop::clock_us() - start;
+    if (m == 0) {
+      printf("append:  %llu records in %llu us, %.1f ns per record, %.1f M records/s, rest synced in %llu us\n",
+             (unsigned long long)(records / MANAGERS), (unsigned long long)us,
+             us * 1000.0 / (records / MANAGERS), records / MANAGERS / (double)us, (unsigned long long)sync_us);
+    }
+  }
+
+  monitor_table tables[MANAGERS] = {monitor_table(MONITORS), monitor_table(MONITORS)};
+  log_stats st[MANAGERS];
+  std::thread threads[MANAGERS];
+
+  start = event_loop::clock_us();
+  for (unsigned m = 0; m < MANAGERS; m++) {
+    threads[m] = std::thread([&, m] {
+      event_log log(dir_of(m).c_str(), 0, tables[m], 10);
+
+      st[m] = log.stats();
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  us = event_loop::clock_us() - start;
+  for (unsigned m = 0; m < MANAGERS; m++) {
+    printf("recover: manager %u, snapshot of %u monitors and %llu records in %u us\n", m, MONITORS,
+           (unsigned long long)st[m].recovered, st[m].recover_us);
+  }
+  printf("start:   %u monitors on %u managers in %llu us, the new snapshots written\n", MONITORS * MANAGERS,
+         MANAGERS, (unsigned long long)us);
+  system(("rm -rf " + std::string(dir) + ".*").c_str());
+  return 0;
+}
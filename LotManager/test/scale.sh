@@ -0,0 +1,42 @@
+#!/bin/sh
+#
+# LotManager scaling benchmark
+#
+# Runs lotmanager with 1, 2, 4 .. shards up to the cores of the host, each
+# against as many fleets as there are cores, every fleet with 65536 / cores
+# single-bay nodes measuring at 100 Hz and reporting every measurement, more
+# than any number of shards takes. Prints the status frames per second the
+# manager took over and the share of the frames sent.
+#
+# usage: test/scale.sh [seconds]
+
+SECONDS_RUN=${1:-5}
+CORES=$(nproc)
+SPAN=$((65536 / CORES))
+PORT=7400
+
+printf '%6s %14s %14s %8s\n' shards sent/s taken/s taken
+shards=1
+while [ $shards -le $CORES ]; do
+  ./lotmanager -a 127.0.0.1 -u $PORT -t $((PORT + 1)) -n 65536 -s 60000 -j $shards 2>/dev/null &
+  manager=$!
+  sleep 0.3
+  f=0
+  fleets=
+  while [ $f -lt $CORES ]; do
+    ./fleet -m 127.0.0.1:$PORT:$((PORT + 1)) -o $((f * SPAN)) -n $SPAN -H 100 -p 0 -t "$SECONDS_RUN" \
+      > /tmp/lotmanager_scale.$f &
+    fleets="$fleets $!"
+    f=$((f + 1))
+  done
+  wait $fleets
+  kill $manager
+  wait $manager 2>/dev/null
+  cat /tmp/lotmanager_scale.* | awk -v shards=$shards -v s="$SECONDS_RUN" '
+    /^  frames/ { sent += $2 }
+    /^  manager/ { for (i = 2; i < NF; i++) if ($i == "updates" && $(i + 1) > taken) taken = $(i + 1) }
+    END { printf "%6d %14.0f %14.0f %7.1f%%\n", shards, sent / s, taken / s, sent ? 100 * taken / sent : 0 }'
+  rm -f /tmp/lotmanager_scale.*
+  shards=$((shards * 2))
+  PORT=$((PORT + 2))
+done
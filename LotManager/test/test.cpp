@@ -0,0 +1,723 @@
+/*
+ * LotManager tests
+ *
+ * Runs the manager on loopback against simulated monitors (UDP sockets) and
+ * LotManagement clients (TCP connections). The test drives the event loop
+ * itself, so no threads are involved.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "cluster.h"
+#include "event_log.h"
+#include "lot_batch.h"
+#include "lot_shm.h"
+#include "manager.h"
+#include "occupancy.h"
+
+static int failures;
+
+#define CHECK(cond) do { if (!(cond)) { \
+  printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+  failures++; } } while (0)
+
+//---------
+// Runs the loop until cond() holds, at most ms milliseconds
+//----------
+template <typename F> static bool until(event_loop &loop, F cond, int ms = 1000) {
+//----------
+  uint64_t end = event_loop::clock_us() + ms * 1000;
+
+  while (!cond()) {
+    if (event_loop::clock_us() > end) {
+      return false;
+    }
+    loop.poll(1);
+  }
+  return true;
+}
+
+static struct sockaddr_in loopback(uint16_t port) {
+  struct sockaddr_in a = {};
+
+  a.sin_family = AF_INET;
+  a.sin_port = htons(port);
+  a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  return a;
+}
+
+// A simulated monitor, or a multi-bay node sending for several ids
+struct monitor {
+  int fd;
+  struct sockaddr_in to;
+
+  explicit monitor(uint16_t port) : to(loopback(port)) {
+    struct sockaddr_in a = loopback(0);
+
+    fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    bind(fd, (struct sockaddr *)&a, sizeof(a));
+  }
+  ~monitor() { close(fd); }
+
+  void send(const void *b, size_t len) {
+    sendto(fd, b, len, 0, (struct sockaddr *)&to, sizeof(to));
+  }
+  void status(uint16_t id, uint8_t seq, uint8_t state, uint16_t distance_cm) {
+    uint8_t b[LOT_HEADER_LEN + LOT_FRAME_LEN];
+
+    lot_frame_set(lot_header_set(b, LOT_STATUS, 1), id, seq, state, distance_cm, 0);
+    send(b, sizeof(b));
+  }
+  ssize_t receive(uint8_t *b, size_t len) { return recv(fd, b, len, 0); }
+};
+
+// A LotManagement connection
+struct client {
+  int fd;
+  std::string in;
+
+  explicit client(uint16_t port) {
+    struct sockaddr_in a = loopback(port);
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    connect(fd, (struct sockaddr *)&a, sizeof(a)); // backlog, no accept needed
+  }
+  ~client() { close(fd); }
+
+  void send(const char *line) { ::send(fd, line, strlen(line), 0); }
+
+  // Next line without '\n', "" if none arrived within ms
+  std::string line(event_loop &loop, int ms = 1000) {
+    size_t eol;
+    char buf[4096];
+
+    until(loop, [&] {
+      ssize_t n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+
+      if (n > 0) {
+        in.append(buf, n);
+      }
+      return in.find('\n') != std::string::npos;
+    }, ms);
+    if ((eol = in.find('\n')) == std::string::npos) {
+      return "";
+    }
+    std::string l = in.substr(0, eol);
+    in.erase(0, eol + 1);
+    return l;
+  }
+
+  std::string ask(event_loop &loop, const char *line) {
+    send(line);
+    return this->line(loop);
+  }
+};
+
+static manager_config test_config(void) {
+  manager_config cfg;
+
+  cfg.address = "127.0.0.1";
+  cfg.udp_port = 0;
+  cfg.tcp_port = 0;
+  cfg.monitors = 4096;
+  return cfg;
+}
+
+static void test_status(void) {
+  event_loop loop;
+  manager m(loop, test_config());
+  monitor mon(m.udp_port());
+  client c(m.tcp_port());
+
+  CHECK(c.ask(loop, "GET 5\n") == "STATUS 5 0 0 0 0 0");
+  mon.status(5, 1, OCCUPANCY_OCCUPIED, 120);
+  CHECK(until(loop, [&] { return m.stats().updates == 1; }));
+  CHECK(m.table().online() == 1);
+  CHECK(c.ask(loop, "GET 5\n").rfind("STATUS 5 2 120 0 1 ", 0) == 0);
+  CHECK(c.ask(loop, "GET 4096\n") == "ERROR unknown monitor");
+  CHECK(c.ask(loop, "HELLO\n") == "ERROR bad command");
+
+  mon.status(5, 1, OCCUPANCY_FREE, 0);       // duplicate
+  mon.status(5, 0, OCCUPANCY_FREE, 0);       // late
+  mon.status(4096, 1, OCCUPANCY_FREE, 0);    // beyond the table
+  mon.send("LP\x11\x01\x05", 5);             // truncated
+  mon.status(5, 2, OCCUPANCY_FREE, 0);
+  CHECK(until(loop, [&] { return m.stats().datagrams == 6; }));
+  CHECK(m.stats().duplicates == 2);
+  CHECK(m.stats().unknown == 1);
+  CHECK(m.stats().malformed == 1);
+  CHECK(m.stats().updates == 2);
+  CHECK(m.table()[5].state == OCCUPANCY_FREE && m.table()[5].seq == 2);
+  CHECK(c.ask(loop, "STATS\n").rfind("STATS monitors 4096 online 1 datagrams 6 frames 5 updates 2 changes 2 ", 0) == 0);
+}
+
+static void test_watch(void) {
+  event_loop loop;
+  manager_config cfg = test_config();
+  cfg.stale_ms = 100;
+  manager m(loop, cfg);
+  monitor mon(m.udp_port());
+  client c(m.tcp_port());
+
+  CHECK(c.ask(loop, "WATCH\n") == "OK");
+  mon.status(7, 1, OCCUPANCY_FREE, 0);
+  CHECK(c.line(loop) == "CHANGE 7 0 0 1");   // came online
+  mon.status(7, 2, OCCUPANCY_APPROACHING, 250);
+  CHECK(c.line(loop) == "CHANGE 7 1 250 1");
+  mon.status(7, 3, OCCUPANCY_APPROACHING, 200); // distance only, no change
+  mon.status(7, 4, OCCUPANCY_OCCUPIED, 150);
+  CHECK(c.line(loop) == "CHANGE 7 2 150 1");
+  CHECK(c.line(loop, 500) == "CHANGE 7 2 150 0"); // silent, offline
+  CHECK(m.table().online() == 0);
+  mon.status(7, 0, OCCUPANCY_OCCUPIED, 150); // restarted, seq from 0
+  CHECK(c.line(loop) == "CHANGE 7 2 150 1");
+  CHECK(m.stats().reports == 5);
+}
+
+static void test_reserve(void) {
+  event_loop loop;
+  manager m(loop, test_config());
+  monitor mon(m.udp_port());
+  client c(m.tcp_port());
+  uint8_t b[LOT_DATAGRAM_MAX], type, count;
+  const lot_frame *f;
+  ssize_t len = 0;
+
+  CHECK(c.ask(loop, "QUERY 9\n") == "ERROR monitor never reported");
+  CHECK(c.ask(loop, "RESERVE 9 1\n") == "OK"); // kept until it reports
+  CHECK(m.table()[9].flags & MONITOR_RESERVED);
+  CHECK(c.ask(loop, "RESERVE 9999 1\n") == "ERROR unknown monitor");
+  CHECK(c.ask(loop, "RESERVE 9 2\n") == "ERROR bad command");
+
+  mon.status(9, 1, OCCUPANCY_FREE, 0);
+  CHECK(until(loop, [&] { return m.stats().updates == 1; }));
+  CHECK(c.ask(loop, "RESERVE 9 0\n") == "OK");
+  CHECK(until(loop, [&] { return (len = mon.receive(b, sizeof(b))) > 0; }));
+  f = lot_frames(b, len, &type, &count);
+  CHECK(f && type == LOT_RESERVE && count == 1 && lot_frame_valid(f));
+  CHECK(lot_id(f) == 9 && !(lot_flags(f) & LOT_F_RESERVED));
+  CHECK(c.ask(loop, "QUERY 9\n") == "OK");
+  CHECK(until(loop, [&] { return (len = mon.receive(b, sizeof(b))) > 0; }));
+  f = lot_frames(b, len, &type, &count);
+  CHECK(f && type == LOT_QUERY && count == 1 && lot_id(f) == 9);
+}
+
+static void test_validate(void) {
+  uint8_t b[LOT_DATAGRAM_MAX];
+  lot_frame *f = lot_header_set(b, LOT_STATUS, LOT_FRAMES_MAX);
+  uint8_t type, count;
+  uint32_t seed = 1;
+
+  lot_frame_set(&f[0], 0x1234, 200, OCCUPANCY_TOO_CLOSE | LOT_F_NO_ECHO, 300, 7);
+  CHECK(lot_id(&f[0]) == 0x1234 && lot_seq(&f[0]) == 200 && lot_state(&f[0]) == OCCUPANCY_TOO_CLOSE);
+  CHECK(lot_flags(&f[0]) == LOT_F_NO_ECHO && lot_distance_cm(&f[0]) == 300 && lot_aux(&f[0]) == 7);
+  CHECK(lot_frames(b, lot_len(LOT_FRAMES_MAX), &type, &count) == f && count == LOT_FRAMES_MAX);
+  CHECK(!lot_frames(b, lot_len(LOT_FRAMES_MAX) - 1, &type, &count));
+  b[2] = 2 << 4 | LOT_STATUS;                // next version
+  CHECK(!lot_frames(b, lot_len(LOT_FRAMES_MAX), &type, &count));
+
+  // Random frames, half of them damaged, every count and offset
+  for (int i = 0; i < LOT_FRAMES_MAX; i++) {
+    seed = seed * 1103515245 + 12345;
+    lot_frame_set(&f[i], seed >> 16, seed >> 8, seed & 0x3F, seed >> 20, 0);
+    switch (seed >> 28 & 3) {
+    case 0: f[i].b[seed >> 4 & 7] ^= 1 << (seed >> 8 & 7); break;
+    case 1: f[i].b[3] |= 0x80; f[i].b[7] -= 0x80; break; // check ok, flag invalid
+    }
+  }
+  for (unsigned start = 0; start < 4; start++) {
+    for (unsigned n = 0; start + n <= LOT_FRAMES_MAX; n++) {
+      if (lot_validate(f + start, n) != lot_validate_scalar(f + start, n)) {
+        CHECK(!"vector and scalar validation differ");
+        return;
+      }
+    }
+  }
+  CHECK(lot_validate_scalar(f, LOT_FRAMES_MAX) != 0);
+  CHECK(lot_validate_scalar(f, LOT_FRAMES_MAX) != ~0ull);
+}
+
+//---------
+// A node reports its bays in one datagram, a damaged frame costs only itself
+//----------
+static void test_batch(void) {
+//----------
+  event_loop loop;
+  manager m(loop, test_config());
+  monitor node(m.udp_port());
+  uint8_t b[lot_len(3)];
+  lot_frame *f = lot_header_set(b, LOT_STATUS, 3);
+
+  lot_frame_set(&f[0], 20, 1, OCCUPANCY_FREE, 0, 0);
+  lot_frame_set(&f[1], 21, 1, OCCUPANCY_OCCUPIED | LOT_F_RESERVED, 140, 0);
+  lot_frame_set(&f[2], 22, 1, OCCUPANCY_APPROACHING, 260, 0);
+  f[2].b[4] ^= 0x10;
+  node.send(b, sizeof(b));
+  CHECK(until(loop, [&] { return m.stats().frames == 3; }));
+  CHECK(m.stats().updates == 2 && m.stats().bad_frames == 1);
+  CHECK(m.table()[21].state == OCCUPANCY_OCCUPIED && m.table()[21].distance_cm == 140);
+  CHECK(m.table()[21].reported == LOT_F_RESERVED);
+  CHECK(!(m.table()[22].flags & MONITOR_ONLINE));
+
+  lot_frame_set(&f[0], 20, 0, OCCUPANCY_OCCUPIED | LOT_F_BOOT, 130, 0); // restarted
+  b[3] = 1;
+  node.send(b, lot_len(1));
+  CHECK(until(loop, [&] { return m.stats().updates == 3; }));
+  CHECK(m.table()[20].state == OCCUPANCY_OCCUPIED && m.table()[20].seq == 0);
+
+  lot_header_set(b, LOT_QUERY, 1);           // wrong direction
+  node.send(b, lot_len(1));
+  CHECK(until(loop, [&] { return m.stats().malformed == 1; }));
+}
+
+//---------
+// Thousands of monitors reporting 10 times, interleaved with the loop as
+// their traffic would be. Loopback loses nothing, so every status must be
+// taken over, and GET must be answered in between.
+//----------
+static void test_load(void) {
+//----------
+  event_loop loop;
+  manager m(loop, test_config());
+  monitor mon(m.udp_port());
+  client c(m.tcp_port());
+  const uint32_t monitors = 4000, rounds = 10;
+
+  for (uint32_t r = 1; r <= rounds; r++) {
+    for (uint32_t id = 0; id < monitors; id++) {
+      mon.status(id, r, r & 1 ? OCCUPANCY_FREE : OCCUPANCY_OCCUPIED, r);
+      if (id % 500 == 499) {
+        loop.poll(0);
+      }
+    }
+    CHECK(c.ask(loop, "GET 3999\n").rfind("STATUS 3999 ", 0) == 0);
+  }
+  CHECK(until(loop, [&] { return m.stats().updates == monitors * rounds; }));
+  CHECK(m.stats().changes == monitors * rounds);
+  CHECK(m.table().online() == monitors);
+  CHECK(m.table()[1234].seq == rounds && m.table()[1234].distance_cm == rounds);
+}
+
+//---------
+// A sweep of 10000 monitors on nodes of 4 bays, one in 20 queries lost. The
+// nodes answer right away like the ESP8266 sketch, the lost ones are asked
+// again, and every monitor ends up answered or lost. How long it took
+// against one measurement period depends on the host, so it is reported
+// rather than checked.
+//----------
+static void test_sweep(void) {
+//----------
+  event_loop loop;
+  manager_config cfg = test_config();
+  cfg.monitors = 10000;
+  manager m(loop, cfg);
+  client c(m.tcp_port());
+  const uint32_t bays = 4;
+  std::vector<std::unique_ptr<monitor>> nodes;
+  std::vector<uint8_t> seq(cfg.monitors, 1);
+  uint32_t queries = 0;
+  unsigned monitors, count, answered, lost, datagrams, retries, us;
+
+  for (uint32_t n = 0; n < cfg.monitors / bays; n++) {
+    monitor *node = new monitor(m.udp_port());
+    uint8_t b[lot_len(bays)];
+    lot_frame *f = lot_header_set(b, LOT_STATUS, bays);
+
+    nodes.emplace_back(node);
+    for (uint32_t i = 0; i < bays; i++) {
+      lot_frame_set(&f[i], n * bays + i, seq[n * bays + i], OCCUPANCY_FREE, 0, 0);
+    }
+    node->send(b, sizeof(b));
+    loop.add(node->fd, EPOLLIN, [&, node](uint32_t) {
+      uint8_t q[LOT_DATAGRAM_MAX], type, k;
+      ssize_t len;
+
+      while ((len = node->receive(q, sizeof(q))) > 0) {
+        const lot_frame *qf = lot_frames(q, len, &type, &k);
+        uint8_t a[LOT_DATAGRAM_MAX];
+        lot_frame *af;
+
+        if (!qf || type != LOT_QUERY || ++queries % 20 == 0) {
+          continue;                          // lost on the way
+        }
+        af = lot_header_set(a, LOT_STATUS, k);
+        for (uint8_t i = 0; i < k; i++) {
+          uint16_t id = lot_id(&qf[i]);
+
+          lot_frame_set(&af[i], id, ++seq[id], OCCUPANCY_FREE | LOT_F_REPLY, 0, 0);
+        }
+        node->send(a, lot_len(k));
+      }
+    });
+    if (n % 64 == 63) {
+      loop.poll(0);
+    }
+  }
+  CHECK(until(loop, [&] { return m.stats().updates == cfg.monitors; }));
+
+  std::string line = c.ask(loop, "SWEEP\n");
+  CHECK(sscanf(line.c_str(), "SWEEP monitors %u nodes %u answered %u lost %u datagrams %u retries %u us %u",
+               &monitors, &count, &answered, &lost, &datagrams, &retries, &us) == 7);
+  CHECK(monitors == cfg.monitors && count == cfg.monitors / bays);
+  CHECK(answered + lost == cfg.monitors && answered > 0);
+  CHECK(retries > 0 && datagrams == count + retries);
+  CHECK(m.stats().sweeps == 1 && m.stats().sweep_us_max == us);
+  printf("sweep: %u monitors on %u nodes in %u us, %s the %u ms period, %u retries, %u lost\n", monitors, count, us,
+         us < MONITOR_PERIOD_MS * 1000 ? "within" : "beyond", MONITOR_PERIOD_MS, retries, lost);
+  for (auto &node : nodes) {
+    loop.remove(node->fd);
+  }
+}
+
+//---------
+// Four shards of 1024 monitors on the same ports, driven from outside like
+// a real cluster: the status lands on the owning shard, a node straddling
+// two shards is split, commands about any monitor are answered in order on
+// whichever shard took the connection, and changes reach every watcher.
+//----------
+static void test_cluster(void) {
+//----------
+  event_loop idle;                           // for the clients to wait on
+  manager_config cfg = test_config();
+  cfg.shards = 4;
+  cluster cl(cfg);
+  monitor mon(cl.udp_port());
+  client w(cl.tcp_port()), c(cl.tcp_port()), d(cl.tcp_port());
+  uint8_t b[LOT_DATAGRAM_MAX], type, count;
+  lot_frame *f = lot_header_set(b, LOT_STATUS, 4);
+  std::string seen;
+
+  cl.start();
+  CHECK(cl.span() == 1024 && cl.owner(1023) == 0 && cl.owner(1024) == 1 && cl.owner(4095) == 3);
+  CHECK(w.ask(idle, "WATCH\n") == "OK");
+  CHECK(d.ask(idle, "FEED 10 100\n") == "OK");
+  mon.status(5, 1, OCCUPANCY_OCCUPIED, 100);
+  mon.status(1500, 1, OCCUPANCY_OCCUPIED, 150);
+  for (int i = 0; i < 4; i++) {              // bays 1022..1025, shards 0 and 1
+    lot_frame_set(&f[i], 1022 + i, 1, OCCUPANCY_APPROACHING, 200 + i, 0);
+  }
+  mon.send(b, lot_len(4));
+  for (int i = 0; i < 6; i++) {
+    seen += w.line(idle) + ";";
+  }
+  for (unsigned id : {5, 1500, 1022, 1023, 1024, 1025}) {
+    CHECK(seen.find("CHANGE " + std::to_string(id) + " ") != std::string::npos);
+  }
+  unsigned deltas = 0;                       // the shards' rounds may share a line
+  while (deltas < 6) {
+    unsigned n = 0;
+
+    if (sscanf(d.line(idle).c_str(), "DELTA %*u %u", &n) != 1) {
+      break;
+    }
+    deltas += n;
+  }
+  CHECK(deltas == 6);
+
+  c.send("GET 1024\nGET 5\nGET 3000\nQUERY 1500\nGET 1023\n");
+  CHECK(c.line(idle).rfind("STATUS 1024 1 202 0 1 ", 0) == 0);
+  CHECK(c.line(idle).rfind("STATUS 5 2 100 0 1 ", 0) == 0);
+  CHECK(c.line(idle) == "STATUS 3000 0 0 0 0 0");
+  CHECK(c.line(idle) == "OK");
+  CHECK(c.line(idle).rfind("STATUS 1023 1 201 0 1 ", 0) == 0);
+  CHECK(mon.receive(b, sizeof(b)) > 0 || until(idle, [&] { return mon.receive(b, sizeof(b)) > 0; }));
+  CHECK(lot_frames(b, lot_len(1), &type, &count) && type == LOT_QUERY && lot_id((lot_frame *)&b[4]) == 1500);
+
+  CHECK(c.ask(idle, "RESERVE 1000-1100 1\n") == "OK");
+  CHECK(c.ask(idle, "GET 1023\n").rfind("STATUS 1023 1 201 1 1 ", 0) == 0);
+  CHECK(c.ask(idle, "GET 1100\n").rfind("STATUS 1100 0 0 1 0 ", 0) == 0);
+  CHECK(c.ask(idle, "RESERVE 4000-4096 1\n") == "ERROR unknown monitor");
+  int reservations = 0;
+  until(idle, [&] {
+    while (mon.receive(b, sizeof(b)) > 0) {
+      reservations += lot_frames(b, lot_len(1), &type, &count) && type == LOT_RESERVE;
+    }
+    return reservations == 4;                // 1022..1025 reported before
+  });
+  CHECK(reservations == 4);
+
+  std::string stats = c.ask(idle, "STATS\n");
+  CHECK(stats.rfind("STATS monitors 4096 online 6 datagrams 3 frames 6 updates 6 changes 6 ", 0) == 0);
+  CHECK(stats.find(" shards 4 ") != std::string::npos);
+  cl.stop();
+  CHECK(cl.shard(1).stats().datagrams == 1); // steered by the first id
+  CHECK(cl.shard(1).table()[1024].updates == 1 && !cl.shard(0).table().owns(1024));
+  CHECK(cl.shard(3).table().first() == 3072 && cl.shard(3).table().size() == 1024);
+}
+
+//---------
+// Changes within the window coalesce to one delta per monitor, a feed out
+// of credits queues at most one delta per monitor however much changes.
+//----------
+static void test_feed(void) {
+//----------
+  event_loop loop;
+  manager m(loop, test_config());
+  monitor mon(m.udp_port());
+  client f(m.tcp_port()), c(m.tcp_port());
+  uint8_t b[LOT_DATAGRAM_MAX];
+
+  CHECK(f.ask(loop, "FEED 50 1\n") == "OK");
+  mon.status(7, 1, OCCUPANCY_FREE, 0);
+  mon.status(7, 2, OCCUPANCY_APPROACHING, 250);
+  mon.status(7, 3, OCCUPANCY_OCCUPIED, 150);
+  mon.status(8, 1, OCCUPANCY_OCCUPIED, 120);
+  CHECK(f.line(loop) == "DELTA 0 2 7 2 150 1 8 2 120 1");
+  mon.status(7, 4, OCCUPANCY_FREE, 0);
+  mon.status(9, 1, OCCUPANCY_FREE, 0);
+  CHECK(f.line(loop, 200) == "");            // out of credits
+  CHECK(c.ask(loop, "STATS\n").find(" feed_depth 2 ") != std::string::npos);
+  f.send("CREDIT 1\n");
+  CHECK(f.line(loop) == "DELTA 1 2 7 0 0 1 9 0 0 1");
+  CHECK(c.ask(loop, "STATS\n").find(" feed_changes 6 feed_coalesced 2 feed_deltas 4 feed_batches 2 "
+                                    "feed_depth 0 feed_depth_max 2") != std::string::npos);
+
+  for (uint8_t seq = 10; seq < 20; seq++) {  // every bay flaps, no credit
+    for (uint32_t first = 0; first < 4096; first += LOT_FRAMES_MAX) {
+      lot_frame *x = lot_header_set(b, LOT_STATUS, LOT_FRAMES_MAX);
+
+      for (int i = 0; i < LOT_FRAMES_MAX; i++) {
+        lot_frame_set(&x[i], first + i, seq, seq & 1 ? OCCUPANCY_OCCUPIED : OCCUPANCY_FREE, 100, 0);
+      }
+      mon.send(b, lot_len(LOT_FRAMES_MAX));
+    }
+    until(loop, [&] { return m.stats().updates >= 6 + (seq - 9) * 4096u; });
+  }
+  CHECK(m.stats().feed_depth == 4096 && m.stats().feed_depth_max == 4096 && m.stats().slow_clients == 0);
+  f.send("CREDIT 100\n");
+  until(loop, [&] { return m.stats().feed_depth == 0; });
+  CHECK(m.stats().feed_deltas == 4 + 4096 && m.stats().feed_batches == 2 + 4096 / FEED_BATCH);
+  for (int i = 0; i < 4096 / FEED_BATCH; i++) {
+    CHECK(f.line(loop).rfind("DELTA " + std::to_string(2 + i) + " 256 ", 0) == 0);
+  }
+}
+
+//---------
+// The shared table follows status, reservations and expiry, read from a
+// mapping of its own like any reader. Then a reader races a writer on one
+// slot and must never see the words of two writes mixed.
+//----------
+static void test_snapshot(void) {
+//----------
+  const char *path = "/tmp/lotmanager_test.shm";
+  event_loop loop;
+  manager_config cfg = test_config();
+  cfg.stale_ms = 100;
+  cfg.snapshot = path;
+  manager m(loop, cfg);
+  monitor mon(m.udp_port());
+  int fd = open(path, O_RDONLY);
+  size_t len = lot_shm_len(cfg.monitors);
+  auto *h = (const lot_shm_header *)mmap(nullptr, len, PROT_READ, MAP_SHARED, fd, 0);
+  const lot_shm_slot *slots = lot_shm_slots(h);
+  lot_shm_state s;
+
+  close(fd);
+  CHECK(h != MAP_FAILED);
+  if (h == MAP_FAILED) {
+    return;
+  }
+  CHECK(h->magic == LOT_SHM_MAGIC && h->monitors == 4096 && h->stale_ms == 100 && h->pid == (uint32_t)getpid());
+  mon.status(42, 1, OCCUPANCY_OCCUPIED, 120);
+  until(loop, [&] { return m.stats().updates == 1; });
+  lot_shm_read(&slots[42], &s);
+  CHECK(s.state == OCCUPANCY_OCCUPIED && s.distance_cm == 120 && s.flags == LOT_SHM_ONLINE && s.changes == 1);
+  CHECK(s.seen_ms == m.table()[42].seen_ms);
+  m.reserve(42, true);
+  lot_shm_read(&slots[42], &s);
+  CHECK(s.flags == (LOT_SHM_ONLINE | LOT_SHM_RESERVED));
+  until(loop, [&] { lot_shm_read(&slots[42], &s); return !(s.flags & LOT_SHM_ONLINE); }, 500);
+  CHECK(s.flags == LOT_SHM_RESERVED && s.state == OCCUPANCY_OCCUPIED);
+  CHECK((uint32_t)loop.now_ms() - h->heartbeat_ms <= 100);
+  lot_shm_read(&slots[43], &s);
+  CHECK(s.seen_ms == 0 && s.flags == 0);
+  munmap((void *)h, len);
+
+  lot_shm_slot slot = {};
+  std::atomic<bool> stop{false};
+  std::thread writer([&] {
+    lot_shm_state w = {};
+
+    for (uint32_t i = 1; !stop; i++) {       // every word follows i
+      w.distance_cm = (uint16_t)i;
+      w.seen_ms = i;
+      w.changes = (uint16_t)i;
+      lot_shm_write(&slot, &w);
+    }
+  });
+  uint64_t torn = 0;
+
+  for (int i = 0; i < 200000; i++) {
+    lot_shm_read(&slot, &s);
+    torn += s.distance_cm != (uint16_t)s.seen_ms || s.changes != (uint16_t)s.seen_ms;
+  }
+  stop = true;
+  writer.join();
+  CHECK(torn == 0);
+  unlink(path);
+}
+
+//---------
+// Restarts a manager from its log directory, refuses to with another number
+// of shards, then replays records up to a torn tail
+//----------
+static void test_log(void) {
+//----------
+  const char *dir = "/tmp/lotmanager_test.log";
+  manager_config cfg = test_config();
+
+  system("rm -rf /tmp/lotmanager_test.log");
+  cfg.log_dir = dir;
+  cfg.commit_ms = 1;
+  {
+    event_loop loop;
+    manager m(loop, cfg);
+    monitor mon(m.udp_port());
+
+    mon.status(42, 1, OCCUPANCY_OCCUPIED, 120);
+    mon.status(44, 1, OCCUPANCY_APPROACHING, 300);
+    CHECK(until(loop, [&] { return m.stats().updates == 2; }));
+    m.reserve(43, true);
+    CHECK(until(loop, [&] { return m.stats().log_commits > 0 && m.stats().log_records == 3; }));
+  }                                          // snapshot on the way out
+  {
+    event_loop loop;
+    manager m(loop, cfg);
+    const monitor_table &t = m.table();
+
+    CHECK(t.online() == 0 && m.stats().log_recovered == 0);
+    CHECK(t[42].state == OCCUPANCY_OCCUPIED && t[42].distance_cm == 120 && t[42].flags == 0 && t[42].changes == 1);
+    CHECK(t[43].flags == MONITOR_RESERVED && t[44].state == OCCUPANCY_APPROACHING && t[45].changes == 0);
+  }
+  bool refused = false;
+
+  cfg.shards = 2;                            // shard 0 would own 0..2047 only
+  try {
+    cluster cl(cfg);
+  } catch (const std::system_error &) {
+    refused = true;
+  }
+  CHECK(refused);
+
+  monitor_table t(4096);
+  monitor_state s = {};
+  {
+    event_log log(dir, 1, t, 1);
+
+    for (int i = 0; i < 1000; i++) {
+      s.state = (uint8_t)(i % 4);
+      s.distance_cm = (uint16_t)i;
+      s.flags = i == 999 ? MONITOR_RESERVED : 0;
+      log.append(i == 999 ? LOG_RESERVE : LOG_CHANGE, (uint16_t)(i % 10), s);
+    }
+  }                                          // committed, no snapshot
+  FILE *f = fopen("/tmp/lotmanager_test.log/log.1.0000000000000001", "a");
+
+  CHECK(f != nullptr);
+  if (f) {
+    fwrite("\x01\x04\x00\x00\x00\x00\x00", 1, 7, f); // torn
+    fclose(f);
+  }
+  monitor_table r(4096);
+  {
+    event_log log(dir, 1, r, 1);
+
+    CHECK(log.stats().recovered == 1000);
+    CHECK(r[9].state == 3 && r[9].distance_cm == 999 && r[9].flags == MONITOR_RESERVED && r[9].changes == 99);
+    CHECK(r[0].distance_cm == 990 && r[0].changes == 100 && r[10].changes == 0);
+    s.distance_cm = 4711;
+    log.append(LOG_CHANGE, 0, s);
+  }
+  monitor_table again(4096);
+  {
+    event_log log(dir, 1, again, 1);         // from the snapshot, torn tail gone
+
+    CHECK(log.stats().recovered == 1 && again[0].distance_cm == 4711 && again[9].distance_cm == 999);
+  }
+  system("rm -rf /tmp/lotmanager_test.log");
+}
+
+static void test_tdma(void) {
+  event_loop loop;
+  manager_config cfg = test_config();
+  cfg.slots = 5;
+  cfg.sync_ms = 20;
+  manager m(loop, cfg);
+  monitor node(m.udp_port());
+  client c(m.tcp_port());
+  uint8_t b[LOT_DATAGRAM_MAX], type, count;
+  const lot_frame *f = nullptr;
+  ssize_t len = 0;
+  std::string s;
+
+  node.status(10, 1, OCCUPANCY_FREE, 0);
+  node.status(11, 1, OCCUPANCY_FREE, 0);
+  CHECK(until(loop, [&] { return m.stats().updates == 2; }));
+  auto beacon = [&] {                        // the next one for both bays
+    return until(loop, [&] {
+      return (len = node.receive(b, sizeof(b))) > 0 && (f = lot_frames(b, len, &type, &count)) && count == 2;
+    });
+  };
+  CHECK(beacon());
+  CHECK(type == LOT_SYNC && lot_validate(f, count) == 3);
+  CHECK(lot_id(&f[0]) == 10 && lot_sync_slot(&f[0]) == 0 && lot_sync_slots(&f[0]) == 5);
+  CHECK(lot_id(&f[1]) == 11 && lot_sync_slot(&f[1]) == 1 && lot_sync_slots(&f[1]) == 5);
+  CHECK(lot_sync_phase_us(&f[0]) < 5 * LOT_SLOT_MS * 1000 && lot_seq(&f[0]) == lot_seq(&f[1]));
+
+  CHECK(c.ask(loop, "SLOT 11\n") == "SLOT 11 1 0 0");
+  CHECK(c.ask(loop, "SLOT 11 3\n") == "OK");
+  CHECK(c.ask(loop, "SLOT 11 5\n") == "ERROR bad slot");
+  CHECK(c.ask(loop, "SLOT 4096\n") == "ERROR unknown monitor");
+  CHECK(beacon() && lot_sync_slot(&f[1]) == 3);
+
+  lot_frame_set(lot_header_set(b, LOT_STATUS, 1), 10, 2, OCCUPANCY_FREE, 0, lot_aux_drift(-300));
+  node.send(b, LOT_HEADER_LEN + LOT_FRAME_LEN);
+  CHECK(until(loop, [&] { return m.stats().updates == 3; }));
+  CHECK(c.ask(loop, "SLOT 10\n") == "SLOT 10 0 1 -300");
+  s = c.ask(loop, "STATS\n");
+  CHECK(s.find(" tdma_synced 1 tdma_drift_us_max 300") != std::string::npos);
+  CHECK(m.stats().tdma_beacons >= 2);
+
+  manager plain(loop, test_config());
+  client p(plain.tcp_port());
+  bool thrown = false;
+
+  CHECK(p.ask(loop, "SLOT 1\n") == "ERROR no trigger slots");
+  try {
+    slot_schedule(0, 16, LOT_SLOTS_MAX + 1);
+  } catch (const std::system_error &) {
+    thrown = true;
+  }
+  CHECK(thrown);
+}
+
+int main(void) {
+  test_status();
+  test_watch();
+  test_reserve();
+  test_validate();
+  test_batch();
+  test_load();
+  test_sweep();
+  test_cluster();
+  test_feed();
+  test_snapshot();
+  test_log();
+  test_tdma();
+  printf("%s\n", failures ? "FAILED" : "OK");
+  return failures != 0;
+}
@@ -27,6 +27,12 @@ void inline ws2812_setleds_pin(struct cRGB *ledarray, uint16_t leds, uint8_t pin
   _delay_us(ws2812_resettime);
 }
 
+// Setleds without waiting for the reset time
+void inline ws2812_setleds_nowait(struct cRGB *ledarray, uint16_t leds)
+{
+  ws2812_sendarray_mask((uint8_t*)ledarray,leds+leds+leds,_BV(ws2812_pin));
+}
+
 // Setleds for SK6812RGBW
 void inline ws2812_setleds_rgbw(struct cRGBW *ledarray, uint16_t leds)
 {
@@ -34,6 +40,32 @@ void inline ws2812_setleds_rgbw(struct cRGBW *ledarray, uint16_t leds)
   _delay_us(ws2812_resettime);
 }
 
+// Add a stripe to the bit-sliced buffer of ws2812_setleds_parallel
+void ws2812_slice(uint8_t *slices, struct cRGB *ledarray, uint16_t leds, uint8_t pinmask)
+{
+  uint8_t *data = (uint8_t*)ledarray;
+  uint16_t datlen = leds+leds+leds;
+
+  while (datlen--) {
+    uint8_t curbyte = *data++;
+    uint8_t bit;
+
+    for (bit = 0x80; bit; bit >>= 1) {
+      if (curbyte & bit) {
+        *slices &= ~pinmask;   // '1', keep the pin high
+      }
+      slices++;
+    }
+  }
+}
+
+// Setleds for several stripes at once
+void inline ws2812_setleds_parallel(uint8_t *slices, uint16_t leds, uint8_t pinmask)
+{
+  ws2812_sendarray_parallel(slices,(leds+leds+leds)<<3,pinmask);
+  _delay_us(ws2812_resettime);
+}
+
 void ws2812_sendarray(uint8_t *data,uint16_t datlen)
 {
   ws2812_sendarray_mask(data,datlen,_BV(ws2812_pin));
@@ -179,3 +211,121 @@ w_nop16
 
   SREG=sreg_prev;
 }
+
+/*
+  Same bitstream as ws2812_sendarray_mask, but every bit period takes a
+  bit-sliced byte of all stripes. All pins rise together, the ones sending a
+  '0' are toggled low by writing the slice to the PIN register, so the port
+  bits of other pins are not touched. The load of the slice takes the place
+  of the sbrs, therefore w1 is one cycle shorter and the '0' and '1' pulses
+  have the lengths of ws2812_sendarray_mask.
+*/
+
+#define wp_fixedlow    3
+#define wp_fixedhigh   4
+#define wp_fixedtotal  8
+
+#define wp1 (w_zerocycles-wp_fixedlow)
+#define wp2 (w_onecycles-wp_fixedhigh-wp1_nops)
+#define wp3 (w_totalcycles-wp_fixedtotal-wp1_nops-wp2_nops)
+
+#if wp1>0
+#define wp1_nops wp1
+#else
+#define wp1_nops  0
+#endif
+
+#define wp_lowtime ((wp1_nops+wp_fixedlow)*1000000)/(F_CPU/1000)
+#if wp_lowtime>550
+   #error "Light_ws2812: Sorry, the clock speed is too low for parallel output."
+#endif
+
+#if wp2>0
+#define wp2_nops wp2
+#else
+#define wp2_nops  0
+#endif
+
+#if wp3>0
+#define wp3_nops wp3
+#else
+#define wp3_nops  0
+#endif
+
+void inline ws2812_sendarray_parallel(uint8_t *slices,uint16_t datlen,uint8_t maskhi)
+{
+  uint8_t ctr,zeros,masklo;
+  uint8_t sreg_prev;
+
+  ws2812_DDRREG |= maskhi; // Enable output
+
+  masklo	=~maskhi&ws2812_PORTREG;
+  maskhi |=        ws2812_PORTREG;
+
+  sreg_prev=SREG;
+  cli();
+
+  while (datlen) {
+    asm volatile(
+    "       ldi   %0,8  \n\t"
+    "loop%=:            \n\t"
+    "       out   %3,%4 \n\t"    //  [01] - re, all stripes
+    "       ld    %1,Z+ \n\t"    //  [03]
+#if (wp1_nops&1)
+w_nop1
+#endif
+#if (wp1_nops&2)
+w_nop2
+#endif
+#if (wp1_nops&4)
+w_nop4
+#endif
+#if (wp1_nops&8)
+w_nop8
+#endif
+#if (wp1_nops&16)
+w_nop16
+#endif
+    "       out   %5,%1 \n\t"    //  [04] - fe-low, toggles the '0' stripes
+#if (wp2_nops&1)
+  w_nop1
+#endif
+#if (wp2_nops&2)
+  w_nop2
+#endif
+#if (wp2_nops&4)
+  w_nop4
+#endif
+#if (wp2_nops&8)
+  w_nop8
+#endif
+#if (wp2_nops&16)
+  w_nop16
+#endif
+    "       out   %3,%6 \n\t"    //  [+1] - fe-high
+#if (wp3_nops&1)
+w_nop1
+#endif
+#if (wp3_nops&2)
+w_nop2
+#endif
+#if (wp3_nops&4)
+w_nop4
+#endif
+#if (wp3_nops&8)
+w_nop8
+#endif
+#if (wp3_nops&16)
+w_nop16
+#endif
+
+    "       dec   %0    \n\t"    //  [+2]
+    "       brne  loop%=\n\t"    //  [+4]
+    :	"=&d" (ctr), "=&r" (zeros), "+z" (slices)
+    :	"I" (_SFR_IO_ADDR(ws2812_PORTREG)), "r" (maskhi), "I" (_SFR_IO_ADDR(ws2812_PINREG)), "r" (masklo)
+    );
+    datlen -= 8;
+  }
+
+  SREG=sreg_prev;
+}
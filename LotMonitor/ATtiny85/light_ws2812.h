@@ -67,8 +67,39 @@ struct cRGBW { uint8_t g; uint8_t r; uint8_t b; uint8_t w;};
 
 void ws2812_setleds     (struct cRGB  *ledarray, uint16_t number_of_leds);
 void ws2812_setleds_pin (struct cRGB  *ledarray, uint16_t number_of_leds,uint8_t pinmask);
+
+/*
+ * Same as ws2812_setleds, but returns right after the data was sent without
+ * waiting for the reset time. The caller must not send the next frame before
+ * ws2812_resettime passed.
+ */
+
+void ws2812_setleds_nowait(struct cRGB *ledarray, uint16_t number_of_leds);
 void ws2812_setleds_rgbw(struct cRGBW *ledarray, uint16_t number_of_leds);
 
+/*
+ * Parallel output
+ *
+ * Sends up to 8 stripes on different pins of ws2812_port in a single pass, so
+ * they cost the interrupt-off time of the longest one instead of the sum.
+ *
+ * The frames are converted into bit-sliced data first: one byte per data bit
+ * (24 per LED) holding the pins that send a '0'. Fill the buffer with the
+ * pinmask of all stripes (all LEDs off), then add every stripe with
+ * ws2812_slice(), e.g.
+ *
+ *         uint8_t slices[24*LEDS];
+ *         memset(slices, _BV(PB3)|_BV(PB4), sizeof(slices));
+ *         ws2812_slice(slices, entry, LEDS, _BV(PB3));
+ *         ws2812_slice(slices, bay,   LEDS, _BV(PB4));
+ *         ws2812_setleds_parallel(slices, LEDS, _BV(PB3)|_BV(PB4));
+ *
+ * A stripe may be shorter than the buffer, the remaining LEDs are sent off.
+ */
+
+void ws2812_slice           (uint8_t *slices, struct cRGB *ledarray, uint16_t number_of_leds, uint8_t pinmask);
+void ws2812_setleds_parallel(uint8_t *slices, uint16_t number_of_leds, uint8_t pinmask);
+
 /*
  * Old interface / Internal functions
  *
@@ -78,6 +109,7 @@ void ws2812_setleds_rgbw(struct cRGBW *ledarray, uint16_t number_of_leds);
 
 void ws2812_sendarray     (uint8_t *array,uint16_t length);
 void ws2812_sendarray_mask(uint8_t *array,uint16_t length, uint8_t pinmask);
+void ws2812_sendarray_parallel(uint8_t *slices,uint16_t length, uint8_t pinmask);
 
 
 /*
@@ -89,5 +121,6 @@ void ws2812_sendarray_mask(uint8_t *array,uint16_t length, uint8_t pinmask);
 
 #define ws2812_PORTREG  CONCAT_EXP(PORT,ws2812_port)
 #define ws2812_DDRREG   CONCAT_EXP(DDR,ws2812_port)
+#define ws2812_PINREG   CONCAT_EXP(PIN,ws2812_port)
 
 #endif /* LIGHT_WS2812_H_ */
@@ -4,157 +4,536 @@
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <string.h>
+#include <util/atomic.h>
 #include <util/delay.h>
 #include "light_ws2812.h"  // https://github.com/cpldcpu/light_ws2812
+#include "monitor.h"       // ../core, shared with ESP8266 and host builds
+#include "hal.h"
+#include "perf.h"
+#include "trace.h"
+#include "lot_proto.h"
 #include "main.h"
 
 #define ONBOARD_LED   PB1
 #define SRF05_1WIRE   PB3
 //      WS2819_DATA   PB4 // See Makefile WS2812_PIN
+#define UART_TX       PB0 // software UART, 4800 baud 8N1, see Makefile PERF/TRACE
+#define TDMA_SYNC     PB2 // INT0, frame begin, see Makefile TDMA
 
 #define INTERRUPT_DIV 10
 
-#define WS2819_STRIPE_LEN 5
-//#define WS2819_BRIGHTNESS 25  // percent [optional, comment for full brightness]
+//      WS2819_STRIPE_LEN   See ../core/monitor_config.h
 
-struct cRGB led[WS2819_STRIPE_LEN+1];      // one more to prevent array overflow
+struct monitor monitor;
 
-volatile int32_t ticks = 0;                // every 58 usec
-volatile int32_t SRF05_trigger_tick = 0;
-volatile int32_t SRF05_echo_tick = 0;
-volatile int16_t SRF05_echo_length = 0;
-volatile int32_t last_25cm_flicker = 0;
+#define SRF05_TRIGGER_US    12      // HY-SRF05 needs at least 10us
+#define SRF05_US_PER_COUNT  16      // timer0, CLK=16MHz/256 (0.28cm/count)
+#define SRF05_TIMEOUT_OVF   9       // 8-9 * 256 counts = 32.8-36.9ms without
+                                    //   echo end, the first overflow comes
+                                    //   0-4.1ms after the trigger: beyond the
+                                    //   30ms no echo pulse, before the next
+                                    //   trigger of the fast period (39.9ms)
+#define SRF05_TICK_MS       20      // timer1, CLK=16MHz/8192/39 (19.97ms)
+#define SRF05_FLICKER_TICKS 5       // flicker period, 5 ticks
+#define SRF05_PERIOD_US     99840   //   = 100ms
+#define SRF05_TICK_COUNTS   39      // timer1 counts (512us) per tick
+#define WS2812_RESET_COUNTS (ws2812_resettime / SRF05_US_PER_COUNT + 2)
+#define UART_COUNTS         13      // timer0, 208us per bit = 4800 baud
+#define PERF_NOW()          TCNT0   // durations in timer0 counts (16us)
+#define PERF_TICKS          uint8_t
+
+volatile uint8_t  SRF05_overflows = 0;     // timer0 overflows while measuring
+volatile uint8_t  SRF05_echo_high = 0;     // rising echo edge seen
+volatile uint16_t SRF05_echo_start = 0;    // timestamp of rising echo edge
+volatile uint16_t SRF05_echo_us = 0;       // last echo length, 0 if none
+volatile uint8_t  last_25cm_flicker = 0;
+volatile uint8_t  periods = 0;             // triggers so far, see hal_period
+volatile uint8_t  flicker_ticks = 0;       // timer1 ticks since last toggle
+volatile uint8_t  SRF05_ticks = 1;         // timer1 ticks until next trigger
+volatile uint8_t  SRF05_trigger_ticks = MONITOR_PERIOD_MS / SRF05_TICK_MS;
+volatile uint8_t  events = 0;              // MONITOR_EV_* posted by the ISRs
+
+struct monitor_duty duty;                  // awake vs. elapsed time
+volatile uint8_t  ws2812_latching = 0;     // reset time of last frame running
+
+#if MONITOR_TDMA
+#if MONITOR_SLOT >= MONITOR_SLOTS || MONITOR_SLOTS > LOT_SLOTS_MAX || SRF05_TICK_MS != LOT_SLOT_MS
+#error "SLOT must be below SLOTS, SLOTS at most 15, and a slot one timer1 tick"
+#endif
+volatile uint8_t  tdma_slot = 0;           // of the running timer1 tick
+volatile int16_t  tdma_drift = 0;          // at the last sync pulse, 512us counts
+#endif
+
+#if MONITOR_PERF && MONITOR_TRACE
+#error "PERF and TRACE share PB0 and don't fit into the RAM together"
+#endif
+#define MONITOR_UART (MONITOR_PERF || MONITOR_TRACE)
+
+#if MONITOR_UART
+const uint8_t *uart_data;                  // bytes on the software UART
+uint8_t uart_len;
+uint8_t uart_pos;                          //   next byte, all sent if len
+volatile uint8_t uart_bit = 0;             //   0 = start bit next, 1..8
+                                           //   data bits, 9 = stop bit
+uint8_t uart_byte;
+#endif
+
+#if MONITOR_PERF
+struct perf perf;                          // counters of the running period
+struct perf perf_sent;                     // record on the software UART
+#endif
+
+#if MONITOR_TRACE
+struct trace trace;                        // echo trace being recorded
+uint8_t trace_sending[TRACE_BLOCK_LEN];    // block on the software UART
+volatile uint8_t SRF05_dt_ticks = 0;       // timer1 ticks from the trigger
+volatile uint8_t SRF05_since_ticks = 0;    //   before to the last one
+#endif
+
+//---------
+// HAL: Latest echo length in microseconds, 0 if there was no echo
+//----------
+uint16_t hal_echo_us(void) {
+//----------
+  uint16_t echo_us;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {     // 16 bit are read in two steps
+    echo_us = SRF05_echo_us;
+  }
+  if (echo_us > MONITOR_DISTANCE_MAX_CM * MONITOR_US_PER_CM) {
+    PERF_COUNT(&perf, PERF_OUT_OF_RANGE);
+  }
+  return echo_us;
+}
+
+//---------
+// HAL: State of the <26cm alarm flicker, toggled by ISR(TIMER1_COMPA_vect)
+//----------
+uint8_t hal_flicker(void) {
+//----------
+  return last_25cm_flicker;
+}
+
+//---------
+// HAL: Number of measurement periods (triggers) so far, wraps at 256
+//----------
+uint8_t hal_period(void) {
+//----------
+  return periods;
+}
+
+//---------
+// HAL: Sets the time from one trigger to the next in timer1 ticks. A running
+// countdown is shortened, so a moving car is followed at once.
+//----------
+void hal_trigger_ms(uint16_t ms) {
+//----------
+  uint8_t ticks = ms >= 255 * SRF05_TICK_MS ? 255 : ms / SRF05_TICK_MS;
+
+  if (!ticks) {
+    ticks = 1;
+  }
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    SRF05_trigger_ticks = ticks;
+    if (SRF05_ticks > ticks) {
+      SRF05_ticks = ticks;
+    }
+  }
+}
+
+//---------
+// HAL: Sleeps until the ISRs posted at least one event and returns them.
+// The time spent awake is measured on the free running timer0, so a single
+// awake stretch must stay below 256 counts (4ms); a 5 led frame takes 0.5ms.
+//----------
+uint8_t hal_wait_events(void) {
+//----------
+  static uint8_t wake_count;
+  uint8_t posted;
+
+  cli();
+  monitor_duty_awake(&duty, (uint8_t)(TCNT0 - wake_count) * SRF05_US_PER_COUNT);
+  while (!(posted = events)) {
+    sleep_enable();
+    sei();                                 // sei; sleep is atomic, an event
+    sleep_cpu();                           //   can't slip in between
+    sleep_disable();
+    cli();
+  }
+  wake_count = TCNT0;
+  events = 0;
+  sei();
+  if (posted & MONITOR_EV_FLICKER) {       // one per 100ms
+    monitor_duty_elapsed(&duty, SRF05_PERIOD_US);
+  }
+  return posted;
+}
 
 //---------
-// This function lights a bar in the given RGB and length.
+// HAL: Sends a frame of len GRB pixels to the stripe
+//
+// The pin change mask is set from the end of the trigger pulse until the
+// echo ended or timed out. A frame sent in that window would delay the echo
+// ISR by up to a frame time and skew the measurement, so it is refused with
+// MONITOR_TX_SCHEDULE and counted as PERF_DISTURBED without. The check and
+// the start of the frame happen with interrupts disabled, a trigger can't
+// slip in between.
+//
+// The reset time is not waited for either: timer0 compare B fires once it
+// passed and posts MONITOR_EV_READY, a frame before is refused.
+//
+// With MONITOR_PERF or MONITOR_TRACE a frame would also garble the byte the
+// software UART is sending, so it is refused until the stop bit, which
+// posts MONITOR_EV_READY.
 //----------
-void inline setLEDS(uint8_t r, uint8_t g, uint8_t b, uint8_t c) {
+uint8_t hal_show(const struct cRGB *frame, uint8_t len) {
 //----------
-#ifdef WS2819_BRIGHTNESS
-  uint8_t factor = 100/WS2819_BRIGHTNESS;
+  uint8_t sreg = SREG;
+
+  cli();
+#if MONITOR_UART
+  if (uart_bit) {                       // UART byte on the wire
+    SREG = sreg;
+    PERF_COUNT(&perf, PERF_REFUSED);
+    return 0;
+  }
 #endif
-  for(int i=0;i<c;i++) {
-#ifndef WS2819_BRIGHTNESS
-    led[i].r=r;led[i].g=g;led[i].b=b;
+  if (PCMSK & (1 << SRF05_1WIRE)) {        // trigger/echo window
+#if MONITOR_TX_SCHEDULE
+    SREG = sreg;
+    PERF_COUNT(&perf, PERF_REFUSED);
+    return 0;
+#else
+    PERF_COUNT(&perf, PERF_DISTURBED);
 #endif
-#ifdef WS2819_BRIGHTNESS
-    led[i].r=r/factor;led[i].g=g/factor;led[i].b=b/factor;
+  }
+  PERF_BEGIN(start);
+#if MONITOR_TX_SCHEDULE
+  if (ws2812_latching) {                   // reset time of the last frame
+    SREG = sreg;
+    PERF_COUNT(&perf, PERF_REFUSED);
+    return 0;
+  }
+  ws2812_setleds_nowait((struct cRGB *)frame, len);
+  ws2812_latching = 1;
+  OCR0B  = TCNT0 + WS2812_RESET_COUNTS;    // One shot compare B when the
+  TIFR   = (1 << OCF0B);                   //   reset time passed
+  TIMSK |= (1 << OCIE0B);
+  SREG = sreg;
+#else
+  SREG = sreg;
+  ws2812_setleds((struct cRGB *)frame, len);
 #endif
+  PERF_END(&perf, PERF_FRAME_TX, start);
+  PERF_COUNT(&perf, PERF_FRAMES);
+  return 1;
+}
+
+#if MONITOR_UART
+//---------
+// This function hands len bytes at data to the software UART, returns 0 if
+// it is still busy with the last ones. data must stay unchanged until sent.
+//----------
+static uint8_t uart_send(const uint8_t *data, uint8_t len) {
+//----------
+  if (uart_pos < uart_len) {
+    return 0;
   }
-  for(int i=c;i<WS2819_STRIPE_LEN;i++) {
-    led[i].r=0;led[i].g=0;led[i].b=0;
+  uart_data = data;
+  uart_len = len;
+  uart_pos = 0;
+  uart_bit = 0;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    OCR0A  = TCNT0 + UART_COUNTS;          // Start bit of the first byte
+    TIFR   = (1 << OCF0A);
+    TIMSK |= (1 << OCIE0A);
   }
-  ws2812_setleds(led,WS2819_STRIPE_LEN);
+  return 1;
 }
+#endif
 
+#if MONITOR_PERF
 //---------
-// This function turns all LEDs off
+// This function hands the counters of the last MONITOR_PERF_PERIODS periods
+// to the software UART, called once per 100ms flicker period. If the last
+// record is still being sent, the next one covers more periods.
 //----------
-void allOFF() {
+static void perf_send(void) {
 //----------
-  allColor(color_black);
+  static uint8_t periods;
+
+  if (++periods < MONITOR_PERF_PERIODS || uart_pos < uart_len) {
+    return;
+  }
+  perf.idle = monitor_idle_permille(&duty); // duty is the main loop's
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    perf_take(&perf, &perf_sent,
+              (uint32_t)periods * (SRF05_PERIOD_US / SRF05_US_PER_COUNT));
+  }
+  periods = 0;
+  perf_seal(&perf_sent);
+  uart_send((const uint8_t *)&perf_sent, PERF_RECORD_LEN);
 }
+#endif
 
+#if MONITOR_TRACE
 //---------
-// This function lights all LEDs to a given color
+// This function records the echo just measured with the time since the
+// trigger before, in whole timer1 ticks, and hands a full block to the
+// software UART. A block the UART can't take yet is sent after the next
+// sample, or dropped once full (trace_add).
 //----------
-void inline allColor(struct cRGB color) {
+static void trace_record(void) {
 //----------
-  setLEDS(color.r,color.g,color.b, WS2819_STRIPE_LEN);
+  uint8_t len;
+  uint8_t dt_ticks;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    dt_ticks = SRF05_dt_ticks;
+  }
+  len = trace_add(&trace, hal_echo_us(), (uint16_t)dt_ticks * SRF05_TICK_MS);
+  if (len && uart_pos == uart_len) {
+    memcpy(trace_sending, trace.block, len);
+    uart_send(trace_sending, len);
+    trace_sent(&trace);
+  }
+}
+#endif
+
+//---------
+// This function returns the free running timer0 count extended by the
+// overflows counted since the trigger. 16us per count. Called with
+// interrupts disabled, so a pending overflow is accounted for here.
+//----------
+static inline uint16_t SRF05_timestamp(void) {
+//----------
+  uint8_t count = TCNT0;
+  uint8_t overflows = SRF05_overflows;
+
+  if ((TIFR & (1 << TOV0)) && !(count & 0x80)) {
+    overflows++;                           // wrapped, but ISR not yet run
+  }
+  return ((uint16_t)overflows << 8) | count;
 }
 
 //---------
-// This function lights a bar in the given color and length
+// This function stops measuring, no more echo or overflow interrupts
 //----------
-void inline barColor(struct cRGB color, int bars) {
+static inline void SRF05_stop(void) {
 //----------
-  setLEDS(color.r,color.g,color.b, bars);
+  GIMSK &= ~(1 << PCIE);                   // General Interrupt Mask Register,
+                                           //   Pin Change Interrupt DISable
+  PCMSK &= ~(1 << SRF05_1WIRE);            // Pin Change Mask Register, DISable
+                                           //   for ECHO
+  TIMSK &= ~(1 << TOIE0);                  // No more timer0 overflows needed
+  PORTB &= ~(1 << ONBOARD_LED);            // Turn off led
 }
 
 //---------
-// This function creates a beginning of the SRF05 trigger pulse every
-// 100 milliseconds and toggles the flicker-flag for the <26cm alarm
+// This function toggles the flicker-flag for the <26cm alarm every 100
+// milliseconds. Every SRF05_trigger_ticks it creates the SRF05 trigger pulse
+// and arms the echo measurement.
 //----------
 ISR(TIMER1_COMPA_vect) {
 //----------
+#if MONITOR_TRACE
+  if (SRF05_since_ticks < 255) {
+    SRF05_since_ticks++;
+  }
+#endif
+  if (++flicker_ticks >= SRF05_FLICKER_TICKS) {
+    flicker_ticks = 0;
+    last_25cm_flicker = !last_25cm_flicker;// See MONITOR_ALARM_CM in
+                                           //   monitor_render()
+    events |= MONITOR_EV_FLICKER;          // Wake up the main loop
+  }
+#if MONITOR_TDMA
+  if (++tdma_slot == MONITOR_SLOTS) {
+    tdma_slot = 0;
+  }
+  if (SRF05_ticks > 1) {
+    SRF05_ticks--;
+    return;                                // Not yet, see hal_trigger_ms
+  }
+  if (tdma_slot != MONITOR_SLOT) {
+    return;                                // Due, but in the slot of another
+  }                                        //   bay, the period rounds up
+#else
+  if (--SRF05_ticks) {
+    return;                                // Not yet, see hal_trigger_ms
+  }
+#endif
+  SRF05_ticks = SRF05_trigger_ticks;
+#if MONITOR_TRACE
+  SRF05_dt_ticks = SRF05_since_ticks;
+  SRF05_since_ticks = 0;
+#endif
+
+  PERF_BEGIN(start);
+#if MONITOR_PERF
+  if (TCNT1 || (PCMSK & (1 << SRF05_1WIRE))) {
+    PERF_COUNT(&perf, PERF_LATE);          // 512us late, or the last echo
+  }                                        //   still measured
+  PERF_COUNT(&perf, PERF_TRIGGERS);
+#endif
   GIMSK &= ~(1 << PCIE);                   // General Interrupt Mask Register,
                                            //   Pin Change Interrupt DISable
   DDRB  |= (1 << SRF05_1WIRE);             // set data direction register to
                                            //   OUT for HY-SRF05 to trigger port
   PORTB |= (1 << SRF05_1WIRE);             // Start HY-SRF05 trigger
-  SRF05_trigger_tick = ticks;              // Snapshot trigger ticks
-  last_25cm_flicker = !last_25cm_flicker;  // See "distance_cm < 26" in main
-                                           //   while(1) loop
+  periods++;                               // See MONITOR_REFRESH_PERIODS
+  _delay_us(SRF05_TRIGGER_US);
+  PORTB &= ~(1 << SRF05_1WIRE);            // End HY-SRF05 trigger, and then...
+  DDRB  &= ~(1 << SRF05_1WIRE);            // Set data direction register to IN
+                                           //   for HY-SRF05 (echo)
+  SRF05_overflows = 0;                     // Start extending timer0
+  SRF05_echo_high = 0;
+  TIFR   = (1 << TOV0);                    // Clear pending overflow and
+  TIMSK |= (1 << TOIE0);                   //   count them while measuring
+  PCMSK |= (1 << SRF05_1WIRE);             // Pin Change Mask Register, ENable
+                                           //   for ECHO.
+  GIFR   = (1 << PCIF);                    // Forget the trigger's own edges
+  GIMSK |= (1 << PCIE);                    // General Interrupt Mask Register,
+                                           //   Pin Change Interrupt Enable
+  PERF_END(&perf, PERF_TRIGGER_ISR, start);
 }
 
 //---------
-// This function increments ticks every 58 microseconds and creates
-// a ending of the SRF05 trigger pulse after 1 tick (= 58 microseconds)
+// This function extends timer0 while an echo is measured, about 8 times per
+// measurement instead of the former 58us tick, and gives up if the echo
+// never ends.
+//----------
+ISR(TIMER0_OVF_vect) {
+//----------
+  if (++SRF05_overflows >= SRF05_TIMEOUT_OVF) {
+    SRF05_echo_us = 0;
+    SRF05_stop();
+    events |= MONITOR_EV_MEASURED;
+    PERF_COUNT(&perf, PERF_TIMEOUTS);
+  }
+}
+
+//---------
+// This function ends the reset time of the last frame, see hal_show
+//----------
+ISR(TIMER0_COMPB_vect) {
+//----------
+  TIMSK &= ~(1 << OCIE0B);
+  ws2812_latching = 0;
+  events |= MONITOR_EV_READY;              // Offer a refused frame again
+}
+
+#if MONITOR_UART
+//---------
+// This function sends the bytes of uart_send() bit by bit on the software UART,
+// one compare A match of the free running timer0 per bit. A start bit
+// delayed by a frame is resynchronized, the stop bit allows the next frame.
 //----------
 ISR(TIMER0_COMPA_vect) {
 //----------
-  ++ticks;
-  if (SRF05_trigger_tick) {
-    SRF05_trigger_tick = 0;                // Reset trigger snapshot
-    PORTB &= ~(1 << SRF05_1WIRE);          // End HY-SRF05 trigger, and then...
-    DDRB  &= ~(1 << SRF05_1WIRE);          // Set data direction register to IN
-                                           //   for HY-SRF05 (echo)
-    MCUCR |= (1 << ISC01) | (1 << ISC00);  // The rising edge of INT0 generates
-                                           //   an interrupt request, so next
-                                           //   INT0 must be ECHO start.
-    PCMSK |= (1 << SRF05_1WIRE);           // Pin Change Mask Register, ENable
-                                           //   for ECHO.
-    GIMSK |= (1 << PCIE);                  // General Interrupt Mask Register,
-                                           //   Pin Change Interrupt Enable
+  if (uart_bit == 0) {                     // Start bit
+    OCR0A = TCNT0 + UART_COUNTS;
+    uart_byte = uart_data[uart_pos];
+    PORTB &= ~(1 << UART_TX);
+    uart_bit = 1;
+    return;
+  }
+  OCR0A += UART_COUNTS;
+  if (uart_bit < 9) {                      // Data bits, LSB first
+    if (uart_byte & 1) {
+      PORTB |= (1 << UART_TX);
+    } else {
+      PORTB &= ~(1 << UART_TX);
+    }
+    uart_byte >>= 1;
+    uart_bit++;
+  } else {                                 // Stop bit
+    PORTB |= (1 << UART_TX);
+    uart_bit = 0;
+    events |= MONITOR_EV_READY;            // Offer a refused frame again
+    if (++uart_pos == uart_len) {
+      TIMSK &= ~(1 << OCIE0A);             // All sent
+    }
   }
 }
+#endif
 
 //---------
-// This function measures the SRF05 echo length direct in distance in cm
+// This function timestamps the SRF05 echo edges on the free running timer0
+// and measures the echo length in microseconds
 //----------
 ISR(PCINT0_vect){
-  if (!SRF05_echo_tick) {
-    SRF05_echo_tick = ticks;       // Snapshot ECHO start in ticks
-    MCUCR &= ~(1 << ISC00);        // The falling edge of INT0 generates an
-                                   // interrupt request, so next INT0 must be
-                                   // ECHO end.
+//----------
+  PERF_BEGIN(start);
+  uint16_t now = SRF05_timestamp();
+
+  if (PINB & (1 << SRF05_1WIRE)) { // Rising edge, ECHO start
+    SRF05_echo_start = now;
+    SRF05_echo_high = 1;
     PORTB |= (1 << ONBOARD_LED);   // Turn on led (just for fun)
-  } else {
-    SRF05_echo_length = ticks - SRF05_echo_tick;
-    if (SRF05_echo_length > 300) { // Ignores distance greater than 3m
-      SRF05_echo_length = 0;
-    }
-    GIMSK &= ~(1 << PCIE);         // General Interrupt Mask Register,
-                                   //   Pin Change Interrupt DISable
-    PCMSK &= ~(1 << SRF05_1WIRE);  // Pin Change Mask Register, DISable for ECHO
-    PORTB &= ~(1 << ONBOARD_LED);  // Turn off led
-    SRF05_echo_tick = 0;
+  } else if (SRF05_echo_high) {    // Falling edge, ECHO end
+    SRF05_echo_us = (now - SRF05_echo_start) * SRF05_US_PER_COUNT;
+    SRF05_stop();
+    events |= MONITOR_EV_MEASURED; // Wake up the main loop
   }
+  PERF_END(&perf, PERF_ECHO_ISR, start);
 }
 
+#if MONITOR_TDMA
+//---------
+// This function aligns the timer1 ticks to the rising edge of the sync
+// pulse, which marks the begin of a frame of MONITOR_SLOTS ticks, driven by
+// the node synced to the LotManager (see ../core/tdma.h). The tick of slot
+// 0 follows a timer1 count after the edge. tdma_drift keeps how far the
+// ticks were off, the ATtiny85 has no uplink to report it.
+//----------
+ISR(INT0_vect) {
+//----------
+  int16_t frame = MONITOR_SLOTS * SRF05_TICK_COUNTS;
+  int16_t pos = tdma_slot * SRF05_TICK_COUNTS + TCNT1 + 1;
+
+  if (pos >= frame / 2) {                  // the nearer of two frame begins
+    pos -= frame;
+  }
+  tdma_drift = pos;
+  TCNT1 = OCR1C - 1;                       // slot 0 begins on the next count
+  tdma_slot = MONITOR_SLOTS - 1;
+}
+#endif
+
 //---------
 // Setup the necessarities Interrupt and Timer-wise
 //----------
 void setupInterrupts(void) {
   /*
-   * Setup timer0 to fire every 58 microsecond
+   * Setup timer0 to count freely, 16 microseconds per count. The overflow
+   * interrupt is only enabled while an echo is measured.
    */
-  TCCR0A |= (1 << WGM01);   // set timer counter mode to CTC
-  TCCR0B |= (1 << CS01);    // set prescaler to 64 (CLK=16MHz/8/116=17.2kHz, 58us)
-  OCR0A   = 116;            // set Timer's counter max value
-  TIMSK  |= (1 << OCIE0A);  // enable Timer CTC interrupt
+  TCCR0A  = 0;              // set timer counter mode to normal
+  TCCR0B  = (1 << CS02);    // set prescaler to 256 (CLK=16MHz/256=62.5kHz, 16us)
 
   /*
-   * Setup timer1 to fire every 0.1 second
+   * Setup timer1 to fire every 20 milliseconds. The flicker toggles every
+   * 5th tick, the trigger every MONITOR_PERIOD_*_MS / 20 ticks.
    */
   TCNT1   = 0;              // Clear registers
   TCCR1   = 0;
   TCCR1  |= (1 << CTC1);    // set timer counter mode to CTC
-  OCR1C   = 195;            // set Timer's counter max value
+  OCR1C   = 38;             // set Timer's counter max value
   OCR1A   = OCR1C;
-  // set prescaler to 8192 (CLK=16MHz/8192/195=10.01Hz, 0.099s)
+  // set prescaler to 8192 (CLK=16MHz/8192/39=50.08Hz, 0.01997s)
   TCCR1 |= (1 << CS13) | (1 << CS12) | (1 << CS11);
   TIMSK |= (1 << OCIE1A);   // enable Timer CTC interrupt
+
+#if MONITOR_TDMA
+  /*
+   * Setup INT0 on the rising edge of the sync pulse
+   */
+  MCUCR  |= (1 << ISC01) | (1 << ISC00);
+  GIMSK  |= (1 << INT0);
+#endif
 }
 
 //---------
@@ -164,33 +543,39 @@ int main(void) {
 //----------
   // Setup Data-Direction-Register
   DDRB   |= (1 << ONBOARD_LED);   // set data direction register for ONBOARD_LED to output
+#if MONITOR_UART
+  PORTB  |= (1 << UART_TX);       // UART idles high
+  DDRB   |= (1 << UART_TX);
+#endif
+#if MONITOR_PERF
+  perf_init(&perf, PERF_DEVICE_ATTINY85, F_CPU / 256, 0);
+#endif
+#if MONITOR_TRACE
+  trace_init(&trace, SRF05_US_PER_COUNT, 0);
+#endif
 
+  monitor_init(&monitor);
   setupInterrupts();
+  set_sleep_mode(SLEEP_MODE_IDLE);// timers and pin change keep running
   sei();                          //enable global interrupt
 
   while(1)
   {
-    int distance_cm = SRF05_echo_length;     // snapshot b/c volatile may change
-    int bars;
-
-    if ((distance_cm < 1) | (distance_cm > 300)) { // Switch stripe off if
-      allOFF();                                    //   invalid (0) distance or
-    } else {                                       //   greater than 3m.
-      if (distance_cm < 26 ) {                     // less than 26cm, flicker
-        if ( last_25cm_flicker ) {                 //   all leds like crazy
-          allOFF();                                //   based on volatile
-        } else {                                   //   last_25cm_flicker.
-          barColor(color_red, WS2819_STRIPE_LEN);  //   See ISR(TIM0_COMPA_vect)
-        }
-      } else {                                     // Distance 26cm-3m:
-        if (distance_cm < 101) {                   //  more red leds if closer
-          bars = (100 - distance_cm) / 15;         //   than 1m till 26cm. One
-          barColor(color_red, ++bars);             //   additional led per 15cm
-        } else {                                   //  less green leds if closer
-          bars = (distance_cm-100)/40;             //   than 3m till 1m. One led
-          barColor(color_green, ++bars);           //   less per 40cm.
-        }
-      }
+    uint8_t posted = hal_wait_events(); // sleep until the ISRs post an event
+    PERF_BEGIN(start);
+    monitor_event(&monitor, posted); // render the distance and send the
+                                  //   frame only if it changed. See
+                                  //   ../core/monitor.c
+    PERF_END(&perf, PERF_LOOP, start);
+#if MONITOR_PERF
+    if (posted & MONITOR_EV_FLICKER) {
+      perf_send();                // once per 100ms
     }
+#endif
+#if MONITOR_TRACE
+    if (posted & MONITOR_EV_MEASURED) {
+      trace_record();
+    }
+#endif
   }
 }
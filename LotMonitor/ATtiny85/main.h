@@ -1,177 +1,20 @@
-// This function lights a bar in the given RGB and length.
-void inline setLEDS(uint8_t r, uint8_t g, uint8_t b, uint8_t c);
+// This function toggles the flicker-flag every 100 milliseconds and creates
+// the SRF05 trigger pulse and arms the echo measurement every 40 to 500
+// milliseconds (See hal_trigger_ms) by timer1 compare interrupt (See
+// setupInterrupts)
+ISR(TIMER1_COMPA_vect);
 
-// This function turns all LEDs off
-void inline allOFF();
+// This function extends the free running timer0 while an echo is measured
+ISR(TIMER0_OVF_vect);
 
-// This function lights all LEDs to a given color
-void inline allColor(struct cRGB color);
+// This function ends the reset time of the last frame (See hal_show)
+ISR(TIMER0_COMPB_vect);
 
-// This function lights a bar in the given color and length
-void inline barColor(struct cRGB color, int bars);
+// This function sends the profiling record on the software UART (See perf_send)
+ISR(TIMER0_COMPA_vect);
 
-// This function is executed 100 times per sec by timer interupt (See TCCR0B)
-ISR(TIM0_COMPA_vect);
+// This function timestamps the SRF05 echo edges and measures the echo length
+ISR(PCINT0_vect);
 
-// Define some colors. (cRGB is internal grb !)
-static const struct cRGB color_black   = {   0,   0,   0 };
-static const struct cRGB color_red     = {   0, 255,   0 };
-static const struct cRGB color_green   = { 255,   0,   0 };
-static const struct cRGB color_blue    = {   0,   0, 255 };
-static const struct cRGB color_yellow  = { 255, 255,   0 };
-static const struct cRGB color_cyan    = { 255,   0, 255 };
-static const struct cRGB color_magenta = {   0, 255, 255 };
-static const struct cRGB color_white   = { 255, 255, 255 };
-
-/*
- * See: https://www.w3schools.com/colors/colors_names.asp
- *
-static const struct cRGB color_aliceblue = { 248, 240, 255 };
-static const struct cRGB color_antiquewhite = { 235, 250, 215 };
-static const struct cRGB color_aqua = { 255, 0, 255 };
-static const struct cRGB color_aquamarine = { 255, 127, 212 };
-static const struct cRGB color_azure = { 255, 240, 255 };
-static const struct cRGB color_beige = { 245, 245, 220 };
-static const struct cRGB color_bisque = { 228, 255, 196 };
-static const struct cRGB color_black = { 0, 0, 0 };
-static const struct cRGB color_blanchedalmond = { 235, 255, 205 };
-static const struct cRGB color_blue = { 0, 0, 255 };
-static const struct cRGB color_blueviolet = { 43, 138, 226 };
-static const struct cRGB color_brown = { 42, 165, 42 };
-static const struct cRGB color_burlywood = { 184, 222, 135 };
-static const struct cRGB color_cadetblue = { 158, 95, 160 };
-static const struct cRGB color_chartreuse = { 255, 127, 0 };
-static const struct cRGB color_chocolate = { 105, 210, 30 };
-static const struct cRGB color_coral = { 127, 255, 80 };
-static const struct cRGB color_cornflowerblue = { 149, 100, 237 };
-static const struct cRGB color_cornsilk = { 248, 255, 220 };
-static const struct cRGB color_crimson = { 20, 220, 60 };
-static const struct cRGB color_cyan = { 255, 0, 255 };
-static const struct cRGB color_darkblue = { 0, 0, 139 };
-static const struct cRGB color_darkcyan = { 139, 0, 139 };
-static const struct cRGB color_darkgoldenrod = { 134, 184, 11 };
-static const struct cRGB color_darkgray = { 169, 169, 169 };
-static const struct cRGB color_darkgreen = { 100, 0, 0 };
-static const struct cRGB color_darkgrey = { 169, 169, 169 };
-static const struct cRGB color_darkkhaki = { 183, 189, 107 };
-static const struct cRGB color_darkmagenta = { 0, 139, 139 };
-static const struct cRGB color_darkolivegreen = { 107, 85, 47 };
-static const struct cRGB color_darkorange = { 140, 255, 0 };
-static const struct cRGB color_darkorchid = { 50, 153, 204 };
-static const struct cRGB color_darkred = { 0, 139, 0 };
-static const struct cRGB color_darksalmon = { 150, 233, 122 };
-static const struct cRGB color_darkseagreen = { 188, 143, 143 };
-static const struct cRGB color_darkslateblue = { 61, 72, 139 };
-static const struct cRGB color_darkslategray = { 79, 47, 79 };
-static const struct cRGB color_darkslategrey = { 79, 47, 79 };
-static const struct cRGB color_darkturquoise = { 206, 0, 209 };
-static const struct cRGB color_darkviolet = { 0, 148, 211 };
-static const struct cRGB color_deeppink = { 20, 255, 147 };
-static const struct cRGB color_deepskyblue = { 191, 0, 255 };
-static const struct cRGB color_dimgray = { 105, 105, 105 };
-static const struct cRGB color_dimgrey = { 105, 105, 105 };
-static const struct cRGB color_dodgerblue = { 144, 30, 255 };
-static const struct cRGB color_firebrick = { 34, 178, 34 };
-static const struct cRGB color_floralwhite = { 250, 255, 240 };
-static const struct cRGB color_forestgreen = { 139, 34, 34 };
-static const struct cRGB color_fuchsia = { 0, 255, 255 };
-static const struct cRGB color_gainsboro = { 220, 220, 220 };
-static const struct cRGB color_ghostwhite = { 248, 248, 255 };
-static const struct cRGB color_goldenrod = { 165, 218, 32 };
-static const struct cRGB color_gold = { 215, 255, 0 };
-static const struct cRGB color_gray = { 128, 128, 128 };
-static const struct cRGB color_green = { 128, 0, 0 };
-static const struct cRGB color_greenyellow = { 255, 173, 47 };
-static const struct cRGB color_grey = { 128, 128, 128 };
-static const struct cRGB color_honeydew = { 255, 240, 240 };
-static const struct cRGB color_hotpink = { 105, 255, 180 };
-static const struct cRGB color_indianred = { 92, 205, 92 };
-static const struct cRGB color_indigo = { 0, 75, 130 };
-static const struct cRGB color_ivory = { 255, 255, 240 };
-static const struct cRGB color_khaki = { 230, 240, 140 };
-static const struct cRGB color_lavenderblush = { 240, 255, 245 };
-static const struct cRGB color_lavender = { 230, 230, 250 };
-static const struct cRGB color_lawngreen = { 252, 124, 0 };
-static const struct cRGB color_lemonchiffon = { 250, 255, 205 };
-static const struct cRGB color_lightblue = { 216, 173, 230 };
-static const struct cRGB color_lightcoral = { 128, 240, 128 };
-static const struct cRGB color_lightcyan = { 255, 224, 255 };
-static const struct cRGB color_lightgoldenrodyellow = { 250, 250, 210 };
-static const struct cRGB color_lightgray = { 211, 211, 211 };
-static const struct cRGB color_lightgreen = { 238, 144, 144 };
-static const struct cRGB color_lightgrey = { 211, 211, 211 };
-static const struct cRGB color_lightpink = { 182, 255, 193 };
-static const struct cRGB color_lightsalmon = { 160, 255, 122 };
-static const struct cRGB color_lightseagreen = { 178, 32, 170 };
-static const struct cRGB color_lightskyblue = { 206, 135, 250 };
-static const struct cRGB color_lightslategray = { 136, 119, 153 };
-static const struct cRGB color_lightslategrey = { 136, 119, 153 };
-static const struct cRGB color_lightsteelblue = { 196, 176, 222 };
-static const struct cRGB color_lightyellow = { 255, 255, 224 };
-static const struct cRGB color_lime = { 255, 0, 0 };
-static const struct cRGB color_limegreen = { 205, 50, 50 };
-static const struct cRGB color_linen = { 240, 250, 230 };
-static const struct cRGB color_magenta = { 0, 255, 255 };
-static const struct cRGB color_maroon = { 0, 128, 0 };
-static const struct cRGB color_mediumaquamarine = { 205, 102, 170 };
-static const struct cRGB color_mediumblue = { 0, 0, 205 };
-static const struct cRGB color_mediumorchid = { 85, 186, 211 };
-static const struct cRGB color_mediumpurple = { 112, 147, 219 };
-static const struct cRGB color_mediumseagreen = { 179, 60, 113 };
-static const struct cRGB color_mediumslateblue = { 104, 123, 238 };
-static const struct cRGB color_mediumspringgreen = { 250, 0, 154 };
-static const struct cRGB color_mediumturquoise = { 209, 72, 204 };
-static const struct cRGB color_mediumvioletred = { 21, 199, 133 };
-static const struct cRGB color_midnightblue = { 25, 25, 112 };
-static const struct cRGB color_mintcream = { 255, 245, 250 };
-static const struct cRGB color_mistyrose = { 228, 255, 225 };
-static const struct cRGB color_moccasin = { 228, 255, 181 };
-static const struct cRGB color_navajowhite = { 222, 255, 173 };
-static const struct cRGB color_navy = { 0, 0, 128 };
-static const struct cRGB color_oldlace = { 245, 253, 230 };
-static const struct cRGB color_olive = { 128, 128, 0 };
-static const struct cRGB color_olivedrab = { 142, 107, 35 };
-static const struct cRGB color_orange = { 165, 255, 0 };
-static const struct cRGB color_orangered = { 69, 255, 0 };
-static const struct cRGB color_orchid = { 112, 218, 214 };
-static const struct cRGB color_palegoldenrod = { 232, 238, 170 };
-static const struct cRGB color_palegreen = { 251, 152, 152 };
-static const struct cRGB color_paleturquoise = { 238, 175, 238 };
-static const struct cRGB color_palevioletred = { 112, 219, 147 };
-static const struct cRGB color_papayawhip = { 239, 255, 213 };
-static const struct cRGB color_peachpuff = { 218, 255, 185 };
-static const struct cRGB color_peru = { 133, 205, 63 };
-static const struct cRGB color_pink = { 192, 255, 203 };
-static const struct cRGB color_plum = { 160, 221, 221 };
-static const struct cRGB color_powderblue = { 224, 176, 230 };
-static const struct cRGB color_purple = { 0, 128, 128 };
-static const struct cRGB color_rebeccapurple = { 51, 102, 153 };
-static const struct cRGB color_red = { 0, 255, 0 };
-static const struct cRGB color_rosybrown = { 143, 188, 143 };
-static const struct cRGB color_royalblue = { 105, 65, 225 };
-static const struct cRGB color_saddlebrown = { 69, 139, 19 };
-static const struct cRGB color_salmon = { 128, 250, 114 };
-static const struct cRGB color_sandybrown = { 164, 244, 96 };
-static const struct cRGB color_seagreen = { 139, 46, 87 };
-static const struct cRGB color_seashell = { 245, 255, 238 };
-static const struct cRGB color_sienna = { 82, 160, 45 };
-static const struct cRGB color_silver = { 192, 192, 192 };
-static const struct cRGB color_skyblue = { 206, 135, 235 };
-static const struct cRGB color_slateblue = { 90, 106, 205 };
-static const struct cRGB color_slategray = { 128, 112, 144 };
-static const struct cRGB color_slategrey = { 128, 112, 144 };
-static const struct cRGB color_snow = { 250, 255, 250 };
-static const struct cRGB color_springgreen = { 255, 0, 127 };
-static const struct cRGB color_steelblue = { 130, 70, 180 };
-static const struct cRGB color_tan = { 180, 210, 140 };
-static const struct cRGB color_teal = { 128, 0, 128 };
-static const struct cRGB color_thistle = { 191, 216, 216 };
-static const struct cRGB color_tomato = { 99, 255, 71 };
-static const struct cRGB color_turquoise = { 224, 64, 208 };
-static const struct cRGB color_violet = { 130, 238, 238 };
-static const struct cRGB color_wheat = { 222, 245, 179 };
-static const struct cRGB color_white = { 255, 255, 255 };
-static const struct cRGB color_whitesmoke = { 245, 245, 245 };
-static const struct cRGB color_yellow = { 255, 255, 0 };
-static const struct cRGB color_yellowgreen = { 205, 154, 50 };
-*/
+// Setup the necessarities Interrupt and Timer-wise
+void setupInterrupts(void);
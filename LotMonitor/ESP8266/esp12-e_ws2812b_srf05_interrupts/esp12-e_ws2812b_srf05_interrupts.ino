@@ -4,32 +4,125 @@
                       // Arduino IDE: Sketch / Include library / Manage libraries
                       //              Type "FastLED" in the "Filter your search..." field
                       //              Select the entry and click "Install"
+#include "src/monitor.h"  // ../../core, shared with ATtiny85 and host builds
+#include "src/hal.h"
+#include "src/perf.h"     // MONITOR_PERF, see src/monitor_config.h
+#include "src/trace.h"    // MONITOR_TRACE
+#include "src/lot_proto.h" // LOT_NET
+#include "src/tdma.h"      //   trigger slots
+
+// Status reports to the LotManager over WiFi. Off by default, the node then
+// only drives its stripes.
+#define LOT_NET 0
+
+#if LOT_NET
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+
+#define WIFI_SSID       "LotNet"
+#define WIFI_PASS       "change-me"
+#define LOTMANAGER_IP   192,168,4,1
+#define LOTMANAGER_PORT 7300
+#define MONITOR_ID      0     // id of bay 0, bay i reports as MONITOR_ID + i
+#define LOT_REPORT_MS   1000  // status of all bays at least every second
+#endif
 
 #define BAUD_RATE 115200
 
+#define SRF05_WINDOW_CCOUNT 3200000  // 40ms, echo window ends at the latest
+
+// Number of parking bays (sensor + stripe) driven by this node, 1..3.
+// The sensors are triggered one after the other, so their echoes can't
+// interfere: a trigger slot is the period the busiest bay asks for (see
+// monitor_period_ms) divided by BAYS, but at least the 40ms window.
+#define BAYS 1
+
+#if BAYS < 1 || BAYS > 3
+#error "BAYS must be 1..3, see the pin tables below"
+#endif
+
+#define SRF05_SLOT_MIN_MS 40
+
+#define PERF_NOW()  asm_ccount()  // durations in CCOUNT (12.5ns)
+#define PERF_TICKS  uint32_t
+#define PERF_SHIFT  7             // histogram from 1.6us
+
 // Onboard LEDs
 #define ESP12LED    2 // GPIO2  - PIN17 - D4
 #define NodeMCULED 16 // GPIO16 - PIN4  - D0
 
-// SRF05
+// SRF05, one per bay
 #define SRF05_TRIG_PIN 4
 #define SRF05_ECHO_PIN 5
+#define SRF05_TRIG_PIN_1 14   // GPIO14 - D5
+#define SRF05_ECHO_PIN_1 13   // GPIO13 - D7
+#define SRF05_TRIG_PIN_2 16   // GPIO16 - D0, instead of the NodeMCU LED
+#define SRF05_ECHO_PIN_2 3    // GPIO3  - RX, Serial is TX only then; not GPIO0, an
+                              //   idle echo is low and boots the flasher
 
-// WS2812B
-#define NUM_LEDS 5
+// WS2812B, one stripe per bay
+#define NUM_LEDS WS2819_STRIPE_LEN  // See src/monitor_config.h
 #define DATA_PIN 6    // GPIO12 - PIN6 - D6
+#define DATA_PIN_1 8  // GPIO15 - D8, pulled low at boot
+#define DATA_PIN_2 4  // GPIO2  - D4, instead of the ESP-12 LED
+
+static const uint8_t SRF05_trig_pin[] = { SRF05_TRIG_PIN, SRF05_TRIG_PIN_1, SRF05_TRIG_PIN_2 };
+static const uint8_t SRF05_echo_pin[] = { SRF05_ECHO_PIN, SRF05_ECHO_PIN_1, SRF05_ECHO_PIN_2 };
+
+// Per bay echo state, written by the ISRs
+struct bay {
+  volatile uint32_t echo_us;
+  volatile uint8_t  events;    // MONITOR_EV_* posted by the ISR
+  volatile uint8_t  periods;   // triggers so far, see hal_period
+  uint16_t          period_ms; // asked for, see hal_trigger_ms
+#if MONITOR_TRACE
+  int32_t           trigger_ccount; // last trigger of this bay
+  volatile uint16_t dt_ms;     //   and the time since the one before
+#endif
+#if LOT_NET
+  uint8_t           lot_seq;   // of the next status frame
+  uint8_t           lot_flags; // LOT_F_RESERVED, LOT_F_BOOT
+  uint8_t           lot_slot;  // trigger slot, LOT_SLOTS_MAX until a beacon
+  uint32_t          trigger_us; // last trigger begin, in slots
+#endif
+};
 
 Ticker ticker;
+uint16_t SRF05_slot_ms;              // ticker interval, 0 in trigger slots
+volatile uint32_t SRF05_slot_ccount; //   in CCOUNT
 
 volatile int32_t  SRF05_triggered;
 volatile int32_t  SRF05_start_ccount;
-volatile uint32_t SRF05_distance_cm;
-volatile uint32_t SRF05_distance_max = 300; // ignore everything more than 3m away
+volatile int32_t  SRF05_trigger_ccount;
+volatile int32_t  SRF05_measuring;   // from trigger until echo end
+volatile uint8_t  SRF05_bay;         // sensor triggered last
 volatile int32_t  WS2812B_alert_cnt;
 
 int32_t WS2812B_alert_state;
 
-CRGB leds[NUM_LEDS];
+CRGB leds[BAYS][NUM_LEDS];
+CLEDController *strips[BAYS];
+
+struct bay bays[BAYS];
+struct monitor monitor[BAYS];
+uint8_t bay;                         // bay the HAL functions refer to
+
+#if MONITOR_PERF
+struct perf perf;                    // counters of the running period
+struct perf perf_sent;               // last record written to Serial
+int32_t     perf_ccount;             // start of the running period
+#endif
+
+#if MONITOR_TRACE
+struct trace traces[BAYS];           // echo trace of each sensor
+#endif
+
+#if LOT_NET
+WiFiUDP udp;
+int32_t lot_ccount;                  // last status sent
+struct tdma tdma;                    // frames of the trigger slots
+uint8_t SRF05_slotted;               // triggering in slots, see lotSchedule
+#endif
 
 //---------
 // This function reads special 32bit register named CCOUNT that constantly counts clock ticks.
@@ -59,106 +152,480 @@ static inline int32_t asm_ccount(void) {
 }
 
 //---------
-// This function triggers a measurement on the HY-SRF05
+// This function triggers a measurement on the HY-SRF05 of bay next
 //----------
-void inline triggerSRF05(){
+void inline triggerBay(uint8_t next){
 //----------
+  PERF_BEGIN(start);
+  uint8_t pin = SRF05_trig_pin[next];
+
+#if MONITOR_PERF
+  if (SRF05_measuring) {
+    PERF_COUNT(&perf, PERF_TIMEOUTS);  // last echo never ended
+  }
+  if (SRF05_slot_ccount &&
+      (uint32_t)(start - SRF05_trigger_ccount) > SRF05_slot_ccount + SRF05_slot_ccount / 10) {
+    PERF_COUNT(&perf, PERF_LATE);      // ticker 10% late
+  }
+  PERF_COUNT(&perf, PERF_TRIGGERS);
+#endif
+
+#if BAYS < 3
   //digitalWrite(ESP12LED,!(digitalRead(ESP12LED)));  //Toggle LED Pin
   digitalWrite(ESP12LED,LOW);
-  digitalWrite(SRF05_TRIG_PIN, LOW);
+#endif
+  SRF05_bay = next;
+  digitalWrite(pin, LOW);
   delayMicroseconds(2);
-  digitalWrite(SRF05_TRIG_PIN, HIGH);
+  digitalWrite(pin, HIGH);
   delayMicroseconds(10);
-  digitalWrite(SRF05_TRIG_PIN, LOW);
+  digitalWrite(pin, LOW);
   SRF05_triggered = 1;
+  SRF05_trigger_ccount = asm_ccount();
+  SRF05_measuring = 1;
+  bays[next].periods++;
+#if MONITOR_TRACE
+  bays[next].dt_ms = ((uint32_t)(SRF05_trigger_ccount - bays[next].trigger_ccount)) / 80000;
+  bays[next].trigger_ccount = SRF05_trigger_ccount;
+#endif
+#if BAYS < 3
   digitalWrite(ESP12LED,HIGH);
+#endif
+  PERF_END(&perf, PERF_TRIGGER_ISR, start);
 }
 
 //---------
-// This function measurements echo on the HY-SRF05
+// This function triggers a measurement on the next HY-SRF05, round robin
+//----------
+void triggerSRF05(){
+//----------
+  triggerBay(SRF05_bay + 1 < BAYS ? SRF05_bay + 1 : 0);
+}
+
+#if LOT_NET
+//---------
+// This function triggers the bays whose slot begins now and sets the ticker
+// to the next slot due of any bay, see src/tdma.h. A bay keeps its period
+// rounded up to whole frames. The ticker has 1ms steps, a slot within
+// 0.5ms is due.
+//----------
+void triggerSlot(){
+//----------
+  uint32_t now = micros();
+  uint32_t wait_us = ~0u;
+
+  for (uint8_t i = 0; i < BAYS; i++) {
+    struct bay *b = &bays[i];
+    uint32_t at = tdma_trigger_us(&tdma, b->lot_slot, b->trigger_us, b->period_ms, now);
+
+    if ((int32_t)(at - now) <= 500) {
+      triggerBay(i);
+      b->trigger_us = at;
+      at = tdma_trigger_us(&tdma, b->lot_slot, at, b->period_ms, now + 500);
+    }
+    if (at - now < wait_us) {
+      wait_us = at - now;
+    }
+  }
+  ticker.once_ms((wait_us + 500) / 1000, triggerSlot);
+}
+#endif
+
+//---------
+// This function measurements echo on the HY-SRF05 triggered last. Only that
+// sensor is active, so all echo pins share it.
 //----------
 void inline measureSRF05(){
+  if(!SRF05_measuring) {
+    return;                            // late edge after the window
+  }
+  PERF_BEGIN(start);
   if(SRF05_triggered) {
     SRF05_start_ccount = asm_ccount();
     SRF05_triggered = 0;
     //digitalWrite(NodeMCULED,LOW);
   } else {
     int32_t etime = asm_ccount();
-    int echo_ccount = ((uint32_t)(etime-SRF05_start_ccount));
-    if(echo_ccount>1392000) { // 300cm  * 80 CCOUNT * 58us/cm
-      SRF05_distance_cm = 0;
+    struct bay *b = &bays[SRF05_bay];
+    b->echo_us = ((uint32_t)(etime-SRF05_start_ccount)) / 80; // 80 CCOUNT per us
+    b->events |= MONITOR_EV_MEASURED;
+    SRF05_measuring = 0;
+    //digitalWrite(NodeMCULED,HIGH);
+  }
+  PERF_END(&perf, PERF_ECHO_ISR, start);
+}
+
+//---------
+// HAL: Latest echo length of the current bay in microseconds, 0 if there was no echo
+//----------
+uint16_t hal_echo_us(void) {
+//----------
+  uint32_t echo_us = bays[bay].echo_us;
+  if (echo_us > MONITOR_DISTANCE_MAX_CM * MONITOR_US_PER_CM) {
+    PERF_COUNT(&perf, PERF_OUT_OF_RANGE);
+  }
+  return echo_us > 0xFFFF ? 0 : echo_us;  // out of range anyway
+}
+
+//---------
+// HAL: State of the <26cm alarm flicker, toggles every 150ms
+//----------
+uint8_t hal_flicker(void) {
+//----------
+  int32_t now = asm_ccount();
+  if( ((uint32_t)(now-WS2812B_alert_cnt)) > 12000000) { // 12M CCOUNT = 150ms
+    WS2812B_alert_state = !WS2812B_alert_state;
+    WS2812B_alert_cnt = now;
+  }
+  return WS2812B_alert_state;
+}
+
+//---------
+// HAL: Number of measurement periods (triggers) of the current bay so far, wraps at 256
+//----------
+uint8_t hal_period(void) {
+//----------
+  return bays[bay].periods;
+}
+
+//---------
+// This function attaches the round robin ticker at the pace of the busiest
+// bay, unless it runs at that pace already.
+//----------
+void attachSRF05(){
+//----------
+  uint16_t period_ms = 0xFFFF;
+  uint16_t slot_ms;
+
+  for (uint8_t i = 0; i < BAYS; i++) {
+    if (bays[i].period_ms && bays[i].period_ms < period_ms) {
+      period_ms = bays[i].period_ms;
+    }
+  }
+  slot_ms = period_ms / BAYS < SRF05_SLOT_MIN_MS ? SRF05_SLOT_MIN_MS : period_ms / BAYS;
+  if (slot_ms != SRF05_slot_ms) {
+    SRF05_slot_ms = slot_ms;
+    SRF05_slot_ccount = slot_ms * 80000UL;
+    ticker.attach_ms(slot_ms, triggerSRF05);  // restarts the interval
+  }
+}
+
+//---------
+// HAL: Sets the time from one trigger of the current bay to the next. The
+// sensors share the ticker, so it runs at the pace of the busiest bay. In
+// trigger slots triggerSlot() takes the new period with the next trigger.
+//----------
+void hal_trigger_ms(uint16_t ms) {
+//----------
+  bays[bay].period_ms = ms;
+#if LOT_NET
+  if (SRF05_slotted) {
+    return;
+  }
+#endif
+  attachSRF05();
+}
+
+//---------
+// HAL: Returns the events posted for the current bay so far, the ESP8266 does not sleep
+//----------
+uint8_t hal_wait_events(void) {
+//----------
+  noInterrupts();
+  uint8_t events = bays[bay].events;
+  bays[bay].events = 0;
+  interrupts();
+  return events;
+}
+
+//---------
+// HAL: Sends a frame of len GRB pixels to the stripe of the current bay
+//
+// FastLED disables interrupts while sending, which would delay the echo ISR
+// and skew its CCOUNT. So with MONITOR_TX_SCHEDULE a frame is refused from
+// the trigger of any sensor until its echo ended (or 40ms passed), loop()
+// offers it again right after. FastLED itself waits for the reset time.
+//
+// Note: FastLED is set up in RGB order, so it sends the CRGB fields in memory
+// order r,g,b. A GRB cRGB frame therefore can be copied as is.
+//----------
+uint8_t hal_show(const struct cRGB *frame, uint8_t len) {
+//----------
+  if (SRF05_measuring) {
+    if (((uint32_t)(asm_ccount()-SRF05_trigger_ccount)) < SRF05_WINDOW_CCOUNT) {
+#if MONITOR_TX_SCHEDULE
+      PERF_COUNT(&perf, PERF_REFUSED);
+      return 0;
+#else
+      PERF_COUNT(&perf, PERF_DISTURBED);
+#endif
     } else {
-      SRF05_distance_cm = ((uint32_t)(etime-SRF05_start_ccount)) / 80 / 58;
+      SRF05_measuring = 0;             // no echo end, sensor gone?
+      PERF_COUNT(&perf, PERF_TIMEOUTS);
     }
-    //digitalWrite(NodeMCULED,HIGH);
   }
+  PERF_BEGIN(start);
+  memcpy(leds[bay], frame, len * sizeof(struct cRGB));
+  strips[bay]->showLeds();             // this stripe only
+  PERF_END(&perf, PERF_FRAME_TX, start);
+  PERF_COUNT(&perf, PERF_FRAMES);
+  return 1;
 }
 
+#if MONITOR_PERF
 //---------
-// This function lights a bar in the given color.
+// This function writes the counters of the last MONITOR_PERF_PERIODS periods
+// to Serial as a binary record, see host/perfdump.c. The ticker triggers
+// from an interrupt, so the counters are taken with interrupts disabled.
 //----------
-void bar(CRGB x, int c) {
+void perfSend(){
 //----------
-  for(int i=0;i<c;i++) {
-    leds[i] = x;
+  int32_t now = asm_ccount();
+
+  if (((uint32_t)(now - perf_ccount)) < MONITOR_PERF_PERIODS * 100 * 80000UL) {
+    return;
   }
-  for(int i=c;i<NUM_LEDS;i++) {
-    leds[i] = CRGB::Black;
+  noInterrupts();
+  perf_take(&perf, &perf_sent, now - perf_ccount);
+  interrupts();
+  perf_ccount = now;
+  perf_seal(&perf_sent);
+  Serial.write((const uint8_t *)&perf_sent, PERF_RECORD_LEN);
+}
+#endif
+
+#if MONITOR_TRACE
+//---------
+// This function records the echo just measured on the current bay and
+// writes a full block of its trace to Serial, see host/replay.c.
+//----------
+void traceRecord(){
+//----------
+  uint8_t len = trace_add(&traces[bay], hal_echo_us(), bays[bay].dt_ms);
+
+  if (len) {
+    Serial.write(traces[bay].block, len);
+    trace_sent(&traces[bay]);
   }
-  FastLED.show();
 }
+#endif
+
+#if LOT_NET
+//---------
+// This function sends the status of all bays to the LotManager in one
+// datagram, see src/lot_proto.h. flags are added to every frame.
+//----------
+void lotSend(uint8_t flags){
+//----------
+  uint8_t b[LOT_HEADER_LEN + BAYS * LOT_FRAME_LEN];
+  struct lot_frame *f = lot_header_set(b, LOT_STATUS, BAYS);
+
+  for (uint8_t i = 0; i < BAYS; i++) {
+    const struct occupancy *o = &monitor[i].occupancy;
+    uint8_t state_flags = o->state | bays[i].lot_flags | flags;
+
+    if (!bays[i].echo_us) {
+      state_flags |= LOT_F_NO_ECHO;
+    }
+    lot_frame_set(&f[i], MONITOR_ID + i, bays[i].lot_seq, state_flags,
+                  monitor_echo_cm(o->distance_us), SRF05_slotted ? tdma_aux(&tdma, micros()) : 0);
+    if (!++bays[i].lot_seq) {
+      bays[i].lot_flags &= ~LOT_F_BOOT;    // wrapped once since boot
+    }
+  }
+  udp.beginPacket(IPAddress(LOTMANAGER_IP), LOTMANAGER_PORT);
+  udp.write(b, sizeof(b));
+  udp.endPacket();
+  lot_ccount = asm_ccount();
+}
+
+//---------
+// This function takes the reservations and status queries of the LotManager
+// for the bays of this node and answers them with a status. A beacon sets
+// the trigger slots of the bays and aligns their frames, see src/tdma.h.
+//----------
+void lotReceive(){
+//----------
+  uint8_t b[LOT_DATAGRAM_MAX];
+  uint8_t type, count, reply = 0, synced;
+  const struct lot_frame *f;
+
+  while (udp.parsePacket() > 0) {
+    int len = udp.read(b, sizeof(b));
+
+    if (len <= 0 || !(f = lot_frames(b, len, &type, &count))) {
+      continue;
+    }
+    synced = 0;
+    for (uint8_t k = 0; k < count; k++) {
+      uint16_t id = lot_id(&f[k]);
+
+      if (!lot_frame_valid(&f[k]) || id < MONITOR_ID || id >= MONITOR_ID + BAYS) {
+        continue;                          // damaged, or another node's bay
+      }
+      if (type == LOT_RESERVE) {
+        if (lot_flags(&f[k]) & LOT_F_RESERVED) {
+          bays[id - MONITOR_ID].lot_flags |= LOT_F_RESERVED;
+        } else {
+          bays[id - MONITOR_ID].lot_flags &= ~LOT_F_RESERVED;
+        }
+        reply = 1;                         // confirms the reservation
+      } else if (type == LOT_QUERY) {
+        reply = 1;
+      } else if (type == LOT_SYNC) {
+        bays[id - MONITOR_ID].lot_slot = lot_sync_slot(&f[k]);
+        if (!synced) {                     // once per beacon
+          tdma_sync(&tdma, micros(), lot_sync_slots(&f[k]), lot_sync_phase_us(&f[k]));
+          synced = 1;
+        }
+      }
+    }
+  }
+  if (reply) {
+    lotSend(LOT_F_REPLY);
+  }
+}
+
+//---------
+// This function switches the triggers to slots once all bays have one and
+// the beacons come, and back to round robin once they stop for
+// TDMA_TIMEOUT_US.
+//----------
+void lotSchedule(){
+//----------
+  uint32_t now = micros();
+  uint8_t slotted = tdma_active(&tdma, now);
+
+  for (uint8_t i = 0; i < BAYS; i++) {
+    slotted &= bays[i].lot_slot < tdma.slots;
+  }
+  if (slotted == SRF05_slotted) {
+    return;
+  }
+  ticker.detach();
+  SRF05_slotted = slotted;
+  SRF05_slot_ms = 0;
+  SRF05_slot_ccount = 0;
+  if (slotted) {
+    for (uint8_t i = 0; i < BAYS; i++) {
+      bays[i].trigger_us = now - bays[i].period_ms * 1000UL;  // due in its next slot
+    }
+    triggerSlot();
+  } else {
+    attachSRF05();
+  }
+}
+#endif
 
 //---------
 // This function is called once to initialize the program
 //----------
 void setup(){
 //----------
+#if BAYS < 3                           // else both pins belong to bay 2
   pinMode(ESP12LED, OUTPUT);
   pinMode(NodeMCULED, OUTPUT);
 
   digitalWrite(ESP12LED,HIGH);
   digitalWrite(NodeMCULED,HIGH);
+#endif
 
-  // Setup HY-SRF05
-  pinMode(SRF05_TRIG_PIN, OUTPUT);
-  pinMode(SRF05_ECHO_PIN, INPUT);
+  // Setup HY-SRF05s
+  for (uint8_t i = 0; i < BAYS; i++) {
+    pinMode(SRF05_trig_pin[i], OUTPUT);
+    pinMode(SRF05_echo_pin[i], INPUT);
+  }
 
-  FastLED.addLeds<WS2812B, DATA_PIN, RGB>(leds, NUM_LEDS);
+  // The data pin is a template argument
+  strips[0] = &FastLED.addLeds<WS2812B, DATA_PIN, RGB>(leds[0], NUM_LEDS);
+#if BAYS > 1
+  strips[1] = &FastLED.addLeds<WS2812B, DATA_PIN_1, RGB>(leds[1], NUM_LEDS);
+#endif
+#if BAYS > 2
+  strips[2] = &FastLED.addLeds<WS2812B, DATA_PIN_2, RGB>(leds[2], NUM_LEDS);
+#endif
+  for (uint8_t i = 0; i < BAYS; i++) {
+    monitor_init(&monitor[i]);
+  }
 
+#if BAYS > 2
+  Serial.begin(BAUD_RATE, SERIAL_8N1, SERIAL_TX_ONLY); // RX is the echo of bay 2
+#else
   Serial.begin(BAUD_RATE);
+#endif
+#if MONITOR_PERF
+  perf_init(&perf, PERF_DEVICE_ESP8266, F_CPU, PERF_SHIFT);
+  perf_ccount = asm_ccount();
+#endif
+#if MONITOR_TRACE
+  for (uint8_t i = 0; i < BAYS; i++) {
+    trace_init(&traces[i], 1, i);      // echo in us, source = bay
+  }
+#endif
 
-  attachInterrupt(digitalPinToInterrupt(SRF05_ECHO_PIN), measureSRF05, CHANGE);
-  ticker.attach(0.1, triggerSRF05);
+#if LOT_NET
+  for (uint8_t i = 0; i < BAYS; i++) {
+    bays[i].lot_flags = LOT_F_BOOT;    // seq starts over
+    bays[i].lot_slot = LOT_SLOTS_MAX;  // until the first beacon
+  }
+  tdma_init(&tdma);
+  WiFi.mode(WIFI_STA);
+  WiFi.begin(WIFI_SSID, WIFI_PASS);    // connects in the background
+  udp.begin(LOTMANAGER_PORT);
+#endif
+
+  SRF05_bay = BAYS - 1;                // first trigger goes to bay 0
+  for (uint8_t i = 0; i < BAYS; i++) {
+    attachInterrupt(digitalPinToInterrupt(SRF05_echo_pin[i]), measureSRF05, CHANGE);
+  }
+  for (bay = 0; bay < BAYS; bay++) {
+    hal_trigger_ms(MONITOR_PERIOD_MS); // until the first measurements
+  }
 }
 
 //---------
 // This function contains the main loop which is executed continuously
-//
-// Note: CRGB::Green is Red and CRGB::Red is Green ... Don't know why.
 //---------
 void loop(){
 //---------
-  int distance_cm = SRF05_distance_cm;
-  if(distance_cm) {
-    //Serial.print("Nearest object within 3m: ");
-    //Serial.println(SRF05_distance_cm);
-    int bars;
-    if(distance_cm<26) { // last 25cm ... let it blink like crazy
-        int32_t now = asm_ccount();
-        if( ((uint32_t)(now-WS2812B_alert_cnt)) > 12000000) { // 12M CCOUNT = 150ms
-          WS2812B_alert_state = !WS2812B_alert_state;
-          WS2812B_alert_cnt = now;
-        }
-        if(WS2812B_alert_state) { bar(CRGB::Green, 5);
-        } else {                  bar(CRGB::Black, 5);    }
-    } else if(distance_cm<101) { // 100-25cm/5lebs=15cm
-      bars = (100 - distance_cm) / 15;
-      bar(CRGB::Green, ++bars);
-    } else { // 100cm-300cm
-      bars = (distance_cm-100)/40; // 2m/5leds=40cm
-      bar(CRGB::Red, ++bars);
+  // A new measurement goes through the occupancy filter, the filtered
+  // distance is rendered and FastLED.show() only called if the frame changed.
+  // The stripe is always ready, FastLED waits for the reset time itself.
+  // The bays take turns, the HAL functions refer to the current one.
+  // See src/monitor.c
+  uint8_t changed = 0;
+
+  for (bay = 0; bay < BAYS; bay++) {
+    uint8_t posted = hal_wait_events();
+    PERF_BEGIN(start);
+    uint8_t result = monitor_event(&monitor[bay], posted | MONITOR_EV_READY);
+    if (posted) {                      // not the idle polling
+      PERF_END(&perf, PERF_LOOP, start);
     }
-  } else {
-    bar(CRGB::Black, 5);
+#if MONITOR_TRACE
+    if (posted & MONITOR_EV_MEASURED) {
+      traceRecord();
+    }
+#endif
+
+    if (result & MONITOR_OCCUPANCY_CHANGED) {
+      changed = 1;
+      Serial.print("Occupancy ");
+      Serial.print(bay);
+      Serial.print(": ");
+      Serial.println(monitor[bay].occupancy.state);
+    }
+  }
+#if MONITOR_PERF
+  perfSend();
+#endif
+#if LOT_NET
+  lotReceive();
+  lotSchedule();
+  if (changed || ((uint32_t)(asm_ccount() - lot_ccount)) > LOT_REPORT_MS * 80000UL) {
+    lotSend(0);                        // all bays in one datagram
   }
+#else
+  (void)changed;
+#endif
 }
@@ -0,0 +1,49 @@
+/*
+ * LotMonitor hardware abstraction layer
+ *
+ * The functions below are everything the core needs from a platform. They
+ * are implemented by ATtiny85/main.c, by the ESP8266 sketch and by the host
+ * simulation in host/sim.c.
+ */
+
+#ifndef HAL_H_
+#define HAL_H_
+
+#include <stdint.h>
+#include "colors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Latest echo length in microseconds, 0 if there was no echo. The core
+// converts it (see monitor_echo_cm), so sub-cm resolution is kept up to here.
+uint16_t hal_echo_us(void);
+
+// State of the <26cm alarm flicker, toggled by the platform's timer
+uint8_t hal_flicker(void);
+
+// Number of measurement periods (triggers) so far, wraps at 256
+uint8_t hal_period(void);
+
+// Sets the time from one trigger to the next, see monitor_period_ms(). Called
+// after every measurement, takes effect with the next trigger at the latest.
+void hal_trigger_ms(uint16_t ms);
+
+// Sleeps until the interrupt handlers posted at least one MONITOR_EV_* event
+// and returns the posted events, clearing them. The ESP8266 does not sleep,
+// it returns the events posted so far right away.
+uint8_t hal_wait_events(void);
+
+// Sends a frame of len GRB pixels to the stripe. Sending disables interrupts,
+// so with MONITOR_TX_SCHEDULE the frame is refused while a measurement is in
+// progress or the previous frame's reset time is not over yet. Returns 1 if
+// sent, 0 if refused. A refused frame is offered again on the next event, at
+// the latest on MONITOR_EV_MEASURED or MONITOR_EV_READY.
+uint8_t hal_show(const struct cRGB *frame, uint8_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HAL_H_ */
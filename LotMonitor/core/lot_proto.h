@@ -0,0 +1,168 @@
+/*
+ * LotMonitor status protocol
+ *
+ * Datagrams between the LotMonitors and their LotManager. A datagram is a
+ * 4 byte header followed by up to LOT_FRAMES_MAX frames of 8 bytes, one per
+ * bay, so a node with several bays reports all of them at once:
+ *
+ *   header  'L' 'P' version << 4 | type  count
+ *   frame   id[2] seq state_flags distance_cm[2] aux check
+ *
+ * Multi-byte fields are little endian. state_flags holds the OCCUPANCY_*
+ * state in bits 0..1 and the LOT_F_* flags, bits 6..7 are 0. check makes
+ * the sum of the 8 frame bytes 0 mod 256, so every frame is validated on
+ * its own and a receiver can validate whole batches of frames with a few
+ * vector instructions (LotManager/src/lot_batch.h).
+ *
+ *   LOT_STATUS   monitor -> manager  periodically, on change and on query
+ *   LOT_RESERVE  manager -> monitor  LOT_F_RESERVED set or clear for id
+ *   LOT_QUERY    manager -> monitor  answered by a LOT_STATUS of id
+ *   LOT_SYNC     manager -> monitor  trigger slot of id and frame phase
+ *
+ * Trigger slots: the manager cuts a frame of slots * LOT_SLOT_MS into slots
+ * and gives neighbouring monitors different ones, a monitor triggers its
+ * sensor at the begin of its own slot only (tdma.h). A LOT_SYNC frame is
+ * the beacon: aux is slots << 4 | slot, distance_cm the time into the
+ * frame of the manager when it was sent, in 10us, seq counts the beacons.
+ * In a LOT_STATUS frame aux is 0 while the monitor has no slot, else
+ * LOT_AUX_SYNCED plus the drift it found at the last beacon in 100us,
+ * signed. aux is 0 in the other frames.
+ *
+ * seq counts the status frames of a bay, a receiver drops frames not newer
+ * than the last one (mod 256). After a restart seq starts over at 0 with
+ * LOT_F_BOOT set until it wraps the first time, a receiver takes such a
+ * frame even if its seq is not newer.
+ *
+ * Frames are accessed in place, they need no alignment. Plain C, the
+ * firmware builds datagrams with it on a few bytes of RAM.
+ */
+
+#ifndef LOT_PROTO_H_
+#define LOT_PROTO_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LOT_MAGIC0        'L'
+#define LOT_MAGIC1        'P'
+#define LOT_VERSION       1
+#define LOT_HEADER_LEN    4
+#define LOT_FRAME_LEN     8
+#define LOT_FRAMES_MAX    64
+#define LOT_DATAGRAM_MAX  (LOT_HEADER_LEN + LOT_FRAMES_MAX * LOT_FRAME_LEN)
+
+#define LOT_STATUS        1
+#define LOT_RESERVE       2
+#define LOT_QUERY         3
+#define LOT_SYNC          4
+
+#define LOT_SLOT_MS       20                 // longer than the 17.4ms echo of 300cm
+#define LOT_SLOTS_MAX     15
+#define LOT_AUX_SYNCED    0x80               // LOT_STATUS aux, see above
+
+#define LOT_STATE_MASK    0x03               // OCCUPANCY_*
+#define LOT_F_RESERVED    0x04               // the bay is reserved
+#define LOT_F_NO_ECHO     0x08               // last measurement had no echo
+#define LOT_F_REPLY       0x10               // answers a LOT_QUERY
+#define LOT_F_BOOT        0x20               // seq started over
+#define LOT_F_INVALID     0xC0               // must be 0
+
+struct lot_frame {
+  uint8_t b[LOT_FRAME_LEN];
+};
+
+static inline uint16_t lot_id(const struct lot_frame *f) { return f->b[0] | f->b[1] << 8; }
+static inline uint8_t lot_seq(const struct lot_frame *f) { return f->b[2]; }
+static inline uint8_t lot_state(const struct lot_frame *f) { return f->b[3] & LOT_STATE_MASK; }
+static inline uint8_t lot_flags(const struct lot_frame *f) { return f->b[3] & ~LOT_STATE_MASK; }
+static inline uint16_t lot_distance_cm(const struct lot_frame *f) { return f->b[4] | f->b[5] << 8; }
+static inline uint8_t lot_aux(const struct lot_frame *f) { return f->b[6]; }
+
+// This function fills in a frame, state_flags is state | LOT_F_*.
+static inline void lot_frame_set(struct lot_frame *f, uint16_t id, uint8_t seq, uint8_t state_flags,
+                                 uint16_t distance_cm, uint8_t aux) {
+  uint8_t sum;
+
+  f->b[0] = id & 0xFF;
+  f->b[1] = id >> 8;
+  f->b[2] = seq;
+  f->b[3] = state_flags;
+  f->b[4] = distance_cm & 0xFF;
+  f->b[5] = distance_cm >> 8;
+  f->b[6] = aux;
+  sum = f->b[0] + f->b[1] + f->b[2] + f->b[3] + f->b[4] + f->b[5] + f->b[6];
+  f->b[7] = (uint8_t)-sum;
+}
+
+// This function fills in the beacon of id for slot of slots, phase_us into
+// the frame.
+static inline void lot_sync_set(struct lot_frame *f, uint16_t id, uint8_t seq, uint8_t slot, uint8_t slots,
+                                uint32_t phase_us) {
+  lot_frame_set(f, id, seq, 0, (uint16_t)(phase_us / 10), (uint8_t)(slots << 4 | slot));
+}
+
+static inline uint8_t lot_sync_slot(const struct lot_frame *f) { return f->b[6] & 0x0F; }
+static inline uint8_t lot_sync_slots(const struct lot_frame *f) { return f->b[6] >> 4; }
+static inline uint32_t lot_sync_phase_us(const struct lot_frame *f) { return lot_distance_cm(f) * 10UL; }
+
+// This function returns the aux byte of a status with drift_us found at the
+// last beacon, saturated at +-12.7ms.
+static inline uint8_t lot_aux_drift(int32_t drift_us) {
+  int32_t d = drift_us / 100;
+
+  return (uint8_t)(LOT_AUX_SYNCED + (d > 127 ? 127 : d < -127 ? -127 : d));
+}
+
+// This function returns the drift of a status aux byte, 0 if unsynced.
+static inline int32_t lot_aux_drift_us(uint8_t aux) {
+  return aux ? ((int32_t)aux - LOT_AUX_SYNCED) * 100 : 0;
+}
+
+// This function returns 1 if f is a valid frame.
+static inline int lot_frame_valid(const struct lot_frame *f) {
+  uint8_t sum = 0;
+
+  for (uint8_t i = 0; i < LOT_FRAME_LEN; i++) {
+    sum += f->b[i];
+  }
+  return !sum && !(f->b[3] & LOT_F_INVALID);
+}
+
+// This function writes the header of a datagram of count frames to b and
+// returns the frames following it.
+static inline struct lot_frame *lot_header_set(uint8_t *b, uint8_t type, uint8_t count) {
+  b[0] = LOT_MAGIC0;
+  b[1] = LOT_MAGIC1;
+  b[2] = LOT_VERSION << 4 | type;
+  b[3] = count;
+  return (struct lot_frame *)(b + LOT_HEADER_LEN);
+}
+
+// This function returns the length of a datagram of count frames.
+static inline size_t lot_len(uint8_t count) {
+  return LOT_HEADER_LEN + (size_t)count * LOT_FRAME_LEN;
+}
+
+// This function checks the header of the datagram of len bytes at b and
+// returns its frames in place, their number in count and the type. Returns
+// NULL if it is no datagram of this version. The frames are not validated.
+static inline const struct lot_frame *lot_frames(const uint8_t *b, size_t len, uint8_t *type,
+                                                 uint8_t *count) {
+  if (len < LOT_HEADER_LEN || b[0] != LOT_MAGIC0 || b[1] != LOT_MAGIC1 ||
+      b[2] >> 4 != LOT_VERSION || b[3] > LOT_FRAMES_MAX || len != lot_len(b[3])) {
+    return NULL;
+  }
+  *type = b[2] & 0x0F;
+  *count = b[3];
+  return (const struct lot_frame *)(b + LOT_HEADER_LEN);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOT_PROTO_H_ */
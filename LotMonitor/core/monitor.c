@@ -0,0 +1,142 @@
+/*
+ * LotMonitor core
+ *
+ * See monitor.h
+ */
+
+#include <string.h>
+#include "monitor.h"
+#include "hal.h"
+#include "profile.h"
+
+//---------
+// This function renders the frame for a filtered echo length and the alarm
+// flicker state: a lookup in the compiled display profile plus a copy.
+//----------
+void monitor_render(struct cRGB *frame, uint16_t distance_us, uint8_t flicker) {
+//----------
+  uint16_t bucket = distance_us >> PROFILE_SHIFT;
+  uint8_t index = PROFILE_OFF;                 // Switch stripe off if beyond
+
+  if (bucket < PROFILE_BUCKETS) {              //   the table.
+    index = profile_read_byte(&profile_index[bucket]);
+  }
+  if (index == PROFILE_ALARM) {                // less than 26cm, flicker all
+    index = flicker ? PROFILE_OFF : PROFILE_RED(WS2819_STRIPE_LEN);
+  }                                            //   leds like crazy.
+  profile_memcpy(frame, profile_frames[index], sizeof(profile_frames[index]));
+}
+
+//---------
+// This function returns the time from one trigger to the next the bay asks
+// for. Fast while moving, slow at rest, so neighbouring bays hear less of
+// each other and the sensor idles while nothing happens.
+//----------
+uint16_t monitor_period_ms(const struct monitor *m) {
+//----------
+  const struct occupancy *o = &m->occupancy;
+
+  if (o->still_cnt < MONITOR_SETTLE_SAMPLES || o->candidate_cnt) {
+    return MONITOR_PERIOD_FAST_MS;
+  }
+  if (o->state == OCCUPANCY_FREE || o->state == OCCUPANCY_OCCUPIED) {
+    return MONITOR_PERIOD_SLOW_MS;
+  }
+  return MONITOR_PERIOD_MS;
+}
+
+//---------
+// This function prepares m for the first monitor_step().
+//----------
+void monitor_init(struct monitor *m) {
+//----------
+  memset(m, 0, sizeof(*m));
+  occupancy_init(&m->occupancy);
+}
+
+//---------
+// This function renders the filtered distance and sends the frame. The
+// frame is only sent if it differs from the one shown or is due for refresh,
+// and only if the platform accepts it (see hal_show).
+//----------
+uint8_t monitor_step(struct monitor *m) {
+//----------
+  uint8_t period = hal_period();
+
+  monitor_render(m->frame, m->occupancy.distance_us, hal_flicker());
+  if (m->shown_valid && !memcmp(m->frame, m->shown, sizeof(m->frame))) {
+    if (!MONITOR_REFRESH_PERIODS ||
+        (uint8_t)(period - m->shown_period) < MONITOR_REFRESH_PERIODS) {
+      return 0;                                // nothing new to show
+    }
+  }
+  if (!hal_show(m->frame, WS2819_STRIPE_LEN)) {
+    return 0;                                  // echo window, try again later
+  }
+  memcpy(m->shown, m->frame, sizeof(m->shown));
+  m->shown_period = period;
+  m->shown_valid = 1;
+  return 1;
+}
+
+//---------
+// This function handles the events returned by hal_wait_events(). A new
+// measurement is fed to the occupancy filter and adapts the trigger rate.
+//----------
+uint8_t monitor_event(struct monitor *m, uint8_t events) {
+//----------
+  uint8_t result = 0;
+
+  if (events & MONITOR_EV_MEASURED) {
+    if (occupancy_update(&m->occupancy, hal_echo_us())) {
+      result |= MONITOR_OCCUPANCY_CHANGED;
+    }
+    hal_trigger_ms(monitor_period_ms(m));
+  }
+  if (events & (MONITOR_EV_MEASURED | MONITOR_EV_FLICKER | MONITOR_EV_READY)) {
+    if (monitor_step(m)) {
+      result |= MONITOR_FRAME_SENT;
+    }
+  }
+  return result;
+}
+
+//---------
+// This function accounts time spent awake, i.e. not sleeping.
+//----------
+void monitor_duty_awake(struct monitor_duty *d, uint32_t us) {
+//----------
+  d->awake_us += us;
+}
+
+//---------
+// This function accounts elapsed time, awake or not. Both sums are halved
+// before they overflow, so the ratio keeps up with long uptimes.
+//----------
+void monitor_duty_elapsed(struct monitor_duty *d, uint32_t us) {
+//----------
+  d->elapsed_us += us;
+  if (d->elapsed_us & 0x80000000UL) {
+    d->elapsed_us >>= 1;
+    d->awake_us >>= 1;
+  }
+}
+
+//---------
+// This function returns the idle time in per mille of the elapsed time. Both
+// sums are scaled down until awake_us * 1000 fits 32 bits, the ATtiny85
+// sends it with its profiling record and has no room for a 64 bit division.
+//----------
+uint16_t monitor_idle_permille(const struct monitor_duty *d) {
+//----------
+  uint32_t awake = d->awake_us, elapsed = d->elapsed_us;
+
+  if (!elapsed || awake >= elapsed) {
+    return 0;
+  }
+  while (awake > 0xFFFFFFFFUL / 1000) {
+    awake >>= 1;
+    elapsed >>= 1;
+  }
+  return 1000 - (uint16_t)(awake * 1000 / elapsed);
+}
@@ -0,0 +1,89 @@
+/*
+ * LotMonitor core
+ *
+ * Distance-to-LED logic shared by all LotMonitor platforms. Nothing in here
+ * touches hardware, see hal.h for the platform side.
+ */
+
+#ifndef MONITOR_H_
+#define MONITOR_H_
+
+#include <stdint.h>
+#include "monitor_config.h"
+#include "colors.h"
+#include "occupancy.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MONITOR_EV_MEASURED 0x01  // echo measurement complete or timed out
+#define MONITOR_EV_FLICKER  0x02  // alarm flicker toggled, every 100ms
+#define MONITOR_EV_READY    0x04  // stripe latched, a refused frame can go
+
+#define MONITOR_FRAME_SENT        0x01  // monitor_event(): frame was sent
+#define MONITOR_OCCUPANCY_CHANGED 0x02  //   occupancy state changed
+
+struct monitor {
+  struct occupancy occupancy;            // filtered distance and state
+  struct cRGB frame[WS2819_STRIPE_LEN];  // frame rendered by monitor_step()
+  struct cRGB shown[WS2819_STRIPE_LEN];  // last frame sent to the stripe
+  uint8_t shown_period;                  // hal_period() when it was sent
+  uint8_t shown_valid;                   // 0 until the first frame was sent
+};
+
+struct monitor_duty {
+  uint32_t awake_us;                     // time spent outside of sleep
+  uint32_t elapsed_us;                   // total time, both are halved
+};                                       //   before elapsed_us overflows
+
+//---------
+// This function converts an echo length in microseconds into a distance
+// in cm. Everything beyond MONITOR_DISTANCE_MAX_CM is reported as 0 (invalid).
+// Inline because it is called from the echo interrupt handlers.
+//----------
+static inline uint16_t monitor_echo_cm(uint32_t echo_us) {
+//----------
+  if (echo_us > (uint32_t)MONITOR_DISTANCE_MAX_CM * MONITOR_US_PER_CM) {
+    return 0;
+  }
+  return echo_us / MONITOR_US_PER_CM;
+}
+
+// This function renders the frame for a filtered echo length and the alarm
+// flicker state from the compiled display profile (see profile.h).
+void monitor_render(struct cRGB *frame, uint16_t distance_us, uint8_t flicker);
+
+// This function returns the time from one trigger to the next the bay asks
+// for: MONITOR_PERIOD_FAST_MS while a car moves or the occupancy is about to
+// change, MONITOR_PERIOD_SLOW_MS while it is steadily free or occupied and
+// MONITOR_PERIOD_MS otherwise, i.e. while a car stands too close.
+uint16_t monitor_period_ms(const struct monitor *m);
+
+// This function prepares m for the first monitor_step().
+void monitor_init(struct monitor *m);
+
+// This function renders the filtered distance and sends the frame. The
+// frame is only sent if it differs from the one shown or is due for refresh,
+// and only if the platform accepts it (see hal_show). Returns 1 if sent.
+uint8_t monitor_step(struct monitor *m);
+
+// This function handles the events returned by hal_wait_events(). A new
+// measurement is fed to the occupancy filter and adapts the trigger rate.
+// Returns MONITOR_FRAME_SENT and MONITOR_OCCUPANCY_CHANGED flags.
+uint8_t monitor_event(struct monitor *m, uint8_t events);
+
+// This function accounts time spent awake, i.e. not sleeping.
+void monitor_duty_awake(struct monitor_duty *d, uint32_t us);
+
+// This function accounts elapsed time, awake or not.
+void monitor_duty_elapsed(struct monitor_duty *d, uint32_t us);
+
+// This function returns the idle time in per mille of the elapsed time.
+uint16_t monitor_idle_permille(const struct monitor_duty *d);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MONITOR_H_ */
@@ -0,0 +1,51 @@
+/*
+ * LotMonitor configuration
+ *
+ * Shared by the ATtiny85 firmware, the ESP8266 sketch and the host build, so
+ * every platform measures and lights the stripe the very same way.
+ */
+
+#ifndef MONITOR_CONFIG_H_
+#define MONITOR_CONFIG_H_
+
+#ifndef WS2819_STRIPE_LEN
+#define WS2819_STRIPE_LEN 5
+#endif
+//#define WS2819_BRIGHTNESS 25  // percent [optional, comment for full brightness]
+
+#define MONITOR_US_PER_CM       58   // echo round trip time per cm
+#define MONITOR_DISTANCE_MAX_CM 300  // ignore everything more than 3m away
+#define MONITOR_ALARM_CM        26   // less than 26cm, flicker all leds
+#define MONITOR_RED_CM          101  // less than 1m, red bar growing
+#define MONITOR_RED_STEP_CM     15   // one additional red led per 15cm
+#define MONITOR_GREEN_STEP_CM   40   // one green led less per 40cm
+
+#define MONITOR_FREE_CM         250  // a car within 2.5m occupies the bay
+#define MONITOR_HYST_CM         10   // hysteresis of the occupancy thresholds
+#define MONITOR_STILL_CM        2    // a car moving less per sample stands
+#define MONITOR_SETTLE_SAMPLES  10   //   and is parked after 10 samples standing
+#define MONITOR_DEBOUNCE        3    // samples an occupancy change must last
+#define MONITOR_FILTER_SHIFT    1    // exponential filter weight 1/2^shift
+#define MONITOR_JUMP_CM         50   // the filter follows bigger jumps at once
+
+#define MONITOR_PERIOD_MS       100  // trigger every 100ms (10 Hz),
+#define MONITOR_PERIOD_FAST_MS  40   //   every 40ms (25 Hz) while a car moves,
+#define MONITOR_PERIOD_SLOW_MS  500  //   every 500ms (2 Hz) while the bay is
+                                     //   steadily free or occupied. Multiples
+                                     //   of 20ms, all the same = fixed rate
+
+#define MONITOR_REFRESH_PERIODS 10   // resend an unchanged frame every 10
+                                     //   measurement periods (1s), 0 = never
+#define MONITOR_TX_SCHEDULE     1    // send frames only outside the trigger/
+                                     //   echo window, 0 = send right away
+
+#ifndef MONITOR_PERF
+#define MONITOR_PERF            0    // 1 = keep profiling counters (perf.h)
+#endif
+#define MONITOR_PERF_PERIODS    50   //   and send a record every 5s
+
+#ifndef MONITOR_TRACE
+#define MONITOR_TRACE           0    // 1 = record the echoes (trace.h)
+#endif
+
+#endif /* MONITOR_CONFIG_H_ */
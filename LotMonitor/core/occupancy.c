@@ -0,0 +1,103 @@
+/*
+ * LotMonitor occupancy
+ *
+ * See occupancy.h
+ */
+
+#include "occupancy.h"
+
+#define US(cm) ((uint16_t)((cm) * MONITOR_US_PER_CM))
+
+//---------
+// This function resets o to a free bay.
+//----------
+void occupancy_init(struct occupancy *o) {
+//----------
+  o->sample_us[0] = o->sample_us[1] = o->sample_us[2] = OCCUPANCY_FAR_US;
+  o->distance_us = OCCUPANCY_FAR_US;
+  o->state = o->candidate = OCCUPANCY_FREE;
+  o->candidate_cnt = 0;
+  o->still_cnt = 0;
+}
+
+//---------
+// This function returns the median of three values.
+//----------
+static inline uint16_t median3(uint16_t a, uint16_t b, uint16_t c) {
+//----------
+  if (a > b) { uint16_t t = a; a = b; b = t; }   // a <= b
+  if (b > c) { b = c; }                           // b = min(b, c)
+  return a > b ? a : b;                           // max(a, min(b, c))
+}
+
+//---------
+// This function returns the state the filtered distance points to. The
+// thresholds are widened by MONITOR_HYST_CM in favour of the current state.
+//----------
+static uint8_t classify(const struct occupancy *o) {
+//----------
+  uint16_t d = o->distance_us;
+  uint16_t alarm = US(MONITOR_ALARM_CM);
+  uint16_t free_us = US(MONITOR_FREE_CM);
+
+  if (o->state == OCCUPANCY_TOO_CLOSE) alarm += US(MONITOR_HYST_CM);
+  if (o->state != OCCUPANCY_FREE)      free_us += US(MONITOR_HYST_CM);
+
+  if (d < alarm) {
+    return OCCUPANCY_TOO_CLOSE;
+  } else if (d >= free_us) {
+    return OCCUPANCY_FREE;
+  } else if (o->still_cnt >= MONITOR_SETTLE_SAMPLES) {
+    return OCCUPANCY_OCCUPIED;
+  }
+  return OCCUPANCY_APPROACHING;
+}
+
+//---------
+// This function feeds one raw echo length (0 = no echo) into o. Returns 1 if
+// the occupancy state changed.
+//----------
+uint8_t occupancy_update(struct occupancy *o, uint16_t echo_us) {
+//----------
+  uint16_t median, last = o->distance_us;
+  int16_t  delta;
+  uint8_t  target;
+
+  if (!echo_us || echo_us > OCCUPANCY_FAR_US) {
+    echo_us = OCCUPANCY_FAR_US;              // nothing in range
+  }
+  o->sample_us[0] = o->sample_us[1];
+  o->sample_us[1] = o->sample_us[2];
+  o->sample_us[2] = echo_us;
+  median = median3(o->sample_us[0], o->sample_us[1], o->sample_us[2]);
+
+  delta = (int16_t)(median - last);
+  if (delta > (int16_t)US(MONITOR_JUMP_CM) || delta < -(int16_t)US(MONITOR_JUMP_CM)) {
+    o->distance_us = median;                 // arrived or left, follow now
+  } else {
+    o->distance_us = last + (delta >> MONITOR_FILTER_SHIFT);
+  }
+
+  delta = (int16_t)(o->distance_us - last);
+  if (delta <= (int16_t)US(MONITOR_STILL_CM) && delta >= -(int16_t)US(MONITOR_STILL_CM)) {
+    if (o->still_cnt < 255) o->still_cnt++;
+  } else {
+    o->still_cnt = 0;
+  }
+
+  target = classify(o);
+  if (target == o->state) {
+    o->candidate_cnt = 0;
+    return 0;
+  }
+  if (target != o->candidate) {              // debounce the change
+    o->candidate = target;
+    o->candidate_cnt = 0;
+  }
+  if (++o->candidate_cnt < MONITOR_DEBOUNCE) {
+    return 0;
+  }
+  o->state = target;
+  o->candidate_cnt = 0;
+  return 1;
+}
@@ -0,0 +1,50 @@
+/*
+ * LotMonitor occupancy
+ *
+ * Integer-only echo filter (median of 3, then exponential) and a hysteresis
+ * state machine deriving the occupancy of the bay. Constant time per sample
+ * and 12 bytes of RAM, so it runs in the ATtiny85 main loop. The state only
+ * changes when a car really arrives, parks, comes too close or leaves, a
+ * single bad echo changes neither the filtered distance nor the state.
+ */
+
+#ifndef OCCUPANCY_H_
+#define OCCUPANCY_H_
+
+#include <stdint.h>
+#include "monitor_config.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OCCUPANCY_FREE        0  // nothing within MONITOR_FREE_CM
+#define OCCUPANCY_APPROACHING 1  // a car within, still moving
+#define OCCUPANCY_OCCUPIED    2  // a car parked
+#define OCCUPANCY_TOO_CLOSE   3  // a car within MONITOR_ALARM_CM
+
+// Filtered echo length of "nothing in range", rendered as stripe off. 2cm
+// beyond the range, so that its 64us profile bucket is beyond as well.
+#define OCCUPANCY_FAR_US ((MONITOR_DISTANCE_MAX_CM + 2) * MONITOR_US_PER_CM)
+
+struct occupancy {
+  uint16_t sample_us[3];   // last raw samples for the median
+  uint16_t distance_us;    // filtered echo length
+  uint8_t  state;          // OCCUPANCY_*
+  uint8_t  candidate;      // state the samples point to
+  uint8_t  candidate_cnt;  //   for that many samples
+  uint8_t  still_cnt;      // samples the car did not move
+};
+
+// This function resets o to a free bay.
+void occupancy_init(struct occupancy *o);
+
+// This function feeds one raw echo length (0 = no echo) into o. Returns 1 if
+// the occupancy state changed.
+uint8_t occupancy_update(struct occupancy *o, uint16_t echo_us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* OCCUPANCY_H_ */
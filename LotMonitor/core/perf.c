@@ -0,0 +1,87 @@
+/*
+ * LotMonitor profiling
+ *
+ * See perf.h
+ */
+
+#include <string.h>
+#include "perf.h"
+
+// The record must look the same on every platform
+typedef char perf_record_len[sizeof(struct perf) == PERF_RECORD_LEN ? 1 : -1];
+
+//---------
+// This function sets up p for a device with the given tick rate.
+//----------
+void perf_init(struct perf *p, uint8_t device, uint32_t tick_hz, uint8_t shift) {
+//----------
+  memset(p, 0, sizeof(*p));
+  p->magic[0] = PERF_MAGIC0;
+  p->magic[1] = PERF_MAGIC1;
+  p->version = PERF_VERSION;
+  p->len = PERF_RECORD_LEN;
+  p->tick_hz = tick_hz;
+  p->device = device;
+  p->shift = shift;
+  p->idle = PERF_IDLE_UNKNOWN;
+}
+
+//---------
+// This function adds a duration in ticks to a probe of p. Bucket i counts
+// durations below 2^(i+1) units, the last one everything above.
+//----------
+void perf_record(struct perf *p, uint8_t probe, uint32_t ticks) {
+//----------
+  struct perf_probe *pr = &p->probe[probe];
+  uint32_t units = ticks >> p->shift;
+  uint8_t bucket = 0;
+
+  while (units > 1 && bucket < PERF_BUCKETS - 1) {
+    units >>= 1;
+    bucket++;
+  }
+  if (pr->hist[bucket] != 0xFFFF) {
+    pr->hist[bucket]++;
+  }
+  if (pr->count != 0xFFFF) {          // sum / count stays the average
+    pr->count++;
+    pr->sum += ticks;
+  }
+  if (ticks > pr->max) {
+    pr->max = ticks;
+  }
+}
+
+//---------
+// This function copies live to record and clears live for the next record.
+//----------
+void perf_take(struct perf *live, struct perf *record, uint32_t elapsed) {
+//----------
+  memcpy(record, live, sizeof(*record));
+  record->elapsed = elapsed;
+  live->seq++;
+  memset(live->counter, 0, sizeof(live->counter));
+  memset(live->probe, 0, sizeof(live->probe));
+}
+
+//---------
+// This function returns the sum of all bytes of a record but the check sum.
+//----------
+uint16_t perf_check(const struct perf *record) {
+//----------
+  const uint8_t *b = (const uint8_t *)record;
+  uint16_t sum = 0;
+
+  for (uint8_t i = 0; i < PERF_RECORD_LEN; i++) {
+    sum += b[i];
+  }
+  return sum - (record->check & 0xFF) - (record->check >> 8);
+}
+
+//---------
+// This function fills in the check sum of a record before it is sent.
+//----------
+void perf_seal(struct perf *record) {
+//----------
+  record->check = perf_check(record);
+}
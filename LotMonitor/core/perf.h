@@ -0,0 +1,123 @@
+/*
+ * LotMonitor profiling
+ *
+ * Event counters and duration histograms kept by the firmware's interrupt
+ * handlers and main loop, sent as a compact binary record every
+ * MONITOR_PERF_PERIODS measurement periods and turned into a report on the
+ * host by host/perfdump.c. Durations are in platform ticks (CCOUNT on the
+ * ESP8266, timer0 counts on the ATtiny85), the record carries the tick rate.
+ * A platform keeping a monitor_duty sets idle before each perf_take, the
+ * others leave it at PERF_IDLE_UNKNOWN.
+ *
+ * The record is sent as it lies in memory: all fields are little endian and
+ * naturally aligned, so the layout is the same with and without
+ * -fpack-struct. Only compiled in with MONITOR_PERF.
+ */
+
+#ifndef PERF_H_
+#define PERF_H_
+
+#include <stdint.h>
+#include "monitor_config.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PERF_MAGIC0     'P'
+#define PERF_MAGIC1     'F'
+#define PERF_VERSION    2
+#define PERF_RECORD_LEN 148          // sizeof(struct perf)
+#define PERF_BUCKETS    9            // log2 histogram, see perf_record
+
+#define PERF_DEVICE_ATTINY85 1
+#define PERF_DEVICE_ESP8266  2
+#define PERF_DEVICE_HOST     3
+
+#define PERF_IDLE_UNKNOWN 0xFFFF     // idle of a platform without duty
+
+// Event counters
+#define PERF_TRIGGERS     0          // measurements started
+#define PERF_LATE         1          // triggers run late
+#define PERF_TIMEOUTS     2          // no echo end within the window
+#define PERF_OUT_OF_RANGE 3          // echo beyond MONITOR_DISTANCE_MAX_CM
+#define PERF_FRAMES       4          // frames sent
+#define PERF_REFUSED      5          // frames refused by hal_show
+#define PERF_DISTURBED    6          // frames sent while measuring
+#define PERF_COUNTERS     7
+
+// Duration probes
+#define PERF_TRIGGER_ISR  0          // trigger pulse and arming
+#define PERF_ECHO_ISR     1          // echo edge
+#define PERF_FRAME_TX     2          // frame transmission
+#define PERF_LOOP         3          // main loop handling events
+#define PERF_PROBES       4
+
+struct perf_probe {
+  uint32_t sum;                      // ticks
+  uint32_t max;                      // ticks
+  uint16_t count;                    // saturates, as do the buckets
+  uint16_t hist[PERF_BUCKETS];       // [0] < 2, [i] < 2^(i+1) ticks >> shift
+};
+
+struct perf {
+  uint8_t  magic[2];                 // PERF_MAGIC0, PERF_MAGIC1
+  uint8_t  version;                  // PERF_VERSION
+  uint8_t  len;                      // PERF_RECORD_LEN
+  uint32_t tick_hz;                  // ticks per second
+  uint32_t elapsed;                  // ticks covered by this record
+  uint16_t seq;                      // record number, gaps = lost records
+  uint16_t check;                    // sum of all bytes, see perf_seal
+  uint8_t  device;                   // PERF_DEVICE_*
+  uint8_t  shift;                    // histogram resolution
+  uint16_t counter[PERF_COUNTERS];
+  uint16_t idle;                     // per mille asleep, monitor_idle_permille
+  uint16_t spare;                    // 0, keeps the probes aligned
+  struct perf_probe probe[PERF_PROBES];
+};
+
+#if MONITOR_PERF
+
+// Measures a duration between PERF_BEGIN and PERF_END. The platform defines
+// PERF_NOW() returning its tick count as PERF_TICKS.
+#define PERF_BEGIN(t)          PERF_TICKS t = PERF_NOW()
+#define PERF_END(p, probe, t)  perf_record(p, probe, (PERF_TICKS)(PERF_NOW() - (t)))
+#define PERF_COUNT(p, counter) perf_count(p, counter)
+
+#else
+
+#define PERF_BEGIN(t)
+#define PERF_END(p, probe, t)
+#define PERF_COUNT(p, counter)
+
+#endif
+
+// This function sets up p for a device with the given tick rate. Durations
+// are histogrammed in units of 2^shift ticks.
+void perf_init(struct perf *p, uint8_t device, uint32_t tick_hz, uint8_t shift);
+
+// This function adds a duration in ticks to a probe of p.
+void perf_record(struct perf *p, uint8_t probe, uint32_t ticks);
+
+// This function counts an event of p.
+static inline void perf_count(struct perf *p, uint8_t counter) {
+  if (p->counter[counter] != 0xFFFF) {
+    p->counter[counter]++;
+  }
+}
+
+// This function copies live to record, which covers elapsed ticks, and
+// clears live for the next record. To be called with interrupts disabled.
+void perf_take(struct perf *live, struct perf *record, uint32_t elapsed);
+
+// This function fills in the check sum of a record before it is sent.
+void perf_seal(struct perf *record);
+
+// This function returns the check sum of a record as perf_seal computes it.
+uint16_t perf_check(const struct perf *record);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PERF_H_ */
@@ -0,0 +1,103 @@
+/*
+ * LotMonitor display profile
+ *
+ * See profile.h. Everything below is evaluated by the compiler.
+ */
+
+#include "profile.h"
+#include "occupancy.h"
+
+#if WS2819_STRIPE_LEN < 1 || WS2819_STRIPE_LEN > 16
+#error "profile.c: WS2819_STRIPE_LEN must be 1..16"
+#endif
+#if (OCCUPANCY_FAR_US >> PROFILE_SHIFT) >= PROFILE_BUCKETS
+#error "profile.c: PROFILE_BUCKETS do not cover MONITOR_DISTANCE_MAX_CM"
+#endif
+
+#define PROFILE_CONCAT_(a, b)  a ## b
+#define PROFILE_CONCAT(a, b)   PROFILE_CONCAT_(a, b)
+#define MIN(a, b)      ((a) < (b) ? (a) : (b))
+
+/*
+ * Frames
+ */
+
+#if MONITOR_GAMMA == 2
+#define LEVEL(c) ((uint8_t)((c) * (c) / 255 * PROFILE_BRIGHTNESS / 100))
+#else
+#define LEVEL(c) ((uint8_t)((c) * PROFILE_BRIGHTNESS / 100))
+#endif
+
+// pixel i of a bar of n leds
+#define PX_(i, n, g, r, b) { (i) < (n) ? LEVEL(g) : 0, \
+                             (i) < (n) ? LEVEL(r) : 0, \
+                             (i) < (n) ? LEVEL(b) : 0 }
+#define PX(i, n, ...)  PX_(i, n, __VA_ARGS__)  // colour as g, r, b
+
+// a bar of n leds, WS2819_STRIPE_LEN pixels
+#define ROW1(n, ...)   PX(0, n, __VA_ARGS__)
+#define ROW2(n, ...)   ROW1(n, __VA_ARGS__),  PX(1, n, __VA_ARGS__)
+#define ROW3(n, ...)   ROW2(n, __VA_ARGS__),  PX(2, n, __VA_ARGS__)
+#define ROW4(n, ...)   ROW3(n, __VA_ARGS__),  PX(3, n, __VA_ARGS__)
+#define ROW5(n, ...)   ROW4(n, __VA_ARGS__),  PX(4, n, __VA_ARGS__)
+#define ROW6(n, ...)   ROW5(n, __VA_ARGS__),  PX(5, n, __VA_ARGS__)
+#define ROW7(n, ...)   ROW6(n, __VA_ARGS__),  PX(6, n, __VA_ARGS__)
+#define ROW8(n, ...)   ROW7(n, __VA_ARGS__),  PX(7, n, __VA_ARGS__)
+#define ROW9(n, ...)   ROW8(n, __VA_ARGS__),  PX(8, n, __VA_ARGS__)
+#define ROW10(n, ...)  ROW9(n, __VA_ARGS__),  PX(9, n, __VA_ARGS__)
+#define ROW11(n, ...)  ROW10(n, __VA_ARGS__), PX(10, n, __VA_ARGS__)
+#define ROW12(n, ...)  ROW11(n, __VA_ARGS__), PX(11, n, __VA_ARGS__)
+#define ROW13(n, ...)  ROW12(n, __VA_ARGS__), PX(12, n, __VA_ARGS__)
+#define ROW14(n, ...)  ROW13(n, __VA_ARGS__), PX(13, n, __VA_ARGS__)
+#define ROW15(n, ...)  ROW14(n, __VA_ARGS__), PX(14, n, __VA_ARGS__)
+#define ROW16(n, ...)  ROW15(n, __VA_ARGS__), PX(15, n, __VA_ARGS__)
+#define ROW(n, ...)    { PROFILE_CONCAT(ROW, WS2819_STRIPE_LEN)(n, __VA_ARGS__) }
+
+// bars of 1..WS2819_STRIPE_LEN leds
+#define BARS1(...)     ROW(1, __VA_ARGS__)
+#define BARS2(...)     BARS1(__VA_ARGS__),  ROW(2, __VA_ARGS__)
+#define BARS3(...)     BARS2(__VA_ARGS__),  ROW(3, __VA_ARGS__)
+#define BARS4(...)     BARS3(__VA_ARGS__),  ROW(4, __VA_ARGS__)
+#define BARS5(...)     BARS4(__VA_ARGS__),  ROW(5, __VA_ARGS__)
+#define BARS6(...)     BARS5(__VA_ARGS__),  ROW(6, __VA_ARGS__)
+#define BARS7(...)     BARS6(__VA_ARGS__),  ROW(7, __VA_ARGS__)
+#define BARS8(...)     BARS7(__VA_ARGS__),  ROW(8, __VA_ARGS__)
+#define BARS9(...)     BARS8(__VA_ARGS__),  ROW(9, __VA_ARGS__)
+#define BARS10(...)    BARS9(__VA_ARGS__),  ROW(10, __VA_ARGS__)
+#define BARS11(...)    BARS10(__VA_ARGS__), ROW(11, __VA_ARGS__)
+#define BARS12(...)    BARS11(__VA_ARGS__), ROW(12, __VA_ARGS__)
+#define BARS13(...)    BARS12(__VA_ARGS__), ROW(13, __VA_ARGS__)
+#define BARS14(...)    BARS13(__VA_ARGS__), ROW(14, __VA_ARGS__)
+#define BARS15(...)    BARS14(__VA_ARGS__), ROW(15, __VA_ARGS__)
+#define BARS16(...)    BARS15(__VA_ARGS__), ROW(16, __VA_ARGS__)
+#define BARS(...)      PROFILE_CONCAT(BARS, WS2819_STRIPE_LEN)(__VA_ARGS__)
+
+const struct cRGB profile_frames[PROFILE_FRAMES][WS2819_STRIPE_LEN] PROFILE_FLASH = {
+  ROW(0, PROFILE_NEAR),                    // PROFILE_OFF
+  BARS(PROFILE_NEAR),                      // PROFILE_RED(1..len)
+  BARS(PROFILE_FAR),                       // PROFILE_GREEN(1..len)
+};
+
+/*
+ * Distance buckets, same mapping as the former per-sample computation:
+ * off if invalid (0) or beyond 3m, flicker below 26cm, one additional red
+ * led per 15cm below 1m, one green led less per 40cm from 3m to 1m.
+ */
+
+#define CM(b)        ((uint32_t)(b) * (1 << PROFILE_SHIFT) / MONITOR_US_PER_CM)
+#define INDEX(b)     (CM(b) < 1 || CM(b) > MONITOR_DISTANCE_MAX_CM ? PROFILE_OFF : \
+                      CM(b) < MONITOR_ALARM_CM ? PROFILE_ALARM :                   \
+                      CM(b) < MONITOR_RED_CM ? PROFILE_RED(MIN(                    \
+                        (MONITOR_RED_CM - 1 - CM(b)) / MONITOR_RED_STEP_CM + 1,    \
+                        WS2819_STRIPE_LEN)) :                                      \
+                      PROFILE_GREEN(MIN(                                           \
+                        (CM(b) - (MONITOR_RED_CM - 1)) / MONITOR_GREEN_STEP_CM + 1,\
+                        WS2819_STRIPE_LEN)))
+
+#define I4(b)        INDEX(b), INDEX(b + 1), INDEX(b + 2), INDEX(b + 3)
+#define I16(b)       I4(b), I4(b + 4), I4(b + 8), I4(b + 12)
+#define I64(b)       I16(b), I16(b + 16), I16(b + 32), I16(b + 48)
+
+const uint8_t profile_index[PROFILE_BUCKETS] PROFILE_FLASH = {
+  I64(0), I64(64), I64(128), I64(192), I64(256)
+};
@@ -0,0 +1,65 @@
+/*
+ * LotMonitor display profile
+ *
+ * The thresholds of monitor_config.h, the colours below, brightness, gamma
+ * and the stripe length are folded into two flash-resident tables at compile
+ * time: every frame the stripe can show, and the frame index for each 64us
+ * bucket of the filtered echo length. Rendering is a table lookup plus a
+ * copy, no division at runtime. Used by the ATtiny85 and the ESP8266 alike.
+ */
+
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#include <stdint.h>
+#include "monitor_config.h"
+#include "colors.h"
+
+#if defined(__AVR__) || defined(ARDUINO_ARCH_ESP8266)
+#if defined(__AVR__)
+#include <avr/pgmspace.h>
+#else
+#include <pgmspace.h>
+#endif
+#define PROFILE_FLASH                    PROGMEM
+#define profile_read_byte(p)             pgm_read_byte(p)
+#define profile_memcpy(dst, src, len)    memcpy_P(dst, src, len)
+#else
+#define PROFILE_FLASH
+#define profile_read_byte(p)             (*(const uint8_t *)(p))
+#define profile_memcpy(dst, src, len)    memcpy(dst, src, len)
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Colours as g, r, b (cRGB is internal grb !)
+#define PROFILE_NEAR   0, 255, 0  // red bar, growing below 1m
+#define PROFILE_FAR  255,   0, 0  // green bar, shrinking from 3m to 1m
+
+#ifndef MONITOR_GAMMA
+#define MONITOR_GAMMA 1           // 1 = linear, 2 = square law
+#endif
+#ifdef WS2819_BRIGHTNESS
+#define PROFILE_BRIGHTNESS WS2819_BRIGHTNESS
+#else
+#define PROFILE_BRIGHTNESS 100
+#endif
+
+#define PROFILE_SHIFT    6        // 64us (1.1cm) buckets of the echo length
+#define PROFILE_BUCKETS  320      // up to 20480us (353cm)
+#define PROFILE_OFF      0        // frame index: all leds off
+#define PROFILE_RED(n)   (n)      //   red bar of n leds (n = 1..len)
+#define PROFILE_GREEN(n) (WS2819_STRIPE_LEN + (n)) // green bar of n leds
+#define PROFILE_FRAMES   (2 * WS2819_STRIPE_LEN + 1)
+#define PROFILE_ALARM    0xFF     // bucket index: flicker red / off
+
+extern const struct cRGB profile_frames[PROFILE_FRAMES][WS2819_STRIPE_LEN] PROFILE_FLASH;
+extern const uint8_t profile_index[PROFILE_BUCKETS] PROFILE_FLASH;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PROFILE_H_ */
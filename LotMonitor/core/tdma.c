@@ -0,0 +1,89 @@
+/*
+ * LotMonitor trigger slots
+ *
+ * See tdma.h
+ */
+
+#include "tdma.h"
+
+void tdma_init(struct tdma *t) {
+  t->origin_us = 0;
+  t->synced_us = 0;
+  t->frame_us = 0;
+  t->drift_us = 0;
+  t->slots = 0;
+}
+
+//---------
+// This function takes the local frame to the manager's. The first beacon,
+// one after a timeout and one with another number of slots set the frame,
+// the others correct it by the drift: at once from TDMA_JUMP_US on, else
+// by half of it. origin_us is kept at the latest frame begin, so the
+// arithmetic stays within int32_t.
+//----------
+void tdma_sync(struct tdma *t, uint32_t now_us, uint8_t slots, uint32_t phase_us) {
+//----------
+  int32_t frame = slots * TDMA_SLOT_US;
+  int32_t elapsed;
+
+  if (!slots || slots > LOT_SLOTS_MAX) {
+    return;
+  }
+  phase_us %= frame;
+  if (!tdma_active(t, now_us) || t->slots != slots) {
+    t->origin_us = now_us - phase_us;
+    t->drift_us = 0;
+  } else {
+    elapsed = (int32_t)(now_us - t->origin_us) % frame;
+    int32_t err = (elapsed < 0 ? elapsed + frame : elapsed) - (int32_t)phase_us;
+
+    if (err >= frame / 2) {                  // the nearer of two frame begins
+      err -= frame;
+    } else if (err < -frame / 2) {
+      err += frame;
+    }
+    t->drift_us = err;
+    t->origin_us += err > TDMA_JUMP_US || err < -TDMA_JUMP_US ? err : err / 2;
+  }
+  elapsed = (int32_t)(now_us - t->origin_us);
+  if (elapsed >= 0) {
+    t->origin_us += elapsed / frame * frame;
+  } else {
+    t->origin_us -= (-elapsed + frame - 1) / frame * frame;
+  }
+  t->synced_us = now_us;
+  t->frame_us = frame;
+  t->slots = slots;
+}
+
+uint8_t tdma_active(const struct tdma *t, uint32_t now_us) {
+  return t->frame_us && now_us - t->synced_us < TDMA_TIMEOUT_US;
+}
+
+uint32_t tdma_next_us(const struct tdma *t, uint8_t slot, uint32_t after_us) {
+  uint32_t begin = t->origin_us + (uint32_t)(slot % t->slots) * TDMA_SLOT_US;
+  int32_t d = (int32_t)(after_us - begin);
+  int32_t frame = t->frame_us;
+  int32_t k = d > 0 ? (d + frame - 1) / frame : -(-d / frame);
+
+  return begin + (uint32_t)(k * frame);
+}
+
+//---------
+// This function allows for a timer firing a little late: a slot begun
+// less than half a slot before now_us is still due.
+//----------
+uint32_t tdma_trigger_us(const struct tdma *t, uint8_t slot, uint32_t last_us, uint16_t period_ms,
+                         uint32_t now_us) {
+//----------
+  uint32_t after_us = last_us + period_ms * 1000UL - TDMA_SLOT_US / 2;
+
+  if ((int32_t)(now_us - TDMA_SLOT_US / 2 - after_us) > 0) {
+    after_us = now_us - TDMA_SLOT_US / 2;
+  }
+  return tdma_next_us(t, slot, after_us);
+}
+
+uint8_t tdma_aux(const struct tdma *t, uint32_t now_us) {
+  return tdma_active(t, now_us) ? lot_aux_drift(t->drift_us) : 0;
+}
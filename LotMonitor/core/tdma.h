@@ -0,0 +1,69 @@
+/*
+ * LotMonitor trigger slots
+ *
+ * Neighbouring HY-SRF05 hear each other's echoes when they are triggered
+ * at the same time. The LotManager cuts time into frames of slots *
+ * LOT_SLOT_MS and gives neighbouring bays different slots, a bay triggers
+ * at the begin of its own slot only, so no two neighbours measure at once.
+ * Its trigger period is rounded up to whole frames.
+ *
+ * The frames are kept on the local microsecond clock and aligned to the
+ * beacons of the manager (LOT_SYNC, lot_proto.h), which tell where in its
+ * frame the manager was when it sent them. The difference to the local
+ * frame is the drift since the last beacon, reported in the status aux
+ * byte. A small drift is halved, so the jitter of the WiFi doesn't shake
+ * the frame, a large one or a new number of slots takes the beacon as is.
+ * Without a beacon for TDMA_TIMEOUT_US the monitor is unsynced again.
+ *
+ * Times are uint32_t microseconds, they wrap after 71 minutes.
+ */
+
+#ifndef TDMA_H_
+#define TDMA_H_
+
+#include <stdint.h>
+#include "lot_proto.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TDMA_SLOT_US     (LOT_SLOT_MS * 1000UL)
+#define TDMA_JUMP_US     2000        // drift taken as is from here
+#define TDMA_TIMEOUT_US  5000000UL   // unsynced without a beacon
+
+struct tdma {
+  uint32_t origin_us;        // begin of a frame, the latest one at the last beacon
+  uint32_t synced_us;        // last beacon
+  uint32_t frame_us;         // 0 until the first beacon
+  int32_t  drift_us;         // found at the last beacon
+  uint8_t  slots;
+};
+
+// This function resets t to unsynced.
+void tdma_init(struct tdma *t);
+
+// This function aligns the frames of t to a beacon received at now_us,
+// phase_us into a frame of slots.
+void tdma_sync(struct tdma *t, uint32_t now_us, uint8_t slots, uint32_t phase_us);
+
+// This function returns 1 if t had a beacon within TDMA_TIMEOUT_US.
+uint8_t tdma_active(const struct tdma *t, uint32_t now_us);
+
+// This function returns the first begin of slot at or after after_us.
+uint32_t tdma_next_us(const struct tdma *t, uint8_t slot, uint32_t after_us);
+
+// This function returns when a bay in slot, last triggered at last_us, is
+// triggered next to keep period_ms: the first begin of its slot from half a
+// slot before last_us + period_ms on, but not before now_us.
+uint32_t tdma_trigger_us(const struct tdma *t, uint8_t slot, uint32_t last_us, uint16_t period_ms,
+                         uint32_t now_us);
+
+// This function returns the aux byte of a status, see lot_proto.h.
+uint8_t tdma_aux(const struct tdma *t, uint32_t now_us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TDMA_H_ */
@@ -0,0 +1,166 @@
+/*
+ * LotMonitor echo traces
+ *
+ * See trace.h
+ */
+
+#include "trace.h"
+
+#define OFS_VERSION 2
+#define OFS_UNIT    3
+#define OFS_SOURCE  4
+#define OFS_LEN     5
+#define OFS_SEQ     6
+
+//---------
+// This function appends v as varint (7 bits per byte, LSB first) at p and
+// returns the end.
+//----------
+static uint8_t *put_varint(uint8_t *p, uint32_t v) {
+//----------
+  while (v >= 0x80) {
+    *p++ = (uint8_t)v | 0x80;
+    v >>= 7;
+  }
+  *p++ = (uint8_t)v;
+  return p;
+}
+
+//---------
+// This function reads a varint at *p, not beyond end. Returns 0 if the
+// varint is cut off.
+//----------
+static uint8_t get_varint(const uint8_t **p, const uint8_t *end, uint32_t *v) {
+//----------
+  uint8_t shift = 0;
+
+  *v = 0;
+  while (*p < end && shift < 28) {
+    uint8_t b = *(*p)++;
+    *v |= (uint32_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) {
+      return 1;
+    }
+    shift += 7;
+  }
+  return 0;
+}
+
+//---------
+// This function returns the check sum over the header and len payload bytes.
+//----------
+static uint16_t check(const uint8_t *b, uint8_t len) {
+//----------
+  uint16_t sum = 0;
+
+  for (uint8_t i = 0; i < TRACE_HEADER_LEN + len; i++) {
+    sum += b[i];
+  }
+  return sum;
+}
+
+//---------
+// This function starts recording the samples of one sensor into t.
+//----------
+void trace_init(struct trace *t, uint8_t unit_us, uint8_t source) {
+//----------
+  t->block[0] = TRACE_MAGIC0;
+  t->block[1] = TRACE_MAGIC1;
+  t->block[OFS_VERSION] = TRACE_VERSION;
+  t->block[OFS_UNIT] = unit_us;
+  t->block[OFS_SOURCE] = source;
+  t->block[OFS_SEQ] = 0;
+  t->len = 0;
+}
+
+//---------
+// This function starts the next block of t.
+//----------
+void trace_sent(struct trace *t) {
+//----------
+  t->block[OFS_SEQ]++;
+  t->len = 0;
+}
+
+//---------
+// This function adds a sample to t, returns the length of the block to send
+// once it holds TRACE_FLUSH_LEN payload bytes.
+//----------
+uint8_t trace_add(struct trace *t, uint16_t echo_us, uint16_t dt_ms) {
+//----------
+  uint16_t echo = echo_us / t->block[OFS_UNIT];
+  uint8_t *payload = t->block + TRACE_HEADER_LEN;
+  uint8_t *p;
+  uint16_t sum;
+
+  if (t->len + TRACE_SAMPLE_MAX > TRACE_PAYLOAD_MAX) {
+    trace_sent(t);                       // not sent in time, drop it
+  }
+  p = payload + t->len;
+  if (!t->len) {
+    p = put_varint(p, echo);
+    p = put_varint(p, dt_ms);
+  } else {
+    int32_t delta = (int32_t)echo - t->echo;
+    uint32_t zigzag = delta < 0 ? ((uint32_t)-delta << 1) - 1 : (uint32_t)delta << 1;
+
+    p = put_varint(p, zigzag << 1 | (dt_ms != t->dt_ms));
+    if (dt_ms != t->dt_ms) {
+      p = put_varint(p, dt_ms);
+    }
+  }
+  t->len = p - payload;
+  t->echo = echo;
+  t->dt_ms = dt_ms;
+  if (t->len < TRACE_FLUSH_LEN) {
+    return 0;
+  }
+  t->block[OFS_LEN] = t->len;
+  sum = check(t->block, t->len);
+  p[0] = sum & 0xFF;
+  p[1] = sum >> 8;
+  return TRACE_HEADER_LEN + t->len + 2;
+}
+
+//---------
+// This function decodes the block at b. Returns its length, 0 if there is
+// no valid block.
+//----------
+uint8_t trace_decode(const uint8_t *b, uint32_t avail, struct trace_sample *samples,
+                     uint8_t *count, uint8_t *unit_us, uint8_t *source, uint8_t *seq) {
+//----------
+  const uint8_t *p = b + TRACE_HEADER_LEN, *end;
+  uint32_t echo = 0, dt = 0, v;
+  uint8_t len;
+
+  if (avail < TRACE_HEADER_LEN + 2 || b[0] != TRACE_MAGIC0 || b[1] != TRACE_MAGIC1 ||
+      b[OFS_VERSION] != TRACE_VERSION || !b[OFS_UNIT] ||
+      (len = b[OFS_LEN]) > TRACE_PAYLOAD_MAX || avail < TRACE_HEADER_LEN + len + 2u ||
+      check(b, len) != (b[TRACE_HEADER_LEN + len] | b[TRACE_HEADER_LEN + len + 1] << 8)) {
+    return 0;
+  }
+  end = p + len;
+  *count = 0;
+  while (p < end) {
+    if (!*count) {
+      if (!get_varint(&p, end, &echo) || !get_varint(&p, end, &dt)) {
+        return 0;
+      }
+    } else {
+      if (!get_varint(&p, end, &v)) {
+        return 0;
+      }
+      echo += (v & 2) ? -(int32_t)((v >> 2) + 1) : (int32_t)(v >> 2);
+      if ((v & 1) && !get_varint(&p, end, &dt)) {
+        return 0;
+      }
+    }
+    samples[*count].echo_us = (uint16_t)echo * b[OFS_UNIT];
+    samples[*count].dt_ms = dt;
+    ++*count;
+  }
+  *unit_us = b[OFS_UNIT];
+  *source = b[OFS_SOURCE];
+  *seq = b[OFS_SEQ];
+  return TRACE_HEADER_LEN + len + 2;
+}
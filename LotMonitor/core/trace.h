@@ -0,0 +1,76 @@
+/*
+ * LotMonitor echo traces
+ *
+ * Raw echo lengths as the firmware measured them, recorded in the field and
+ * replayed on the host through the very same core (see host/replay.c).
+ *
+ * The samples are delta encoded into self-contained blocks of at most
+ * TRACE_BLOCK_LEN bytes, so a block can be sent between other output on the
+ * same serial line and a lost block costs only its own samples:
+ *
+ *   'E' 'T' version unit_us source len seq  payload[len]  check (16 bit LE)
+ *
+ * The first sample of a block is stored as varint(echo) varint(dt_ms), every
+ * following one as varint(zigzag(echo delta) << 1 | dt changed), followed by
+ * varint(dt_ms) if the trigger period changed. echo is in units of unit_us
+ * (the platform's echo resolution), 0 = no echo. A sample standing still at
+ * the same rate takes one byte. check is the sum of all bytes before it.
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+#include "monitor_config.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TRACE_MAGIC0      'E'
+#define TRACE_MAGIC1      'T'
+#define TRACE_VERSION     1
+#define TRACE_HEADER_LEN  7
+#define TRACE_BLOCK_LEN   64
+#define TRACE_PAYLOAD_MAX (TRACE_BLOCK_LEN - TRACE_HEADER_LEN - 2)
+#define TRACE_FLUSH_LEN   32   // payload bytes from which a block is sent
+#define TRACE_SAMPLE_MAX  6    // bytes of the longest sample
+#define TRACE_SAMPLES_MAX TRACE_PAYLOAD_MAX
+
+struct trace_sample {
+  uint16_t echo_us;            // echo length, 0 = no echo
+  uint16_t dt_ms;              // time since the trigger before
+};
+
+struct trace {
+  uint8_t  block[TRACE_BLOCK_LEN]; // block being filled
+  uint8_t  len;                // payload bytes so far
+  uint16_t echo;               // last sample, in unit_us
+  uint16_t dt_ms;              //   and its trigger period
+};
+
+// This function starts recording the samples of one sensor (source) with an
+// echo resolution of unit_us into t.
+void trace_init(struct trace *t, uint8_t unit_us, uint8_t source);
+
+// This function adds a sample to t. Returns the length of the block to send
+// once it holds TRACE_FLUSH_LEN payload bytes, 0 before. The block stays
+// valid until the next trace_add(), call trace_sent() once it went out. If
+// it can't be sent before it is full, it is dropped for a new one.
+uint8_t trace_add(struct trace *t, uint16_t echo_us, uint16_t dt_ms);
+
+// This function starts the next block of t after the last one was sent.
+void trace_sent(struct trace *t);
+
+// This function decodes the block at b, of which avail bytes are available.
+// Returns the length of the block and stores up to TRACE_SAMPLES_MAX samples
+// in samples, their number in count, the header in unit_us, source and seq.
+// Returns 0 if there is no valid block at b.
+uint8_t trace_decode(const uint8_t *b, uint32_t avail, struct trace_sample *samples,
+                     uint8_t *count, uint8_t *unit_us, uint8_t *source, uint8_t *seq);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TRACE_H_ */
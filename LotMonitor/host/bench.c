@@ -0,0 +1,77 @@
+/*
+ * LotMonitor host benchmark
+ *
+ * Runs the firmware main loop (monitor_step) against the simulated HY-SRF05
+ * and reports the host cost per iteration plus the simulated latency from a
+ * completed measurement to the frame showing it. The stripe busy time is the
+ * share of time spent sending frames with interrupts disabled, disturbed
+ * echoes were skewed because an edge fell into such a frame. Every 7th echo
+ * is lost, the occupancy must change 4 times per car nevertheless.
+ *
+ * The profiling records the simulated firmware sends every 5s are written to
+ * perf_file if given, see perfdump.c.
+ *
+ * usage: monitor_bench [wakeups [perf_file]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "monitor.h"
+#include "sim.h"
+
+//---------
+// Monotonic host time in nanoseconds
+//----------
+static uint64_t now_ns(void) {
+//----------
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+int main(int argc, char **argv) {
+  uint32_t iterations = argc > 1 ? strtoul(argv[1], NULL, 0) : 1000000;
+  FILE *perf = NULL;
+  struct monitor m;
+  struct sim s;
+  uint64_t start, elapsed;
+
+  if (argc > 2 && !(perf = fopen(argv[2], "wb"))) {
+    perror(argv[2]);
+    return 1;
+  }
+  sim_init(&s, sim_scene_parking);
+  s.glitch_every = 7;
+  monitor_init(&m);
+  start = now_ns();
+  for (uint32_t i = 0; i < iterations; i++) {
+    sim_step(&s, &m);
+    if (perf && s.perf_ready) {
+      fwrite(&s.perf_record, PERF_RECORD_LEN, 1, perf);
+      s.perf_ready = 0;
+    }
+  }
+  elapsed = now_ns() - start;
+  if (perf) {
+    fclose(perf);
+  }
+
+  printf("iterations        %u\n", iterations);
+  printf("ns/iteration      %.1f\n", (double)elapsed / iterations);
+  printf("virtual time      %.1f s\n", s.now_us / 1e6);
+  printf("measurements      %u\n", s.measurements);
+  printf("occupancy changes %u\n", s.occupancy_changes);
+  printf("frames            %u\n", s.frames);
+  printf("stripe busy       %.2f %%\n", 100.0 * s.frames *
+         WS2819_STRIPE_LEN * SIM_LED_US / s.now_us);
+  printf("interrupts/s      %.0f\n", s.interrupts / (s.now_us / 1e6));
+  printf("frames deferred   %u\n", s.deferred);
+  printf("disturbed echoes  %u\n", s.disturbed);
+  printf("idle              %.1f %%\n", monitor_idle_permille(&s.duty) / 10.0);
+  printf("frame latency avg %.0f us\n",
+         s.latency_count ? (double)s.latency_sum_us / s.latency_count : 0.0);
+  printf("frame latency max %u us\n", s.latency_max_us);
+  return 0;
+}
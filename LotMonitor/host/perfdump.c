@@ -0,0 +1,223 @@
+/*
+ * LotMonitor profiling report
+ *
+ * Decodes the profiling records (see ../core/perf.h) in a serial capture of a
+ * LotMonitor and prints a performance report per capture: event counters
+ * with their rates and, per probe, average, maximum and histogram of the
+ * durations in microseconds, and the time the device slept, if it keeps
+ * track. Other output in the capture, e.g. the
+ * occupancy messages of the ESP8266, is skipped. Records with a bad check
+ * sum are counted and ignored, gaps in the record numbers count as lost.
+ *
+ * usage: perfdump [capture...]    reads stdin without capture
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "perf.h"
+
+// Record field offsets, see struct perf
+#define OFS_TICK_HZ  4
+#define OFS_ELAPSED  8
+#define OFS_SEQ      12
+#define OFS_CHECK    14
+#define OFS_DEVICE   16
+#define OFS_SHIFT    17
+#define OFS_COUNTER  18
+#define OFS_IDLE     32
+#define OFS_PROBE    36
+#define PROBE_LEN    28
+
+struct report {
+  uint8_t  device;
+  uint8_t  shift;
+  uint32_t tick_hz;
+  uint32_t records;
+  uint32_t lost;
+  uint32_t bad;
+  uint16_t seq;                          // of the last record
+  uint16_t idle;                         // per mille, of the last record
+  uint64_t elapsed;                      // ticks
+  uint64_t counter[PERF_COUNTERS];
+  struct {
+    uint64_t count, sum, hist[PERF_BUCKETS];
+    uint32_t max;
+  } probe[PERF_PROBES];
+};
+
+static const char *counter_names[PERF_COUNTERS] = {
+  "triggers", "late triggers", "echo timeouts", "out of range",
+  "frames", "frames refused", "frames disturbing",
+};
+
+static const char *probe_names[PERF_PROBES] = {
+  "trigger isr", "echo isr", "frame tx", "main loop",
+};
+
+static const char *device_names[] = { "?", "ATtiny85", "ESP8266", "host" };
+
+static uint16_t le16(const uint8_t *b) { return b[0] | b[1] << 8; }
+static uint32_t le32(const uint8_t *b) { return le16(b) | (uint32_t)le16(b + 2) << 16; }
+
+//---------
+// This function returns 1 if a valid record starts at b.
+//----------
+static int valid(const uint8_t *b) {
+//----------
+  uint16_t sum = 0;
+
+  for (int i = 0; i < PERF_RECORD_LEN; i++) {
+    if (i != OFS_CHECK && i != OFS_CHECK + 1) {
+      sum += b[i];
+    }
+  }
+  return sum == le16(b + OFS_CHECK);
+}
+
+//---------
+// This function adds the record at b to r.
+//----------
+static void add(struct report *r, const uint8_t *b) {
+//----------
+  uint16_t seq = le16(b + OFS_SEQ);
+
+  if (r->records && seq != (uint16_t)(r->seq + 1)) {
+    r->lost += (uint16_t)(seq - r->seq - 1);
+  }
+  r->records++;
+  r->seq = seq;
+  r->device = b[OFS_DEVICE];
+  r->shift = b[OFS_SHIFT];
+  r->idle = le16(b + OFS_IDLE);
+  r->tick_hz = le32(b + OFS_TICK_HZ);
+  r->elapsed += le32(b + OFS_ELAPSED);
+  for (int i = 0; i < PERF_COUNTERS; i++) {
+    r->counter[i] += le16(b + OFS_COUNTER + 2 * i);
+  }
+  for (int i = 0; i < PERF_PROBES; i++) {
+    const uint8_t *p = b + OFS_PROBE + i * PROBE_LEN;
+    uint32_t max = le32(p + 4);
+
+    r->probe[i].sum += le32(p);
+    r->probe[i].count += le16(p + 8);
+    for (int k = 0; k < PERF_BUCKETS; k++) {
+      r->probe[i].hist[k] += le16(p + 10 + 2 * k);
+    }
+    if (max > r->probe[i].max) {
+      r->probe[i].max = max;
+    }
+  }
+}
+
+//---------
+// This function scans a capture of len bytes for records.
+//----------
+static void scan(struct report *r, const uint8_t *b, size_t len) {
+//----------
+  size_t i = 0;
+
+  while (i + PERF_RECORD_LEN <= len) {
+    if (b[i] != PERF_MAGIC0 || b[i + 1] != PERF_MAGIC1 ||
+        b[i + 2] != PERF_VERSION || b[i + 3] != PERF_RECORD_LEN) {
+      i++;
+    } else if (!valid(b + i)) {
+      r->bad++;
+      i++;
+    } else {
+      add(r, b + i);
+      i += PERF_RECORD_LEN;
+    }
+  }
+}
+
+//---------
+// This function prints the report of a capture.
+//----------
+static void print(const struct report *r, const char *name) {
+//----------
+  double us = r->tick_hz ? 1e6 / r->tick_hz : 0;
+  double seconds = r->elapsed * us / 1e6;
+
+  printf("%s\n", name);
+  if (!r->records) {
+    printf("  no records (%u bad)\n\n", r->bad);
+    return;
+  }
+  printf("  device %s, %u ticks/s, %u records (%u lost, %u bad), %.1f s\n",
+         device_names[r->device < 4 ? r->device : 0], r->tick_hz,
+         r->records, r->lost, r->bad, seconds);
+  if (r->idle != PERF_IDLE_UNKNOWN) {
+    printf("  idle %.1f %%\n", r->idle / 10.0);
+  }
+  printf("  %-18s %10s %10s\n", "counter", "total", "/s");
+  for (int i = 0; i < PERF_COUNTERS; i++) {
+    printf("  %-18s %10llu %10.2f\n", counter_names[i],
+           (unsigned long long)r->counter[i], seconds ? r->counter[i] / seconds : 0);
+  }
+  printf("  %-18s %10s %10s %10s  histogram [us]\n", "probe", "count", "avg us", "max us");
+  for (int i = 0; i < PERF_PROBES; i++) {
+    printf("  %-18s %10llu %10.1f %10.1f ", probe_names[i],
+           (unsigned long long)r->probe[i].count,
+           r->probe[i].count ? (double)r->probe[i].sum / r->probe[i].count * us : 0,
+           r->probe[i].max * us);
+    for (int k = 0; k < PERF_BUCKETS; k++) {
+      double bound = (double)(2u << k << r->shift) * us;
+
+      if (r->probe[i].hist[k]) {
+        printf(" %s%g:%llu", k < PERF_BUCKETS - 1 ? "<" : ">=",
+               k < PERF_BUCKETS - 1 ? bound : bound / 2,
+               (unsigned long long)r->probe[i].hist[k]);
+      }
+    }
+    printf("\n");
+  }
+  printf("\n");
+}
+
+//---------
+// This function reports on one capture, returns 0 if it could not be read.
+//----------
+static int report(FILE *f, const char *name) {
+//----------
+  struct report r;
+  uint8_t *b = NULL;
+  size_t len = 0, size = 0, n;
+
+  do {
+    if (len == size) {
+      size = size ? 2 * size : 65536;
+      if (!(b = realloc(b, size))) {
+        perror(name);
+        return 0;
+      }
+    }
+    n = fread(b + len, 1, size - len, f);
+    len += n;
+  } while (n);
+  memset(&r, 0, sizeof(r));
+  scan(&r, b, len);
+  print(&r, name);
+  free(b);
+  return 1;
+}
+
+int main(int argc, char **argv) {
+  int ok = 1;
+
+  if (argc < 2) {
+    return !report(stdin, "stdin");
+  }
+  for (int i = 1; i < argc; i++) {
+    FILE *f = fopen(argv[i], "rb");
+
+    if (!f) {
+      perror(argv[i]);
+      ok = 0;
+      continue;
+    }
+    ok &= report(f, argv[i]);
+    fclose(f);
+  }
+  return !ok;
+}
@@ -0,0 +1,197 @@
+/*
+ * LotMonitor echo trace replay
+ *
+ * Replays echo traces recorded by the firmware (see ../core/trace.h) through
+ * the core on the simulated platform: the recorded echoes at the recorded
+ * trigger times go through the occupancy filter, the display profile and the
+ * frame scheduling exactly as on the device, in virtual time. Reports per
+ * sensor what the bay went through plus the replay speed, with -v also one
+ * line per measurement (time, raw echo, filtered distance, state, frame) to
+ * diff against a known good replay. -n repeats the replay for benchmarking.
+ *
+ * usage: replay [-v] [-n repeat] capture...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "monitor.h"
+#include "sim.h"
+
+#define SOURCES 256
+
+struct source {
+  struct trace_sample *samples;
+  uint32_t len, size;
+  uint32_t blocks, lost;
+  uint8_t  unit_us, seq;
+};
+
+static struct source sources[SOURCES];
+
+//---------
+// Monotonic host time in nanoseconds
+//----------
+static uint64_t now_ns(void) {
+//----------
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+//---------
+// This function appends the blocks of a capture to their sources, other
+// output in the capture is skipped.
+//----------
+static void scan(const uint8_t *b, size_t len) {
+//----------
+  struct trace_sample samples[TRACE_SAMPLES_MAX];
+  uint8_t count, unit_us, id, seq, n;
+  size_t i = 0;
+
+  while (i < len) {
+    struct source *src;
+
+    if (!(n = trace_decode(b + i, len - i, samples, &count, &unit_us, &id, &seq))) {
+      i++;
+      continue;
+    }
+    i += n;
+    src = &sources[id];
+    if (src->blocks && seq != (uint8_t)(src->seq + 1)) {
+      src->lost += (uint8_t)(seq - src->seq - 1);
+    }
+    src->blocks++;
+    src->seq = seq;
+    src->unit_us = unit_us;
+    if (src->len + count > src->size) {
+      src->size = 2 * src->size + TRACE_SAMPLES_MAX;
+      src->samples = realloc(src->samples, src->size * sizeof(*src->samples));
+      if (!src->samples) {
+        perror("replay");
+        exit(1);
+      }
+    }
+    memcpy(src->samples + src->len, samples, count * sizeof(*samples));
+    src->len += count;
+  }
+}
+
+//---------
+// This function reads a capture and scans it, returns 0 if it can't be read.
+//----------
+static int load(const char *name) {
+//----------
+  FILE *f = fopen(name, "rb");
+  uint8_t *b = NULL;
+  size_t len = 0, size = 0, n;
+
+  if (!f) {
+    perror(name);
+    return 0;
+  }
+  do {
+    if (len == size) {
+      size = size ? 2 * size : 65536;
+      if (!(b = realloc(b, size))) {
+        perror(name);
+        fclose(f);
+        return 0;
+      }
+    }
+    n = fread(b + len, 1, size - len, f);
+    len += n;
+  } while (n);
+  fclose(f);
+  scan(b, len);
+  free(b);
+  return 1;
+}
+
+//---------
+// This function prints the frame shown, one hex GRB triple per led.
+//----------
+static void print_frame(const struct cRGB *frame) {
+//----------
+  for (int i = 0; i < WS2819_STRIPE_LEN; i++) {
+    printf(" %02x%02x%02x", frame[i].g, frame[i].r, frame[i].b);
+  }
+  printf("\n");
+}
+
+//---------
+// This function replays the samples of a source.
+//----------
+static void replay(int id, const struct source *src, int verbose, uint32_t repeat) {
+//----------
+  struct monitor m;
+  struct sim s;
+  uint64_t start, elapsed;
+
+  start = now_ns();
+  for (uint32_t r = 0; r < repeat; r++) {
+    uint32_t measurements = 0;
+
+    sim_init(&s, NULL);
+    sim_replay(&s, src->samples, src->len, src->unit_us);
+    monitor_init(&m);
+    while (s.trace_pos < s.trace_len || s.echo_end_us) {
+      sim_step(&s, &m);
+      if (verbose && !r && s.measurements != measurements) {
+        measurements = s.measurements;
+        printf("%10.3f %5u %4u %u", s.now_us / 1e6, s.echo_measured_us,
+               m.occupancy.distance_us / MONITOR_US_PER_CM, m.occupancy.state);
+        print_frame(s.frame);
+      }
+    }
+  }
+  elapsed = now_ns() - start;
+
+  printf("source %d\n", id);
+  printf("  samples           %u in %u blocks (%u lost), %u us resolution\n",
+         src->len, src->blocks, src->lost, src->unit_us);
+  printf("  recorded time     %.1f s\n", s.now_us / 1e6);
+  printf("  occupancy changes %u, now %u\n", s.occupancy_changes, m.occupancy.state);
+  printf("  frames            %u (%u deferred)\n", s.frames, s.deferred);
+  printf("  replay            %.0f ns/sample, %.0fx real time\n",
+         (double)elapsed / repeat / (src->len ? src->len : 1),
+         elapsed ? s.now_us * 1e3 * repeat / elapsed : 0.0);
+}
+
+int main(int argc, char **argv) {
+  uint32_t repeat = 1;
+  int verbose = 0, i, found = 0;
+
+  for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+    if (!strcmp(argv[i], "-v")) {
+      verbose = 1;
+    } else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+      repeat = strtoul(argv[++i], NULL, 0);
+    } else {
+      fprintf(stderr, "usage: replay [-v] [-n repeat] capture...\n");
+      return 1;
+    }
+  }
+  if (i == argc || !repeat) {
+    fprintf(stderr, "usage: replay [-v] [-n repeat] capture...\n");
+    return 1;
+  }
+  for (; i < argc; i++) {
+    if (!load(argv[i])) {
+      return 1;
+    }
+  }
+  for (i = 0; i < SOURCES; i++) {
+    if (sources[i].len) {
+      replay(i, &sources[i], verbose, repeat);
+      found = 1;
+    }
+  }
+  if (!found) {
+    fprintf(stderr, "replay: no echo traces found\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,351 @@
+/*
+ * LotMonitor host simulation
+ *
+ * See sim.h
+ */
+
+#include <string.h>
+#include "sim.h"
+#include "hal.h"
+
+struct sim *sim;
+
+//---------
+// This function resets s to time 0 and makes it the HAL instance.
+//----------
+void sim_init(struct sim *s, sim_scene scene) {
+//----------
+  memset(s, 0, sizeof(*s));
+  s->trigger_us = SIM_TRIGGER_US;
+  s->trigger_period_us = SIM_TRIGGER_US;
+  s->flicker_us = SIM_FLICKER_US;
+  s->scene = scene;
+  s->schedule = MONITOR_TX_SCHEDULE;
+  s->count_us = SIM_COUNT_US;
+  perf_init(&s->perf, PERF_DEVICE_HOST, 1000000, 0);
+  sim = s;
+}
+
+//---------
+// This function replays recorded samples on s instead of its scene.
+//----------
+void sim_replay(struct sim *s, const struct trace_sample *trace, uint32_t len,
+                uint8_t count_us) {
+//----------
+  s->trace = trace;
+  s->trace_len = len;
+  s->trace_pos = 0;
+  s->count_us = count_us;
+  s->fixed_rate = 1;
+  if (len && trace[0].dt_ms) {
+    s->trigger_us = (uint64_t)trace[0].dt_ms * 1000;
+  }
+}
+
+//---------
+// Timer1 compare match: trigger the HY-SRF05. Accounts the interrupts of
+// the whole measurement: trigger, both echo edges and the timer0 overflows
+// in between.
+//----------
+static void sim_trigger(struct sim *s) {
+//----------
+  uint16_t mm;
+
+  if (s->trace) {                       // recorded echo, 0 = none
+    s->echo_us = s->trace_pos < s->trace_len ? s->trace[s->trace_pos++].echo_us : 0;
+    if (s->trace_pos < s->trace_len && s->trace[s->trace_pos].dt_ms) {
+      s->trigger_period_us = (uint32_t)s->trace[s->trace_pos].dt_ms * 1000;
+    }
+  } else {
+    mm = s->scene(s->now_us);
+    s->echo_us = mm ? (uint32_t)mm * MONITOR_US_PER_CM / 10 : SIM_ECHO_TIMEOUT_US;
+  }
+  if (s->glitch_every && (s->measurements + 1) % s->glitch_every == 0) {
+    s->echo_us = SIM_ECHO_TIMEOUT_US;   // echo lost
+  }
+  if (s->echo_us > MONITOR_DISTANCE_MAX_CM * MONITOR_US_PER_CM) {
+    perf_count(&s->perf, PERF_OUT_OF_RANGE);
+  }
+  if (s->echo_end_us) {
+    perf_count(&s->perf, PERF_LATE);    // last echo still measured
+  }
+  perf_count(&s->perf, PERF_TRIGGERS);
+  perf_record(&s->perf, PERF_TRIGGER_ISR, SIM_TRIGGER_PULSE_US);
+  s->trigger_dt_us = s->now_us - s->triggered_us;
+  s->triggered_us = s->now_us;
+  s->echo_end_us = s->now_us + SIM_TRIGGER_PULSE_US + SIM_ECHO_DELAY_US + s->echo_us;
+  s->trigger_us += s->trigger_period_us;
+  s->period++;
+  s->interrupts += 1 + 2 + (s->echo_end_us - s->now_us) / SIM_OVERFLOW_US;
+}
+
+//---------
+// Timer1 compare match: toggle the flicker-flag. Hands the profiling
+// counters over every MONITOR_PERF_PERIODS toggles.
+//----------
+static void sim_flicker(struct sim *s) {
+//----------
+  s->flicker_us += SIM_FLICKER_US;
+  s->flicker = !s->flicker;
+  s->events |= MONITOR_EV_FLICKER;
+  if (++s->flickers % MONITOR_PERF_PERIODS == 0) {
+    s->perf.idle = monitor_idle_permille(&s->duty);
+    perf_take(&s->perf, &s->perf_record, MONITOR_PERF_PERIODS * SIM_FLICKER_US);
+    perf_seal(&s->perf_record);
+    s->perf_ready = 1;
+  }
+}
+
+//---------
+// This function returns the time an echo edge at us gets timestamped. An
+// edge while a frame is sent is only seen once interrupts are enabled again.
+//----------
+static uint64_t sim_edge(const struct sim *s, uint64_t us) {
+//----------
+  if (us >= s->cli_from_us && us < s->cli_until_us) {
+    return s->cli_until_us;
+  }
+  return us;
+}
+
+//---------
+// Falling echo edge: the measurement is complete.
+//----------
+static void sim_echo(struct sim *s) {
+//----------
+  uint32_t measured_us = sim_edge(s, s->echo_end_us) -
+                         sim_edge(s, s->echo_end_us - s->echo_us);
+
+  if (measured_us != s->echo_us) {
+    s->disturbed++;
+  }
+  s->echo_measured_us = measured_us / s->count_us * s->count_us;
+  perf_record(&s->perf, PERF_ECHO_ISR, 0);
+  s->echo_end_us = 0;
+  s->measurements++;
+  s->pending = 1;
+  s->measured_us = s->now_us;
+  s->events |= MONITOR_EV_MEASURED;
+}
+
+//---------
+// Stripe latched after the reset time, a refused frame can be sent now.
+//----------
+static void sim_ready(struct sim *s) {
+//----------
+  s->ready_us = 0;
+  s->events |= MONITOR_EV_READY;
+}
+
+//---------
+// This function returns the time of the next timer or echo event.
+//----------
+static uint64_t sim_next(const struct sim *s) {
+//----------
+  uint64_t next = s->trigger_us;
+
+  if (s->flicker_us < next) {
+    next = s->flicker_us;
+  }
+  if (s->echo_end_us && s->echo_end_us < next) {
+    next = s->echo_end_us;
+  }
+  if (s->ready_us && s->ready_us < next) {
+    next = s->ready_us;
+  }
+  return next;
+}
+
+//---------
+// This function advances virtual time and runs the timer and echo events.
+//----------
+void sim_advance(struct sim *s, uint32_t us) {
+//----------
+  uint64_t until = s->now_us + us;
+  uint64_t next;
+
+  while ((next = sim_next(s)) <= until) {
+    s->now_us = next;
+    if (next == s->ready_us) {
+      sim_ready(s);
+    } else if (next == s->echo_end_us) {
+      sim_echo(s);
+    } else if (next == s->trigger_us) {
+      sim_trigger(s);
+    } else {
+      sim_flicker(s);
+    }
+  }
+  s->now_us = until;
+}
+
+//---------
+// This function runs one iteration of the event driven firmware main loop on
+// s: sleep until the next event, then handle it. Rendering costs SIM_LOOP_US.
+//----------
+void sim_step(struct sim *s, struct monitor *m) {
+//----------
+  uint8_t events = hal_wait_events();
+  uint32_t deferred = s->deferred;
+
+  s->iterations++;
+  if (monitor_event(m, events) & MONITOR_OCCUPANCY_CHANGED) {
+    s->occupancy_changes++;
+  }
+  if (s->deferred == deferred) {
+    s->reading = 0;                // frame sent or unchanged
+  }
+  sim_advance(s, SIM_LOOP_US);
+  perf_record(&s->perf, PERF_LOOP, s->now_us - s->wake_us);
+}
+
+//---------
+// This function runs one iteration of a polling main loop on s, as the
+// ESP8266 does and the ATtiny85 did before sleeping between events. The
+// stripe is offered a frame in every iteration.
+//----------
+void sim_poll(struct sim *s, struct monitor *m) {
+//----------
+  uint8_t events = s->events;
+  uint32_t deferred = s->deferred;
+
+  s->iterations++;
+  s->events = 0;
+  if (monitor_event(m, events | MONITOR_EV_READY) & MONITOR_OCCUPANCY_CHANGED) {
+    s->occupancy_changes++;
+  }
+  if (s->deferred == deferred) {
+    s->reading = 0;                // frame sent or unchanged
+  }
+  sim_advance(s, SIM_LOOP_US);
+}
+
+//---------
+// A car arriving, parking in the alarm zone, leaving again. 20s period.
+//----------
+uint16_t sim_scene_parking(uint64_t now_us) {
+//----------
+  uint32_t ms = (now_us / 1000) % 20000;
+
+  if (ms < 2000) {                 // empty bay, nothing in range
+    return 0;
+  } else if (ms < 8000) {          // arriving from 3.5m to 20cm
+    return 3500 - (ms - 2000) * 3300 / 6000;
+  } else if (ms < 14000) {         // parked in the alarm zone
+    return 200;
+  } else if (ms < 18000) {         // leaving to 3.5m
+    return 200 + (ms - 14000) * 3300 / 4000;
+  }
+  return 0;                        // empty bay again
+}
+
+//---------
+// HAL: Latest echo length in microseconds, 0 if there was no echo
+//----------
+uint16_t hal_echo_us(void) {
+//----------
+  sim->reading = sim->pending;     // frame latency is accounted if the
+  sim->reading_us = sim->measured_us; //   frame changed and is sent now or
+  sim->pending = 0;                //   after being refused
+  return sim->echo_measured_us;
+}
+
+//---------
+// HAL: State of the <26cm alarm flicker, toggled by the simulated timer1
+//----------
+uint8_t hal_flicker(void) {
+//----------
+  return sim->flicker;
+}
+
+//---------
+// HAL: Number of measurement periods (triggers) so far, wraps at 256
+//----------
+uint8_t hal_period(void) {
+//----------
+  return sim->period;
+}
+
+//---------
+// HAL: Sets the time from one trigger to the next. As the ATtiny85 counts
+// down its timer ticks, a shorter period applies to the running one as well.
+//----------
+void hal_trigger_ms(uint16_t ms) {
+//----------
+  uint64_t last = sim->trigger_us - sim->trigger_period_us;
+
+  if (sim->fixed_rate) {
+    return;
+  }
+  sim->trigger_period_us = (uint32_t)ms * 1000;
+  if (last + sim->trigger_period_us < sim->trigger_us) {
+    sim->trigger_us = last + sim->trigger_period_us;
+    if (sim->trigger_us < sim->now_us) {
+      sim->trigger_us = sim->now_us;
+    }
+  }
+}
+
+//---------
+// HAL: Sleeps until the next event, like SLEEP_MODE_IDLE on the ATtiny85
+//----------
+uint8_t hal_wait_events(void) {
+//----------
+  uint8_t events;
+
+  monitor_duty_awake(&sim->duty, sim->now_us - sim->wake_us);
+  monitor_duty_elapsed(&sim->duty, sim->now_us - sim->wake_us);
+  while (!sim->events) {
+    uint64_t next = sim_next(sim);
+    monitor_duty_elapsed(&sim->duty, next - sim->now_us);
+    sim_advance(sim, next - sim->now_us);
+  }
+  sim->wake_us = sim->now_us;
+  events = sim->events;
+  sim->events = 0;
+  return events;
+}
+
+//---------
+// HAL: Sends a frame of len GRB pixels to the stripe. Takes as long as the
+// bit-banged transmission with interrupts disabled. Without schedule also
+// the reset time is waited for, as ws2812_setleds() does. With schedule,
+// MONITOR_EV_READY is posted once the reset time passed.
+//----------
+uint8_t hal_show(const struct cRGB *frame, uint8_t len) {
+//----------
+  uint8_t  reading = sim->reading;  // frame rendered from a new measurement
+  uint64_t measured_us = sim->reading_us;
+
+  if (sim->schedule && (sim->echo_end_us || sim->ready_us)) {
+    sim->deferred++;                // trigger/echo window or reset time
+    perf_count(&sim->perf, PERF_REFUSED);
+    return 0;
+  }
+  if (sim->echo_end_us) {
+    perf_count(&sim->perf, PERF_DISTURBED);
+  }
+  if (sim->frames && sim->now_us < sim->cli_until_us + SIM_RESET_US) {
+    sim->reset_violations++;
+  }
+  memcpy(sim->frame, frame, len * sizeof(*frame));
+  sim->frames++;
+  sim->reading = 0;
+  sim->cli_from_us = sim->now_us;
+  sim->cli_until_us = sim->now_us + len * SIM_LED_US;
+  if (sim->schedule) {
+    sim->ready_us = sim->cli_until_us + SIM_RESET_US;
+  }
+  sim_advance(sim, len * SIM_LED_US + (sim->schedule ? 0 : SIM_RESET_US));
+  perf_record(&sim->perf, PERF_FRAME_TX, sim->now_us - sim->cli_from_us);
+  perf_count(&sim->perf, PERF_FRAMES);
+  if (reading) {
+    uint32_t latency = sim->now_us - measured_us;
+    sim->latency_count++;
+    sim->latency_sum_us += latency;
+    if (latency > sim->latency_max_us) {
+      sim->latency_max_us = latency;
+    }
+  }
+  return 1;
+}
@@ -0,0 +1,111 @@
+/*
+ * LotMonitor host simulation
+ *
+ * Simulated HY-SRF05 and timer driver backing the HAL (see ../core/hal.h) on
+ * a plain Linux host. Time is virtual: it only advances when the firmware
+ * would spend it, e.g. while sending a frame to the stripe, so the same
+ * scene always produces the same measurements and frames.
+ */
+
+#ifndef SIM_H_
+#define SIM_H_
+
+#include <stdint.h>
+#include "monitor.h"
+#include "perf.h"
+#include "trace.h"
+
+#define SIM_TRIGGER_US      100000  // MONITOR_PERIOD_MS, first trigger
+#define SIM_FLICKER_US      100000  // alarm flicker toggle, 10 Hz
+#define SIM_TRIGGER_PULSE_US 12     // ISR(TIMER1_COMPA_vect) trigger pulse
+#define SIM_COUNT_US        16      // timer0 resolution of the echo timestamps
+#define SIM_OVERFLOW_US     4096    // timer0 overflow period
+#define SIM_ECHO_DELAY_US   500     // trigger end to echo start (40kHz burst)
+#define SIM_ECHO_TIMEOUT_US 30000   // echo length if there is nothing in range
+#define SIM_LED_US          30      // 24 bit * 1.25us per led
+#define SIM_RESET_US        300     // ws2812_resettime
+#define SIM_LOOP_US         40      // main loop iteration, without sending
+
+// A scene returns the distance to the nearest object in mm at a given time,
+// 0 if there is nothing in range of the sensor.
+typedef uint16_t (*sim_scene)(uint64_t now_us);
+
+struct sim {
+  uint64_t now_us;                       // virtual time
+  uint64_t trigger_us;                   // next trigger
+  uint32_t trigger_period_us;            //   after the one before, see
+                                         //   hal_trigger_ms
+  uint64_t triggered_us;                 // last trigger
+  uint32_t trigger_dt_us;                //   after the one before
+  uint64_t flicker_us;                   // next flicker toggle
+  uint32_t flickers;                     //   toggles so far
+  uint64_t echo_end_us;                  // falling echo edge, 0 if idle
+  uint64_t ready_us;                     // reset time over, 0 if not sending
+  uint32_t echo_us;                      // length of the pending echo
+  uint16_t echo_measured_us;             // as SRF05_echo_us
+  uint8_t  flicker;                      // as last_25cm_flicker
+  uint8_t  period;                       // triggers so far
+  uint8_t  events;                       // posted MONITOR_EV_* events
+  uint64_t wake_us;                      // end of the last sleep
+  struct monitor_duty duty;              // awake and elapsed time
+  sim_scene scene;
+  uint8_t  schedule;                     // MONITOR_TX_SCHEDULE, may be changed
+  uint8_t  fixed_rate;                   // ignore hal_trigger_ms, 10 Hz
+  uint8_t  count_us;                     // echo resolution, SIM_COUNT_US
+
+  const struct trace_sample *trace;      // recorded echoes instead of the
+  uint32_t trace_len;                    //   scene, at the recorded trigger
+  uint32_t trace_pos;                    //   times, see sim_replay
+  uint32_t glitch_every;                 // every n-th echo is lost, 0 = never
+
+  struct cRGB frame[WS2819_STRIPE_LEN];  // what the stripe shows right now
+  uint32_t measurements;                 // completed echo measurements
+  uint32_t occupancy_changes;            // MONITOR_OCCUPANCY_CHANGED results
+  uint32_t iterations;                   // main loop iterations (wakeups)
+  uint32_t frames;                       // frames sent to the stripe
+  uint32_t interrupts;                   // trigger, echo edge and overflow ISRs
+  uint32_t deferred;                     // frames refused in the echo window
+  uint32_t disturbed;                    // measurements skewed by a frame
+  uint32_t reset_violations;             // frames sent within the reset time
+  uint64_t cli_from_us;                  // last frame sent with interrupts
+  uint64_t cli_until_us;                 //   disabled in between
+
+  uint8_t  pending;                      // measurement not yet read
+  uint64_t measured_us;                  //   completed at this time
+  uint8_t  reading;                      // measurement read, frame may follow
+  uint64_t reading_us;                   //   completed at this time
+  uint32_t latency_count;                // measurement to frame latency
+  uint64_t latency_sum_us;
+  uint32_t latency_max_us;
+
+  struct perf perf;                      // profiling counters, ticks are us
+  struct perf perf_record;               // taken every MONITOR_PERF_PERIODS
+  uint8_t  perf_ready;                   //   periods, set until consumed
+};
+
+// Instance backing the HAL functions
+extern struct sim *sim;
+
+// This function resets s to time 0 and makes it the HAL instance.
+void sim_init(struct sim *s, sim_scene scene);
+
+// This function replays len recorded samples on s instead of its scene, with
+// an echo resolution of count_us. The trigger rate is the recorded one.
+void sim_replay(struct sim *s, const struct trace_sample *trace, uint32_t len,
+                uint8_t count_us);
+
+// This function advances virtual time and runs the timer and echo events.
+void sim_advance(struct sim *s, uint32_t us);
+
+// This function runs one iteration of the event driven firmware main loop on
+// s: sleep until the next event, then handle it.
+void sim_step(struct sim *s, struct monitor *m);
+
+// This function runs one iteration of a polling main loop on s, as the
+// ESP8266 does and the ATtiny85 did before sleeping between events.
+void sim_poll(struct sim *s, struct monitor *m);
+
+// A car arriving, parking in the alarm zone, leaving again. 20s period.
+uint16_t sim_scene_parking(uint64_t now_us);
+
+#endif /* SIM_H_ */
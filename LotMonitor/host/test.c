@@ -0,0 +1,429 @@
+/*
+ * LotMonitor host tests
+ *
+ * Checks the core against the behaviour of the original firmware main loops
+ * and runs it end to end on the simulated HY-SRF05.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "monitor.h"
+#include "profile.h"
+#include "sim.h"
+#include "tdma.h"
+
+static int failures;
+
+#define CHECK(cond) do { if (!(cond)) { \
+  printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+  failures++; } } while (0)
+
+//---------
+// Number of leading LEDs in the given color, -1 if the rest is not black
+//----------
+static int bars(const struct cRGB *frame, struct cRGB color) {
+//----------
+  int n = 0;
+
+  while (n < WS2819_STRIPE_LEN && !memcmp(&frame[n], &color, sizeof(color))) {
+    n++;
+  }
+  for (int i = n; i < WS2819_STRIPE_LEN; i++) {
+    if (frame[i].r | frame[i].g | frame[i].b) return -1;
+  }
+  return n;
+}
+
+static void test_echo_cm(void) {
+  CHECK(monitor_echo_cm(0) == 0);
+  CHECK(monitor_echo_cm(58 * 26) == 26);
+  CHECK(monitor_echo_cm(58 * 300) == 300);
+  CHECK(monitor_echo_cm(58 * 300 + 1) == 0);
+  CHECK(monitor_echo_cm(30000) == 0);
+}
+
+#define US(cm) ((cm) * MONITOR_US_PER_CM + MONITOR_US_PER_CM / 2)
+
+static void test_render(void) {
+  struct cRGB f[WS2819_STRIPE_LEN];
+
+  monitor_render(f, 0, 0);       CHECK(bars(f, color_black) == WS2819_STRIPE_LEN);
+  monitor_render(f, US(320), 0); CHECK(bars(f, color_black) == WS2819_STRIPE_LEN);
+  monitor_render(f, 60000, 0);   CHECK(bars(f, color_black) == WS2819_STRIPE_LEN);
+  monitor_render(f, US(20), 0);  CHECK(bars(f, color_red) == 5);
+  monitor_render(f, US(20), 1);  CHECK(bars(f, color_black) == WS2819_STRIPE_LEN);
+  monitor_render(f, US(30), 1);  CHECK(bars(f, color_red) == 5);
+  monitor_render(f, US(80), 0);  CHECK(bars(f, color_red) == 2);
+  monitor_render(f, US(95), 0);  CHECK(bars(f, color_red) == 1);
+  monitor_render(f, US(110), 0); CHECK(bars(f, color_green) == 1);
+  monitor_render(f, US(190), 0); CHECK(bars(f, color_green) == 3);
+  monitor_render(f, US(290), 0); CHECK(bars(f, color_green) == 5);
+}
+
+//---------
+// The former per-sample mapping from main.c, reference for the profile
+//----------
+static void render_cm(struct cRGB *f, int cm, int flicker) {
+//----------
+  struct cRGB color = color_black;
+  int n = 0;
+
+  if (cm < 1 || cm > 300) {
+  } else if (cm < 26) {
+    color = color_red; n = flicker ? 0 : 5;
+  } else if (cm < 101) {
+    color = color_red; n = (100 - cm) / 15 + 1;
+  } else {
+    color = color_green; n = (cm - 100) / 40 + 1;
+  }
+  for (int i = 0; i < WS2819_STRIPE_LEN; i++) {
+    f[i] = i < n ? color : color_black;
+  }
+}
+
+static void test_profile(void) {
+  struct cRGB f[WS2819_STRIPE_LEN], ref[WS2819_STRIPE_LEN];
+
+  for (uint32_t us = 0; us < 20000; us += 8) {
+    int cm = (us >> PROFILE_SHIFT << PROFILE_SHIFT) / MONITOR_US_PER_CM;
+    for (int flicker = 0; flicker < 2; flicker++) {
+      monitor_render(f, us, flicker);
+      render_cm(ref, cm, flicker);
+      CHECK(!memcmp(f, ref, sizeof(f)));
+    }
+  }
+}
+
+//---------
+// Feeds n samples of cm (0 = no echo) and returns the number of changes
+//----------
+static int feed(struct occupancy *o, uint16_t cm, int n) {
+//----------
+  int changes = 0;
+
+  while (n--) {
+    changes += occupancy_update(o, cm * MONITOR_US_PER_CM);
+  }
+  return changes;
+}
+
+static void test_occupancy(void) {
+  struct occupancy o;
+
+  occupancy_init(&o);
+  CHECK(feed(&o, 0, 20) == 0);             // empty bay
+  CHECK(feed(&o, 120, 1) == 0);            // single bad echo
+  CHECK(feed(&o, 0, 2) == 0);
+  CHECK(o.distance_us == OCCUPANCY_FAR_US);
+
+  for (int cm = 240; cm > 150; cm -= 10) { // arriving
+    feed(&o, cm, 1);
+  }
+  CHECK(o.state == OCCUPANCY_APPROACHING);
+  CHECK(feed(&o, 150, 20) == 1);           // parked
+  CHECK(o.state == OCCUPANCY_OCCUPIED);
+  CHECK(o.distance_us / MONITOR_US_PER_CM == 150);
+
+  for (int i = 0; i < 10; i++) {           // lost echoes, small noise
+    CHECK(feed(&o, 0, 1) + feed(&o, 151, 2) + feed(&o, 149, 2) == 0);
+  }
+  CHECK(o.state == OCCUPANCY_OCCUPIED);
+
+  CHECK(feed(&o, 20, 5) == 1);             // too close
+  CHECK(o.state == OCCUPANCY_TOO_CLOSE);
+  CHECK(feed(&o, 30, 5) == 0);             // within hysteresis
+  CHECK(feed(&o, 0, 5) == 1);              // left
+  CHECK(o.state == OCCUPANCY_FREE);
+}
+
+static void test_sim(void) {
+  struct monitor m;
+  struct sim s;
+
+  sim_init(&s, sim_scene_parking);
+  s.fixed_rate = 1;
+  monitor_init(&m);
+  while (s.now_us < 5000000) {     // arriving
+    sim_step(&s, &m);
+  }
+  CHECK(s.measurements == 49);     // the 5s echo is still on its way
+  CHECK(s.echo_measured_us == 11040); // 4.9s: 3.5m - 3.3m * 2.9s/6s
+  CHECK(monitor_echo_cm(s.echo_measured_us) == 190);
+  CHECK(bars(s.frame, color_green) == 3);
+  CHECK(s.latency_max_us <= (WS2819_STRIPE_LEN * SIM_LED_US + SIM_RESET_US) * 2);
+
+  while (s.now_us < 10000000) {    // parked in the alarm zone
+    sim_step(&s, &m);
+  }
+  CHECK(monitor_echo_cm(s.echo_measured_us) == 19);  // 200mm, 16us counts
+  CHECK(s.interrupts < 10 * 10 * 10);
+  CHECK(bars(s.frame, color_red) == 5 ||
+        bars(s.frame, color_black) == WS2819_STRIPE_LEN);
+}
+
+static uint16_t scene_empty(uint64_t now_us) {
+  return 0;
+}
+
+static void test_refresh(void) {
+  struct monitor m;
+  struct sim s;
+
+  sim_init(&s, scene_empty);
+  s.fixed_rate = 1;
+  monitor_init(&m);
+
+  while (s.now_us < 5050000) {     // 51 triggers, 1 frame + 4 refreshes
+    sim_step(&s, &m);
+  }
+  CHECK(s.frames == 50 / MONITOR_REFRESH_PERIODS);
+  CHECK(s.iterations == 2 * 50 + 5 + 1); // one per trigger and per echo,
+                                   //   one per frame sent (ready)
+  CHECK(monitor_idle_permille(&s.duty) > 990);
+  CHECK(bars(s.frame, color_black) == WS2819_STRIPE_LEN);
+}
+
+static void test_glitches(void) {
+  struct monitor m;
+  struct sim s;
+
+  sim_init(&s, sim_scene_parking);
+  s.glitch_every = 5;
+  monitor_init(&m);
+  while (s.now_us < 20000000) {    // free, approaching, too close, leaving,
+    sim_step(&s, &m);              //   free again
+  }
+  CHECK(s.occupancy_changes == 4);
+  CHECK(m.occupancy.state == OCCUPANCY_FREE);
+}
+
+static void test_schedule(void) {
+  struct monitor m;
+  struct sim s;
+
+  sim_init(&s, sim_scene_parking);  // sending every iteration right away
+  s.schedule = 0;
+  monitor_init(&m);
+  while (s.now_us < 20000000) {
+    m.shown_valid = 0;
+    sim_poll(&s, &m);
+  }
+  CHECK(s.disturbed > 0);
+
+  sim_init(&s, sim_scene_parking);  // outside the echo window only
+  monitor_init(&m);
+  while (s.now_us < 20000000) {
+    m.shown_valid = 0;
+    sim_poll(&s, &m);
+  }
+  CHECK(s.disturbed == 0);
+  CHECK(s.deferred > 0);
+  CHECK(s.reset_violations == 0);
+}
+
+//---------
+// Number of measurements of s from now until the given time
+//----------
+static uint32_t measure_until(struct sim *s, struct monitor *m, uint64_t until_us) {
+//----------
+  uint32_t measurements = s->measurements;
+
+  while (s->now_us < until_us) {
+    sim_step(s, m);
+  }
+  return s->measurements - measurements;
+}
+
+static void test_adaptive(void) {
+  struct monitor m;
+  struct sim s;
+
+  sim_init(&s, sim_scene_parking);
+  s.glitch_every = 5;
+  monitor_init(&m);
+  measure_until(&s, &m, 1000000);  // settled on the empty bay
+  CHECK(measure_until(&s, &m, 2000000) == 1000 / MONITOR_PERIOD_SLOW_MS);
+  measure_until(&s, &m, 4000000);  // arriving
+  CHECK(measure_until(&s, &m, 7000000) >= 3000 / MONITOR_PERIOD_FAST_MS - 1);
+  measure_until(&s, &m, 10000000); // standing too close
+  CHECK(measure_until(&s, &m, 13000000) == 3000 / MONITOR_PERIOD_MS);
+  measure_until(&s, &m, 20000000); // leaving, empty again
+  CHECK(s.occupancy_changes == 4);
+  CHECK(m.occupancy.state == OCCUPANCY_FREE);
+  CHECK(monitor_period_ms(&m) == MONITOR_PERIOD_SLOW_MS);
+}
+
+static void test_trace(void) {
+  static struct trace_sample samples[2000], decoded[TRACE_SAMPLES_MAX];
+  static uint8_t capture[16000];
+  struct trace t;
+  struct monitor m;
+  struct sim s;
+  uint32_t len = 0, n = 0, measurements = 0, changes, frames;
+  uint8_t count, unit_us, source, seq, size;
+
+  sim_init(&s, sim_scene_parking);  // record 40s of a parking lot
+  s.glitch_every = 5;
+  monitor_init(&m);
+  trace_init(&t, SIM_COUNT_US, 3);
+  while (s.now_us < 40000000) {
+    sim_step(&s, &m);
+    if (s.measurements != measurements) {
+      measurements = s.measurements;
+      if ((size = trace_add(&t, s.echo_measured_us, s.trigger_dt_us / 1000))) {
+        capture[len++] = '\n';          // other output in between
+        memcpy(capture + len, t.block, size);
+        len += size;
+        trace_sent(&t);
+      }
+    }
+  }
+  CHECK(len < measurements * 2);     // mostly one byte per sample
+  changes = s.occupancy_changes;
+  frames = s.frames;
+
+  for (uint32_t i = 0; i < len; ) {  // and back
+    if (!(size = trace_decode(capture + i, len - i, decoded, &count, &unit_us, &source, &seq))) {
+      i++;
+      continue;
+    }
+    CHECK(unit_us == SIM_COUNT_US && source == 3);
+    memcpy(samples + n, decoded, count * sizeof(*decoded));
+    n += count;
+    i += size;
+  }
+  CHECK(n > measurements - TRACE_SAMPLES_MAX && n <= measurements);
+  CHECK(samples[0].dt_ms == SIM_TRIGGER_US / 1000);
+
+  sim_init(&s, NULL);               // the replay goes through the same states
+  sim_replay(&s, samples, n, SIM_COUNT_US);
+  monitor_init(&m);
+  while (s.trace_pos < s.trace_len || s.echo_end_us) {
+    sim_step(&s, &m);
+  }
+  CHECK(s.measurements == n);
+  CHECK(s.occupancy_changes == changes);
+  CHECK(s.frames <= frames && s.frames + 10 > frames);
+}
+
+static void test_perf(void) {
+  struct monitor m;
+  struct sim s;
+  struct perf p;
+
+  perf_init(&p, PERF_DEVICE_HOST, 1000000, 2);
+  perf_record(&p, PERF_LOOP, 0);   // below 2 units
+  perf_record(&p, PERF_LOOP, 7);   // 1 unit
+  perf_record(&p, PERF_LOOP, 8);   // 2 units
+  perf_record(&p, PERF_LOOP, 4000000);
+  CHECK(p.probe[PERF_LOOP].hist[0] == 2);
+  CHECK(p.probe[PERF_LOOP].hist[1] == 1);
+  CHECK(p.probe[PERF_LOOP].hist[PERF_BUCKETS - 1] == 1);
+  CHECK(p.probe[PERF_LOOP].count == 4);
+  CHECK(p.probe[PERF_LOOP].max == 4000000);
+
+  sim_init(&s, scene_empty);
+  s.fixed_rate = 1;
+  monitor_init(&m);
+  while (!s.perf_ready) {
+    sim_step(&s, &m);
+  }
+  CHECK(s.perf_record.magic[0] == PERF_MAGIC0 && s.perf_record.len == PERF_RECORD_LEN);
+  CHECK(s.perf_record.check == perf_check(&s.perf_record));
+  CHECK(s.perf_record.elapsed == MONITOR_PERF_PERIODS * SIM_FLICKER_US);
+  CHECK(s.perf_record.counter[PERF_TRIGGERS] == MONITOR_PERF_PERIODS);
+  CHECK(s.perf_record.counter[PERF_OUT_OF_RANGE] == MONITOR_PERF_PERIODS);
+  CHECK(s.perf_record.counter[PERF_LATE] == 0);
+  CHECK(s.perf_record.counter[PERF_FRAMES] == s.frames);
+  CHECK(s.perf_record.idle > 900 && s.perf_record.idle <= 1000);
+  CHECK(s.perf_record.probe[PERF_FRAME_TX].max == WS2819_STRIPE_LEN * SIM_LED_US);
+  CHECK(s.perf.seq == 1 && s.perf.counter[PERF_TRIGGERS] == 0);
+}
+
+static void test_tdma(void) {
+  struct tdma t;
+  uint32_t phase;
+
+  tdma_init(&t);
+  CHECK(!tdma_active(&t, 0) && tdma_aux(&t, 0) == 0);
+  tdma_sync(&t, 1000000, 5, 30000);  // 30ms into a frame of 100ms
+  CHECK(tdma_active(&t, 1000000) && t.origin_us == 970000);
+  CHECK(tdma_next_us(&t, 2, 1000000) == 1010000);
+  CHECK(tdma_next_us(&t, 0, 1000000) == 1070000);
+  CHECK(tdma_next_us(&t, 0, 970000) == 970000);
+  CHECK(tdma_next_us(&t, 0, 800001) == 870000);
+  CHECK(tdma_trigger_us(&t, 2, 1010000, 40, 1020000) == 1110000);  // rounded up to a frame
+  CHECK(tdma_trigger_us(&t, 2, 1010000, 500, 1020000) == 1510000);
+  CHECK(tdma_trigger_us(&t, 2, 0, 500, 1115000) == 1110000);        // a late timer, still due
+  CHECK(tdma_aux(&t, 1000000) == LOT_AUX_SYNCED);
+
+  tdma_sync(&t, 2000500, 5, 30000);  // the local clock ran 500us ahead
+  CHECK(t.drift_us == 500 && t.origin_us == 1970250);
+  tdma_sync(&t, 3070200, 5, 150);    // 200us behind, across the frame begin
+  CHECK(t.drift_us == -200 && t.origin_us == 3070150);
+  tdma_sync(&t, 4005000, 5, 30000);  // jumps
+  CHECK(t.drift_us == 4850 && t.origin_us == 3975000);
+  CHECK(tdma_aux(&t, 4005000) == LOT_AUX_SYNCED + 48 && lot_aux_drift_us(tdma_aux(&t, 4005000)) == 4800);
+  CHECK(lot_aux_drift(-20000) == LOT_AUX_SYNCED - 127);
+  tdma_sync(&t, 4500000, 3, 0);      // new slots, taken as is
+  CHECK(t.drift_us == 0 && t.origin_us == 4500000 && t.frame_us == 60000);
+  CHECK(!tdma_active(&t, 4500000 + TDMA_TIMEOUT_US) && tdma_aux(&t, 4500000 + TDMA_TIMEOUT_US) == 0);
+
+  // Three neighbours on clocks 80ppm apart, beacons every second with up
+  // to 1ms of WiFi latency: their triggers never come closer than a slot.
+  struct tdma m[3];
+  const int32_t ppm[3] = { -40, 0, 40 };
+  uint32_t offset[3] = { 12345, 4000000000u, 777 }, last[3], next[3];
+  uint64_t at[3] = { 0 }, closest = ~0ull;
+  uint32_t triggers = 0, seed = 1;
+
+  for (int i = 0; i < 3; i++) {
+    tdma_init(&m[i]);
+  }
+  for (uint64_t us = 0; us < 20000000; us += 50) {
+    for (int i = 0; i < 3; i++) {
+      uint32_t local = offset[i] + (uint32_t)(us + (int64_t)us * ppm[i] / 1000000);
+
+      if (us % 1000000 == 0) {
+        seed = seed * 1103515245 + 12345;
+        phase = (uint32_t)(us % (3 * TDMA_SLOT_US));
+        tdma_sync(&m[i], local + (seed >> 16) % 1000, 3, phase);
+        if (us == 0) {
+          last[i] = local;
+          next[i] = tdma_trigger_us(&m[i], i, last[i], 40, local);
+        }
+        continue;
+      }
+      if ((int32_t)(local - next[i]) >= 0) {
+        for (int j = 0; j < 3; j++) {
+          if (j != i && at[j] && us - at[j] < closest) {
+            closest = us - at[j];
+          }
+        }
+        at[i] = us;
+        last[i] = next[i];
+        next[i] = tdma_trigger_us(&m[i], i, last[i], 40, local);
+        triggers++;
+      }
+    }
+  }
+  CHECK(triggers > 3 * 20000 / 60 - 10);     // every frame
+  CHECK(closest > TDMA_SLOT_US - 2000);
+}
+
+int main(void) {
+  test_echo_cm();
+  test_render();
+  test_profile();
+  test_occupancy();
+  test_sim();
+  test_glitches();
+  test_refresh();
+  test_schedule();
+  test_adaptive();
+  test_perf();
+  test_trace();
+  test_tdma();
+  printf("%s\n", failures ? "FAILED" : "OK");
+  return failures != 0;
+}